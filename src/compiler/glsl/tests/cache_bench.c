@@ -0,0 +1,158 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Compares the per-file and the single-file disk_cache backends.
+ *
+ * Usage: cache_bench [num_entries [entry_size]]
+ *
+ * The cache is created in ./cache-bench-tmp, which is removed afterwards.
+ */
+
+#include <errno.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "util/disk_cache.h"
+#include "util/os_time.h"
+
+#define CACHE_BENCH_TMP "./cache-bench-tmp"
+
+static int
+remove_entry(const char *path, const struct stat *sb, int typeflag,
+             struct FTW *ftwbuf)
+{
+   return remove(path);
+}
+
+static void
+fill_entry(uint8_t *data, unsigned size, unsigned seed)
+{
+   /* Roughly as compressible as a typical shader binary. */
+   uint32_t x = seed * 2654435761u + 1;
+   for (unsigned i = 0; i < size; i++) {
+      x = x * 1103515245 + 12345;
+      data[i] = (x >> 16) & 0x0f;
+   }
+}
+
+static void
+run(const char *name, bool single_file, unsigned num_entries,
+    unsigned entry_size)
+{
+   struct disk_cache *cache;
+   uint8_t (*keys)[20] = malloc(num_entries * sizeof(*keys));
+   uint8_t *data = malloc(entry_size);
+   unsigned hits = 0;
+   unsigned batch_hits = 0;
+   int64_t start, put_time, open_time, get_time, batch_time;
+   struct disk_cache_batch *batch;
+
+   nftw(CACHE_BENCH_TMP, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+   mkdir(CACHE_BENCH_TMP, 0755);
+
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_BENCH_TMP, 1);
+   if (single_file)
+      setenv("MESA_DISK_CACHE_SINGLE_FILE", "true", 1);
+   else
+      unsetenv("MESA_DISK_CACHE_SINGLE_FILE");
+
+   cache = disk_cache_create("bench", "cache_bench", 0);
+   if (!cache) {
+      fprintf(stderr, "%s: disk_cache_create failed\n", name);
+      exit(1);
+   }
+
+   start = os_time_get_nano();
+   for (unsigned i = 0; i < num_entries; i++) {
+      fill_entry(data, entry_size, i);
+      disk_cache_compute_key(cache, data, entry_size, keys[i]);
+      disk_cache_put(cache, keys[i], data, entry_size, NULL);
+   }
+   disk_cache_wait_for_idle(cache);
+   put_time = os_time_get_nano() - start;
+
+   disk_cache_destroy(cache);
+
+   /* Reopen to measure lookups by a fresh process. */
+   start = os_time_get_nano();
+   cache = disk_cache_create("bench", "cache_bench", 0);
+   open_time = os_time_get_nano() - start;
+
+   start = os_time_get_nano();
+   for (unsigned i = 0; i < num_entries; i++) {
+      size_t size;
+      void *entry = disk_cache_get(cache, keys[i], &size);
+      if (entry) {
+         hits++;
+         free(entry);
+      }
+   }
+   get_time = os_time_get_nano() - start;
+
+   disk_cache_destroy(cache);
+
+   /* Same lookups, through the cache's threads. */
+   cache = disk_cache_create("bench", "cache_bench", 0);
+
+   start = os_time_get_nano();
+   batch = disk_cache_get_batch(cache, (const cache_key *)keys, num_entries);
+   for (unsigned i = 0; i < num_entries; i++) {
+      size_t size;
+      void *entry = disk_cache_batch_get(batch, i, &size);
+      if (entry) {
+         batch_hits++;
+         free(entry);
+      }
+   }
+   disk_cache_batch_destroy(batch);
+   batch_time = os_time_get_nano() - start;
+
+   printf("%-12s put %8.2f ms  open %8.2f ms  get %8.2f ms  "
+          "batch get %8.2f ms  (%u/%u/%u hits)\n",
+          name, put_time / 1e6, open_time / 1e6, get_time / 1e6,
+          batch_time / 1e6, hits, batch_hits, num_entries);
+
+   disk_cache_destroy(cache);
+   nftw(CACHE_BENCH_TMP, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+
+   free(data);
+   free(keys);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_entries = argc > 1 ? atoi(argv[1]) : 10000;
+   unsigned entry_size = argc > 2 ? atoi(argv[2]) : 8192;
+
+#ifdef ENABLE_SHADER_CACHE
+   printf("%u entries of %u bytes\n", num_entries, entry_size);
+   run("per-file", false, num_entries, entry_size);
+   run("single-file", true, num_entries, entry_size);
+#endif
+
+   return 0;
+}
@@ -28,6 +28,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <ftw.h>
+#include <dirent.h>
 #include <errno.h>
 #include <stdarg.h>
 #include <inttypes.h>
@@ -162,18 +163,23 @@ does_cache_contain(struct disk_cache *cache, const cache_key key)
    return false;
 }
 
-static void *
+static bool
 cache_exists(struct disk_cache *cache)
 {
    uint8_t dummy_key[20];
    char data[] = "some test data";
+   void *result;
+   bool exists;
 
    if (!cache)
-      return NULL;
+      return false;
 
    disk_cache_put(cache, dummy_key, data, sizeof(data), NULL);
    disk_cache_wait_for_idle(cache);
-   return disk_cache_get(cache, dummy_key, NULL);
+   result = disk_cache_get(cache, dummy_key, NULL);
+   exists = result != NULL;
+   free(result);
+   return exists;
 }
 
 #define CACHE_TEST_TMP "./cache-test-tmp"
@@ -207,8 +213,9 @@ test_disk_cache_create(void)
    /* Test with XDG_CACHE_HOME set */
    setenv("XDG_CACHE_HOME", CACHE_TEST_TMP "/xdg-cache-home", 1);
    cache = disk_cache_create("test", "make_check", 0);
-   expect_null(cache_exists(cache), "disk_cache_create with XDG_CACHE_HOME set "
+   expect_true(!cache_exists(cache), "disk_cache_create with XDG_CACHE_HOME set "
                "with a non-existing parent directory");
+   disk_cache_destroy(cache);
 
    err = mkdir(CACHE_TEST_TMP, 0755);
    if (err != 0) {
@@ -218,8 +225,8 @@ test_disk_cache_create(void)
    }
 
    cache = disk_cache_create("test", "make_check", 0);
-   expect_non_null(cache_exists(cache), "disk_cache_create with XDG_CACHE_HOME "
-                   "set");
+   expect_true(cache_exists(cache), "disk_cache_create with XDG_CACHE_HOME "
+               "set");
 
    check_directories_created(CACHE_TEST_TMP "/xdg-cache-home/"
                              CACHE_DIR_NAME);
@@ -232,8 +239,9 @@ test_disk_cache_create(void)
 
    setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/mesa-glsl-cache-dir", 1);
    cache = disk_cache_create("test", "make_check", 0);
-   expect_null(cache_exists(cache), "disk_cache_create with MESA_GLSL_CACHE_DIR"
+   expect_true(!cache_exists(cache), "disk_cache_create with MESA_GLSL_CACHE_DIR"
                " set with a non-existing parent directory");
+   disk_cache_destroy(cache);
 
    err = mkdir(CACHE_TEST_TMP, 0755);
    if (err != 0) {
@@ -243,8 +251,8 @@ test_disk_cache_create(void)
    }
 
    cache = disk_cache_create("test", "make_check", 0);
-   expect_non_null(cache_exists(cache), "disk_cache_create with "
-                   "MESA_GLSL_CACHE_DIR set");
+   expect_true(cache_exists(cache), "disk_cache_create with "
+               "MESA_GLSL_CACHE_DIR set");
 
    check_directories_created(CACHE_TEST_TMP "/mesa-glsl-cache-dir/"
                              CACHE_DIR_NAME);
@@ -423,6 +431,328 @@ test_put_and_get(void)
    disk_cache_destroy(cache);
 }
 
+static void
+test_single_file(void)
+{
+   struct disk_cache *cache;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   uint8_t *big[3];
+   uint8_t big_key[3][20];
+   struct stat sb;
+   char *result;
+   size_t size;
+   int i, j;
+
+   setenv("MESA_DISK_CACHE_SINGLE_FILE", "true", 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "64K", 1);
+
+   cache = disk_cache_create("test", "make_check", 0);
+   expect_non_null(cache, "disk_cache_create with MESA_DISK_CACHE_SINGLE_FILE");
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_wait_for_idle(cache);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "single file disk_cache_get (pointer)");
+   expect_equal(size, sizeof(blob), "single file disk_cache_get (size)");
+   free(result);
+
+   expect_true(stat(CACHE_TEST_TMP "/mesa-glsl-cache-dir/" CACHE_DIR_NAME
+                    "/cache.pack", &sb) == 0 &&
+               sb.st_size > sizeof(blob),
+               "single file entries are written to cache.pack");
+
+   /* Entries must survive re-opening the cache. */
+   disk_cache_destroy(cache);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "single file disk_cache_get after reopen");
+   free(result);
+
+   disk_cache_remove(cache, blob_key);
+   expect_true(!does_cache_contain(cache, blob_key),
+               "single file disk_cache_get after disk_cache_remove");
+
+   /* Add three incompressible 24K items.  The third one pushes the pack
+    * over 64K, which should leave only the newest entry.
+    */
+   srand(42);
+   for (i = 0; i < 3; i++) {
+      big[i] = malloc(24 * 1024);
+      for (j = 0; j < 24 * 1024; j++)
+         big[i][j] = rand();
+
+      disk_cache_compute_key(cache, big[i], 24 * 1024, big_key[i]);
+      disk_cache_put(cache, big_key[i], big[i], 24 * 1024, NULL);
+      disk_cache_wait_for_idle(cache);
+   }
+
+   expect_true(!does_cache_contain(cache, big_key[0]) &&
+               !does_cache_contain(cache, big_key[1]),
+               "single file eviction of older entries");
+
+   result = disk_cache_get(cache, big_key[2], &size);
+   expect_true(result && size == 24 * 1024 &&
+               memcmp(result, big[2], size) == 0,
+               "single file eviction keeps the newest entry");
+   free(result);
+
+   for (i = 0; i < 3; i++)
+      free(big[i]);
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_DISK_CACHE_SINGLE_FILE");
+   unsetenv("MESA_GLSL_CACHE_MAX_SIZE");
+}
+
+static void
+test_get_batch(void)
+{
+   struct disk_cache *cache;
+   char data[4][32];
+   cache_key keys[4];
+   struct disk_cache_batch *batch;
+   char *result;
+   size_t size;
+   int i;
+
+   cache = disk_cache_create("test", "make_check", 0);
+
+   for (i = 0; i < 4; i++) {
+      snprintf(data[i], sizeof(data[i]), "batch entry number %d", i);
+      disk_cache_compute_key(cache, data[i], sizeof(data[i]), keys[i]);
+   }
+
+   /* Leave the last one out of the cache. */
+   for (i = 0; i < 3; i++)
+      disk_cache_put(cache, keys[i], data[i], sizeof(data[i]), NULL);
+   disk_cache_wait_for_idle(cache);
+
+   batch = disk_cache_get_batch(cache, (const cache_key *)keys, 4);
+   expect_non_null(batch, "disk_cache_get_batch");
+
+   /* Retrieve them out of order. */
+   for (i = 2; i >= 0; i--) {
+      result = disk_cache_batch_get(batch, i, &size);
+      expect_true(result && size == sizeof(data[i]) &&
+                  memcmp(result, data[i], size) == 0,
+                  "disk_cache_batch_get of existing item");
+      free(result);
+   }
+
+   result = disk_cache_batch_get(batch, 3, &size);
+   expect_null(result, "disk_cache_batch_get of non-existent item (pointer)");
+   expect_equal(size, 0, "disk_cache_batch_get of non-existent item (size)");
+
+   disk_cache_batch_destroy(batch);
+
+   /* Destroying a batch with entries that were not retrieved. */
+   batch = disk_cache_get_batch(cache, (const cache_key *)keys, 4);
+   disk_cache_batch_destroy(batch);
+
+   /* Prefetched entries are returned by disk_cache_get(). */
+   disk_cache_prefetch(cache, (const cache_key *)keys, 4);
+   disk_cache_wait_for_idle(cache);
+
+   for (i = 0; i < 3; i++) {
+      result = disk_cache_get(cache, keys[i], &size);
+      expect_true(result && size == sizeof(data[i]) &&
+                  memcmp(result, data[i], size) == 0,
+                  "disk_cache_get of prefetched item");
+      free(result);
+   }
+
+   expect_true(!does_cache_contain(cache, keys[3]),
+               "disk_cache_get of non-existent prefetched item");
+
+   /* A removed entry must not come back from the prefetched ones. */
+   disk_cache_prefetch(cache, (const cache_key *)keys, 1);
+   disk_cache_wait_for_idle(cache);
+   disk_cache_remove(cache, keys[0]);
+   expect_true(!does_cache_contain(cache, keys[0]),
+               "disk_cache_get of removed prefetched item");
+
+   /* Entries that were prefetched but never read are freed with the
+    * cache, which leak checkers notice otherwise.
+    */
+   disk_cache_prefetch(cache, (const cache_key *)&keys[1], 2);
+   disk_cache_wait_for_idle(cache);
+
+   disk_cache_destroy(cache);
+}
+
+#ifdef HAVE_ZSTD
+#define ZSTD_DICT_TEST_ENTRIES 2048
+#define ZSTD_DICT_TEST_REWRITTEN 256
+
+/* Roughly 1.5K of shader-like text that differs between entries. */
+static char *
+make_shader_text(int index, size_t *size)
+{
+   char *text = malloc(2048);
+   int len = 0;
+
+   len += sprintf(text + len, "#version 450\n"
+                  "layout(location = 0) in vec2 uv;\n"
+                  "layout(location = 0) out vec4 color;\n"
+                  "layout(binding = %d) uniform sampler2D tex;\n"
+                  "void main()\n{\n", index % 16);
+   for (int i = 0; len < 1400; i++) {
+      len += sprintf(text + len,
+                     "   vec4 t%d = texture(tex, uv * %d.0 + vec2(%d.%d));\n"
+                     "   color += t%d * vec4(%d.0 / 255.0);\n",
+                     i, (index + i) % 7 + 1, index % 13, i % 10,
+                     i, (index * 31 + i * 17) % 256);
+   }
+   len += sprintf(text + len, "}\n");
+
+   *size = len + 1;
+   return text;
+}
+
+static off_t
+cache_file_size(const char *cache_dir, const cache_key key)
+{
+   char buf[41];
+   char *filename;
+   struct stat sb;
+   off_t size = 0;
+
+   _mesa_sha1_format(buf, key);
+   if (asprintf(&filename, "%s/%c%c/%s", cache_dir, buf[0], buf[1],
+                buf + 2) == -1)
+      return 0;
+
+   if (stat(filename, &sb) == 0)
+      size = sb.st_size;
+
+   free(filename);
+   return size;
+}
+
+static bool
+has_zstd_dict(const char *cache_dir)
+{
+   DIR *dir = opendir(cache_dir);
+   struct dirent *entry;
+   bool found = false;
+
+   if (!dir)
+      return false;
+
+   while ((entry = readdir(dir))) {
+      if (strncmp(entry->d_name, "zstd_dict_", 10) == 0 &&
+          !strstr(entry->d_name, ".tmp"))
+         found = true;
+   }
+
+   closedir(dir);
+   return found;
+}
+
+static bool
+cache_entry_matches(struct disk_cache *cache, const cache_key key,
+                    const char *text, size_t text_size)
+{
+   size_t size;
+   char *result = disk_cache_get(cache, key, &size);
+   bool matches = result && size == text_size &&
+                  memcmp(result, text, size) == 0;
+
+   free(result);
+   return matches;
+}
+
+static void
+test_zstd_dict(void)
+{
+   const char *cache_dir = CACHE_TEST_TMP "/mesa-glsl-cache-dir/"
+                           CACHE_DIR_NAME;
+   struct disk_cache *cache;
+   char *text[ZSTD_DICT_TEST_ENTRIES];
+   size_t size[ZSTD_DICT_TEST_ENTRIES];
+   cache_key *keys = malloc(ZSTD_DICT_TEST_ENTRIES * sizeof(cache_key));
+   off_t plain_size = 0, dict_size = 0;
+   bool all_match;
+   int i;
+
+   /* A driver of its own, so that it starts without a dictionary. */
+   cache = disk_cache_create("test", "zstd_dict", 0);
+   expect_true(!has_zstd_dict(cache_dir), "no zstd dictionary at first");
+
+   for (i = 0; i < ZSTD_DICT_TEST_ENTRIES; i++) {
+      text[i] = make_shader_text(i, &size[i]);
+      disk_cache_compute_key(cache, text[i], size[i], keys[i]);
+      disk_cache_put(cache, keys[i], text[i], size[i], NULL);
+   }
+   disk_cache_wait_for_idle(cache);
+
+   expect_true(has_zstd_dict(cache_dir),
+               "zstd dictionary trained once enough entries were put");
+
+   /* The process that trained it doesn't use it. */
+   all_match = true;
+   for (i = 0; i < ZSTD_DICT_TEST_ENTRIES; i++)
+      all_match &= cache_entry_matches(cache, keys[i], text[i], size[i]);
+   expect_true(all_match, "disk_cache_get while training a zstd dictionary");
+
+   disk_cache_destroy(cache);
+
+   /* A new cache loads the dictionary and still reads the entries that
+    * were compressed without it.
+    */
+   cache = disk_cache_create("test", "zstd_dict", 0);
+
+   all_match = true;
+   for (i = 0; i < ZSTD_DICT_TEST_ENTRIES; i++)
+      all_match &= cache_entry_matches(cache, keys[i], text[i], size[i]);
+   expect_true(all_match, "disk_cache_get of entries from before the zstd "
+               "dictionary");
+
+   /* Write some of them again, compressed with the dictionary. */
+   for (i = 0; i < ZSTD_DICT_TEST_REWRITTEN; i++) {
+      plain_size += cache_file_size(cache_dir, keys[i]);
+      disk_cache_remove(cache, keys[i]);
+      disk_cache_put(cache, keys[i], text[i], size[i], NULL);
+   }
+   disk_cache_wait_for_idle(cache);
+
+   all_match = true;
+   for (i = 0; i < ZSTD_DICT_TEST_REWRITTEN; i++) {
+      dict_size += cache_file_size(cache_dir, keys[i]);
+      all_match &= cache_entry_matches(cache, keys[i], text[i], size[i]);
+   }
+   expect_true(all_match, "disk_cache_get of entries compressed with the "
+               "zstd dictionary");
+   expect_true(dict_size > 0 && dict_size < plain_size,
+               "entries are smaller with the zstd dictionary");
+
+   disk_cache_destroy(cache);
+
+   /* Without the dictionary, the entries that need it are misses. */
+   setenv("MESA_DISK_CACHE_ZSTD_DICT", "false", 1);
+   cache = disk_cache_create("test", "zstd_dict", 0);
+
+   expect_true(!does_cache_contain(cache, keys[0]),
+               "disk_cache_get of an entry that needs a missing dictionary");
+   expect_true(cache_entry_matches(cache, keys[ZSTD_DICT_TEST_REWRITTEN],
+                                   text[ZSTD_DICT_TEST_REWRITTEN],
+                                   size[ZSTD_DICT_TEST_REWRITTEN]),
+               "disk_cache_get of an entry without a dictionary");
+
+   disk_cache_destroy(cache);
+   unsetenv("MESA_DISK_CACHE_ZSTD_DICT");
+
+   for (i = 0; i < ZSTD_DICT_TEST_ENTRIES; i++)
+      free(text[i]);
+   free(keys);
+}
+#endif
+
 static void
 test_put_key_and_get_key(void)
 {
@@ -486,6 +816,14 @@ main(void)
 
    test_put_and_get();
 
+   test_single_file();
+
+   test_get_batch();
+
+#ifdef HAVE_ZSTD
+   test_zstd_dict();
+#endif
+
    test_put_key_and_get_key();
 
    err = rmrf_local(CACHE_TEST_TMP);
@@ -42,7 +42,8 @@ nir_shader_create(void *mem_ctx,
                   const nir_shader_compiler_options *options,
                   shader_info *si)
 {
-   nir_shader *shader = rzalloc(mem_ctx, nir_shader);
+   /* Nearly everything of the shader is allocated out of it. */
+   nir_shader *shader = rzalloc_arena(mem_ctx, nir_shader);
 
    exec_list_make_empty(&shader->variables);
 
@@ -309,6 +310,10 @@ nir_function_impl_create_bare(nir_shader *shader)
    impl->reg_alloc = 0;
    impl->ssa_alloc = 0;
    impl->valid_metadata = nir_metadata_none;
+   impl->change_count = 1;
+   impl->validated_change_count = 0;
+   list_inithead(&impl->algebraic_states);
+   impl->range_cache = NULL;
 
    /* create start & end blocks */
    nir_block *start_block = nir_block_create(shader);
@@ -790,6 +795,30 @@ nir_cursors_equal(nir_cursor a, nir_cursor b)
    return a.block == b.block && a.option == b.option;
 }
 
+/* Calls nir_function_impl_changed() on the impl containing node, if any.
+ * Control flow that was extracted with nir_cf_extract() or isn't inserted
+ * yet has no impl, nir_cf_reinsert() and nir_cf_node_insert() take care of
+ * it instead.
+ */
+void
+nir_cf_node_changed(nir_cf_node *node)
+{
+#ifndef NDEBUG
+   while (node && node->type != nir_cf_node_function)
+      node = node->parent;
+
+   if (node)
+      nir_function_impl_changed(nir_cf_node_as_function(node));
+#endif
+}
+
+static void
+instr_changed(nir_instr *instr)
+{
+   if (instr->block)
+      nir_cf_node_changed(&instr->block->cf_node);
+}
+
 static bool
 add_use_cb(nir_src *src, void *state)
 {
@@ -884,6 +913,8 @@ nir_instr_insert(nir_cursor cursor, nir_instr *instr)
 
    if (instr->type == nir_instr_type_jump)
       nir_handle_add_jump(instr->block);
+
+   instr_changed(instr);
 }
 
 static bool
@@ -923,6 +954,7 @@ remove_defs_uses(nir_instr *instr)
 
 void nir_instr_remove_v(nir_instr *instr)
 {
+   instr_changed(instr);
    remove_defs_uses(instr);
    exec_node_remove(&instr->node);
 
@@ -1435,6 +1467,8 @@ nir_instr_rewrite_src(nir_instr *instr, nir_src *src, nir_src new_src)
    src_remove_all_uses(src);
    *src = new_src;
    src_add_all_uses(src, instr, NULL);
+
+   instr_changed(instr);
 }
 
 void
@@ -1447,6 +1481,8 @@ nir_instr_move_src(nir_instr *dest_instr, nir_src *dest, nir_src *src)
    *dest = *src;
    *src = NIR_SRC_INIT;
    src_add_all_uses(dest, dest_instr, NULL);
+
+   instr_changed(dest_instr);
 }
 
 void
@@ -1458,6 +1494,8 @@ nir_if_rewrite_condition(nir_if *if_stmt, nir_src new_src)
    src_remove_all_uses(src);
    *src = new_src;
    src_add_all_uses(src, NULL, if_stmt);
+
+   nir_cf_node_changed(&if_stmt->cf_node);
 }
 
 void
@@ -1482,6 +1520,8 @@ nir_instr_rewrite_dest(nir_instr *instr, nir_dest *dest, nir_dest new_dest)
 
    if (dest->reg.indirect)
       src_add_all_uses(dest->reg.indirect, instr, NULL);
+
+   instr_changed(instr);
 }
 
 /* note: does *not* take ownership of 'name' */
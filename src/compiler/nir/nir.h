@@ -96,6 +96,7 @@ struct nir_function;
 struct nir_shader;
 struct nir_instr;
 struct nir_builder;
+struct nir_range_cache;
 
 
 /**
@@ -2719,7 +2720,12 @@ typedef enum {
     *   - nir_block::live_out
     *
     * A pass can preserve this metadata type if it never adds or removes any
-    * SSA defs (most passes shouldn't preserve this metadata type).
+    * SSA defs (most passes shouldn't preserve this metadata type).  A pass
+    * that only removes unused instructions or changes the uses of existing
+    * SSA defs can still preserve it by calling nir_live_ssa_def_update() on
+    * every def whose uses changed, and one that moves instructions to later
+    * places by calling nir_live_ssa_defs_instr_moved() on them, as long as
+    * that is cheaper than recomputing it.
     */
    nir_metadata_live_ssa_defs = 0x4,
 
@@ -2778,6 +2784,22 @@ typedef struct {
    unsigned num_blocks;
 
    nir_metadata valid_metadata;
+
+   /**
+    * Bumped by nir_function_impl_changed() in debug builds, so that
+    * nir_validate_shader() can skip impls that didn't change since it last
+    * looked at them.
+    */
+   unsigned change_count;
+
+   /** change_count when nir_validate_shader() last validated this impl */
+   unsigned validated_change_count;
+
+   /** what nir_algebraic_impl() remembers between calls, per pass */
+   struct list_head algebraic_states;
+
+   /** ranges found by nir_analyze_range(), see nir_range_cache_get() */
+   struct nir_range_cache *range_cache;
 } nir_function_impl;
 
 #define nir_foreach_function_temp_variable(var, impl) \
@@ -3221,6 +3243,13 @@ typedef struct nir_shader_compiler_options {
    /** Whether 16-bit ALU is supported. */
    bool support_16bit_alu;
 
+   /**
+    * Whether to run nir_opt_gvn_pre() in the generic optimization loops.
+    * It removes values computed on more than one path through an if, at the
+    * cost of keeping some of them live across the if.
+    */
+   bool use_gvn_pre;
+
    unsigned max_unroll_iterations;
 
    nir_lower_int64_options lower_int64_options;
@@ -3291,6 +3320,47 @@ nir_shader_get_entrypoint(nir_shader *shader)
    return func->impl;
 }
 
+struct util_queue;
+
+/** A pass that only reads and writes the function_impl it's given
+ *
+ * See nir_shader_foreach_impl_parallel().
+ */
+typedef bool (*nir_impl_pass_cb)(nir_function_impl *impl);
+
+/** Runs \p pass on every function_impl of \p shader
+ *
+ * If \p queue isn't NULL, the impls are spread over the calling thread and
+ * up to as many jobs on \p queue as it has threads.  The calling thread
+ * takes part, so this may be called from a job of the same queue, but the
+ * queue must then be created with UTIL_QUEUE_INIT_RESIZE_IF_FULL.  With a
+ * NULL queue or a single impl, the impls are simply visited in order.
+ *
+ * \p pass may create, change and remove instructions, blocks, registers and
+ * local variables of its impl, and may read anything else in the shader.
+ * It must not change anything else, e.g. shader variables, shader_info or
+ * other functions, and must not use metadata of other impls.  These passes
+ * are known to be safe:
+ *
+ *  - nir_copy_prop_impl
+ *  - nir_lower_returns_impl
+ *  - nir_lower_vars_to_ssa_impl
+ *  - nir_opt_algebraic_impl, nir_opt_algebraic_before_ffma_impl and
+ *    nir_opt_algebraic_late_impl
+ *  - nir_opt_comparison_pre_impl
+ *  - nir_opt_cse_impl
+ *  - nir_opt_dce_impl
+ *  - nir_opt_dead_cf_impl
+ *  - nir_opt_deref_impl
+ *  - nir_opt_gvn_pre_impl
+ *  - nir_opt_remove_phis_impl
+ *
+ * Returns true if \p pass made progress on any impl.
+ */
+bool nir_shader_foreach_impl_parallel(nir_shader *shader,
+                                      struct util_queue *queue,
+                                      nir_impl_pass_cb pass);
+
 nir_shader *nir_shader_create(void *mem_ctx,
                               gl_shader_stage stage,
                               const nir_shader_compiler_options *options,
@@ -3348,6 +3418,24 @@ void nir_metadata_preserve(nir_function_impl *impl, nir_metadata preserved);
 /** Preserves all metadata for the given shader */
 void nir_shader_preserve_all_metadata(nir_shader *shader);
 
+/**
+ * Records that the impl changed.
+ *
+ * Inserting, removing or rewriting instructions and control flow does this
+ * already, as does dirtying metadata with nir_metadata_preserve().  Code that
+ * changes the IR some other way and doesn't dirty any metadata has to call
+ * this for nir_validate_shader() to look at the impl again.
+ */
+static inline void
+nir_function_impl_changed(nir_function_impl *impl)
+{
+#ifndef NDEBUG
+   impl->change_count++;
+#else
+   (void) impl;
+#endif
+}
+
 /** creates an instruction with default swizzle/writemask/etc. with NULL registers */
 nir_alu_instr *nir_alu_instr_create(nir_shader *shader, nir_op op);
 
@@ -3824,6 +3912,29 @@ static inline bool should_serialize_deserialize_nir(void) { return false; }
 static inline bool should_print_nir(void) { return false; }
 #endif /* NDEBUG */
 
+/* See nir_pass_stats.c.  Unlike the above, these also work in release builds,
+ * which is where compile times are measured.
+ */
+typedef struct {
+   int64_t time;
+   unsigned num_instrs;
+} nir_pass_stats_start;
+
+bool nir_pass_stats_enabled(void);
+void nir_pass_stats_begin(nir_shader *shader, nir_pass_stats_start *start);
+void nir_pass_stats_end(nir_shader *shader, const char *pass, int progress,
+                        const nir_pass_stats_start *start);
+
+static inline bool
+should_collect_nir_pass_stats(void)
+{
+   static int collect = -1;
+   if (collect < 0)
+      collect = nir_pass_stats_enabled();
+
+   return collect;
+}
+
 #define _PASS(pass, nir, do_pass) do {                               \
    if (should_skip_nir(#pass)) {                                     \
       printf("skipping %s\n", #pass);                                \
@@ -3844,7 +3955,13 @@ static inline bool should_print_nir(void) { return false; }
    nir_metadata_set_validation_flag(nir);                            \
    if (should_print_nir())                                           \
       printf("%s\n", #pass);                                         \
-   if (pass(nir, ##__VA_ARGS__)) {                                   \
+   nir_pass_stats_start _stats_start = { 0 };                        \
+   if (should_collect_nir_pass_stats())                              \
+      nir_pass_stats_begin(nir, &_stats_start);                      \
+   bool _pass_progress = pass(nir, ##__VA_ARGS__);                   \
+   if (should_collect_nir_pass_stats())                              \
+      nir_pass_stats_end(nir, #pass, _pass_progress, &_stats_start); \
+   if (_pass_progress) {                                             \
       progress = true;                                               \
       if (should_print_nir())                                        \
          nir_print_shader(nir, stdout);                              \
@@ -3855,11 +3972,38 @@ static inline bool should_print_nir(void) { return false; }
 #define NIR_PASS_V(nir, pass, ...) _PASS(pass, nir,                  \
    if (should_print_nir())                                           \
       printf("%s\n", #pass);                                         \
+   nir_pass_stats_start _stats_start = { 0 };                        \
+   if (should_collect_nir_pass_stats())                              \
+      nir_pass_stats_begin(nir, &_stats_start);                      \
    pass(nir, ##__VA_ARGS__);                                         \
+   if (should_collect_nir_pass_stats())                              \
+      nir_pass_stats_end(nir, #pass, -1, &_stats_start);             \
    if (should_print_nir())                                           \
       nir_print_shader(nir, stdout);                                 \
 )
 
+/** Runs a per-impl pass on all functions, see
+ * nir_shader_foreach_impl_parallel().
+ */
+#define NIR_PASS_PARALLEL(progress, nir, queue, pass) _PASS(pass, nir,  \
+   nir_metadata_set_validation_flag(nir);                               \
+   if (should_print_nir())                                              \
+      printf("%s\n", #pass);                                            \
+   nir_pass_stats_start _stats_start = { 0 };                           \
+   if (should_collect_nir_pass_stats())                                 \
+      nir_pass_stats_begin(nir, &_stats_start);                         \
+   bool _pass_progress =                                                \
+      nir_shader_foreach_impl_parallel(nir, queue, pass);               \
+   if (should_collect_nir_pass_stats())                                 \
+      nir_pass_stats_end(nir, #pass, _pass_progress, &_stats_start);    \
+   if (_pass_progress) {                                                \
+      progress = true;                                                  \
+      if (should_print_nir())                                           \
+         nir_print_shader(nir, stdout);                                 \
+      nir_metadata_check_validation_flag(nir);                          \
+   }                                                                    \
+)
+
 #define NIR_SKIP(name) should_skip_nir(#name)
 
 /** An instruction filtering callback
@@ -4159,6 +4303,7 @@ bool nir_is_per_vertex_io(const nir_variable *var, gl_shader_stage stage);
 
 bool nir_lower_regs_to_ssa_impl(nir_function_impl *impl);
 bool nir_lower_regs_to_ssa(nir_shader *shader);
+bool nir_lower_vars_to_ssa_impl(nir_function_impl *impl);
 bool nir_lower_vars_to_ssa(nir_shader *shader);
 
 bool nir_remove_dead_derefs(nir_shader *shader);
@@ -4526,6 +4671,9 @@ bool nir_lower_memory_model(nir_shader *shader);
 bool nir_normalize_cubemap_coords(nir_shader *shader);
 
 void nir_live_ssa_defs_impl(nir_function_impl *impl);
+void nir_live_ssa_def_update(nir_ssa_def *def);
+unsigned nir_live_ssa_defs_update_budget(nir_function_impl *impl);
+bool nir_live_ssa_defs_instr_moved(nir_instr *instr, unsigned *budget);
 
 void nir_loop_analyze_impl(nir_function_impl *impl,
                            nir_variable_mode indirect_mask);
@@ -4559,8 +4707,11 @@ bool nir_opt_comparison_pre(nir_shader *shader);
 
 bool nir_opt_access(nir_shader *shader);
 bool nir_opt_algebraic(nir_shader *shader);
+bool nir_opt_algebraic_impl(nir_function_impl *impl);
 bool nir_opt_algebraic_before_ffma(nir_shader *shader);
+bool nir_opt_algebraic_before_ffma_impl(nir_function_impl *impl);
 bool nir_opt_algebraic_late(nir_shader *shader);
+bool nir_opt_algebraic_late_impl(nir_function_impl *impl);
 bool nir_opt_algebraic_distribute_src_mods(nir_shader *shader);
 bool nir_opt_constant_folding(nir_shader *shader);
 
@@ -4577,14 +4728,18 @@ bool nir_opt_combine_memory_barriers(nir_shader *shader,
 
 bool nir_opt_combine_stores(nir_shader *shader, nir_variable_mode modes);
 
+bool nir_copy_prop_impl(nir_function_impl *impl);
 bool nir_copy_prop(nir_shader *shader);
 
 bool nir_opt_copy_prop_vars(nir_shader *shader);
 
+bool nir_opt_cse_impl(nir_function_impl *impl);
 bool nir_opt_cse(nir_shader *shader);
 
+bool nir_opt_dce_impl(nir_function_impl *impl);
 bool nir_opt_dce(nir_shader *shader);
 
+bool nir_opt_dead_cf_impl(nir_function_impl *impl);
 bool nir_opt_dead_cf(nir_shader *shader);
 
 bool nir_opt_dead_write_vars(nir_shader *shader);
@@ -4596,6 +4751,9 @@ bool nir_opt_find_array_copies(nir_shader *shader);
 
 bool nir_opt_gcm(nir_shader *shader, bool value_number);
 
+bool nir_opt_gvn_pre_impl(nir_function_impl *impl);
+bool nir_opt_gvn_pre(nir_shader *shader);
+
 bool nir_opt_idiv_const(nir_shader *shader, unsigned min_bit_size);
 
 bool nir_opt_if(nir_shader *shader, bool aggressive_last_continue);
@@ -4627,6 +4785,7 @@ bool nir_opt_peephole_select(nir_shader *shader, unsigned limit,
 
 bool nir_opt_rematerialize_compares(nir_shader *shader);
 
+bool nir_opt_remove_phis_impl(nir_function_impl *impl);
 bool nir_opt_remove_phis(nir_shader *shader);
 bool nir_opt_remove_phis_block(nir_block *block);
 
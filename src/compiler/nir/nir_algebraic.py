@@ -1125,11 +1125,9 @@ const uint16_t ${pass_name}_transform_counts[] = {
 % endfor
 };
 
-bool
-${pass_name}(nir_shader *shader)
+static void
+${pass_name}_conditions(const nir_shader *shader, bool *condition_flags)
 {
-   bool progress = false;
-   bool condition_flags[${len(condition_list)}];
    const nir_shader_compiler_options *options = shader->options;
    const shader_info *info = &shader->info;
    (void) options;
@@ -1138,14 +1136,40 @@ ${pass_name}(nir_shader *shader)
    % for index, condition in enumerate(condition_list):
    condition_flags[${index}] = ${condition};
    % endfor
+}
+
+static bool
+${pass_name}_run(nir_function_impl *impl, const bool *condition_flags)
+{
+   return nir_algebraic_impl(impl, condition_flags, ${len(condition_list)},
+                             ${pass_name}_transforms,
+                             ${pass_name}_transform_counts,
+                             ${pass_name}_table,
+                             ${use_levels});
+}
+
+% if impl_pass:
+bool
+${pass_name}_impl(nir_function_impl *impl)
+{
+   bool condition_flags[${len(condition_list)}];
+
+   ${pass_name}_conditions(impl->function->shader, condition_flags);
+   return ${pass_name}_run(impl, condition_flags);
+}
+
+% endif
+bool
+${pass_name}(nir_shader *shader)
+{
+   bool progress = false;
+   bool condition_flags[${len(condition_list)}];
+
+   ${pass_name}_conditions(shader, condition_flags);
 
    nir_foreach_function(function, shader) {
-      if (function->impl) {
-         progress |= nir_algebraic_impl(function->impl, condition_flags,
-                                        ${pass_name}_transforms,
-                                        ${pass_name}_transform_counts,
-                                        ${pass_name}_table);
-      }
+      if (function->impl)
+         progress |= ${pass_name}_run(function->impl, condition_flags);
    }
 
    return progress;
@@ -1154,10 +1178,14 @@ ${pass_name}(nir_shader *shader)
 
 
 class AlgebraicPass(object):
-   def __init__(self, pass_name, transforms):
+   def __init__(self, pass_name, transforms, impl_pass=False):
+      """If impl_pass is set, a <pass_name>_impl() function that runs the
+      pass on a single nir_function_impl is generated as well.
+      """
       self.xforms = []
       self.opcode_xforms = defaultdict(lambda : [])
       self.pass_name = pass_name
+      self.impl_pass = impl_pass
 
       error = False
 
@@ -1210,6 +1238,21 @@ class AlgebraicPass(object):
 
       self.automaton = TreeAutomaton(self.xforms)
 
+      # Expression conditions like is_used_once look at the uses of the
+      # expression, so a change of the uses of a value may change whether a
+      # pattern matches on a user up to this many levels up.
+      def use_levels(val, depth):
+         if not isinstance(val, Expression):
+            return 0
+
+         levels = depth + 1 if val.cond else 0
+         for src in val.sources:
+            levels = max(levels, use_levels(src, depth + 1))
+         return levels
+
+      self.use_levels = max([use_levels(xform.search, 0)
+                             for xform in self.xforms] + [0])
+
       if error:
          sys.exit(1)
 
@@ -1219,6 +1262,8 @@ class AlgebraicPass(object):
                                              xforms=self.xforms,
                                              opcode_xforms=self.opcode_xforms,
                                              condition_list=condition_list,
+                                             use_levels=self.use_levels,
+                                             impl_pass=self.impl_pass,
                                              automaton=self.automaton,
                                              get_c_opcode=get_c_opcode,
                                              itertools=itertools)
@@ -31,6 +31,11 @@
  *        Clone body of foo (ie. parent class, embedded struct, etc)
  */
 
+typedef struct {
+   const void *orig;
+   void *clone;
+} clone_remap_entry;
+
 typedef struct {
    /* True if we are cloning an entire shader. */
    bool global_clone;
@@ -45,6 +50,17 @@ typedef struct {
    /* maps orig ptr -> cloned ptr: */
    struct hash_table *remap_table;
 
+   /* When cloning a whole impl, the SSA defs and registers are remapped
+    * through these arrays indexed by nir_ssa_def::index and
+    * nir_register::index instead of remap_table.  Anything with an index
+    * that is out of range or already taken by another def goes to
+    * remap_table as usual.
+    */
+   clone_remap_entry *ssa_remap;
+   unsigned ssa_remap_size;
+   clone_remap_entry *reg_remap;
+   unsigned reg_remap_size;
+
    /* List of phi sources. */
    struct list_head phi_srcs;
 
@@ -59,6 +75,11 @@ init_clone_state(clone_state *state, struct hash_table *remap_table,
    state->global_clone = global;
    state->allow_remap_fallback = allow_remap_fallback;
 
+   state->ssa_remap = NULL;
+   state->ssa_remap_size = 0;
+   state->reg_remap = NULL;
+   state->reg_remap_size = 0;
+
    if (remap_table) {
       state->remap_table = remap_table;
    } else {
@@ -72,6 +93,8 @@ static void
 free_clone_state(clone_state *state)
 {
    _mesa_hash_table_destroy(state->remap_table, NULL);
+   free(state->ssa_remap);
+   free(state->reg_remap);
 }
 
 static inline void *
@@ -117,10 +140,78 @@ remap_global(clone_state *state, const void *ptr)
    return _lookup_ptr(state, ptr, true);
 }
 
+static inline void
+add_remap_indexed(clone_state *state, clone_remap_entry *remap, unsigned size,
+                  unsigned index, void *nptr, const void *ptr)
+{
+   if (index < size && remap[index].orig == NULL) {
+      remap[index].orig = ptr;
+      remap[index].clone = nptr;
+   } else {
+      add_remap(state, nptr, ptr);
+   }
+}
+
+static inline void *
+remap_indexed(clone_state *state, clone_remap_entry *remap, unsigned size,
+              unsigned index, const void *ptr)
+{
+   if (index < size && remap[index].orig == ptr)
+      return remap[index].clone;
+
+   return remap_local(state, ptr);
+}
+
+static void
+add_remap_ssa(clone_state *state, nir_ssa_def *ndef, const nir_ssa_def *def)
+{
+   add_remap_indexed(state, state->ssa_remap, state->ssa_remap_size,
+                     def->index, ndef, def);
+}
+
+static nir_ssa_def *
+remap_ssa(clone_state *state, const nir_ssa_def *def)
+{
+   if (!def)
+      return NULL;
+
+   return remap_indexed(state, state->ssa_remap, state->ssa_remap_size,
+                        def->index, def);
+}
+
 static nir_register *
 remap_reg(clone_state *state, const nir_register *reg)
 {
-   return _lookup_ptr(state, reg, false);
+   if (!reg)
+      return NULL;
+
+   return remap_indexed(state, state->reg_remap, state->reg_remap_size,
+                        reg->index, reg);
+}
+
+/* Resets the dense remap arrays for cloning fi, growing them if needed. */
+static void
+init_impl_remap(clone_state *state, const nir_function_impl *fi)
+{
+   if (fi->ssa_alloc > state->ssa_remap_size) {
+      free(state->ssa_remap);
+      state->ssa_remap = malloc(fi->ssa_alloc * sizeof(*state->ssa_remap));
+      state->ssa_remap_size = state->ssa_remap ? fi->ssa_alloc : 0;
+   }
+   if (fi->reg_alloc > state->reg_remap_size) {
+      free(state->reg_remap);
+      state->reg_remap = malloc(fi->reg_alloc * sizeof(*state->reg_remap));
+      state->reg_remap_size = state->reg_remap ? fi->reg_alloc : 0;
+   }
+
+   if (state->ssa_remap_size > 0) {
+      memset(state->ssa_remap, 0,
+             state->ssa_remap_size * sizeof(*state->ssa_remap));
+   }
+   if (state->reg_remap_size > 0) {
+      memset(state->reg_remap, 0,
+             state->reg_remap_size * sizeof(*state->reg_remap));
+   }
 }
 
 static nir_variable *
@@ -206,7 +297,8 @@ static nir_register *
 clone_register(clone_state *state, const nir_register *reg)
 {
    nir_register *nreg = rzalloc(state->ns, nir_register);
-   add_remap(state, nreg, reg);
+   add_remap_indexed(state, state->reg_remap, state->reg_remap_size,
+                     reg->index, nreg, reg);
 
    nreg->num_components = reg->num_components;
    nreg->bit_size = reg->bit_size;
@@ -240,7 +332,7 @@ __clone_src(clone_state *state, void *ninstr_or_if,
 {
    nsrc->is_ssa = src->is_ssa;
    if (src->is_ssa) {
-      nsrc->ssa = remap_local(state, src->ssa);
+      nsrc->ssa = remap_ssa(state, src->ssa);
    } else {
       nsrc->reg.reg = remap_reg(state, src->reg.reg);
       if (src->reg.indirect) {
@@ -260,7 +352,7 @@ __clone_dst(clone_state *state, nir_instr *ninstr,
       nir_ssa_dest_init(ninstr, ndst, dst->ssa.num_components,
                         dst->ssa.bit_size, dst->ssa.name);
       if (likely(state->remap_table))
-         add_remap(state, &ndst->ssa, &dst->ssa);
+         add_remap_ssa(state, &ndst->ssa, &dst->ssa);
    } else {
       ndst->reg.reg = remap_reg(state, dst->reg.reg);
       if (dst->reg.indirect) {
@@ -377,7 +469,7 @@ clone_load_const(clone_state *state, const nir_load_const_instr *lc)
 
    memcpy(&nlc->value, &lc->value, sizeof(*nlc->value) * lc->def.num_components);
 
-   add_remap(state, &nlc->def, &lc->def);
+   add_remap_ssa(state, &nlc->def, &lc->def);
 
    return nlc;
 }
@@ -389,7 +481,7 @@ clone_ssa_undef(clone_state *state, const nir_ssa_undef_instr *sa)
       nir_ssa_undef_instr_create(state->ns, sa->def.num_components,
                                  sa->def.bit_size);
 
-   add_remap(state, &nsa->def, &sa->def);
+   add_remap_ssa(state, &nsa->def, &sa->def);
 
    return nsa;
 }
@@ -620,7 +712,7 @@ fixup_phi_srcs(clone_state *state)
       list_del(&src->src.use_link);
 
       if (src->src.is_ssa) {
-         src->src.ssa = remap_local(state, src->src.ssa);
+         src->src.ssa = remap_ssa(state, src->src.ssa);
          list_addtail(&src->src.use_link, &src->src.ssa->uses);
       } else {
          src->src.reg.reg = remap_reg(state, src->src.reg.reg);
@@ -663,6 +755,8 @@ clone_function_impl(clone_state *state, const nir_function_impl *fi)
 {
    nir_function_impl *nfi = nir_function_impl_create_bare(state->ns);
 
+   init_impl_remap(state, fi);
+
    clone_var_list(state, &nfi->locals, &fi->locals);
    clone_reg_list(state, &nfi->registers, &fi->registers);
    nfi->reg_alloc = fi->reg_alloc;
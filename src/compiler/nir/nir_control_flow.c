@@ -582,6 +582,8 @@ nir_cf_node_insert(nir_cursor cursor, nir_cf_node *node)
 
    split_block_cursor(cursor, &before, &after);
 
+   nir_cf_node_changed(&before->cf_node);
+
    if (node->type == nir_cf_node_block) {
       nir_block *block = nir_cf_node_as_block(node);
       exec_node_insert_after(&before->cf_node.node, &block->cf_node.node);
@@ -734,6 +736,8 @@ nir_cf_reinsert(nir_cf_list *cf_list, nir_cursor cursor)
 
    split_block_cursor(cursor, &before, &after);
 
+   nir_cf_node_changed(&before->cf_node);
+
    foreach_list_typed_safe(nir_cf_node, node, node, &cf_list->list) {
       exec_node_remove(&node->node);
       node->parent = before->cf_node.parent;
@@ -37,5 +37,6 @@
 
 void nir_handle_add_jump(nir_block *block);
 void nir_handle_remove_jump(nir_block *block, nir_jump_type type);
+void nir_cf_node_changed(nir_cf_node *node);
 
 #endif /* NIR_CONTROL_FLOW_PRIVATE_H */
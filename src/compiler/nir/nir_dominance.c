@@ -46,9 +46,8 @@ init_block(nir_block *block, nir_function_impl *impl)
    block->dom_pre_index = INT16_MAX;
    block->dom_post_index = -1;
 
-   set_foreach(block->dom_frontier, entry) {
-      _mesa_set_remove(block->dom_frontier, entry);
-   }
+   if (block->dom_frontier->entries > 0)
+      _mesa_set_clear(block->dom_frontier, NULL);
 
    return true;
 }
@@ -130,15 +129,21 @@ static void
 calc_dom_children(nir_function_impl* impl)
 {
    void *mem_ctx = ralloc_parent(impl);
+   unsigned num_children = 0;
 
    nir_foreach_block(block, impl) {
-      if (block->imm_dom)
+      if (block->imm_dom) {
          block->imm_dom->num_dom_children++;
+         num_children++;
+      }
    }
 
+   /* All of the arrays share one allocation. */
+   nir_block **children = ralloc_array(mem_ctx, nir_block *, num_children);
+
    nir_foreach_block(block, impl) {
-      block->dom_children = ralloc_array(mem_ctx, nir_block *,
-                                         block->num_dom_children);
+      block->dom_children = children;
+      children += block->num_dom_children;
       block->num_dom_children = 0;
    }
 
@@ -174,14 +179,24 @@ nir_calc_dominance_impl(nir_function_impl *impl)
       init_block(block, impl);
    }
 
-   bool progress = true;
-   while (progress) {
-      progress = false;
-      nir_foreach_block(block, impl) {
-         if (block != nir_start_block(impl))
-            progress |= calc_dominance(block);
+   /* NIR control flow is structured, so walking the blocks in order visits
+    * every predecessor of a block before it, except for the ones reaching
+    * it through a loop back-edge.  Those don't change its dominator, so a
+    * single pass finds all of them.
+    */
+   nir_foreach_block(block, impl) {
+      if (block != nir_start_block(impl))
+         calc_dominance(block);
+   }
+
+#ifndef NDEBUG
+   nir_foreach_block(block, impl) {
+      if (block != nir_start_block(impl)) {
+         bool progress = calc_dominance(block);
+         assert(!progress);
       }
    }
+#endif
 
    nir_foreach_block(block, impl) {
       calc_dom_frontier(block);
@@ -25,8 +25,6 @@
  */
 
 #include "nir.h"
-#include "nir_worklist.h"
-#include "nir_vla.h"
 
 /*
  * Basic liveness analysis.  This works only in SSA form.
@@ -40,16 +38,22 @@
  * SSA value may not dominate a use is if the use is in a phi node and the
  * uses in phi no are in the live-out of the corresponding predecessor
  * block but not in the live-in of the block containing the phi node.
+ *
+ * Instead of iterating a data-flow problem over whole bitsets until nothing
+ * changes, the live range of each SSA def is found by walking up the CFG
+ * from its uses until the definition is reached, as described in "Computing
+ * Liveness Sets for SSA-Form Programs" by Brandner et al.  Only defs used
+ * outside of the block they are defined in cost anything beyond looking at
+ * their uses, and a single def can be updated on its own after its uses
+ * changed.
  */
 
 struct live_ssa_defs_state {
    unsigned num_ssa_defs;
    unsigned bitset_words;
 
-   /* Used in propagate_across_edge() */
-   BITSET_WORD *tmp_live;
-
-   nir_block_worklist worklist;
+   /* Blocks to walk up from in mark_live_in(), at most one per block */
+   nir_block **stack;
 };
 
 static bool
@@ -65,10 +69,8 @@ index_ssa_def(nir_ssa_def *def, void *void_state)
    return true;
 }
 
-/* Initialize the liveness data to zero and add the given block to the
- * worklist.
- */
-static bool
+/* Initialize the liveness data to zero. */
+static void
 init_liveness_block(nir_block *block,
                     struct live_ssa_defs_state *state)
 {
@@ -79,88 +81,87 @@ init_liveness_block(nir_block *block,
    block->live_out = reralloc(block, block->live_out, BITSET_WORD,
                               state->bitset_words);
    memset(block->live_out, 0, state->bitset_words * sizeof(BITSET_WORD));
-
-   nir_block_worklist_push_head(&state->worklist, block);
-
-   return true;
 }
 
-static bool
-set_src_live(nir_src *src, void *void_live)
+/* Marks def live coming into block and on every path from its definition to
+ * block.  Phi nodes are defined on the edges into their block, so the
+ * destination of a phi is live in its own block but not live out of the
+ * predecessors.
+ */
+static void
+mark_live_in(nir_ssa_def *def, nir_block *block,
+             struct live_ssa_defs_state *state)
 {
-   BITSET_WORD *live = void_live;
+   nir_block *def_block = def->parent_instr->block;
+   const bool is_phi = def->parent_instr->type == nir_instr_type_phi;
+   const unsigned index = def->live_index;
+   unsigned stack_size = 0;
 
-   if (!src->is_ssa)
-      return true;
+   if ((block == def_block && !is_phi) ||
+       BITSET_TEST(block->live_in, index))
+      return;
 
-   if (src->ssa->live_index == 0)
-      return true;   /* undefined variables are never live */
+   BITSET_SET(block->live_in, index);
+   state->stack[stack_size++] = block;
 
-   BITSET_SET(live, src->ssa->live_index);
+   while (stack_size > 0) {
+      block = state->stack[--stack_size];
+      if (block == def_block)
+         continue;
 
-   return true;
-}
+      set_foreach(block->predecessors, entry) {
+         nir_block *pred = (nir_block *)entry->key;
 
-static bool
-set_ssa_def_dead(nir_ssa_def *def, void *void_live)
-{
-   BITSET_WORD *live = void_live;
+         BITSET_SET(pred->live_out, index);
 
-   BITSET_CLEAR(live, def->live_index);
+         if ((pred == def_block && !is_phi) ||
+             BITSET_TEST(pred->live_in, index))
+            continue;
 
-   return true;
+         BITSET_SET(pred->live_in, index);
+         state->stack[stack_size++] = pred;
+      }
+   }
 }
 
-/** Propagates the live in of succ across the edge to the live out of pred
- *
- * Phi nodes exist "between" blocks and all the phi nodes at the start of a
- * block act "in parallel".  When we propagate from the live_in of one
- * block to the live out of the other, we have to kill any writes from phis
- * and make live any sources.
- *
- * Returns true if updating live out of pred added anything
- */
 static bool
-propagate_across_edge(nir_block *pred, nir_block *succ,
-                      struct live_ssa_defs_state *state)
+mark_ssa_def_live(nir_ssa_def *def, void *void_state)
 {
-   BITSET_WORD *live = state->tmp_live;
-   memcpy(live, succ->live_in, state->bitset_words * sizeof *live);
+   struct live_ssa_defs_state *state = void_state;
 
-   nir_foreach_instr(instr, succ) {
-      if (instr->type != nir_instr_type_phi)
-         break;
-      nir_phi_instr *phi = nir_instr_as_phi(instr);
+   if (def->live_index == 0)
+      return true;   /* undefined variables are never live */
 
-      assert(phi->dest.is_ssa);
-      set_ssa_def_dead(&phi->dest.ssa, live);
-   }
+   nir_foreach_use(use, def) {
+      nir_instr *instr = use->parent_instr;
 
-   nir_foreach_instr(instr, succ) {
-      if (instr->type != nir_instr_type_phi)
-         break;
-      nir_phi_instr *phi = nir_instr_as_phi(instr);
+      if (instr->type == nir_instr_type_phi) {
+         nir_block *pred = exec_node_data(nir_phi_src, use, src)->pred;
 
-      nir_foreach_phi_src(src, phi) {
-         if (src->pred == pred) {
-            set_src_live(&src->src, live);
-            break;
-         }
+         BITSET_SET(pred->live_out, def->live_index);
+         mark_live_in(def, pred, state);
+      } else {
+         mark_live_in(def, instr->block, state);
       }
    }
 
-   BITSET_WORD progress = 0;
-   for (unsigned i = 0; i < state->bitset_words; ++i) {
-      progress |= live[i] & ~pred->live_out[i];
-      pred->live_out[i] |= live[i];
+   /* Uses in if conditions are in the block immediately preceding the if */
+   nir_foreach_if_use(use, def) {
+      nir_if *nif = use->parent_if;
+      nir_block *block =
+         nir_cf_node_as_block(nir_cf_node_prev(&nif->cf_node));
+
+      mark_live_in(def, block, state);
    }
-   return progress != 0;
+
+   return true;
 }
 
 void
 nir_live_ssa_defs_impl(nir_function_impl *impl)
 {
    struct live_ssa_defs_state state;
+   unsigned num_blocks = 0;
 
    /* We start at 1 because we reserve the index value of 0 for ssa_undef
     * instructions.  Those are never live, so their liveness information
@@ -170,67 +171,226 @@ nir_live_ssa_defs_impl(nir_function_impl *impl)
    nir_foreach_block(block, impl) {
       nir_foreach_instr(instr, block)
          nir_foreach_ssa_def(instr, index_ssa_def, &state);
+      num_blocks++;
    }
 
-   nir_block_worklist_init(&state.worklist, impl->num_blocks, NULL);
-
    /* We now know how many unique ssa definitions we have and we can go
-    * ahead and allocate live_in and live_out sets and add all of the
-    * blocks to the worklist.
+    * ahead and allocate live_in and live_out sets.
     */
    state.bitset_words = BITSET_WORDS(state.num_ssa_defs);
-   state.tmp_live = rzalloc_array(impl, BITSET_WORD, state.bitset_words);
    nir_foreach_block(block, impl) {
       init_liveness_block(block, &state);
    }
 
+   state.stack = ralloc_array(NULL, nir_block *, num_blocks);
 
-   /* We're now ready to work through the worklist and update the liveness
-    * sets of each of the blocks.  By the time we get to this point, every
-    * block in the function implementation has been pushed onto the
-    * worklist in reverse order.  As long as we keep the worklist
-    * up-to-date as we go, everything will get covered.
-    */
-   while (!nir_block_worklist_is_empty(&state.worklist)) {
-      /* We pop them off in the reverse order we pushed them on.  This way
-       * the first walk of the instructions is backwards so we only walk
-       * once in the case of no control flow.
-       */
-      nir_block *block = nir_block_worklist_pop_head(&state.worklist);
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block)
+         nir_foreach_ssa_def(instr, mark_ssa_def_live, &state);
+   }
 
-      memcpy(block->live_in, block->live_out,
-             state.bitset_words * sizeof(BITSET_WORD));
+   ralloc_free(state.stack);
+}
 
-      nir_if *following_if = nir_block_get_following_if(block);
-      if (following_if)
-         set_src_live(&following_if->condition, block->live_in);
+/* Recomputes the liveness of def after its uses changed.  The CFG and the
+ * instruction defining def must not have changed since the liveness was
+ * computed.
+ */
+void
+nir_live_ssa_def_update(nir_ssa_def *def)
+{
+   nir_function_impl *impl =
+      nir_cf_node_get_function(&def->parent_instr->block->cf_node);
+   struct live_ssa_defs_state state;
+   unsigned num_blocks = 0;
 
-      nir_foreach_instr_reverse(instr, block) {
-         /* Phi nodes are handled seperately so we want to skip them.  Since
-          * we are going backwards and they are at the beginning, we can just
-          * break as soon as we see one.
-          */
-         if (instr->type == nir_instr_type_phi)
+   assert(impl->valid_metadata & nir_metadata_live_ssa_defs);
+
+   if (def->live_index == 0)
+      return;
+
+   nir_foreach_block(block, impl) {
+      BITSET_CLEAR(block->live_in, def->live_index);
+      BITSET_CLEAR(block->live_out, def->live_index);
+      num_blocks++;
+   }
+
+   state.stack = ralloc_array(NULL, nir_block *, num_blocks);
+   mark_ssa_def_live(def, &state);
+   ralloc_free(state.stack);
+}
+
+struct renumber_state {
+   unsigned old_index;
+   unsigned new_index;
+   bool renumber;
+};
+
+/* Finds the last index that a moved def passed, and with renumber set, moves
+ * the defs between its old and its new place one index down.  Returns false
+ * once a def before its old place is reached.
+ */
+static bool
+renumber_def(nir_ssa_def *def, void *void_state)
+{
+   struct renumber_state *state = void_state;
+
+   if (def->live_index == 0)
+      return true;
+   if (def->live_index < state->old_index)
+      return false;
+
+   if (state->new_index == state->old_index)
+      state->new_index = def->live_index;
+   if (state->renumber)
+      def->live_index--;
+   return true;
+}
+
+/* Calls renumber_def() on the defs before instr, back to its old place.
+ * Returns the number of instructions visited, stopping after max of them.
+ */
+static unsigned
+renumber_defs_before(nir_instr *instr, struct renumber_state *state,
+                     unsigned max)
+{
+   nir_block *block = instr->block;
+   nir_instr *prev = nir_instr_prev(instr);
+   unsigned num_instrs = 0;
+
+   while (num_instrs <= max) {
+      if (prev == NULL) {
+         block = nir_block_cf_tree_prev(block);
+         if (block == NULL)
             break;
+         prev = nir_block_last_instr(block);
+         continue;
+      }
+      num_instrs++;
+      if (!nir_foreach_ssa_def(prev, renumber_def, state))
+         break;
+      prev = nir_instr_prev(prev);
+   }
+
+   return num_instrs;
+}
+
+/* Moves bits start + 1 to end of set one bit down, and clears bit end. */
+static void
+shift_bits_down(BITSET_WORD *set, unsigned start, unsigned end)
+{
+   for (unsigned w = start / BITSET_WORDBITS; w <= end / BITSET_WORDBITS; w++) {
+      BITSET_WORD shifted = set[w] >> 1;
+      BITSET_WORD mask = ~0u;
+
+      if (w < end / BITSET_WORDBITS)
+         shifted |= set[w + 1] << (BITSET_WORDBITS - 1);
+      if (w == start / BITSET_WORDBITS)
+         mask &= ~0u << (start % BITSET_WORDBITS);
+      if (w == end / BITSET_WORDBITS)
+         mask &= ~0u >> (BITSET_WORDBITS - 1 - end % BITSET_WORDBITS);
+
+      set[w] = (set[w] & ~mask) | (shifted & mask);
+   }
+   BITSET_CLEAR(set, end);
+}
+
+static bool
+count_src_def(nir_src *src, void *num_srcs)
+{
+   if (src->is_ssa)
+      (*(unsigned *)num_srcs)++;
+   return true;
+}
+
+static bool
+update_src_def(nir_src *src, void *void_state)
+{
+   if (src->is_ssa)
+      nir_live_ssa_def_update(src->ssa);
+   return true;
+}
+
+/* Returns roughly what nir_live_ssa_defs_impl() costs, in the units of the
+ * budget of nir_live_ssa_defs_instr_moved(): instructions visited plus
+ * bitset words touched.  The block indices must be valid.
+ */
+unsigned
+nir_live_ssa_defs_update_budget(nir_function_impl *impl)
+{
+   assert(impl->valid_metadata & nir_metadata_block_index);
 
-         nir_foreach_ssa_def(instr, set_ssa_def_dead, block->live_in);
-         nir_foreach_src(instr, set_src_live, block->live_in);
+   return impl->ssa_alloc +
+          2 * impl->num_blocks * BITSET_WORDS(impl->ssa_alloc);
+}
+
+/* Updates the liveness after instr was moved to a later place, e.g. into a
+ * block it dominated, without any other change to the CFG or the defs.
+ *
+ * The live indices have to stay in the order of the instructions, so the
+ * defs that instr moved past each take one index less and instr's def takes
+ * the last of them.  That shifts the bitsets of every block, and the live
+ * ranges of the def and its sources are found again, so the cost grows with
+ * the distance moved and with the number of blocks.
+ *
+ * The cost is taken from *budget, see nir_live_ssa_defs_update_budget().
+ * If it's more than what's left, nothing is updated and false is returned,
+ * and the caller has to drop nir_metadata_live_ssa_defs.  The block indices
+ * must be valid.
+ */
+bool
+nir_live_ssa_defs_instr_moved(nir_instr *instr, unsigned *budget)
+{
+   nir_function_impl *impl = nir_cf_node_get_function(&instr->block->cf_node);
+   nir_ssa_def *def = nir_instr_ssa_def(instr);
+   struct renumber_state state = { 0, 0, false };
+   unsigned num_srcs = 0, cost;
+
+   assert(impl->valid_metadata & nir_metadata_live_ssa_defs);
+   assert(impl->valid_metadata & nir_metadata_block_index);
+
+   if (def != NULL && def->live_index != 0) {
+      state.old_index = state.new_index = def->live_index;
+      cost = renumber_defs_before(instr, &state, *budget);
+      if (cost > *budget)
+         return false;
+
+      /* Clearing and marking the def in every block. */
+      cost += 2 * impl->num_blocks;
+      if (state.new_index != state.old_index) {
+         cost += 2 * impl->num_blocks *
+                 (state.new_index / BITSET_WORDBITS -
+                  state.old_index / BITSET_WORDBITS + 1);
       }
+   } else {
+      cost = 0;
+   }
 
-      /* Walk over all of the predecessors of the current block updating
-       * their live in with the live out of this one.  If anything has
-       * changed, add the predecessor to the work list so that we ensure
-       * that the new information is used.
-       */
-      set_foreach(block->predecessors, entry) {
-         nir_block *pred = (nir_block *)entry->key;
-         if (propagate_across_edge(pred, block, &state))
-            nir_block_worklist_push_tail(&state.worklist, pred);
+   nir_foreach_src(instr, count_src_def, &num_srcs);
+   cost += 2 * impl->num_blocks * num_srcs;
+
+   if (cost > *budget)
+      return false;
+   *budget -= cost;
+
+   if (state.new_index != state.old_index) {
+      state.new_index = state.old_index;
+      state.renumber = true;
+      renumber_defs_before(instr, &state, UINT_MAX);
+
+      nir_foreach_block(block, impl) {
+         shift_bits_down(block->live_in, state.old_index, state.new_index);
+         shift_bits_down(block->live_out, state.old_index, state.new_index);
       }
+      def->live_index = state.new_index;
    }
 
-   ralloc_free(state.tmp_live);
-   nir_block_worklist_fini(&state.worklist);
+   if (def != NULL)
+      nir_live_ssa_def_update(def);
+
+   /* The sources are now used elsewhere. */
+   nir_foreach_src(instr, update_src_def, NULL);
+   return true;
 }
 
 static bool
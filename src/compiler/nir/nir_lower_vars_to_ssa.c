@@ -705,7 +705,7 @@ rename_variables(struct lower_variables_state *state)
  *  4) Perform "variable renaming" by replacing the load/store instructions
  *     with SSA definitions and SSA uses.
  */
-static bool
+bool
 nir_lower_vars_to_ssa_impl(nir_function_impl *impl)
 {
    struct lower_variables_state state;
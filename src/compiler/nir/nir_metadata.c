@@ -57,6 +57,10 @@ void
 nir_metadata_preserve(nir_function_impl *impl, nir_metadata preserved)
 {
    impl->valid_metadata &= preserved;
+
+   /* Anything that dirties metadata changed the impl. */
+   if ((preserved & nir_metadata_all) != nir_metadata_all)
+      nir_function_impl_changed(impl);
 }
 
 void
@@ -253,7 +253,7 @@ copy_prop_if(nir_if *if_stmt)
    return copy_prop_src(&if_stmt->condition, NULL, if_stmt, 1);
 }
 
-static bool
+bool
 nir_copy_prop_impl(nir_function_impl *impl)
 {
    bool progress = false;
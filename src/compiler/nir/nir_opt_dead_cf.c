@@ -354,8 +354,8 @@ dead_cf_list(struct exec_list *list, bool *list_ends_in_jump)
    return progress;
 }
 
-static bool
-opt_dead_cf_impl(nir_function_impl *impl)
+bool
+nir_opt_dead_cf_impl(nir_function_impl *impl)
 {
    bool dummy;
    bool progress = dead_cf_list(&impl->body, &dummy);
@@ -387,7 +387,7 @@ nir_opt_dead_cf(nir_shader *shader)
 
    nir_foreach_function(function, shader)
       if (function->impl)
-         progress |= opt_dead_cf_impl(function->impl);
+         progress |= nir_opt_dead_cf_impl(function->impl);
 
    return progress;
 }
@@ -0,0 +1,335 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "nir.h"
+#include "nir_instr_set.h"
+
+/*
+ * Implements global value numbering with partial redundancy elimination
+ * around if statements.
+ *
+ * nir_opt_cse only replaces a value with an equal one that dominates it, so
+ * a value computed in both arms of an if, or in one arm and again after the
+ * if, is still computed twice on some path.  Values are numbered with the
+ * hashing and comparison of nir_instr_set and, for every if:
+ *
+ *  - A value computed in the first block of both arms is fully redundant on
+ *    the paths through the if.  It is hoisted in front of the if and the
+ *    copy in the else arm is removed.
+ *
+ *  - A value computed after the if that is also computed in the first block
+ *    of one arm is partially redundant.  It is moved to the end of the other
+ *    arm and the two are merged with a phi, so the path through the first
+ *    arm computes it once and the other path doesn't get any longer.  If the
+ *    other arm is a single block, both are hoisted in front of the if
+ *    instead.
+ *
+ * Only values whose sources are available in front of the if are moved, so
+ * nothing has to be translated through phis.  Ifs are visited innermost
+ * first, which lets values hoisted out of an inner if take part in the
+ * outer one.
+ */
+
+static bool
+src_is_available(nir_src *src, void *block)
+{
+   return src->is_ssa &&
+          nir_block_dominates(src->ssa->parent_instr->block, block);
+}
+
+/* Whether instr computes a value that only depends on its sources, all of
+ * which are available at the end of block.  If into_arm is set, instr is
+ * going to be moved into an arm of the if, which is non-uniform control
+ * flow.
+ */
+static bool
+instr_can_move(nir_instr *instr, nir_block *block, bool into_arm)
+{
+   switch (instr->type) {
+   case nir_instr_type_alu: {
+      nir_alu_instr *alu = nir_instr_as_alu(instr);
+      if (!alu->dest.dest.is_ssa)
+         return false;
+
+      switch (alu->op) {
+      case nir_op_fddx:
+      case nir_op_fddy:
+      case nir_op_fddx_fine:
+      case nir_op_fddy_fine:
+      case nir_op_fddx_coarse:
+      case nir_op_fddy_coarse:
+         /* These can only go in uniform control flow */
+         if (into_arm)
+            return false;
+         break;
+      default:
+         break;
+      }
+      break;
+   }
+
+   case nir_instr_type_tex: {
+      nir_tex_instr *tex = nir_instr_as_tex(instr);
+      if (!tex->dest.is_ssa)
+         return false;
+      if (into_arm && nir_tex_instr_has_implicit_derivative(tex))
+         return false;
+      break;
+   }
+
+   case nir_instr_type_load_const:
+      return true;
+
+   case nir_instr_type_intrinsic: {
+      nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+      if (!nir_intrinsic_infos[intrin->intrinsic].has_dest ||
+          !intrin->dest.is_ssa ||
+          !nir_intrinsic_can_reorder(intrin))
+         return false;
+      break;
+   }
+
+   default:
+      return false;
+   }
+
+   return nir_foreach_src(instr, src_is_available, block);
+}
+
+static void
+merge_exact(nir_instr *instr, nir_instr *other)
+{
+   /* nir_instrs_equal() ignores the exact bit, so the value that is kept
+    * has to be exact if either of them was.
+    */
+   if (instr->type == nir_instr_type_alu && nir_instr_as_alu(other)->exact)
+      nir_instr_as_alu(instr)->exact = true;
+}
+
+static bool
+hoist_common_values(nir_if *nif, nir_block *before)
+{
+   nir_block *then_block = nir_if_first_then_block(nif);
+   nir_block *else_block = nir_if_first_else_block(nif);
+   bool progress = false;
+
+   struct set *else_values = nir_instr_set_create(NULL);
+   nir_foreach_instr(instr, else_block) {
+      if (instr_can_move(instr, before, false))
+         _mesa_set_search_or_add(else_values, instr);
+   }
+
+   nir_foreach_instr_safe(instr, then_block) {
+      if (else_values->entries == 0)
+         break;
+
+      if (!instr_can_move(instr, before, false))
+         continue;
+
+      struct set_entry *entry = _mesa_set_search(else_values, instr);
+      if (!entry)
+         continue;
+
+      nir_instr *match = (nir_instr *) entry->key;
+      _mesa_set_remove(else_values, entry);
+
+      merge_exact(instr, match);
+      nir_instr_remove(instr);
+      nir_instr_insert(nir_after_block(before), instr);
+
+      nir_ssa_def *def = nir_instr_ssa_def(instr);
+      nir_ssa_def_rewrite_uses(nir_instr_ssa_def(match), nir_src_for_ssa(def));
+      nir_instr_remove(match);
+      progress = true;
+
+      /* Values in the else block that used the removed copy may be
+       * available in front of the if now.
+       */
+      nir_foreach_use(use, def) {
+         nir_instr *user = use->parent_instr;
+         if (user->block == else_block &&
+             instr_can_move(user, before, false))
+            _mesa_set_search_or_add(else_values, user);
+      }
+   }
+
+   nir_instr_set_destroy(else_values);
+
+   return progress;
+}
+
+static void
+add_phi_src(nir_phi_instr *phi, nir_block *pred, nir_ssa_def *def)
+{
+   nir_phi_src *src = ralloc(phi, nir_phi_src);
+   src->pred = pred;
+   src->src = nir_src_for_ssa(def);
+   exec_list_push_tail(&phi->srcs, &src->node);
+}
+
+static bool
+merge_partial_values(nir_shader *shader, nir_if *nif,
+                     nir_block *before, nir_block *after)
+{
+   nir_block *then_first = nir_if_first_then_block(nif);
+   nir_block *then_last = nir_if_last_then_block(nif);
+   nir_block *else_first = nir_if_first_else_block(nif);
+   nir_block *else_last = nir_if_last_else_block(nif);
+   bool progress = false;
+
+   /* If an arm jumps away, the block after the if isn't reached from it and
+    * values from the other arm dominate it, which nir_opt_cse takes care of.
+    */
+   if (nir_block_ends_in_jump(then_last) || nir_block_ends_in_jump(else_last))
+      return false;
+
+   struct set *arm_values = nir_instr_set_create(NULL);
+   nir_foreach_instr(instr, then_first) {
+      if (instr_can_move(instr, before, false))
+         _mesa_set_search_or_add(arm_values, instr);
+   }
+   nir_foreach_instr(instr, else_first) {
+      if (instr_can_move(instr, before, false))
+         _mesa_set_search_or_add(arm_values, instr);
+   }
+
+   nir_foreach_instr_safe(instr, after) {
+      if (arm_values->entries == 0)
+         break;
+
+      if (instr->type == nir_instr_type_phi ||
+          !instr_can_move(instr, before, true))
+         continue;
+
+      struct set_entry *entry = _mesa_set_search(arm_values, instr);
+      if (!entry)
+         continue;
+
+      nir_instr *match = (nir_instr *) entry->key;
+      bool in_then = match->block == then_first;
+      nir_block *other_last = in_then ? else_last : then_last;
+      nir_ssa_def *def = nir_instr_ssa_def(instr);
+
+      /* If the other arm is a single block, the copy would be in its first
+       * block and hoist_common_values() would move both in front of the if
+       * on the next run, so do that right away.
+       */
+      if (other_last == (in_then ? else_first : then_first)) {
+         _mesa_set_remove(arm_values, entry);
+         merge_exact(match, instr);
+         nir_instr_remove(match);
+         nir_instr_insert(nir_after_block(before), match);
+
+         nir_ssa_def_rewrite_uses(def, nir_src_for_ssa(nir_instr_ssa_def(match)));
+         nir_instr_remove(instr);
+         progress = true;
+         continue;
+      }
+
+      nir_phi_instr *phi = nir_phi_instr_create(shader);
+      add_phi_src(phi, in_then ? then_last : else_last,
+                  nir_instr_ssa_def(match));
+      add_phi_src(phi, other_last, def);
+      nir_ssa_dest_init(&phi->instr, &phi->dest,
+                        def->num_components, def->bit_size, NULL);
+
+      /* The phi isn't inserted yet, so its source isn't rewritten. */
+      nir_ssa_def_rewrite_uses(def, nir_src_for_ssa(&phi->dest.ssa));
+      nir_instr_insert(nir_before_block(after), &phi->instr);
+
+      merge_exact(match, instr);
+      nir_instr_remove(instr);
+      nir_instr_insert(nir_after_block(other_last), instr);
+      progress = true;
+   }
+
+   nir_instr_set_destroy(arm_values);
+
+   return progress;
+}
+
+static bool
+opt_gvn_pre_cf_list(nir_shader *shader, struct exec_list *cf_list)
+{
+   bool progress = false;
+
+   foreach_list_typed(nir_cf_node, cf_node, node, cf_list) {
+      switch (cf_node->type) {
+      case nir_cf_node_block:
+         break;
+
+      case nir_cf_node_if: {
+         nir_if *nif = nir_cf_node_as_if(cf_node);
+         progress |= opt_gvn_pre_cf_list(shader, &nif->then_list);
+         progress |= opt_gvn_pre_cf_list(shader, &nif->else_list);
+
+         nir_block *before = nir_cf_node_as_block(nir_cf_node_prev(cf_node));
+         nir_block *after = nir_cf_node_as_block(nir_cf_node_next(cf_node));
+         progress |= hoist_common_values(nif, before);
+         progress |= merge_partial_values(shader, nif, before, after);
+         break;
+      }
+
+      case nir_cf_node_loop:
+         progress |= opt_gvn_pre_cf_list(shader,
+                                         &nir_cf_node_as_loop(cf_node)->body);
+         break;
+
+      default:
+         unreachable("Invalid CF node type");
+      }
+   }
+
+   return progress;
+}
+
+bool
+nir_opt_gvn_pre_impl(nir_function_impl *impl)
+{
+   nir_metadata_require(impl, nir_metadata_block_index |
+                              nir_metadata_dominance);
+
+   bool progress = opt_gvn_pre_cf_list(impl->function->shader, &impl->body);
+
+   if (progress) {
+      nir_metadata_preserve(impl, nir_metadata_block_index |
+                                  nir_metadata_dominance);
+   } else {
+      nir_metadata_preserve(impl, nir_metadata_all);
+   }
+
+   return progress;
+}
+
+bool
+nir_opt_gvn_pre(nir_shader *shader)
+{
+   bool progress = false;
+
+   nir_foreach_function(function, shader) {
+      if (function->impl)
+         progress |= nir_opt_gvn_pre_impl(function->impl);
+   }
+
+   return progress;
+}
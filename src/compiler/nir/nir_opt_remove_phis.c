@@ -146,7 +146,7 @@ nir_opt_remove_phis_block(nir_block *block)
    return remove_phis_block(block, &b);
 }
 
-static bool
+bool
 nir_opt_remove_phis_impl(nir_function_impl *impl)
 {
    bool progress = false;
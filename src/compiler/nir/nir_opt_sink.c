@@ -220,6 +220,16 @@ nir_opt_sink(nir_shader *shader, nir_move_options options)
       nir_metadata_require(function->impl,
                            nir_metadata_block_index | nir_metadata_dominance);
 
+      /* Moving an instruction only changes the live ranges around it.  Once
+       * updating them costs more than recomputing them would, give up.
+       */
+      nir_metadata preserved =
+         nir_metadata_block_index | nir_metadata_dominance |
+         (function->impl->valid_metadata & nir_metadata_live_ssa_defs);
+      unsigned live_budget = 0;
+      if (preserved & nir_metadata_live_ssa_defs)
+         live_budget = nir_live_ssa_defs_update_budget(function->impl);
+
       nir_foreach_block_reverse(block, function->impl) {
          nir_foreach_instr_reverse_safe(instr, block) {
             if (!nir_can_move_instr(instr, options))
@@ -247,12 +257,15 @@ nir_opt_sink(nir_shader *shader, nir_move_options options)
 
             instr->block = use_block;
 
+            if ((preserved & nir_metadata_live_ssa_defs) &&
+                !nir_live_ssa_defs_instr_moved(instr, &live_budget))
+               preserved &= ~nir_metadata_live_ssa_defs;
+
             progress = true;
          }
       }
 
-      nir_metadata_preserve(function->impl,
-                            nir_metadata_block_index | nir_metadata_dominance);
+      nir_metadata_preserve(function->impl, preserved);
    }
 
    return progress;
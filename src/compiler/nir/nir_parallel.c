@@ -0,0 +1,165 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Running a per-impl pass on the functions of a shader in parallel.
+ *
+ * Everything of a shader is allocated out of the shader's ralloc arena, so
+ * the arena is made thread-safe while the pass runs.  Apart from that, a
+ * pass that only touches its own impl doesn't share anything with the
+ * threads working on other impls.
+ *
+ * The calling thread and the queue jobs take impls from a shared counter
+ * until there are none left.  Once the calling thread runs out, the jobs
+ * that haven't started yet are dropped, so this works even if the queue is
+ * busy, e.g. with the job that called us.
+ */
+
+#include "nir.h"
+#include "util/u_queue.h"
+
+struct parallel_state {
+   nir_impl_pass_cb pass;
+
+   nir_function_impl **impls;
+   bool *progress;
+   unsigned num_impls;
+
+   /* The next impl to run the pass on. */
+   unsigned next;
+};
+
+struct parallel_job {
+   struct parallel_state *state;
+   struct util_queue_fence fence;
+};
+
+static void
+run_impls(struct parallel_state *state)
+{
+   while (true) {
+      unsigned i = p_atomic_inc_return(&state->next) - 1;
+      if (i >= state->num_impls)
+         break;
+
+      state->progress[i] = state->pass(state->impls[i]);
+   }
+}
+
+static void
+run_impls_job(void *data, int thread_index)
+{
+   struct parallel_job *job = data;
+   run_impls(job->state);
+}
+
+/* Larger impls first, so that no thread starts a large impl at the end while
+ * the others are idle.
+ */
+static int
+compare_impl_size(const void *_a, const void *_b)
+{
+   const nir_function_impl *a = *(const nir_function_impl **)_a;
+   const nir_function_impl *b = *(const nir_function_impl **)_b;
+
+   return (b->ssa_alloc > a->ssa_alloc) - (b->ssa_alloc < a->ssa_alloc);
+}
+
+static bool
+foreach_impl_serial(nir_shader *shader, nir_impl_pass_cb pass)
+{
+   bool progress = false;
+
+   nir_foreach_function(function, shader) {
+      if (function->impl)
+         progress |= pass(function->impl);
+   }
+
+   return progress;
+}
+
+bool
+nir_shader_foreach_impl_parallel(nir_shader *shader,
+                                 struct util_queue *queue,
+                                 nir_impl_pass_cb pass)
+{
+   unsigned num_impls = 0;
+   nir_foreach_function(function, shader) {
+      if (function->impl)
+         num_impls++;
+   }
+
+   if (queue == NULL || num_impls <= 1)
+      return foreach_impl_serial(shader, pass);
+
+   const unsigned num_jobs = MIN2(queue->num_threads, num_impls - 1);
+
+   struct parallel_state state = {
+      .pass = pass,
+      .impls = malloc(num_impls * sizeof(*state.impls)),
+      .progress = calloc(num_impls, sizeof(*state.progress)),
+      .num_impls = num_impls,
+   };
+   struct parallel_job *jobs = malloc(num_jobs * sizeof(*jobs));
+
+   if (state.impls == NULL || state.progress == NULL || jobs == NULL) {
+      free(state.impls);
+      free(state.progress);
+      free(jobs);
+      return foreach_impl_serial(shader, pass);
+   }
+
+   unsigned i = 0;
+   nir_foreach_function(function, shader) {
+      if (function->impl)
+         state.impls[i++] = function->impl;
+   }
+   qsort(state.impls, num_impls, sizeof(*state.impls), compare_impl_size);
+
+   ralloc_arena_set_thread_safe(shader, true);
+
+   for (i = 0; i < num_jobs; i++) {
+      jobs[i].state = &state;
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(queue, &jobs[i], &jobs[i].fence, run_impls_job,
+                         NULL, 0);
+   }
+
+   run_impls(&state);
+
+   for (i = 0; i < num_jobs; i++) {
+      util_queue_drop_job(queue, &jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+
+   ralloc_arena_set_thread_safe(shader, false);
+
+   bool progress = false;
+   for (i = 0; i < num_impls; i++)
+      progress |= state.progress[i];
+
+   free(state.impls);
+   free(state.progress);
+   free(jobs);
+
+   return progress;
+}
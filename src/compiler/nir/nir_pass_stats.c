@@ -0,0 +1,238 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/* Statistics of the passes run with NIR_PASS and NIR_PASS_V.
+ *
+ * With NIR_PASS_STATS=true, the time spent in each pass, how often it was
+ * run, how often it made progress and by how much it changed the number of
+ * instructions are summed up by pass name and printed to stderr at exit.
+ * NIR_PASS_STATS_JSON=<file> writes them to the given file as JSON instead.
+ *
+ * The time of the invocations that didn't make progress is also reported
+ * separately, which is the time wasted by optimization loops that run the
+ * pass once more than needed.  Progress is unknown for NIR_PASS_V.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "nir.h"
+#include "util/debug.h"
+#include "util/hash_table.h"
+#include "util/os_time.h"
+#include "util/simple_mtx.h"
+
+struct pass_stats {
+   const char *name;
+   uint64_t num_calls;
+   uint64_t num_progress;
+   uint64_t num_no_progress;
+   int64_t time;
+   int64_t wasted_time;
+   int64_t instr_delta;
+};
+
+static simple_mtx_t stats_mutex = _SIMPLE_MTX_INITIALIZER_NP;
+static struct hash_table *stats_table;
+static bool reported;
+static const char *json_filename;
+
+bool
+nir_pass_stats_enabled(void)
+{
+   static int enabled = -1;
+   if (enabled < 0) {
+      json_filename = getenv("NIR_PASS_STATS_JSON");
+      enabled = json_filename || env_var_as_boolean("NIR_PASS_STATS", false);
+   }
+
+   return enabled;
+}
+
+static unsigned
+count_instrs(nir_shader *shader)
+{
+   unsigned count = 0;
+
+   nir_foreach_function(function, shader) {
+      if (!function->impl)
+         continue;
+
+      nir_foreach_block(block, function->impl) {
+         nir_foreach_instr(instr, block)
+            count++;
+      }
+   }
+
+   return count;
+}
+
+static int
+compare_time(const void *a, const void *b)
+{
+   const struct pass_stats *sa = *(const struct pass_stats **)a;
+   const struct pass_stats *sb = *(const struct pass_stats **)b;
+
+   if (sa->time != sb->time)
+      return sa->time < sb->time ? 1 : -1;
+   return strcmp(sa->name, sb->name);
+}
+
+static void
+print_table(FILE *fp, struct pass_stats **stats, unsigned num_stats)
+{
+   struct pass_stats total = { .name = "total" };
+
+   fprintf(fp, "%-40s %10s %10s %12s %12s %10s\n", "pass", "calls",
+           "progress", "time (ms)", "wasted (ms)", "instrs");
+
+   for (unsigned i = 0; i <= num_stats; i++) {
+      const struct pass_stats *s = i < num_stats ? stats[i] : &total;
+      char progress[24] = "-";
+
+      if (s->num_progress || s->num_no_progress)
+         snprintf(progress, sizeof(progress), "%" PRIu64, s->num_progress);
+
+      fprintf(fp, "%-40s %10" PRIu64 " %10s %12.3f %12.3f %+10" PRId64 "\n",
+              s->name, s->num_calls, progress, s->time / 1e6,
+              s->wasted_time / 1e6, s->instr_delta);
+
+      total.num_calls += s->num_calls;
+      total.num_progress += s->num_progress;
+      total.num_no_progress += s->num_no_progress;
+      total.time += s->time;
+      total.wasted_time += s->wasted_time;
+      total.instr_delta += s->instr_delta;
+   }
+}
+
+static void
+print_json(FILE *fp, struct pass_stats **stats, unsigned num_stats)
+{
+   fprintf(fp, "[\n");
+   for (unsigned i = 0; i < num_stats; i++) {
+      const struct pass_stats *s = stats[i];
+      char progress[24] = "null";
+
+      if (s->num_progress || s->num_no_progress)
+         snprintf(progress, sizeof(progress), "%" PRIu64, s->num_progress);
+
+      fprintf(fp, "  {\"pass\": \"%s\", \"calls\": %" PRIu64 ", "
+              "\"progress\": %s, \"time_ns\": %" PRId64 ", "
+              "\"wasted_ns\": %" PRId64 ", \"instr_delta\": %" PRId64 "}%s\n",
+              s->name, s->num_calls, progress, s->time,
+              s->wasted_time, s->instr_delta, i + 1 < num_stats ? "," : "");
+   }
+   fprintf(fp, "]\n");
+}
+
+static void
+report_pass_stats(void)
+{
+   simple_mtx_lock(&stats_mutex);
+
+   unsigned num_stats = stats_table->entries;
+   struct pass_stats **stats = malloc(num_stats * sizeof(*stats));
+   unsigned i = 0;
+
+   hash_table_foreach(stats_table, entry)
+      stats[i++] = entry->data;
+   qsort(stats, num_stats, sizeof(*stats), compare_time);
+
+   if (json_filename) {
+      FILE *fp = fopen(json_filename, "w");
+      if (fp) {
+         print_json(fp, stats, num_stats);
+         fclose(fp);
+      } else {
+         fprintf(stderr, "NIR_PASS_STATS_JSON: couldn't open %s\n",
+                 json_filename);
+      }
+   } else {
+      print_table(stderr, stats, num_stats);
+   }
+
+   free(stats);
+   ralloc_free(stats_table);
+   stats_table = NULL;
+   reported = true;
+
+   simple_mtx_unlock(&stats_mutex);
+}
+
+void
+nir_pass_stats_begin(nir_shader *shader, nir_pass_stats_start *start)
+{
+   start->num_instrs = count_instrs(shader);
+   start->time = os_time_get_nano();
+}
+
+/**
+ * Adds an invocation of the given pass to the statistics.  progress is -1
+ * for NIR_PASS_V, whose passes don't report progress.
+ */
+void
+nir_pass_stats_end(nir_shader *shader, const char *pass, int progress,
+                   const nir_pass_stats_start *start)
+{
+   int64_t time = os_time_get_nano() - start->time;
+   int64_t instr_delta = (int64_t)count_instrs(shader) - start->num_instrs;
+
+   simple_mtx_lock(&stats_mutex);
+
+   /* Passes run by other atexit handlers aren't reported. */
+   if (reported) {
+      simple_mtx_unlock(&stats_mutex);
+      return;
+   }
+
+   if (!stats_table) {
+      stats_table = _mesa_hash_table_create(NULL, _mesa_hash_string,
+                                            _mesa_key_string_equal);
+      atexit(report_pass_stats);
+   }
+
+   struct hash_entry *entry = _mesa_hash_table_search(stats_table, pass);
+   struct pass_stats *stats;
+   if (entry) {
+      stats = entry->data;
+   } else {
+      stats = rzalloc(stats_table, struct pass_stats);
+      stats->name = ralloc_strdup(stats, pass);
+      _mesa_hash_table_insert(stats_table, stats->name, stats);
+   }
+
+   stats->num_calls++;
+   stats->time += time;
+   stats->instr_delta += instr_delta;
+   if (progress > 0) {
+      stats->num_progress++;
+   } else if (progress == 0) {
+      stats->num_no_progress++;
+      stats->wasted_time += time;
+   }
+
+   simple_mtx_unlock(&stats_mutex);
+}
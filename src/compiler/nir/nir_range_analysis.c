@@ -25,6 +25,7 @@
 #include "nir.h"
 #include "nir_range_analysis.h"
 #include "util/hash_table.h"
+#include "util/u_dynarray.h"
 
 /**
  * Analyzes a sequence of operations to determine some aspects of the range of
@@ -37,43 +38,231 @@ is_not_negative(enum ssa_ranges r)
    return r == gt_zero || r == ge_zero || r == eq_zero;
 }
 
-static void *
-pack_data(const struct ssa_result_range r)
+/* Everything nir_analyze_range() found out about an SSA value. */
+struct range_cache_entry {
+   /* Signature of the instruction the ranges were found for */
+   uint64_t signature;
+
+   /* Indexed by range_type_index(), packed by pack_range().  0 if the range
+    * for that type wasn't needed yet.
+    */
+   uint8_t ranges[4];
+
+   /* Whether the signature of the value or of something it's computed from
+    * was different in the last nir_range_cache_check_def().
+    */
+   bool changed;
+};
+
+struct nir_range_cache {
+   /* Indexed by SSA index */
+   unsigned num_defs;
+   struct range_cache_entry *entries;
+
+   /* Scratch space for nir_range_cache_invalidate_users() */
+   struct util_dynarray queue;
+};
+
+static uint8_t
+pack_range(const struct ssa_result_range r)
 {
-   return (void *)(uintptr_t)(r.range | r.is_integral << 8);
+   STATIC_ASSERT(last_range < 8);
+   return 0x80 | r.is_integral << 3 | r.range;
 }
 
 static struct ssa_result_range
-unpack_data(const void *p)
+unpack_range(uint8_t v)
 {
-   const uintptr_t v = (uintptr_t) p;
-
-   return (struct ssa_result_range){v & 0xff, (v & 0x0ff00) != 0};
+   return (struct ssa_result_range){v & 0x7, (v & 0x8) != 0};
 }
 
-static void *
-pack_key(const struct nir_alu_instr *instr, nir_alu_type type)
+static unsigned
+range_type_index(nir_alu_type type)
 {
-   uintptr_t type_encoding;
-   uintptr_t ptr = (uintptr_t) instr;
-
-   /* The low 2 bits have to be zero or this whole scheme falls apart. */
-   assert((ptr & 0x3) == 0);
-
    /* NIR is typeless in the sense that sequences of bits have whatever
     * meaning is attached to them by the instruction that consumes them.
     * However, the number of bits must match between producer and consumer.
     * As a result, the number of bits does not need to be encoded here.
     */
    switch (nir_alu_type_get_base_type(type)) {
-   case nir_type_int:   type_encoding = 0; break;
-   case nir_type_uint:  type_encoding = 1; break;
-   case nir_type_bool:  type_encoding = 2; break;
-   case nir_type_float: type_encoding = 3; break;
+   case nir_type_int:   return 0;
+   case nir_type_uint:  return 1;
+   case nir_type_bool:  return 2;
+   case nir_type_float: return 3;
    default: unreachable("Invalid base type.");
    }
+}
+
+static bool
+range_cache_resize(struct nir_range_cache *cache, unsigned num_defs)
+{
+   if (num_defs > cache->num_defs) {
+      struct range_cache_entry *entries =
+         reralloc(cache, cache->entries, struct range_cache_entry, num_defs);
+      if (!entries)
+         return false;
+
+      cache->entries = entries;
+   }
+
+   /* Entries past the end don't belong to any value.  A value that gets
+    * their index later mustn't see them.
+    */
+   if (num_defs != cache->num_defs) {
+      unsigned first = MIN2(num_defs, cache->num_defs);
+      unsigned last = MAX2(num_defs, cache->num_defs);
+      memset(cache->entries + first, 0,
+             (last - first) * sizeof(*cache->entries));
+      cache->num_defs = num_defs;
+   }
 
-   return (void *)(ptr | type_encoding);
+   return true;
+}
+
+static bool
+range_cache_lookup(struct nir_range_cache *cache, const nir_alu_instr *alu,
+                   nir_alu_type type, struct ssa_result_range *r)
+{
+   const unsigned index = alu->dest.dest.ssa.index;
+   if (!cache || index >= cache->num_defs)
+      return false;
+
+   const uint8_t v = cache->entries[index].ranges[range_type_index(type)];
+   if (v == 0)
+      return false;
+
+   *r = unpack_range(v);
+   return true;
+}
+
+static void
+range_cache_store(struct nir_range_cache *cache, const nir_alu_instr *alu,
+                  nir_alu_type type, struct ssa_result_range r)
+{
+   const unsigned index = alu->dest.dest.ssa.index;
+   if (!cache)
+      return;
+
+   /* Values added since nir_range_cache_get() */
+   if (index >= cache->num_defs &&
+       !range_cache_resize(cache, MAX2(index + 1, cache->num_defs * 2)))
+      return;
+
+   cache->entries[index].ranges[range_type_index(type)] = pack_range(r);
+}
+
+/* Returns whether there was anything to forget. */
+static bool
+range_cache_clear(struct nir_range_cache *cache, const nir_ssa_def *def)
+{
+   if (def->index >= cache->num_defs)
+      return false;
+
+   struct range_cache_entry *entry = &cache->entries[def->index];
+   uint32_t ranges;
+
+   STATIC_ASSERT(sizeof(ranges) == sizeof(entry->ranges));
+   memcpy(&ranges, entry->ranges, sizeof(ranges));
+   memset(entry->ranges, 0, sizeof(entry->ranges));
+
+   return ranges != 0;
+}
+
+struct nir_range_cache *
+nir_range_cache_get(nir_function_impl *impl)
+{
+   struct nir_range_cache *cache = impl->range_cache;
+
+   if (!cache) {
+      cache = rzalloc(impl, struct nir_range_cache);
+      if (!cache)
+         return NULL;
+
+      util_dynarray_init(&cache->queue, cache);
+      impl->range_cache = cache;
+   }
+
+   if (!range_cache_resize(cache, impl->ssa_alloc)) {
+      nir_range_cache_reset(impl);
+      return NULL;
+   }
+
+   return cache;
+}
+
+void
+nir_range_cache_check_def(struct nir_range_cache *cache, nir_ssa_def *def,
+                          uint64_t signature)
+{
+   if (!cache)
+      return;
+
+   assert(def->index < cache->num_defs);
+   struct range_cache_entry *entry = &cache->entries[def->index];
+   bool changed = entry->signature != signature;
+
+   /* Only ALU instructions are looked through.  Their sources come first,
+    * so they have been checked already.
+    */
+   if (!changed && def->parent_instr->type == nir_instr_type_alu) {
+      nir_alu_instr *alu = nir_instr_as_alu(def->parent_instr);
+
+      for (unsigned i = 0; i < nir_op_infos[alu->op].num_inputs; i++) {
+         const nir_src *src = &alu->src[i].src;
+
+         if (src->is_ssa && cache->entries[src->ssa->index].changed) {
+            changed = true;
+            break;
+         }
+      }
+   }
+
+   if (changed) {
+      entry->signature = signature;
+      memset(entry->ranges, 0, sizeof(entry->ranges));
+   }
+   entry->changed = changed;
+}
+
+void
+nir_range_cache_invalidate_users(struct nir_range_cache *cache,
+                                 nir_ssa_def *def)
+{
+   if (!cache)
+      return;
+
+   util_dynarray_append(&cache->queue, nir_ssa_def *, def);
+
+   while (util_dynarray_num_elements(&cache->queue, nir_ssa_def *) > 0) {
+      def = util_dynarray_pop(&cache->queue, nir_ssa_def *);
+
+      nir_foreach_use(use, def) {
+         if (use->parent_instr->type != nir_instr_type_alu)
+            continue;
+
+         nir_alu_instr *user = nir_instr_as_alu(use->parent_instr);
+         if (!user->dest.dest.is_ssa)
+            continue;
+
+         /* Finding the range of a value finds the ranges of the values it
+          * depends on first, so nothing depends on a value without a range
+          * through it.  Except that nir_alu_srcs_negative_equal() looks
+          * through negations without analyzing them.
+          */
+         if (range_cache_clear(cache, &user->dest.dest.ssa) ||
+             user->op == nir_op_fneg || user->op == nir_op_ineg) {
+            util_dynarray_append(&cache->queue, nir_ssa_def *,
+                                 &user->dest.dest.ssa);
+         }
+      }
+   }
+}
+
+void
+nir_range_cache_reset(nir_function_impl *impl)
+{
+   ralloc_free(impl->range_cache);
+   impl->range_cache = NULL;
 }
 
 static nir_alu_type
@@ -403,7 +592,7 @@ union_ranges(enum ssa_ranges a, enum ssa_ranges b)
  */
 static struct ssa_result_range
 analyze_expression(const nir_alu_instr *instr, unsigned src,
-                   struct hash_table *ht, nir_alu_type use_type)
+                   struct nir_range_cache *cache, nir_alu_type use_type)
 {
    /* Ensure that the _Pragma("GCC unroll 7") above are correct. */
    STATIC_ASSERT(last_range + 1 == 7);
@@ -438,12 +627,11 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
       }
    }
 
-   struct hash_entry *he = _mesa_hash_table_search(ht, pack_key(alu, use_type));
-   if (he != NULL)
-      return unpack_data(he->data);
-
    struct ssa_result_range r = {unknown, false};
 
+   if (range_cache_lookup(cache, alu, use_type, &r))
+      return r;
+
    /* ge_zero: ge_zero + ge_zero
     *
     * gt_zero: gt_zero + eq_zero
@@ -550,9 +738,9 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
 
    case nir_op_bcsel: {
       const struct ssa_result_range left =
-         analyze_expression(alu, 1, ht, use_type);
+         analyze_expression(alu, 1, cache, use_type);
       const struct ssa_result_range right =
-         analyze_expression(alu, 2, ht, use_type);
+         analyze_expression(alu, 2, cache, use_type);
 
       r.is_integral = left.is_integral && right.is_integral;
 
@@ -617,7 +805,7 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
 
    case nir_op_i2f32:
    case nir_op_u2f32:
-      r = analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0));
+      r = analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0));
 
       r.is_integral = true;
 
@@ -627,7 +815,7 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
       break;
 
    case nir_op_fabs:
-      r = analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0));
+      r = analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0));
 
       switch (r.range) {
       case unknown:
@@ -650,9 +838,9 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
 
    case nir_op_fadd: {
       const struct ssa_result_range left =
-         analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0));
+         analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0));
       const struct ssa_result_range right =
-         analyze_expression(alu, 1, ht, nir_alu_src_type(alu, 1));
+         analyze_expression(alu, 1, cache, nir_alu_src_type(alu, 1));
 
       r.is_integral = left.is_integral && right.is_integral;
       r.range = fadd_table[left.range][right.range];
@@ -669,7 +857,7 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
          ge_zero, ge_zero, ge_zero, gt_zero, gt_zero, ge_zero, gt_zero
       };
 
-      r = analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0));
+      r = analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0));
 
       ASSERT_UNION_OF_DISJOINT_MATCHES_UNKNOWN_1_SOURCE(table);
       ASSERT_UNION_OF_EQ_AND_STRICT_INEQ_MATCHES_NONSTRICT_1_SOURCE(table);
@@ -681,9 +869,9 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
 
    case nir_op_fmax: {
       const struct ssa_result_range left =
-         analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0));
+         analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0));
       const struct ssa_result_range right =
-         analyze_expression(alu, 1, ht, nir_alu_src_type(alu, 1));
+         analyze_expression(alu, 1, cache, nir_alu_src_type(alu, 1));
 
       r.is_integral = left.is_integral && right.is_integral;
 
@@ -746,9 +934,9 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
 
    case nir_op_fmin: {
       const struct ssa_result_range left =
-         analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0));
+         analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0));
       const struct ssa_result_range right =
-         analyze_expression(alu, 1, ht, nir_alu_src_type(alu, 1));
+         analyze_expression(alu, 1, cache, nir_alu_src_type(alu, 1));
 
       r.is_integral = left.is_integral && right.is_integral;
 
@@ -811,9 +999,9 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
 
    case nir_op_fmul: {
       const struct ssa_result_range left =
-         analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0));
+         analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0));
       const struct ssa_result_range right =
-         analyze_expression(alu, 1, ht, nir_alu_src_type(alu, 1));
+         analyze_expression(alu, 1, cache, nir_alu_src_type(alu, 1));
 
       r.is_integral = left.is_integral && right.is_integral;
 
@@ -834,23 +1022,23 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
 
    case nir_op_frcp:
       r = (struct ssa_result_range){
-         analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0)).range,
+         analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0)).range,
          false
       };
       break;
 
    case nir_op_mov:
-      r = analyze_expression(alu, 0, ht, use_type);
+      r = analyze_expression(alu, 0, cache, use_type);
       break;
 
    case nir_op_fneg:
-      r = analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0));
+      r = analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0));
 
       r.range = fneg_table[r.range];
       break;
 
    case nir_op_fsat:
-      r = analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0));
+      r = analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0));
 
       switch (r.range) {
       case le_zero:
@@ -876,7 +1064,7 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
 
    case nir_op_fsign:
       r = (struct ssa_result_range){
-         analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0)).range,
+         analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0)).range,
          true
       };
       break;
@@ -888,7 +1076,7 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
 
    case nir_op_ffloor: {
       const struct ssa_result_range left =
-         analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0));
+         analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0));
 
       r.is_integral = true;
 
@@ -904,7 +1092,7 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
 
    case nir_op_fceil: {
       const struct ssa_result_range left =
-         analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0));
+         analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0));
 
       r.is_integral = true;
 
@@ -920,7 +1108,7 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
 
    case nir_op_ftrunc: {
       const struct ssa_result_range left =
-         analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0));
+         analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0));
 
       r.is_integral = true;
 
@@ -1002,9 +1190,9 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
       };
 
       const struct ssa_result_range left =
-         analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0));
+         analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0));
       const struct ssa_result_range right =
-         analyze_expression(alu, 1, ht, nir_alu_src_type(alu, 1));
+         analyze_expression(alu, 1, cache, nir_alu_src_type(alu, 1));
 
       ASSERT_UNION_OF_DISJOINT_MATCHES_UNKNOWN_2_SOURCE(table);
       ASSERT_UNION_OF_EQ_AND_STRICT_INEQ_MATCHES_NONSTRICT_2_SOURCE(table);
@@ -1017,11 +1205,11 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
 
    case nir_op_ffma: {
       const struct ssa_result_range first =
-         analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0));
+         analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0));
       const struct ssa_result_range second =
-         analyze_expression(alu, 1, ht, nir_alu_src_type(alu, 1));
+         analyze_expression(alu, 1, cache, nir_alu_src_type(alu, 1));
       const struct ssa_result_range third =
-         analyze_expression(alu, 2, ht, nir_alu_src_type(alu, 2));
+         analyze_expression(alu, 2, cache, nir_alu_src_type(alu, 2));
 
       r.is_integral = first.is_integral && second.is_integral &&
                       third.is_integral;
@@ -1045,11 +1233,11 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
 
    case nir_op_flrp: {
       const struct ssa_result_range first =
-         analyze_expression(alu, 0, ht, nir_alu_src_type(alu, 0));
+         analyze_expression(alu, 0, cache, nir_alu_src_type(alu, 0));
       const struct ssa_result_range second =
-         analyze_expression(alu, 1, ht, nir_alu_src_type(alu, 1));
+         analyze_expression(alu, 1, cache, nir_alu_src_type(alu, 1));
       const struct ssa_result_range third =
-         analyze_expression(alu, 2, ht, nir_alu_src_type(alu, 2));
+         analyze_expression(alu, 2, cache, nir_alu_src_type(alu, 2));
 
       r.is_integral = first.is_integral && second.is_integral &&
                       third.is_integral;
@@ -1073,17 +1261,17 @@ analyze_expression(const nir_alu_instr *instr, unsigned src,
    if (r.range == eq_zero)
       r.is_integral = true;
 
-   _mesa_hash_table_insert(ht, pack_key(alu, use_type), pack_data(r));
+   range_cache_store(cache, alu, use_type, r);
    return r;
 }
 
 #undef _______
 
 struct ssa_result_range
-nir_analyze_range(struct hash_table *range_ht,
+nir_analyze_range(struct nir_range_cache *cache,
                   const nir_alu_instr *instr, unsigned src)
 {
-   return analyze_expression(instr, src, range_ht,
+   return analyze_expression(instr, src, cache,
                              nir_alu_src_type(instr, src));
 }
 
@@ -23,6 +23,10 @@
 #ifndef _NIR_RANGE_ANALYSIS_H_
 #define _NIR_RANGE_ANALYSIS_H_
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 enum PACKED ssa_ranges {
    unknown = 0,
    lt_zero,
@@ -42,7 +46,40 @@ struct ssa_result_range {
 };
 
 extern struct ssa_result_range
-nir_analyze_range(struct hash_table *range_ht,
+nir_analyze_range(struct nir_range_cache *cache,
                   const nir_alu_instr *instr, unsigned src);
 
+/* The ranges nir_analyze_range() finds are kept with the impl, so that
+ * they're still known in later passes.  They depend on the instructions a
+ * value is computed from, which other passes may have changed since.
+ *
+ * Before any query, nir_range_cache_check_def() has to be called for every
+ * SSA value, in order, with a signature of its instruction.  The signature
+ * has to change whenever anything about the instruction itself does, and
+ * that forgets the ranges of everything computed from it.  A pass that
+ * replaces a value has to call nir_range_cache_invalidate_users() on the
+ * replacement after rewriting the uses.
+ *
+ * nir_range_cache_get() returns NULL if it runs out of memory.  The ranges
+ * are just not remembered then.
+ */
+struct nir_range_cache *
+nir_range_cache_get(nir_function_impl *impl);
+
+void
+nir_range_cache_check_def(struct nir_range_cache *cache, nir_ssa_def *def,
+                          uint64_t signature);
+
+void
+nir_range_cache_invalidate_users(struct nir_range_cache *cache,
+                                 nir_ssa_def *def);
+
+/* Forgets all the ranges of impl. */
+void
+nir_range_cache_reset(nir_function_impl *impl);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
 #endif /* _NIR_RANGE_ANALYSIS_H_ */
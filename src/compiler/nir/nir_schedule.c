@@ -36,7 +36,8 @@
  * chains for SSA instructions, plus some edges for ordering register writes
  * vs reads, and some more for ordering intrinsics).  Then we pick heads off
  * of the DDG using their heuristic to emit the NIR instructions back into the
- * block in their new order.
+ * block in their new order.  Phis are left at the top of their block, so this
+ * can run on SSA as well as after going out of SSA.
  *
  * The hard case for prepass scheduling on GPUs seems to always be consuming
  * texture/ubo results.  The register pressure heuristic doesn't want to pick
@@ -171,27 +172,48 @@ nir_schedule_scoreboard_get_src(nir_schedule_scoreboard *scoreboard, nir_src *sr
 }
 
 static int
-nir_schedule_def_pressure(nir_ssa_def *def)
+nir_schedule_value_pressure(nir_schedule_scoreboard *scoreboard,
+                            unsigned num_components, unsigned bit_size)
 {
-   return def->num_components;
+   const nir_schedule_options *options = scoreboard->options;
+
+   if (options->pressure_cb) {
+      return options->pressure_cb(num_components, bit_size,
+                                  options->pressure_cb_data);
+   }
+
+   return num_components;
+}
+
+static int
+nir_schedule_def_pressure(nir_schedule_scoreboard *scoreboard,
+                          nir_ssa_def *def)
+{
+   return nir_schedule_value_pressure(scoreboard, def->num_components,
+                                      def->bit_size);
 }
 
 static int
-nir_schedule_src_pressure(nir_src *src)
+nir_schedule_src_pressure(nir_schedule_scoreboard *scoreboard, nir_src *src)
 {
    if (src->is_ssa)
-      return nir_schedule_def_pressure(src->ssa);
+      return nir_schedule_def_pressure(scoreboard, src->ssa);
    else
-      return src->reg.reg->num_components;
+      return nir_schedule_value_pressure(scoreboard,
+                                         src->reg.reg->num_components,
+                                         src->reg.reg->bit_size);
 }
 
 static int
-nir_schedule_dest_pressure(nir_dest *dest)
+nir_schedule_dest_pressure(nir_schedule_scoreboard *scoreboard,
+                           nir_dest *dest)
 {
    if (dest->is_ssa)
-      return nir_schedule_def_pressure(&dest->ssa);
+      return nir_schedule_def_pressure(scoreboard, &dest->ssa);
    else
-      return dest->reg.reg->num_components;
+      return nir_schedule_value_pressure(scoreboard,
+                                         dest->reg.reg->num_components,
+                                         dest->reg.reg->bit_size);
 }
 
 /**
@@ -476,7 +498,7 @@ nir_schedule_calculate_deps(nir_deps_state *state, nir_schedule_node *n)
       break;
 
    case nir_instr_type_phi:
-      unreachable("nir_schedule() should be called after lowering from SSA");
+      unreachable("Phis stay at the top of the block and aren't scheduled");
       break;
 
    case nir_instr_type_intrinsic:
@@ -495,6 +517,9 @@ calculate_forward_deps(nir_schedule_scoreboard *scoreboard, nir_block *block)
    };
 
    nir_foreach_instr(instr, block) {
+      if (instr->type == nir_instr_type_phi)
+         continue;
+
       nir_schedule_node *node = nir_schedule_get_node(scoreboard->instr_map,
                                                       instr);
       nir_schedule_calculate_deps(&state, node);
@@ -513,6 +538,9 @@ calculate_reverse_deps(nir_schedule_scoreboard *scoreboard, nir_block *block)
    };
 
    nir_foreach_instr_reverse(instr, block) {
+      if (instr->type == nir_instr_type_phi)
+         break;
+
       nir_schedule_node *node = nir_schedule_get_node(scoreboard->instr_map,
                                                       instr);
       nir_schedule_calculate_deps(&state, node);
@@ -535,7 +563,7 @@ nir_schedule_regs_freed_src_cb(nir_src *src, void *in_state)
 
    if (remaining_uses->entries == 1 &&
        _mesa_set_search(remaining_uses, src->parent_instr)) {
-      state->regs_freed += nir_schedule_src_pressure(src);
+      state->regs_freed += nir_schedule_src_pressure(scoreboard, src);
    }
 
    return true;
@@ -546,7 +574,7 @@ nir_schedule_regs_freed_def_cb(nir_ssa_def *def, void *in_state)
 {
    nir_schedule_regs_freed_state *state = in_state;
 
-   state->regs_freed -= nir_schedule_def_pressure(def);
+   state->regs_freed -= nir_schedule_def_pressure(state->scoreboard, def);
 
    return true;
 }
@@ -564,7 +592,7 @@ nir_schedule_regs_freed_dest_cb(nir_dest *dest, void *in_state)
 
    /* Only the first def of a reg counts against register pressure. */
    if (!_mesa_set_search(scoreboard->live_values, reg))
-      state->regs_freed -= nir_schedule_dest_pressure(dest);
+      state->regs_freed -= nir_schedule_dest_pressure(scoreboard, dest);
 
    return true;
 }
@@ -882,7 +910,7 @@ nir_schedule_mark_src_scheduled(nir_src *src, void *state)
    nir_schedule_mark_use(scoreboard,
                          src->is_ssa ? (void *)src->ssa : (void *)src->reg.reg,
                          src->parent_instr,
-                         nir_schedule_src_pressure(src));
+                         nir_schedule_src_pressure(scoreboard, src));
 
    return true;
 }
@@ -893,7 +921,7 @@ nir_schedule_mark_def_scheduled(nir_ssa_def *def, void *state)
    nir_schedule_scoreboard *scoreboard = state;
 
    nir_schedule_mark_use(scoreboard, def, def->parent_instr,
-                         nir_schedule_def_pressure(def));
+                         nir_schedule_def_pressure(scoreboard, def));
 
    return true;
 }
@@ -915,7 +943,7 @@ nir_schedule_mark_dest_scheduled(nir_dest *dest, void *state)
     */
    nir_schedule_mark_use(scoreboard, dest->reg.reg,
                          dest->reg.parent_instr,
-                         nir_schedule_dest_pressure(dest));
+                         nir_schedule_dest_pressure(scoreboard, dest));
 
    return true;
 }
@@ -982,29 +1010,89 @@ nir_schedule_instructions(nir_schedule_scoreboard *scoreboard, nir_block *block)
    }
 }
 
+/* Used when the backend doesn't provide a latency table.  Only textures get
+ * a large number, to try to fetch textures early and sample them late.
+ */
+static const nir_schedule_latencies nir_schedule_default_latencies = {
+   .alu = 1,
+   .alu_complex = 1,
+   .tex = 100,
+   .load = 1,
+   .intrinsic = 1,
+};
+
+static bool
+nir_schedule_alu_is_complex(nir_alu_instr *alu)
+{
+   switch (alu->op) {
+   case nir_op_frcp:
+   case nir_op_frsq:
+   case nir_op_fsqrt:
+   case nir_op_fexp2:
+   case nir_op_flog2:
+   case nir_op_fsin:
+   case nir_op_fcos:
+   case nir_op_fpow:
+   case nir_op_fdiv:
+   case nir_op_idiv:
+   case nir_op_udiv:
+   case nir_op_imod:
+   case nir_op_umod:
+   case nir_op_irem:
+      return true;
+   default:
+      return false;
+   }
+}
+
+static bool
+nir_schedule_intrinsic_is_load(nir_intrinsic_instr *intr)
+{
+   switch (intr->intrinsic) {
+   case nir_intrinsic_load_ubo:
+   case nir_intrinsic_load_ssbo:
+   case nir_intrinsic_load_global:
+   case nir_intrinsic_load_shared:
+   case nir_intrinsic_load_scratch:
+   case nir_intrinsic_load_constant:
+   case nir_intrinsic_image_deref_load:
+   case nir_intrinsic_image_load:
+   case nir_intrinsic_bindless_image_load:
+      return true;
+   default:
+      return false;
+   }
+}
+
 static uint32_t
-nir_schedule_get_delay(nir_instr *instr)
+nir_schedule_get_delay(nir_schedule_scoreboard *scoreboard, nir_instr *instr)
 {
+   const nir_schedule_latencies *latencies = scoreboard->options->latencies;
+   if (!latencies)
+      latencies = &nir_schedule_default_latencies;
+
    switch (instr->type) {
+   case nir_instr_type_alu:
+      if (nir_schedule_alu_is_complex(nir_instr_as_alu(instr)))
+         return latencies->alu_complex;
+      return latencies->alu;
+
    case nir_instr_type_ssa_undef:
    case nir_instr_type_load_const:
-   case nir_instr_type_alu:
    case nir_instr_type_deref:
    case nir_instr_type_jump:
    case nir_instr_type_parallel_copy:
    case nir_instr_type_call:
    case nir_instr_type_phi:
-      return 1;
+      return latencies->alu;
 
    case nir_instr_type_intrinsic:
-      /* XXX: Pick a large number for UBO/SSBO/image/shared loads */
-      return 1;
+      if (nir_schedule_intrinsic_is_load(nir_instr_as_intrinsic(instr)))
+         return latencies->load;
+      return latencies->intrinsic;
 
    case nir_instr_type_tex:
-      /* Pick some large number to try to fetch textures early and sample them
-       * late.
-       */
-      return 100;
+      return latencies->tex;
    }
 
    return 0;
@@ -1033,11 +1121,20 @@ nir_schedule_block(nir_schedule_scoreboard *scoreboard, nir_block *block)
    scoreboard->dag = dag_create(mem_ctx);
 
    nir_foreach_instr(instr, block) {
+      /* Phis stay where they are.  Their values are live from the start of
+       * the block.
+       */
+      if (instr->type == nir_instr_type_phi) {
+         nir_foreach_ssa_def(instr, nir_schedule_mark_def_scheduled,
+                             scoreboard);
+         continue;
+      }
+
       nir_schedule_node *n =
          rzalloc(mem_ctx, nir_schedule_node);
 
       n->instr = instr;
-      n->delay = nir_schedule_get_delay(instr);
+      n->delay = nir_schedule_get_delay(scoreboard, instr);
       dag_init_node(scoreboard->dag, &n->dag);
 
       _mesa_hash_table_insert(scoreboard->instr_map, instr, n);
@@ -1054,6 +1151,48 @@ nir_schedule_block(nir_schedule_scoreboard *scoreboard, nir_block *block)
    scoreboard->instr_map = NULL;
 }
 
+/* The values read by the phis of the successors of \p block are used at the
+ * end of it.  A value that reaches a phi from more than one predecessor
+ * stays live until the last of them, in block order.
+ */
+static void
+nir_schedule_mark_phi_uses(nir_schedule_scoreboard *scoreboard,
+                           nir_block *block)
+{
+   for (unsigned i = 0; i < ARRAY_SIZE(block->successors); i++) {
+      nir_block *succ = block->successors[i];
+      if (!succ)
+         continue;
+
+      nir_foreach_instr(instr, succ) {
+         if (instr->type != nir_instr_type_phi)
+            break;
+
+         nir_phi_instr *phi = nir_instr_as_phi(instr);
+         nir_foreach_phi_src(src, phi) {
+            if (src->pred != block)
+               continue;
+
+            bool used_later = false;
+            nir_foreach_phi_src(other, phi) {
+               if (nir_srcs_equal(other->src, src->src) &&
+                   other->pred->index > block->index)
+                  used_later = true;
+            }
+            if (used_later)
+               continue;
+
+            nir_schedule_mark_use(scoreboard,
+                                  src->src.is_ssa ? (void *)src->src.ssa :
+                                                    (void *)src->src.reg.reg,
+                                  instr,
+                                  nir_schedule_src_pressure(scoreboard,
+                                                            &src->src));
+         }
+      }
+   }
+}
+
 static bool
 nir_schedule_ssa_def_init_scoreboard(nir_ssa_def *def, void *state)
 {
@@ -1064,6 +1203,9 @@ nir_schedule_ssa_def_init_scoreboard(nir_ssa_def *def, void *state)
 
    _mesa_set_add(def_uses, def->parent_instr);
 
+   /* Phi uses are marked at the end of their predecessor, see
+    * nir_schedule_mark_phi_uses().
+    */
    nir_foreach_use(src, def) {
       _mesa_set_add(def_uses, src->parent_instr);
    }
@@ -1151,8 +1293,9 @@ nir_schedule_validate_uses(nir_schedule_scoreboard *scoreboard)
  *
  * The threshold represents "number of NIR register/SSA def channels live
  * before switching the scheduling heuristic to reduce register pressure",
- * since most of our GPU architectures are scalar (extending to vector with a
- * flag wouldn't be hard).  This number should be a bit below the number of
+ * since most of our GPU architectures are scalar.  Backends with vector,
+ * half-precision or wide registers can count differently with the
+ * pressure_cb option.  This number should be a bit below the number of
  * registers available (counting any that may be occupied by system value
  * payload values, for example), since the heuristic may not always be able to
  * free a register immediately.  The amount below the limit is up to you to
@@ -1162,6 +1305,9 @@ void
 nir_schedule(nir_shader *shader,
              const nir_schedule_options *options)
 {
+   if (options->stages && !(options->stages & (1 << shader->info.stage)))
+      return;
+
    nir_schedule_scoreboard *scoreboard = nir_schedule_get_scoreboard(shader,
                                                                      options);
 
@@ -1174,8 +1320,12 @@ nir_schedule(nir_shader *shader,
       if (!function->impl)
          continue;
 
+      /* Block indices order the predecessors of phis. */
+      nir_metadata_require(function->impl, nir_metadata_block_index);
+
       nir_foreach_block(block, function->impl) {
          nir_schedule_block(scoreboard, block);
+         nir_schedule_mark_phi_uses(scoreboard, block);
       }
    }
 
@@ -47,6 +47,27 @@ typedef struct nir_schedule_dependency {
    } type;
 } nir_schedule_dependency;
 
+/**
+ * Approximate delays, in abstract scheduler time units, between an
+ * instruction of each class starting and its results being available.
+ */
+typedef struct nir_schedule_latencies {
+   /* ALU instructions and anything else not listed below */
+   uint32_t alu;
+   /* ALU instructions that usually run on a slower unit, such as
+    * transcendentals and integer division
+    */
+   uint32_t alu_complex;
+   /* Texture instructions */
+   uint32_t tex;
+   /* Loads from UBOs, SSBOs, global, shared, scratch and constant memory
+    * and images
+    */
+   uint32_t load;
+   /* Other intrinsics */
+   uint32_t intrinsic;
+} nir_schedule_latencies;
+
 typedef struct nir_schedule_options {
    /* On some hardware with some stages the inputs and outputs to the shader
     * share the same memory. In that case the scheduler needs to ensure that
@@ -73,6 +94,22 @@ typedef struct nir_schedule_options {
                          void *user_data);
    /* Data to pass to the callback */
    void *intrinsic_cb_data;
+   /* Callback returning the register pressure of a value, in the same units
+    * as threshold.  If NULL, each channel counts as one, which fits scalar
+    * architectures with 32-bit registers.
+    */
+   int (* pressure_cb)(unsigned num_components, unsigned bit_size,
+                       void *user_data);
+   /* Data to pass to the callback */
+   void *pressure_cb_data;
+   /* Latencies of the target.  If NULL, only texture instructions are
+    * considered to have a large latency.
+    */
+   const nir_schedule_latencies *latencies;
+   /* Bitmask of the stages to schedule.  Shaders of other stages are left
+    * alone.  If 0, shaders of all stages are scheduled.
+    */
+   unsigned stages;
 } nir_schedule_options;
 
 void nir_schedule(nir_shader *shader, const nir_schedule_options *options);
@@ -27,8 +27,10 @@
 
 #include <inttypes.h>
 #include "nir_search.h"
+#include "nir_range_analysis.h"
 #include "nir_builder.h"
 #include "nir_worklist.h"
+#include "util/bitset.h"
 #include "util/half_float.h"
 
 /* This should be the same as nir_search_max_comm_ops in nir_algebraic.py. */
@@ -45,7 +47,7 @@ struct match_state {
    const struct per_op_table *pass_op_table;
 
    nir_alu_src variables[NIR_SEARCH_MAX_VARIABLES];
-   struct hash_table *range_ht;
+   struct nir_range_cache *range_cache;
 };
 
 static bool
@@ -313,7 +315,7 @@ match_value(const nir_search_value *value, nir_alu_instr *instr, unsigned src,
              instr->src[src].src.ssa->parent_instr->type != nir_instr_type_load_const)
             return false;
 
-         if (var->cond && !var->cond(state->range_ht, instr,
+         if (var->cond && !var->cond(state->range_cache, instr,
                                      src, num_components, new_swizzle))
             return false;
 
@@ -685,7 +687,7 @@ nir_algebraic_update_automaton(nir_instr *new_instr,
 
 nir_ssa_def *
 nir_replace_instr(nir_builder *build, nir_alu_instr *instr,
-                  struct hash_table *range_ht,
+                  struct nir_range_cache *range_cache,
                   struct util_dynarray *states,
                   const struct per_op_table *pass_op_table,
                   const nir_search_expression *search,
@@ -702,7 +704,7 @@ nir_replace_instr(nir_builder *build, nir_alu_instr *instr,
    struct match_state state;
    state.inexact_match = false;
    state.has_exact_alu = false;
-   state.range_ht = range_ht;
+   state.range_cache = range_cache;
    state.pass_op_table = pass_op_table;
 
    STATIC_ASSERT(sizeof(state.comm_op_direction) * 8 >= NIR_SEARCH_MAX_COMM_OPS);
@@ -855,15 +857,428 @@ nir_algebraic_automaton(nir_instr *instr, struct util_dynarray *states,
    }
 }
 
+/* What nir_algebraic_impl() remembers about an impl from the previous call
+ * with the same pass.
+ *
+ * Whether a transform matches an instruction depends only on the
+ * instructions in the expression tree below it (range analysis may look
+ * arbitrarily deep through ALU instructions) and, through expression
+ * conditions, on the uses of the values in the tree.  Each SSA value gets a
+ * signature of its instruction and, for ALU instructions, one of its uses.
+ * An instruction that didn't match last time doesn't match now if none of
+ * the signatures it depends on changed, so it doesn't have to be tried
+ * again.
+ *
+ * Search conditions must not look at anything else.
+ */
+struct algebraic_signature {
+   uint64_t content;
+   uint64_t uses;
+};
+
+struct algebraic_impl_state {
+   struct list_head link;
+
+   const struct per_op_table *pass_op_table;
+   bool *condition_flags;
+   unsigned num_condition_flags;
+   unsigned execution_mode;
+
+   /* Indexed by SSA index.  Only valid for indices below num_defs. */
+   unsigned num_defs;
+   struct algebraic_signature *signatures;
+
+   /* The instruction was tried without progress and nothing it depends on
+    * has changed since.
+    */
+   BITSET_WORD *clean;
+};
+
+struct algebraic_tracking {
+   bool enabled;
+   unsigned use_levels;
+
+   /* Limits how many values marking changes during the pass may visit.  Past
+    * that, every instruction is tried, like without tracking, and nothing is
+    * remembered for the next call.
+    */
+   unsigned budget;
+
+   /* Only values from before the pass are tracked, the instructions added
+    * by it are never skipped.
+    */
+   unsigned num_defs;
+   BITSET_WORD *clean;
+   BITSET_WORD *changed;
+   BITSET_WORD *visited;
+   struct util_dynarray queue;
+};
+
+static nir_ssa_def *
+dest_ssa_def(nir_dest *dest)
+{
+   return dest->is_ssa ? &dest->ssa : NULL;
+}
+
+static nir_ssa_def *
+algebraic_instr_def(nir_instr *instr)
+{
+   switch (instr->type) {
+   case nir_instr_type_alu:
+      return dest_ssa_def(&nir_instr_as_alu(instr)->dest.dest);
+   case nir_instr_type_deref:
+      return dest_ssa_def(&nir_instr_as_deref(instr)->dest);
+   case nir_instr_type_tex:
+      return dest_ssa_def(&nir_instr_as_tex(instr)->dest);
+   case nir_instr_type_phi:
+      return dest_ssa_def(&nir_instr_as_phi(instr)->dest);
+   case nir_instr_type_load_const:
+      return &nir_instr_as_load_const(instr)->def;
+   case nir_instr_type_ssa_undef:
+      return &nir_instr_as_ssa_undef(instr)->def;
+
+   case nir_instr_type_intrinsic: {
+      nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+      if (!nir_intrinsic_infos[intrin->intrinsic].has_dest)
+         return NULL;
+      return dest_ssa_def(&intrin->dest);
+   }
+
+   default:
+      return NULL;
+   }
+}
+
+static inline uint64_t
+signature_add(uint64_t sig, uint64_t value)
+{
+   return ((sig << 23 | sig >> 41) ^ value) * 0x9e3779b97f4a7c15ull;
+}
+
+static struct algebraic_signature
+instr_signature(nir_instr *instr, nir_ssa_def *def)
+{
+   struct algebraic_signature sig = { 0, 0 };
+
+   sig.content = signature_add(0, (uintptr_t)instr);
+   sig.content = signature_add(sig.content, instr->type |
+                                            def->num_components << 8 |
+                                            def->bit_size << 16);
+
+   switch (instr->type) {
+   case nir_instr_type_alu: {
+      nir_alu_instr *alu = nir_instr_as_alu(instr);
+
+      sig.content = signature_add(sig.content,
+                                  alu->op |
+                                  alu->exact << 16 |
+                                  alu->no_signed_wrap << 17 |
+                                  alu->no_unsigned_wrap << 18 |
+                                  alu->dest.saturate << 19 |
+                                  (uint64_t)alu->dest.write_mask << 20);
+
+      for (unsigned i = 0; i < nir_op_infos[alu->op].num_inputs; i++) {
+         const nir_alu_src *src = &alu->src[i];
+         uint64_t swizzle[2];
+
+         STATIC_ASSERT(sizeof(swizzle) == sizeof(src->swizzle));
+         memcpy(swizzle, src->swizzle, sizeof(swizzle));
+
+         sig.content = signature_add(sig.content, src->src.is_ssa ?
+                                     (uintptr_t)src->src.ssa :
+                                     (uintptr_t)src->src.reg.reg);
+         sig.content = signature_add(sig.content, swizzle[0]);
+         sig.content = signature_add(sig.content, swizzle[1]);
+         sig.content = signature_add(sig.content,
+                                     src->abs | src->negate << 1);
+      }
+
+      /* Expression conditions like is_used_once() look at the uses. */
+      nir_foreach_use(use, def) {
+         nir_instr *user = use->parent_instr;
+         sig.uses += signature_add((uintptr_t)user,
+                                   user->type == nir_instr_type_alu ?
+                                   nir_instr_as_alu(user)->op : ~0u);
+      }
+      nir_foreach_if_use(use, def)
+         sig.uses += signature_add((uintptr_t)use->parent_if, 0);
+      break;
+   }
+
+   case nir_instr_type_load_const: {
+      nir_load_const_instr *load_const = nir_instr_as_load_const(instr);
+
+      for (unsigned i = 0; i < def->num_components; i++)
+         sig.content = signature_add(sig.content, load_const->value[i].u64);
+      break;
+   }
+
+   case nir_instr_type_intrinsic:
+      sig.content = signature_add(sig.content,
+                                  nir_instr_as_intrinsic(instr)->intrinsic);
+      break;
+
+   default:
+      break;
+   }
+
+   return sig;
+}
+
+static struct algebraic_impl_state *
+get_algebraic_impl_state(nir_function_impl *impl,
+                         const bool *condition_flags,
+                         unsigned num_condition_flags,
+                         const struct per_op_table *pass_op_table)
+{
+   const unsigned execution_mode =
+      impl->function->shader->info.float_controls_execution_mode;
+
+   list_for_each_entry(struct algebraic_impl_state, state,
+                       &impl->algebraic_states, link) {
+      if (state->pass_op_table != pass_op_table)
+         continue;
+
+      if (state->num_condition_flags != num_condition_flags ||
+          memcmp(state->condition_flags, condition_flags,
+                 num_condition_flags * sizeof(bool)) != 0 ||
+          state->execution_mode != execution_mode) {
+         memcpy(state->condition_flags, condition_flags,
+                num_condition_flags * sizeof(bool));
+         state->execution_mode = execution_mode;
+         state->num_defs = 0;
+      }
+
+      return state;
+   }
+
+   struct algebraic_impl_state *state =
+      rzalloc(impl, struct algebraic_impl_state);
+   if (!state)
+      return NULL;
+
+   state->pass_op_table = pass_op_table;
+   state->condition_flags = ralloc_array(state, bool, num_condition_flags);
+   if (!state->condition_flags) {
+      ralloc_free(state);
+      return NULL;
+   }
+
+   memcpy(state->condition_flags, condition_flags,
+          num_condition_flags * sizeof(bool));
+   state->num_condition_flags = num_condition_flags;
+   state->execution_mode = execution_mode;
+   list_addtail(&state->link, &impl->algebraic_states);
+
+   return state;
+}
+
+void
+nir_algebraic_impl_reset(nir_function_impl *impl)
+{
+   list_for_each_entry_safe(struct algebraic_impl_state, state,
+                            &impl->algebraic_states, link)
+      ralloc_free(state);
+
+   list_inithead(&impl->algebraic_states);
+   nir_range_cache_reset(impl);
+}
+
+static bool
+tracking_init(struct algebraic_tracking *track, unsigned num_defs,
+              unsigned use_levels)
+{
+   const unsigned words = BITSET_WORDS(num_defs);
+
+   track->use_levels = use_levels;
+   track->budget = num_defs;
+   track->num_defs = num_defs;
+   track->clean = calloc(words, sizeof(BITSET_WORD));
+   track->changed = calloc(words, sizeof(BITSET_WORD));
+   track->visited = calloc(words, sizeof(BITSET_WORD));
+   util_dynarray_init(&track->queue, NULL);
+
+   track->enabled = track->clean && track->changed && track->visited;
+   return track->enabled;
+}
+
+static void
+tracking_fini(struct algebraic_tracking *track)
+{
+   util_dynarray_fini(&track->queue);
+   free(track->clean);
+   free(track->changed);
+   free(track->visited);
+}
+
+static void
+tracking_queue_def(struct algebraic_tracking *track, nir_ssa_def *def)
+{
+   if (def->index >= track->num_defs ||
+       BITSET_TEST(track->visited, def->index))
+      return;
+
+   BITSET_SET(track->visited, def->index);
+   BITSET_CLEAR(track->clean, def->index);
+   util_dynarray_append(&track->queue, nir_ssa_def *, def);
+}
+
+/* Queues the ALU users of the queued values from start on, up to levels
+ * levels up, or all of them for UINT_MAX.  Returns the end of the queue.
+ */
+static unsigned
+tracking_queue_users(struct algebraic_tracking *track, unsigned start,
+                     unsigned levels)
+{
+   unsigned end = util_dynarray_num_elements(&track->queue, nir_ssa_def *);
+
+   for (unsigned level = 0; level < levels && start < end; level++) {
+      for (unsigned i = start; i < end; i++) {
+         nir_ssa_def *def =
+            *util_dynarray_element(&track->queue, nir_ssa_def *, i);
+
+         nir_foreach_use(use, def) {
+            if (use->parent_instr->type != nir_instr_type_alu)
+               continue;
+
+            nir_alu_instr *user = nir_instr_as_alu(use->parent_instr);
+            if (user->dest.dest.is_ssa)
+               tracking_queue_def(track, &user->dest.dest.ssa);
+         }
+      }
+
+      start = end;
+      end = util_dynarray_num_elements(&track->queue, nir_ssa_def *);
+   }
+
+   return end;
+}
+
+static void
+tracking_clear_queue(struct algebraic_tracking *track)
+{
+   util_dynarray_foreach(&track->queue, nir_ssa_def *, def)
+      BITSET_CLEAR(track->visited, (*def)->index);
+   util_dynarray_clear(&track->queue);
+}
+
+/* Only the uses of ALU values are looked at by expression conditions. */
+static void
+tracking_queue_uses_changed(struct algebraic_tracking *track,
+                            nir_ssa_def *def)
+{
+   if (def->parent_instr->type == nir_instr_type_alu)
+      tracking_queue_def(track, def);
+}
+
+static void
+tracking_queue_new_srcs(struct algebraic_tracking *track, nir_ssa_def *def,
+                        unsigned first_new_index)
+{
+   if (def->parent_instr->type != nir_instr_type_alu)
+      return;
+
+   if (def->index < first_new_index) {
+      tracking_queue_def(track, def);
+      return;
+   }
+
+   nir_alu_instr *alu = nir_instr_as_alu(def->parent_instr);
+   for (unsigned i = 0; i < nir_op_infos[alu->op].num_inputs; i++) {
+      if (alu->src[i].src.is_ssa)
+         tracking_queue_new_srcs(track, alu->src[i].src.ssa, first_new_index);
+   }
+}
+
+/* Marks what may match differently after instr was replaced by new_def.
+ *
+ * Only the uses of the values that instr and the new instructions use
+ * changed.  Everything that uses instr or new_def comes later in the
+ * program and has already been tried.
+ */
+static void
+tracking_replaced(struct algebraic_tracking *track, nir_alu_instr *instr,
+                  nir_ssa_def *new_def, unsigned first_new_index)
+{
+   if (!track->enabled || track->use_levels == 0)
+      return;
+
+   for (unsigned i = 0; i < nir_op_infos[instr->op].num_inputs; i++) {
+      if (instr->src[i].src.is_ssa)
+         tracking_queue_uses_changed(track, instr->src[i].src.ssa);
+   }
+
+   tracking_queue_new_srcs(track, new_def, first_new_index);
+
+   const unsigned count =
+      tracking_queue_users(track, 0, track->use_levels - 1);
+
+   if (count > track->budget) {
+      track->enabled = false;
+   } else {
+      track->budget -= count;
+      util_dynarray_foreach(&track->queue, nir_ssa_def *, def)
+         BITSET_SET(track->changed, (*def)->index);
+   }
+
+   tracking_clear_queue(track);
+}
+
+/* Queues the values whose signatures differ from last time, or that are new,
+ * and sets up the clean bits for everything else.
+ */
+static void
+tracking_compare(struct algebraic_tracking *track,
+                 const struct algebraic_impl_state *prev,
+                 nir_instr *instr, nir_ssa_def *def,
+                 struct algebraic_signature *signatures,
+                 struct util_dynarray *uses_changed)
+{
+   struct algebraic_signature sig = instr_signature(instr, def);
+   signatures[def->index] = sig;
+
+   if (def->index >= prev->num_defs ||
+       prev->signatures[def->index].content != sig.content) {
+      tracking_queue_def(track, def);
+   } else if (prev->signatures[def->index].uses != sig.uses) {
+      util_dynarray_append(uses_changed, nir_ssa_def *, def);
+   } else if (BITSET_TEST(prev->clean, def->index)) {
+      BITSET_SET(track->clean, def->index);
+   }
+}
+
+/* Clears the clean bits of everything that depends on what changed since
+ * last time.  This isn't limited by the budget.
+ */
+static void
+tracking_mark_changed(struct algebraic_tracking *track,
+                      struct util_dynarray *uses_changed)
+{
+   /* A different instruction changes what matches on everything computed
+    * from it.
+    */
+   unsigned start = tracking_queue_users(track, 0, UINT_MAX);
+
+   /* Different uses only matter to expressions the value is part of. */
+   if (track->use_levels > 0) {
+      util_dynarray_foreach(uses_changed, nir_ssa_def *, def)
+         tracking_queue_def(track, *def);
+      tracking_queue_users(track, start, track->use_levels - 1);
+   }
+
+   tracking_clear_queue(track);
+}
+
 static bool
 nir_algebraic_instr(nir_builder *build, nir_instr *instr,
-                    struct hash_table *range_ht,
+                    struct nir_range_cache *range_cache,
                     const bool *condition_flags,
                     const struct transform **transforms,
                     const uint16_t *transform_counts,
                     struct util_dynarray *states,
                     const struct per_op_table *pass_op_table,
-                    nir_instr_worklist *worklist)
+                    nir_instr_worklist *worklist,
+                    struct algebraic_tracking *track)
 {
 
    if (instr->type != nir_instr_type_alu)
@@ -879,16 +1294,22 @@ nir_algebraic_instr(nir_builder *build, nir_instr *instr,
    const bool ignore_inexact =
       nir_is_float_control_signed_zero_inf_nan_preserve(execution_mode, bit_size) ||
       nir_is_denorm_flush_to_zero(execution_mode, bit_size);
+   const unsigned first_new_index = build->impl->ssa_alloc;
 
    int xform_idx = *util_dynarray_element(states, uint16_t,
                                           alu->dest.dest.ssa.index);
    for (uint16_t i = 0; i < transform_counts[xform_idx]; i++) {
       const struct transform *xform = &transforms[xform_idx][i];
-      if (condition_flags[xform->condition_offset] &&
-          !(xform->search->inexact && ignore_inexact) &&
-          nir_replace_instr(build, alu, range_ht, states, pass_op_table,
-                            xform->search, xform->replace, worklist)) {
-         _mesa_hash_table_clear(range_ht, NULL);
+      if (!condition_flags[xform->condition_offset] ||
+          (xform->search->inexact && ignore_inexact))
+         continue;
+
+      nir_ssa_def *new_def =
+         nir_replace_instr(build, alu, range_cache, states, pass_op_table,
+                           xform->search, xform->replace, worklist);
+      if (new_def) {
+         nir_range_cache_invalidate_users(range_cache, new_def);
+         tracking_replaced(track, alu, new_def, first_new_index);
          return true;
       }
    }
@@ -899,9 +1320,11 @@ nir_algebraic_instr(nir_builder *build, nir_instr *instr,
 bool
 nir_algebraic_impl(nir_function_impl *impl,
                    const bool *condition_flags,
+                   unsigned num_condition_flags,
                    const struct transform **transforms,
                    const uint16_t *transform_counts,
-                   const struct per_op_table *pass_op_table)
+                   const struct per_op_table *pass_op_table,
+                   unsigned use_levels)
 {
    bool progress = false;
 
@@ -919,29 +1342,64 @@ nir_algebraic_impl(nir_function_impl *impl,
    }
    memset(states.data, 0, states.size);
 
-   struct hash_table *range_ht = _mesa_pointer_hash_table_create(NULL);
+   const unsigned num_defs = impl->ssa_alloc;
+   struct algebraic_impl_state *prev =
+      get_algebraic_impl_state(impl, condition_flags, num_condition_flags,
+                               pass_op_table);
+   struct algebraic_signature *signatures =
+      prev ? ralloc_array(prev, struct algebraic_signature, num_defs) : NULL;
+
+   struct algebraic_tracking track;
+   if (!tracking_init(&track, num_defs, use_levels) || !signatures)
+      track.enabled = false;
+
+   struct util_dynarray uses_changed;
+   util_dynarray_init(&uses_changed, NULL);
+
+   /* Ranges are checked with the same signatures, so without them the old
+    * ones can't be trusted.
+    */
+   if (!track.enabled)
+      nir_range_cache_reset(impl);
+   struct nir_range_cache *range_cache = nir_range_cache_get(impl);
 
    nir_instr_worklist *worklist = nir_instr_worklist_create();
 
-   /* Walk top-to-bottom setting up the automaton state. */
+   /* Walk top-to-bottom setting up the automaton state and finding what
+    * changed since the last call.
+    */
    nir_foreach_block(block, impl) {
       nir_foreach_instr(instr, block) {
          nir_algebraic_automaton(instr, &states, pass_op_table);
+
+         nir_ssa_def *def;
+         if (track.enabled && (def = algebraic_instr_def(instr))) {
+            tracking_compare(&track, prev, instr, def, signatures,
+                             &uses_changed);
+            nir_range_cache_check_def(range_cache, def,
+                                      signatures[def->index].content);
+         }
       }
    }
 
+   if (track.enabled)
+      tracking_mark_changed(&track, &uses_changed);
+   util_dynarray_fini(&uses_changed);
+
    /* Put our instrs in the worklist such that we're popping the last instr
     * first.  This will encourage us to match the biggest source patterns when
     * possible.
     */
+   unsigned num_initial = 0;
    nir_foreach_block_reverse(block, impl) {
       nir_foreach_instr_reverse(instr, block) {
          nir_instr_worklist_push_tail(worklist, instr);
+         num_initial++;
       }
    }
 
    nir_instr *instr;
-   while ((instr = nir_instr_worklist_pop_head(worklist))) {
+   for (unsigned i = 0; (instr = nir_instr_worklist_pop_head(worklist)); i++) {
       /* The worklist can have an instr pushed to it multiple times if it was
        * the src of multiple instrs that also got optimized, so make sure that
        * we don't try to re-optimize an instr we already handled.
@@ -949,16 +1407,59 @@ nir_algebraic_impl(nir_function_impl *impl,
       if (exec_node_is_tail_sentinel(&instr->node))
          continue;
 
-      progress |= nir_algebraic_instr(&build, instr,
-                                      range_ht, condition_flags,
-                                      transforms, transform_counts, &states,
-                                      pass_op_table, worklist);
+      /* The instructions pushed by replacements are always tried.  For the
+       * others, a clean one would give the same result as last time.
+       */
+      nir_ssa_def *def = NULL;
+      if (track.enabled && i < num_initial) {
+         def = algebraic_instr_def(instr);
+         if (def && BITSET_TEST(track.clean, def->index))
+            continue;
+      }
+
+      if (nir_algebraic_instr(&build, instr,
+                              range_cache, condition_flags,
+                              transforms, transform_counts, &states,
+                              pass_op_table, worklist, &track)) {
+         progress = true;
+      } else if (def && track.enabled &&
+                 !BITSET_TEST(track.changed, def->index)) {
+         /* Nothing it depends on changed since the start, so it doesn't
+          * match with the signatures from then either.
+          */
+         BITSET_SET(track.clean, def->index);
+      }
    }
 
    nir_instr_worklist_destroy(worklist);
-   ralloc_free(range_ht);
    util_dynarray_fini(&states);
 
+   /* Remember the signatures from the start, the clean bits are relative to
+    * them.
+    */
+   if (prev) {
+      ralloc_free(prev->signatures);
+      ralloc_free(prev->clean);
+      prev->signatures = NULL;
+      prev->clean = NULL;
+      prev->num_defs = 0;
+
+      if (track.enabled) {
+         prev->clean = ralloc_array(prev, BITSET_WORD, BITSET_WORDS(num_defs));
+         if (prev->clean) {
+            memcpy(prev->clean, track.clean,
+                   BITSET_WORDS(num_defs) * sizeof(BITSET_WORD));
+            prev->signatures = signatures;
+            prev->num_defs = num_defs;
+            signatures = NULL;
+         }
+      }
+
+      ralloc_free(signatures);
+   }
+
+   tracking_fini(&track);
+
    if (progress) {
       nir_metadata_preserve(impl, nir_metadata_block_index |
                                   nir_metadata_dominance);
@@ -93,10 +93,11 @@ typedef struct {
     * This is only allowed in search expressions, and allows additional
     * constraints to be placed on the match.  Typically used for 'is_constant'
     * variables to require, for example, power-of-two in order for the search
-    * to match.
+    * to match.  It may only look at the value and the instructions it is
+    * computed from, see nir_algebraic_impl().
     */
-   bool (*cond)(struct hash_table *range_ht, nir_alu_instr *instr, unsigned src,
-                unsigned num_components, const uint8_t *swizzle);
+   bool (*cond)(struct nir_range_cache *range_cache, nir_alu_instr *instr,
+                unsigned src, unsigned num_components, const uint8_t *swizzle);
 
    /** Swizzle (for replace only) */
    uint8_t swizzle[NIR_MAX_VEC_COMPONENTS];
@@ -163,7 +164,8 @@ typedef struct {
     *
     * This allows additional constraints on expression matching, it is
     * typically used to match an expressions uses such as the number of times
-    * the expression is used, and whether its used by an if.
+    * the expression is used, and whether its used by an if.  Besides the
+    * uses, it may only look at what a variable condition may look at.
     */
    bool (*cond)(nir_alu_instr *instr);
 } nir_search_expression;
@@ -199,17 +201,36 @@ NIR_DEFINE_CAST(nir_search_value_as_expression, nir_search_value,
 
 nir_ssa_def *
 nir_replace_instr(struct nir_builder *b, nir_alu_instr *instr,
-                  struct hash_table *range_ht,
+                  struct nir_range_cache *range_cache,
                   struct util_dynarray *states,
                   const struct per_op_table *pass_op_table,
                   const nir_search_expression *search,
                   const nir_search_value *replace,
                   nir_instr_worklist *algebraic_worklist);
+
+/* Runs an algebraic pass on impl.
+ *
+ * Between calls with the same pass, the impl remembers which instructions
+ * were tried without progress, so only the instructions that changed since
+ * then and the ones that depend on them are tried again.  The result is the
+ * same as trying every instruction.
+ *
+ * use_levels is how many levels of users a change of the uses of a value can
+ * affect through expression conditions, as computed by nir_algebraic.py.
+ */
 bool
 nir_algebraic_impl(nir_function_impl *impl,
                    const bool *condition_flags,
+                   unsigned num_condition_flags,
                    const struct transform **transforms,
                    const uint16_t *transform_counts,
-                   const struct per_op_table *pass_op_table);
+                   const struct per_op_table *pass_op_table,
+                   unsigned use_levels);
+
+/* Forgets what previous nir_algebraic_impl() calls remembered, so that the
+ * next one tries every instruction and finds all ranges again.
+ */
+void
+nir_algebraic_impl_reset(nir_function_impl *impl);
 
 #endif /* _NIR_SEARCH_ */
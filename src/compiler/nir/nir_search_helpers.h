@@ -33,7 +33,7 @@
 #include <math.h>
 
 static inline bool
-is_pos_power_of_two(UNUSED struct hash_table *ht, nir_alu_instr *instr,
+is_pos_power_of_two(UNUSED struct nir_range_cache *cache, nir_alu_instr *instr,
                     unsigned src, unsigned num_components,
                     const uint8_t *swizzle)
 {
@@ -65,7 +65,7 @@ is_pos_power_of_two(UNUSED struct hash_table *ht, nir_alu_instr *instr,
 }
 
 static inline bool
-is_neg_power_of_two(UNUSED struct hash_table *ht, nir_alu_instr *instr,
+is_neg_power_of_two(UNUSED struct nir_range_cache *cache, nir_alu_instr *instr,
                     unsigned src, unsigned num_components,
                     const uint8_t *swizzle)
 {
@@ -92,7 +92,7 @@ is_neg_power_of_two(UNUSED struct hash_table *ht, nir_alu_instr *instr,
 
 #define MULTIPLE(test)                                                  \
 static inline bool                                                      \
-is_unsigned_multiple_of_ ## test(UNUSED struct hash_table *ht, nir_alu_instr *instr, \
+is_unsigned_multiple_of_ ## test(UNUSED struct nir_range_cache *cache, nir_alu_instr *instr, \
                                  unsigned src, unsigned num_components, \
                                  const uint8_t *swizzle)                \
 {                                                                       \
@@ -117,7 +117,7 @@ MULTIPLE(32)
 MULTIPLE(64)
 
 static inline bool
-is_zero_to_one(UNUSED struct hash_table *ht, nir_alu_instr *instr, unsigned src,
+is_zero_to_one(UNUSED struct nir_range_cache *cache, nir_alu_instr *instr, unsigned src,
                unsigned num_components,
                const uint8_t *swizzle)
 {
@@ -148,7 +148,7 @@ is_zero_to_one(UNUSED struct hash_table *ht, nir_alu_instr *instr, unsigned src,
  * 1 while this function tests 0 < src < 1.
  */
 static inline bool
-is_gt_0_and_lt_1(UNUSED struct hash_table *ht, nir_alu_instr *instr,
+is_gt_0_and_lt_1(UNUSED struct nir_range_cache *cache, nir_alu_instr *instr,
                  unsigned src, unsigned num_components,
                  const uint8_t *swizzle)
 {
@@ -173,7 +173,7 @@ is_gt_0_and_lt_1(UNUSED struct hash_table *ht, nir_alu_instr *instr,
 }
 
 static inline bool
-is_not_const_zero(UNUSED struct hash_table *ht, nir_alu_instr *instr,
+is_not_const_zero(UNUSED struct nir_range_cache *cache, nir_alu_instr *instr,
                   unsigned src, unsigned num_components,
                   const uint8_t *swizzle)
 {
@@ -202,7 +202,7 @@ is_not_const_zero(UNUSED struct hash_table *ht, nir_alu_instr *instr,
 }
 
 static inline bool
-is_not_const(UNUSED struct hash_table *ht, nir_alu_instr *instr, unsigned src,
+is_not_const(UNUSED struct nir_range_cache *cache, nir_alu_instr *instr, unsigned src,
              UNUSED unsigned num_components,
              UNUSED const uint8_t *swizzle)
 {
@@ -210,7 +210,7 @@ is_not_const(UNUSED struct hash_table *ht, nir_alu_instr *instr, unsigned src,
 }
 
 static inline bool
-is_not_fmul(struct hash_table *ht, nir_alu_instr *instr, unsigned src,
+is_not_fmul(struct nir_range_cache *cache, nir_alu_instr *instr, unsigned src,
             UNUSED unsigned num_components, UNUSED const uint8_t *swizzle)
 {
    nir_alu_instr *src_alu =
@@ -220,7 +220,7 @@ is_not_fmul(struct hash_table *ht, nir_alu_instr *instr, unsigned src,
       return true;
 
    if (src_alu->op == nir_op_fneg)
-      return is_not_fmul(ht, src_alu, 0, 0, NULL);
+      return is_not_fmul(cache, src_alu, 0, 0, NULL);
 
    return src_alu->op != nir_op_fmul;
 }
@@ -242,10 +242,10 @@ is_fsign(nir_alu_instr *instr, unsigned src,
 }
 
 static inline bool
-is_not_const_and_not_fsign(struct hash_table *ht, nir_alu_instr *instr, unsigned src,
+is_not_const_and_not_fsign(struct nir_range_cache *cache, nir_alu_instr *instr, unsigned src,
                            unsigned num_components, const uint8_t *swizzle)
 {
-   return is_not_const(ht, instr, src, num_components, swizzle) &&
+   return is_not_const(cache, instr, src, num_components, swizzle) &&
           !is_fsign(instr, src, num_components, swizzle);
 }
 
@@ -308,7 +308,7 @@ is_used_by_non_fsat(nir_alu_instr *instr)
  * of all its components is zero.
  */
 static inline bool
-is_upper_half_zero(UNUSED struct hash_table *ht,
+is_upper_half_zero(UNUSED struct nir_range_cache *cache,
                    nir_alu_instr *instr, unsigned src,
                    unsigned num_components, const uint8_t *swizzle)
 {
@@ -333,7 +333,7 @@ is_upper_half_zero(UNUSED struct hash_table *ht,
  * of all its components is zero.
  */
 static inline bool
-is_lower_half_zero(UNUSED struct hash_table *ht,
+is_lower_half_zero(UNUSED struct nir_range_cache *cache,
                    nir_alu_instr *instr, unsigned src,
                    unsigned num_components, const uint8_t *swizzle)
 {
@@ -363,20 +363,20 @@ no_unsigned_wrap(nir_alu_instr *instr)
 }
 
 static inline bool
-is_integral(struct hash_table *ht, nir_alu_instr *instr, unsigned src,
+is_integral(struct nir_range_cache *cache, nir_alu_instr *instr, unsigned src,
             UNUSED unsigned num_components, UNUSED const uint8_t *swizzle)
 {
-   const struct ssa_result_range r = nir_analyze_range(ht, instr, src);
+   const struct ssa_result_range r = nir_analyze_range(cache, instr, src);
 
    return r.is_integral;
 }
 
 #define RELATION(r)                                                     \
 static inline bool                                                      \
-is_ ## r (struct hash_table *ht, nir_alu_instr *instr, unsigned src,                           \
+is_ ## r (struct nir_range_cache *cache, nir_alu_instr *instr, unsigned src,                           \
           UNUSED unsigned num_components, UNUSED const uint8_t *swizzle) \
 {                                                                       \
-   const struct ssa_result_range v = nir_analyze_range(ht, instr, src);  \
+   const struct ssa_result_range v = nir_analyze_range(cache, instr, src);  \
    return v.range == r;                                                 \
 }
 
@@ -387,26 +387,26 @@ RELATION(ge_zero)
 RELATION(ne_zero)
 
 static inline bool
-is_not_negative(struct hash_table *ht, nir_alu_instr *instr, unsigned src,
+is_not_negative(struct nir_range_cache *cache, nir_alu_instr *instr, unsigned src,
                 UNUSED unsigned num_components, UNUSED const uint8_t *swizzle)
 {
-   const struct ssa_result_range v = nir_analyze_range(ht, instr, src);
+   const struct ssa_result_range v = nir_analyze_range(cache, instr, src);
    return v.range == ge_zero || v.range == gt_zero || v.range == eq_zero;
 }
 
 static inline bool
-is_not_positive(struct hash_table *ht, nir_alu_instr *instr, unsigned src,
+is_not_positive(struct nir_range_cache *cache, nir_alu_instr *instr, unsigned src,
                 UNUSED unsigned num_components, UNUSED const uint8_t *swizzle)
 {
-   const struct ssa_result_range v = nir_analyze_range(ht, instr, src);
+   const struct ssa_result_range v = nir_analyze_range(cache, instr, src);
    return v.range == le_zero || v.range == lt_zero || v.range == eq_zero;
 }
 
 static inline bool
-is_not_zero(struct hash_table *ht, nir_alu_instr *instr, unsigned src,
+is_not_zero(struct nir_range_cache *cache, nir_alu_instr *instr, unsigned src,
             UNUSED unsigned num_components, UNUSED const uint8_t *swizzle)
 {
-   const struct ssa_result_range v = nir_analyze_range(ht, instr, src);
+   const struct ssa_result_range v = nir_analyze_range(cache, instr, src);
    return v.range == lt_zero || v.range == gt_zero || v.range == ne_zero;
 }
 
@@ -27,12 +27,19 @@
 #include "util/u_math.h"
 
 #define NIR_SERIALIZE_FUNC_HAS_IMPL ((void *)(intptr_t)1)
-#define MAX_OBJECT_IDS (1 << 20)
+
+/* Most of the stream is made of variable-length integers (see
+ * blob_write_varint), so small values such as counts and object references
+ * take a single byte.  SSA sources are stored as the distance back to their
+ * definition, which keeps them small and means that inserting or removing
+ * an instruction only changes the bytes of the instructions referring
+ * across it.  Strings and types are stored once per blob, and later
+ * occurrences refer to the first one.
+ */
 
 typedef struct {
-   size_t blob_offset;
-   nir_ssa_def *src;
-   nir_block *block;
+   const nir_ssa_def *src;
+   const nir_block *block;
 } write_phi_fixup;
 
 typedef struct {
@@ -46,14 +53,16 @@ typedef struct {
    /* the next index to assign to a NIR in-memory object */
    uint32_t next_idx;
 
-   /* Array of write_phi_fixup structs representing phi sources that need to
-    * be resolved in the second pass.
+   /* Array of write_phi_fixup structs representing phi sources that are
+    * written at the end of the function_impl, once all of the objects they
+    * refer to have an index.
     */
    struct util_dynarray phi_fixups;
 
-   /* The last serialized type. */
-   const struct glsl_type *last_type;
-   const struct glsl_type *last_interface_type;
+   /* Maps strings and types to their index in the blob's tables. */
+   struct hash_table *string_table;
+   struct hash_table *type_table;
+
    struct nir_variable_data last_var_data;
 
    /* For skipping equal ALU headers (typical after scalarization). */
@@ -81,9 +90,10 @@ typedef struct {
    /* List of phi sources. */
    struct list_head phi_srcs;
 
-   /* The last deserialized type. */
-   const struct glsl_type *last_type;
-   const struct glsl_type *last_interface_type;
+   /* Strings (pointing into the blob) and types read so far. */
+   struct util_dynarray strings;
+   struct util_dynarray types;
+
    struct nir_variable_data last_var_data;
 } read_ctx;
 
@@ -91,7 +101,6 @@ static void
 write_add_object(write_ctx *ctx, const void *obj)
 {
    uint32_t index = ctx->next_idx++;
-   assert(index != MAX_OBJECT_IDS);
    _mesa_hash_table_insert(ctx->remap_table, obj, (void *)(uintptr_t) index);
 }
 
@@ -117,10 +126,114 @@ read_lookup_object(read_ctx *ctx, uint32_t idx)
    return ctx->idx_table[idx];
 }
 
+static void
+write_object(write_ctx *ctx, const void *obj)
+{
+   blob_write_varint(ctx->blob, write_lookup_object(ctx, obj));
+}
+
 static void *
 read_object(read_ctx *ctx)
 {
-   return read_lookup_object(ctx, blob_read_uint32(ctx->blob));
+   return read_lookup_object(ctx, blob_read_varint(ctx->blob));
+}
+
+/* SSA definitions are referred to by the distance from the next index. */
+static void
+write_ssa_ref(write_ctx *ctx, const nir_ssa_def *def)
+{
+   uint32_t index = write_lookup_object(ctx, def);
+   assert(index < ctx->next_idx);
+   blob_write_varint(ctx->blob, ctx->next_idx - index);
+}
+
+static nir_ssa_def *
+read_ssa_ref(read_ctx *ctx)
+{
+   uint32_t distance = blob_read_varint(ctx->blob);
+   assert(distance > 0 && distance <= ctx->next_idx);
+   return read_lookup_object(ctx, ctx->next_idx - distance);
+}
+
+/* Instruction headers and other bitfields use most of their 32 bits, so they
+ * are stored as they are, but without the alignment padding of
+ * blob_write_uint32().
+ */
+static void
+write_packed_uint32(write_ctx *ctx, uint32_t header)
+{
+   blob_write_bytes(ctx->blob, &header, sizeof(header));
+}
+
+static uint32_t
+read_packed_uint32(read_ctx *ctx)
+{
+   uint32_t header = 0;
+   blob_copy_bytes(ctx->blob, &header, sizeof(header));
+   return header;
+}
+
+/* A string is either a new entry of the string table, which is written out,
+ * or a reference to an entry written before.
+ */
+static void
+write_string(write_ctx *ctx, const char *str)
+{
+   struct hash_entry *entry = _mesa_hash_table_search(ctx->string_table, str);
+   if (entry) {
+      blob_write_varint(ctx->blob, (uintptr_t) entry->data);
+      return;
+   }
+
+   uintptr_t index = ctx->string_table->entries + 1;
+   _mesa_hash_table_insert(ctx->string_table, str, (void *) index);
+   blob_write_varint(ctx->blob, 0);
+   blob_write_string(ctx->blob, str);
+}
+
+static const char *
+read_string(read_ctx *ctx)
+{
+   uint32_t index = blob_read_varint(ctx->blob);
+   if (index) {
+      assert(index <= util_dynarray_num_elements(&ctx->strings, const char *));
+      return *util_dynarray_element(&ctx->strings, const char *, index - 1);
+   }
+
+   const char *str = blob_read_string(ctx->blob);
+   util_dynarray_append(&ctx->strings, const char *, str);
+   return str;
+}
+
+static void
+write_type(write_ctx *ctx, const struct glsl_type *type)
+{
+   struct hash_entry *entry = _mesa_hash_table_search(ctx->type_table, type);
+   if (entry) {
+      blob_write_varint(ctx->blob, (uintptr_t) entry->data);
+      return;
+   }
+
+   uintptr_t index = ctx->type_table->entries + 1;
+   _mesa_hash_table_insert(ctx->type_table, type, (void *) index);
+   blob_write_varint(ctx->blob, 0);
+   encode_type_to_blob(ctx->blob, type);
+}
+
+static const struct glsl_type *
+read_type(read_ctx *ctx)
+{
+   uint32_t index = blob_read_varint(ctx->blob);
+   if (index) {
+      assert(index <= util_dynarray_num_elements(&ctx->types,
+                                                 const struct glsl_type *));
+      return *util_dynarray_element(&ctx->types, const struct glsl_type *,
+                                    index - 1);
+   }
+
+   const struct glsl_type *type = decode_type_from_blob(ctx->blob);
+   util_dynarray_append(&ctx->types, const struct glsl_type *, type);
+   return type;
 }
 
 static uint32_t
@@ -153,7 +266,7 @@ encode_num_components_in_3bits(uint8_t num_components)
    if (num_components == 16)
       return 6;
 
-   /* special value indicating that num_components is in the next uint32 */
+   /* special value indicating that num_components is in the next varint */
    return NUM_COMPONENTS_IS_SEPARATE_7;
 }
 
@@ -175,7 +288,7 @@ static void
 write_constant(write_ctx *ctx, const nir_constant *c)
 {
    blob_write_bytes(ctx->blob, c->values, sizeof(c->values));
-   blob_write_uint32(ctx->blob, c->num_elements);
+   blob_write_varint(ctx->blob, c->num_elements);
    for (unsigned i = 0; i < c->num_elements; i++)
       write_constant(ctx, c->elements[i]);
 }
@@ -186,7 +299,7 @@ read_constant(read_ctx *ctx, nir_variable *nvar)
    nir_constant *c = ralloc(nvar, nir_constant);
 
    blob_copy_bytes(ctx->blob, (uint8_t *)c->values, sizeof(c->values));
-   c->num_elements = blob_read_uint32(ctx->blob);
+   c->num_elements = blob_read_varint(ctx->blob);
    c->elements = ralloc_array(nvar, nir_constant *, c->num_elements);
    for (unsigned i = 0; i < c->num_elements; i++)
       c->elements[i] = read_constant(ctx, nvar);
@@ -210,9 +323,7 @@ union packed_var {
       unsigned has_interface_type:1;
       unsigned num_state_slots:7;
       unsigned data_encoding:2;
-      unsigned type_same_as_last:1;
-      unsigned interface_type_same_as_last:1;
-      unsigned _pad:1;
+      unsigned _pad:3;
       unsigned num_members:16;
    } u;
 };
@@ -241,9 +352,6 @@ write_variable(write_ctx *ctx, const nir_variable *var)
    flags.u.has_constant_initializer = !!(var->constant_initializer);
    flags.u.has_pointer_initializer = !!(var->pointer_initializer);
    flags.u.has_interface_type = !!(var->interface_type);
-   flags.u.type_same_as_last = var->type == ctx->last_type;
-   flags.u.interface_type_same_as_last =
-      var->interface_type && var->interface_type == ctx->last_interface_type;
    flags.u.num_state_slots = var->num_state_slots;
    flags.u.num_members = var->num_members;
 
@@ -282,20 +390,14 @@ write_variable(write_ctx *ctx, const nir_variable *var)
          flags.u.data_encoding = var_encode_full;
    }
 
-   blob_write_uint32(ctx->blob, flags.u32);
+   write_packed_uint32(ctx, flags.u32);
 
-   if (!flags.u.type_same_as_last) {
-      encode_type_to_blob(ctx->blob, var->type);
-      ctx->last_type = var->type;
-   }
-
-   if (var->interface_type && !flags.u.interface_type_same_as_last) {
-      encode_type_to_blob(ctx->blob, var->interface_type);
-      ctx->last_interface_type = var->interface_type;
-   }
+   write_type(ctx, var->type);
+   if (var->interface_type)
+      write_type(ctx, var->interface_type);
 
    if (flags.u.has_name)
-      blob_write_string(ctx->blob, var->name);
+      write_string(ctx, var->name);
 
    if (flags.u.data_encoding == var_encode_full ||
        flags.u.data_encoding == var_encode_location_diff) {
@@ -312,7 +414,7 @@ write_variable(write_ctx *ctx, const nir_variable *var)
          diff.u.driver_location = data.driver_location -
                                   ctx->last_var_data.driver_location;
 
-         blob_write_uint32(ctx->blob, diff.u32);
+         write_packed_uint32(ctx, diff.u32);
       }
 
       ctx->last_var_data = data;
@@ -325,7 +427,7 @@ write_variable(write_ctx *ctx, const nir_variable *var)
    if (var->constant_initializer)
       write_constant(ctx, var->constant_initializer);
    if (var->pointer_initializer)
-      write_lookup_object(ctx, var->pointer_initializer);
+      write_object(ctx, var->pointer_initializer);
    if (var->num_members > 0) {
       blob_write_bytes(ctx->blob, (uint8_t *) var->members,
                        var->num_members * sizeof(*var->members));
@@ -339,26 +441,14 @@ read_variable(read_ctx *ctx)
    read_add_object(ctx, var);
 
    union packed_var flags;
-   flags.u32 = blob_read_uint32(ctx->blob);
+   flags.u32 = read_packed_uint32(ctx);
 
-   if (flags.u.type_same_as_last) {
-      var->type = ctx->last_type;
-   } else {
-      var->type = decode_type_from_blob(ctx->blob);
-      ctx->last_type = var->type;
-   }
-
-   if (flags.u.has_interface_type) {
-      if (flags.u.interface_type_same_as_last) {
-         var->interface_type = ctx->last_interface_type;
-      } else {
-         var->interface_type = decode_type_from_blob(ctx->blob);
-         ctx->last_interface_type = var->interface_type;
-      }
-   }
+   var->type = read_type(ctx);
+   if (flags.u.has_interface_type)
+      var->interface_type = read_type(ctx);
 
    if (flags.u.has_name) {
-      const char *name = blob_read_string(ctx->blob);
+      const char *name = read_string(ctx);
       var->name = ralloc_strdup(var, name);
    } else {
       var->name = NULL;
@@ -373,7 +463,7 @@ read_variable(read_ctx *ctx)
       ctx->last_var_data = var->data;
    } else { /* var_encode_location_diff */
       union packed_var_data_diff diff;
-      diff.u32 = blob_read_uint32(ctx->blob);
+      diff.u32 = read_packed_uint32(ctx);
 
       var->data = ctx->last_var_data;
       var->data.location += diff.u.location;
@@ -416,7 +506,7 @@ read_variable(read_ctx *ctx)
 static void
 write_var_list(write_ctx *ctx, const struct exec_list *src)
 {
-   blob_write_uint32(ctx->blob, exec_list_length(src));
+   blob_write_varint(ctx->blob, exec_list_length(src));
    foreach_list_typed(nir_variable, var, node, src) {
       write_variable(ctx, var);
    }
@@ -426,7 +516,7 @@ static void
 read_var_list(read_ctx *ctx, struct exec_list *dst)
 {
    exec_list_make_empty(dst);
-   unsigned num_vars = blob_read_uint32(ctx->blob);
+   unsigned num_vars = blob_read_varint(ctx->blob);
    for (unsigned i = 0; i < num_vars; i++) {
       nir_variable *var = read_variable(ctx);
       exec_list_push_tail(dst, &var->node);
@@ -437,13 +527,13 @@ static void
 write_register(write_ctx *ctx, const nir_register *reg)
 {
    write_add_object(ctx, reg);
-   blob_write_uint32(ctx->blob, reg->num_components);
-   blob_write_uint32(ctx->blob, reg->bit_size);
-   blob_write_uint32(ctx->blob, reg->num_array_elems);
-   blob_write_uint32(ctx->blob, reg->index);
-   blob_write_uint32(ctx->blob, !ctx->strip && reg->name);
+   blob_write_varint(ctx->blob, reg->num_components);
+   blob_write_varint(ctx->blob, reg->bit_size);
+   blob_write_varint(ctx->blob, reg->num_array_elems);
+   blob_write_varint(ctx->blob, reg->index);
+   blob_write_uint8(ctx->blob, !ctx->strip && reg->name);
    if (!ctx->strip && reg->name)
-      blob_write_string(ctx->blob, reg->name);
+      write_string(ctx, reg->name);
 }
 
 static nir_register *
@@ -451,13 +541,13 @@ read_register(read_ctx *ctx)
 {
    nir_register *reg = ralloc(ctx->nir, nir_register);
    read_add_object(ctx, reg);
-   reg->num_components = blob_read_uint32(ctx->blob);
-   reg->bit_size = blob_read_uint32(ctx->blob);
-   reg->num_array_elems = blob_read_uint32(ctx->blob);
-   reg->index = blob_read_uint32(ctx->blob);
-   bool has_name = blob_read_uint32(ctx->blob);
+   reg->num_components = blob_read_varint(ctx->blob);
+   reg->bit_size = blob_read_varint(ctx->blob);
+   reg->num_array_elems = blob_read_varint(ctx->blob);
+   reg->index = blob_read_varint(ctx->blob);
+   bool has_name = blob_read_uint8(ctx->blob);
    if (has_name) {
-      const char *name = blob_read_string(ctx->blob);
+      const char *name = read_string(ctx);
       reg->name = ralloc_strdup(reg, name);
    } else {
       reg->name = NULL;
@@ -473,7 +563,7 @@ read_register(read_ctx *ctx)
 static void
 write_reg_list(write_ctx *ctx, const struct exec_list *src)
 {
-   blob_write_uint32(ctx->blob, exec_list_length(src));
+   blob_write_varint(ctx->blob, exec_list_length(src));
    foreach_list_typed(nir_register, reg, node, src)
       write_register(ctx, reg);
 }
@@ -482,7 +572,7 @@ static void
 read_reg_list(read_ctx *ctx, struct exec_list *dst)
 {
    exec_list_make_empty(dst);
-   unsigned num_regs = blob_read_uint32(ctx->blob);
+   unsigned num_regs = blob_read_varint(ctx->blob);
    for (unsigned i = 0; i < num_regs; i++) {
       nir_register *reg = read_register(ctx);
       exec_list_push_tail(dst, &reg->node);
@@ -494,22 +584,23 @@ union packed_src {
    struct {
       unsigned is_ssa:1;   /* <-- Header */
       unsigned is_indirect:1;
-      unsigned object_idx:20;
       unsigned _footer:10; /* <-- Footer */
+      unsigned _pad:20;
    } any;
    struct {
-      unsigned _header:22; /* <-- Header */
+      unsigned _header:2;  /* <-- Header */
       unsigned negate:1;   /* <-- Footer */
       unsigned abs:1;
       unsigned swizzle_x:2;
       unsigned swizzle_y:2;
       unsigned swizzle_z:2;
       unsigned swizzle_w:2;
+      unsigned _pad:20;
    } alu;
    struct {
-      unsigned _header:22; /* <-- Header */
+      unsigned _header:2;  /* <-- Header */
       unsigned src_type:5; /* <-- Footer */
-      unsigned _pad:5;
+      unsigned _pad:25;
    } tex;
 };
 
@@ -518,19 +609,19 @@ write_src_full(write_ctx *ctx, const nir_src *src, union packed_src header)
 {
    /* Since sources are very frequent, we try to save some space when storing
     * them. In particular, we store whether the source is a register and
-    * whether the register has an indirect index in the low two bits. We can
-    * assume that the high two bits of the index are zero, since otherwise our
-    * address space would've been exhausted allocating the remap table!
+    * whether the register has an indirect index in the low two bits of a
+    * varint, followed by the instruction-specific footer bits.  The object
+    * reference is a separate varint.
     */
    header.any.is_ssa = src->is_ssa;
    if (src->is_ssa) {
-      header.any.object_idx = write_lookup_object(ctx, src->ssa);
-      blob_write_uint32(ctx->blob, header.u32);
+      blob_write_varint(ctx->blob, header.u32);
+      write_ssa_ref(ctx, src->ssa);
    } else {
-      header.any.object_idx = write_lookup_object(ctx, src->reg.reg);
       header.any.is_indirect = !!src->reg.indirect;
-      blob_write_uint32(ctx->blob, header.u32);
-      blob_write_uint32(ctx->blob, src->reg.base_offset);
+      blob_write_varint(ctx->blob, header.u32);
+      write_object(ctx, src->reg.reg);
+      blob_write_varint(ctx->blob, src->reg.base_offset);
       if (src->reg.indirect) {
          union packed_src header = {0};
          write_src_full(ctx, src->reg.indirect, header);
@@ -550,14 +641,14 @@ read_src(read_ctx *ctx, nir_src *src, void *mem_ctx)
 {
    STATIC_ASSERT(sizeof(union packed_src) == 4);
    union packed_src header;
-   header.u32 = blob_read_uint32(ctx->blob);
+   header.u32 = blob_read_varint(ctx->blob);
 
    src->is_ssa = header.any.is_ssa;
    if (src->is_ssa) {
-      src->ssa = read_lookup_object(ctx, header.any.object_idx);
+      src->ssa = read_ssa_ref(ctx);
    } else {
-      src->reg.reg = read_lookup_object(ctx, header.any.object_idx);
-      src->reg.base_offset = blob_read_uint32(ctx->blob);
+      src->reg.reg = read_object(ctx);
+      src->reg.base_offset = blob_read_varint(ctx->blob);
       if (header.any.is_indirect) {
          src->reg.indirect = ralloc(mem_ctx, nir_src);
          read_src(ctx, src->reg.indirect, mem_ctx);
@@ -593,9 +684,7 @@ enum intrinsic_const_indices_encoding {
     */
    const_indices_9bit_all_combined,
 
-   const_indices_8bit,  /* 8 bits per element */
-   const_indices_16bit, /* 16 bits per element */
-   const_indices_32bit, /* 32 bits per element */
+   const_indices_varint, /* a varint per element */
 };
 
 enum load_const_packing {
@@ -627,7 +716,7 @@ union packed_instr {
       /* Reg: writemask; SSA: swizzles for 2 srcs */
       unsigned writemask_or_two_swizzles:4;
       unsigned op:9;
-      unsigned packed_src_ssa_16bit:1;
+      unsigned packed_src_ssa:1;
       /* Scalarized ALUs always have the same header. */
       unsigned num_followup_alu_sharing_header:2;
       unsigned dest:8;
@@ -635,9 +724,9 @@ union packed_instr {
    struct {
       unsigned instr_type:4;
       unsigned deref_type:3;
-      unsigned cast_type_same_as_last:1;
+      unsigned _pad0:1;
       unsigned mode:10; /* deref_var redefines this */
-      unsigned packed_src_ssa_16bit:1; /* deref_var redefines this */
+      unsigned packed_src_ssa:1; /* deref_var redefines this */
       unsigned _pad:5;  /* deref_var redefines this */
       unsigned dest:8;
    } deref;
@@ -645,7 +734,7 @@ union packed_instr {
       unsigned instr_type:4;
       unsigned deref_type:3;
       unsigned _pad:1;
-      unsigned object_idx:16; /* if 0, the object ID is a separate uint32 */
+      unsigned object_idx:16; /* if 0, the object ID is a separate varint */
       unsigned dest:8;
    } deref_var;
    struct {
@@ -716,44 +805,49 @@ write_dest(write_ctx *ctx, const nir_dest *dst, union packed_instr header,
 
       if (ctx->last_instr_type == nir_instr_type_alu) {
          assert(ctx->last_alu_header_offset);
-         union packed_instr *last_header =
-            (union packed_instr *)(ctx->blob->data +
-                                   ctx->last_alu_header_offset);
+
+         /* The header isn't aligned, so don't access it in place. */
+         union packed_instr last_header;
+         memcpy(&last_header.u32,
+                ctx->blob->data + ctx->last_alu_header_offset,
+                sizeof(last_header.u32));
 
          /* Clear the field that counts ALUs with equal headers. */
          union packed_instr clean_header;
-         clean_header.u32 = last_header->u32;
+         clean_header.u32 = last_header.u32;
          clean_header.alu.num_followup_alu_sharing_header = 0;
 
          /* There can be at most 4 consecutive ALU instructions
           * sharing the same header.
           */
-         if (last_header->alu.num_followup_alu_sharing_header < 3 &&
+         if (last_header.alu.num_followup_alu_sharing_header < 3 &&
              header.u32 == clean_header.u32) {
-            last_header->alu.num_followup_alu_sharing_header++;
+            last_header.alu.num_followup_alu_sharing_header++;
+            blob_overwrite_bytes(ctx->blob, ctx->last_alu_header_offset,
+                                 &last_header.u32, sizeof(last_header.u32));
             equal_header = true;
          }
       }
 
       if (!equal_header) {
          ctx->last_alu_header_offset = ctx->blob->size;
-         blob_write_uint32(ctx->blob, header.u32);
+         write_packed_uint32(ctx, header.u32);
       }
    } else {
-      blob_write_uint32(ctx->blob, header.u32);
+      write_packed_uint32(ctx, header.u32);
    }
 
    if (dest.ssa.is_ssa &&
        dest.ssa.num_components == NUM_COMPONENTS_IS_SEPARATE_7)
-      blob_write_uint32(ctx->blob, dst->ssa.num_components);
+      blob_write_varint(ctx->blob, dst->ssa.num_components);
 
    if (dst->is_ssa) {
       write_add_object(ctx, &dst->ssa);
       if (dest.ssa.has_name)
-         blob_write_string(ctx->blob, dst->ssa.name);
+         write_string(ctx, dst->ssa.name);
    } else {
-      blob_write_uint32(ctx->blob, write_lookup_object(ctx, dst->reg.reg));
-      blob_write_uint32(ctx->blob, dst->reg.base_offset);
+      write_object(ctx, dst->reg.reg);
+      blob_write_varint(ctx->blob, dst->reg.base_offset);
       if (dst->reg.indirect)
          write_src(ctx, dst->reg.indirect);
    }
@@ -770,15 +864,15 @@ read_dest(read_ctx *ctx, nir_dest *dst, nir_instr *instr,
       unsigned bit_size = decode_bit_size_3bits(dest.ssa.bit_size);
       unsigned num_components;
       if (dest.ssa.num_components == NUM_COMPONENTS_IS_SEPARATE_7)
-         num_components = blob_read_uint32(ctx->blob);
+         num_components = blob_read_varint(ctx->blob);
       else
          num_components = decode_num_components_in_3bits(dest.ssa.num_components);
-      char *name = dest.ssa.has_name ? blob_read_string(ctx->blob) : NULL;
+      const char *name = dest.ssa.has_name ? read_string(ctx) : NULL;
       nir_ssa_dest_init(instr, dst, num_components, bit_size, name);
       read_add_object(ctx, &dst->ssa);
    } else {
       dst->reg.reg = read_object(ctx);
-      dst->reg.base_offset = blob_read_uint32(ctx->blob);
+      dst->reg.base_offset = blob_read_varint(ctx->blob);
       if (dest.reg.is_indirect) {
          dst->reg.indirect = ralloc(instr, nir_src);
          read_src(ctx, dst->reg.indirect, instr);
@@ -787,14 +881,7 @@ read_dest(read_ctx *ctx, nir_dest *dst, nir_instr *instr,
 }
 
 static bool
-are_object_ids_16bit(write_ctx *ctx)
-{
-   /* Check the highest object ID, because they are monotonic. */
-   return ctx->next_idx < (1 << 16);
-}
-
-static bool
-is_alu_src_ssa_16bit(write_ctx *ctx, const nir_alu_instr *alu)
+is_alu_src_ssa(const nir_alu_instr *alu)
 {
    unsigned num_srcs = nir_op_infos[alu->op].num_inputs;
 
@@ -817,7 +904,7 @@ is_alu_src_ssa_16bit(write_ctx *ctx, const nir_alu_instr *alu)
       }
    }
 
-   return are_object_ids_16bit(ctx);
+   return true;
 }
 
 static void
@@ -837,9 +924,9 @@ write_alu(write_ctx *ctx, const nir_alu_instr *alu)
    header.alu.no_unsigned_wrap = alu->no_unsigned_wrap;
    header.alu.saturate = alu->dest.saturate;
    header.alu.op = alu->op;
-   header.alu.packed_src_ssa_16bit = is_alu_src_ssa_16bit(ctx, alu);
+   header.alu.packed_src_ssa = is_alu_src_ssa(alu);
 
-   if (header.alu.packed_src_ssa_16bit &&
+   if (header.alu.packed_src_ssa &&
        alu->dest.dest.is_ssa) {
       /* For packed srcs of SSA ALUs, this field stores the swizzles. */
       header.alu.writemask_or_two_swizzles = alu->src[0].swizzle[0];
@@ -853,14 +940,12 @@ write_alu(write_ctx *ctx, const nir_alu_instr *alu)
    write_dest(ctx, &alu->dest.dest, header, alu->instr.type);
 
    if (!alu->dest.dest.is_ssa && dst_components > 4)
-      blob_write_uint32(ctx->blob, alu->dest.write_mask);
+      blob_write_varint(ctx->blob, alu->dest.write_mask);
 
-   if (header.alu.packed_src_ssa_16bit) {
+   if (header.alu.packed_src_ssa) {
       for (unsigned i = 0; i < num_srcs; i++) {
          assert(alu->src[i].src.is_ssa);
-         unsigned idx = write_lookup_object(ctx, alu->src[i].src.ssa);
-         assert(idx < (1 << 16));
-         blob_write_uint16(ctx->blob, idx);
+         write_ssa_ref(ctx, alu->src[i].src.ssa);
       }
    } else {
       for (unsigned i = 0; i < num_srcs; i++) {
@@ -892,7 +977,7 @@ write_alu(write_ctx *ctx, const nir_alu_instr *alu)
                            (4 * j); /* 4 bits per swizzle */
                }
 
-               blob_write_uint32(ctx->blob, value);
+               write_packed_uint32(ctx, value);
             }
          }
       }
@@ -919,14 +1004,14 @@ read_alu(read_ctx *ctx, union packed_instr header)
    } else if (dst_components <= 4) {
       alu->dest.write_mask = header.alu.writemask_or_two_swizzles;
    } else {
-      alu->dest.write_mask = blob_read_uint32(ctx->blob);
+      alu->dest.write_mask = blob_read_varint(ctx->blob);
    }
 
-   if (header.alu.packed_src_ssa_16bit) {
+   if (header.alu.packed_src_ssa) {
       for (unsigned i = 0; i < num_srcs; i++) {
          nir_alu_src *src = &alu->src[i];
          src->src.is_ssa = true;
-         src->src.ssa = read_lookup_object(ctx, blob_read_uint16(ctx->blob));
+         src->src.ssa = read_ssa_ref(ctx);
 
          memset(&src->swizzle, 0, sizeof(src->swizzle));
 
@@ -955,7 +1040,7 @@ read_alu(read_ctx *ctx, union packed_instr header)
          } else {
             /* Load swizzles for vec8 and vec16. */
             for (unsigned o = 0; o < src_channels; o += 8) {
-               unsigned value = blob_read_uint32(ctx->blob);
+               unsigned value = read_packed_uint32(ctx);
 
                for (unsigned j = 0; j < 8 && o + j < src_channels; j++) {
                   alu->src[i].swizzle[o + j] =
@@ -966,7 +1051,7 @@ read_alu(read_ctx *ctx, union packed_instr header)
       }
    }
 
-   if (header.alu.packed_src_ssa_16bit &&
+   if (header.alu.packed_src_ssa &&
        alu->dest.dest.is_ssa) {
       alu->src[0].swizzle[0] = header.alu.writemask_or_two_swizzles & 0x3;
       if (num_srcs > 1)
@@ -988,10 +1073,8 @@ write_deref(write_ctx *ctx, const nir_deref_instr *deref)
    header.deref.instr_type = deref->instr.type;
    header.deref.deref_type = deref->deref_type;
 
-   if (deref->deref_type == nir_deref_type_cast) {
+   if (deref->deref_type == nir_deref_type_cast)
       header.deref.mode = deref->mode;
-      header.deref.cast_type_same_as_last = deref->type == ctx->last_type;
-   }
 
    unsigned var_idx = 0;
    if (deref->deref_type == nir_deref_type_var) {
@@ -1002,9 +1085,8 @@ write_deref(write_ctx *ctx, const nir_deref_instr *deref)
 
    if (deref->deref_type == nir_deref_type_array ||
        deref->deref_type == nir_deref_type_ptr_as_array) {
-      header.deref.packed_src_ssa_16bit =
-         deref->parent.is_ssa && deref->arr.index.is_ssa &&
-         are_object_ids_16bit(ctx);
+      header.deref.packed_src_ssa =
+         deref->parent.is_ssa && deref->arr.index.is_ssa;
    }
 
    write_dest(ctx, &deref->dest, header, deref->instr.type);
@@ -1012,21 +1094,19 @@ write_deref(write_ctx *ctx, const nir_deref_instr *deref)
    switch (deref->deref_type) {
    case nir_deref_type_var:
       if (!header.deref_var.object_idx)
-         blob_write_uint32(ctx->blob, var_idx);
+         blob_write_varint(ctx->blob, var_idx);
       break;
 
    case nir_deref_type_struct:
       write_src(ctx, &deref->parent);
-      blob_write_uint32(ctx->blob, deref->strct.index);
+      blob_write_varint(ctx->blob, deref->strct.index);
       break;
 
    case nir_deref_type_array:
    case nir_deref_type_ptr_as_array:
-      if (header.deref.packed_src_ssa_16bit) {
-         blob_write_uint16(ctx->blob,
-                           write_lookup_object(ctx, deref->parent.ssa));
-         blob_write_uint16(ctx->blob,
-                           write_lookup_object(ctx, deref->arr.index.ssa));
+      if (header.deref.packed_src_ssa) {
+         write_ssa_ref(ctx, deref->parent.ssa);
+         write_ssa_ref(ctx, deref->arr.index.ssa);
       } else {
          write_src(ctx, &deref->parent);
          write_src(ctx, &deref->arr.index);
@@ -1035,11 +1115,8 @@ write_deref(write_ctx *ctx, const nir_deref_instr *deref)
 
    case nir_deref_type_cast:
       write_src(ctx, &deref->parent);
-      blob_write_uint32(ctx->blob, deref->cast.ptr_stride);
-      if (!header.deref.cast_type_same_as_last) {
-         encode_type_to_blob(ctx->blob, deref->type);
-         ctx->last_type = deref->type;
-      }
+      blob_write_varint(ctx->blob, deref->cast.ptr_stride);
+      write_type(ctx, deref->type);
       break;
 
    case nir_deref_type_array_wildcard:
@@ -1074,17 +1151,17 @@ read_deref(read_ctx *ctx, union packed_instr header)
    case nir_deref_type_struct:
       read_src(ctx, &deref->parent, &deref->instr);
       parent = nir_src_as_deref(deref->parent);
-      deref->strct.index = blob_read_uint32(ctx->blob);
+      deref->strct.index = blob_read_varint(ctx->blob);
       deref->type = glsl_get_struct_field(parent->type, deref->strct.index);
       break;
 
    case nir_deref_type_array:
    case nir_deref_type_ptr_as_array:
-      if (header.deref.packed_src_ssa_16bit) {
+      if (header.deref.packed_src_ssa) {
          deref->parent.is_ssa = true;
-         deref->parent.ssa = read_lookup_object(ctx, blob_read_uint16(ctx->blob));
+         deref->parent.ssa = read_ssa_ref(ctx);
          deref->arr.index.is_ssa = true;
-         deref->arr.index.ssa = read_lookup_object(ctx, blob_read_uint16(ctx->blob));
+         deref->arr.index.ssa = read_ssa_ref(ctx);
       } else {
          read_src(ctx, &deref->parent, &deref->instr);
          read_src(ctx, &deref->arr.index, &deref->instr);
@@ -1099,13 +1176,8 @@ read_deref(read_ctx *ctx, union packed_instr header)
 
    case nir_deref_type_cast:
       read_src(ctx, &deref->parent, &deref->instr);
-      deref->cast.ptr_stride = blob_read_uint32(ctx->blob);
-      if (header.deref.cast_type_same_as_last) {
-         deref->type = ctx->last_type;
-      } else {
-         deref->type = decode_type_from_blob(ctx->blob);
-         ctx->last_type = deref->type;
-      }
+      deref->cast.ptr_stride = blob_read_varint(ctx->blob);
+      deref->type = read_type(ctx);
       break;
 
    case nir_deref_type_array_wildcard:
@@ -1162,37 +1234,22 @@ write_intrinsic(write_ctx *ctx, const nir_intrinsic_instr *intrin)
             header.intrinsic.packed_const_indices |=
                intrin->const_index[i] << (i * bit_size);
          }
-      } else if (max_bits <= 8)
-         header.intrinsic.const_indices_encoding = const_indices_8bit;
-      else if (max_bits <= 16)
-         header.intrinsic.const_indices_encoding = const_indices_16bit;
-      else
-         header.intrinsic.const_indices_encoding = const_indices_32bit;
+      } else {
+         header.intrinsic.const_indices_encoding = const_indices_varint;
+      }
    }
 
    if (nir_intrinsic_infos[intrin->intrinsic].has_dest)
       write_dest(ctx, &intrin->dest, header, intrin->instr.type);
    else
-      blob_write_uint32(ctx->blob, header.u32);
+      write_packed_uint32(ctx, header.u32);
 
    for (unsigned i = 0; i < num_srcs; i++)
       write_src(ctx, &intrin->src[i]);
 
-   if (num_indices) {
-      switch (header.intrinsic.const_indices_encoding) {
-      case const_indices_8bit:
-         for (unsigned i = 0; i < num_indices; i++)
-            blob_write_uint8(ctx->blob, intrin->const_index[i]);
-         break;
-      case const_indices_16bit:
-         for (unsigned i = 0; i < num_indices; i++)
-            blob_write_uint16(ctx->blob, intrin->const_index[i]);
-         break;
-      case const_indices_32bit:
-         for (unsigned i = 0; i < num_indices; i++)
-            blob_write_uint32(ctx->blob, intrin->const_index[i]);
-         break;
-      }
+   if (header.intrinsic.const_indices_encoding == const_indices_varint) {
+      for (unsigned i = 0; i < num_indices; i++)
+         blob_write_varint(ctx->blob, intrin->const_index[i]);
    }
 }
 
@@ -1238,17 +1295,9 @@ read_intrinsic(read_ctx *ctx, union packed_instr header)
          }
          break;
       }
-      case const_indices_8bit:
-         for (unsigned i = 0; i < num_indices; i++)
-            intrin->const_index[i] = blob_read_uint8(ctx->blob);
-         break;
-      case const_indices_16bit:
-         for (unsigned i = 0; i < num_indices; i++)
-            intrin->const_index[i] = blob_read_uint16(ctx->blob);
-         break;
-      case const_indices_32bit:
+      case const_indices_varint:
          for (unsigned i = 0; i < num_indices; i++)
-            intrin->const_index[i] = blob_read_uint32(ctx->blob);
+            intrin->const_index[i] = blob_read_varint(ctx->blob);
          break;
       }
    }
@@ -1310,7 +1359,7 @@ write_load_const(write_ctx *ctx, const nir_load_const_instr *lc)
       }
    }
 
-   blob_write_uint32(ctx->blob, header.u32);
+   write_packed_uint32(ctx, header.u32);
 
    if (header.load_const.packing == load_const_full) {
       switch (lc->def.bit_size) {
@@ -1321,12 +1370,12 @@ write_load_const(write_ctx *ctx, const nir_load_const_instr *lc)
 
       case 32:
          for (unsigned i = 0; i < lc->def.num_components; i++)
-            blob_write_uint32(ctx->blob, lc->value[i].u32);
+            blob_write_bytes(ctx->blob, &lc->value[i].u32, sizeof(uint32_t));
          break;
 
       case 16:
          for (unsigned i = 0; i < lc->def.num_components; i++)
-            blob_write_uint16(ctx->blob, lc->value[i].u16);
+            blob_write_bytes(ctx->blob, &lc->value[i].u16, sizeof(uint16_t));
          break;
 
       default:
@@ -1391,12 +1440,12 @@ read_load_const(read_ctx *ctx, union packed_instr header)
 
       case 32:
          for (unsigned i = 0; i < lc->def.num_components; i++)
-            lc->value[i].u32 = blob_read_uint32(ctx->blob);
+            blob_copy_bytes(ctx->blob, &lc->value[i].u32, sizeof(uint32_t));
          break;
 
       case 16:
          for (unsigned i = 0; i < lc->def.num_components; i++)
-            lc->value[i].u16 = blob_read_uint16(ctx->blob);
+            blob_copy_bytes(ctx->blob, &lc->value[i].u16, sizeof(uint16_t));
          break;
 
       default:
@@ -1424,7 +1473,7 @@ write_ssa_undef(write_ctx *ctx, const nir_ssa_undef_instr *undef)
    header.undef.last_component = undef->def.num_components - 1;
    header.undef.bit_size = encode_bit_size_3bits(undef->def.bit_size);
 
-   blob_write_uint32(ctx->blob, header.u32);
+   write_packed_uint32(ctx, header.u32);
    write_add_object(ctx, &undef->def);
 }
 
@@ -1470,8 +1519,8 @@ write_tex(write_ctx *ctx, const nir_tex_instr *tex)
 
    write_dest(ctx, &tex->dest, header, tex->instr.type);
 
-   blob_write_uint32(ctx->blob, tex->texture_index);
-   blob_write_uint32(ctx->blob, tex->sampler_index);
+   blob_write_varint(ctx->blob, tex->texture_index);
+   blob_write_varint(ctx->blob, tex->sampler_index);
    if (tex->op == nir_texop_tg4)
       blob_write_bytes(ctx->blob, tex->tg4_offsets, sizeof(tex->tg4_offsets));
 
@@ -1487,7 +1536,7 @@ write_tex(write_ctx *ctx, const nir_tex_instr *tex)
       .u.texture_non_uniform = tex->texture_non_uniform,
       .u.sampler_non_uniform = tex->sampler_non_uniform,
    };
-   blob_write_uint32(ctx->blob, packed.u32);
+   write_packed_uint32(ctx, packed.u32);
 
    for (unsigned i = 0; i < tex->num_srcs; i++) {
       union packed_src src;
@@ -1505,13 +1554,13 @@ read_tex(read_ctx *ctx, union packed_instr header)
    read_dest(ctx, &tex->dest, &tex->instr, header);
 
    tex->op = header.tex.op;
-   tex->texture_index = blob_read_uint32(ctx->blob);
-   tex->sampler_index = blob_read_uint32(ctx->blob);
+   tex->texture_index = blob_read_varint(ctx->blob);
+   tex->sampler_index = blob_read_varint(ctx->blob);
    if (tex->op == nir_texop_tg4)
       blob_copy_bytes(ctx->blob, tex->tg4_offsets, sizeof(tex->tg4_offsets));
 
    union packed_tex_data packed;
-   packed.u32 = blob_read_uint32(ctx->blob);
+   packed.u32 = read_packed_uint32(ctx);
    tex->sampler_dim = packed.u.sampler_dim;
    tex->dest_type = packed.u.dest_type;
    tex->coord_components = packed.u.coord_components;
@@ -1540,19 +1589,15 @@ write_phi(write_ctx *ctx, const nir_phi_instr *phi)
    header.phi.num_srcs = exec_list_length(&phi->srcs);
 
    /* Phi nodes are special, since they may reference SSA definitions and
-    * basic blocks that don't exist yet. We leave two empty uint32_t's here,
-    * and then store enough information so that a later fixup pass can fill
-    * them in correctly.
+    * basic blocks that don't exist yet. We only remember the sources here,
+    * and write them out at the end of the function_impl, in the same order,
+    * when all of them have an index.
     */
    write_dest(ctx, &phi->dest, header, phi->instr.type);
 
    nir_foreach_phi_src(src, phi) {
       assert(src->src.is_ssa);
-      size_t blob_offset = blob_reserve_uint32(ctx->blob);
-      ASSERTED size_t blob_offset2 = blob_reserve_uint32(ctx->blob);
-      assert(blob_offset + sizeof(uint32_t) == blob_offset2);
       write_phi_fixup fixup = {
-         .blob_offset = blob_offset,
          .src = src->src.ssa,
          .block = src->pred,
       };
@@ -1564,9 +1609,8 @@ static void
 write_fixup_phis(write_ctx *ctx)
 {
    util_dynarray_foreach(&ctx->phi_fixups, write_phi_fixup, fixup) {
-      uint32_t *blob_ptr = (uint32_t *)(ctx->blob->data + fixup->blob_offset);
-      blob_ptr[0] = write_lookup_object(ctx, fixup->src);
-      blob_ptr[1] = write_lookup_object(ctx, fixup->block);
+      write_object(ctx, fixup->src);
+      write_object(ctx, fixup->block);
    }
 
    util_dynarray_clear(&ctx->phi_fixups);
@@ -1579,8 +1623,8 @@ read_phi(read_ctx *ctx, nir_block *blk, union packed_instr header)
 
    read_dest(ctx, &phi->dest, &phi->instr, header);
 
-   /* For similar reasons as before, we just store the index directly into the
-    * pointer, and let a later pass resolve the phi sources.
+   /* For similar reasons as before, we let a later pass read and resolve the
+    * phi sources.
     *
     * In order to ensure that the copied sources (which are just the indices
     * from the blob for now) don't get inserted into the old shader's use-def
@@ -1593,8 +1637,6 @@ read_phi(read_ctx *ctx, nir_block *blk, union packed_instr header)
       nir_phi_src *src = ralloc(phi, nir_phi_src);
 
       src->src.is_ssa = true;
-      src->src.ssa = (nir_ssa_def *)(uintptr_t) blob_read_uint32(ctx->blob);
-      src->pred = (nir_block *)(uintptr_t) blob_read_uint32(ctx->blob);
 
       /* Since we're not letting nir_insert_instr handle use/def stuff for us,
        * we have to set the parent_instr manually.  It doesn't really matter
@@ -1605,7 +1647,7 @@ read_phi(read_ctx *ctx, nir_block *blk, union packed_instr header)
       /* Stash it in the list of phi sources.  We'll walk this list and fix up
        * sources at the very end of read_function_impl.
        */
-      list_add(&src->src.use_link, &ctx->phi_srcs);
+      list_addtail(&src->src.use_link, &ctx->phi_srcs);
 
       exec_list_push_tail(&phi->srcs, &src->node);
    }
@@ -1617,8 +1659,8 @@ static void
 read_fixup_phis(read_ctx *ctx)
 {
    list_for_each_entry_safe(nir_phi_src, src, &ctx->phi_srcs, src.use_link) {
-      src->pred = read_lookup_object(ctx, (uintptr_t)src->pred);
-      src->src.ssa = read_lookup_object(ctx, (uintptr_t)src->src.ssa);
+      src->src.ssa = read_object(ctx);
+      src->pred = read_object(ctx);
 
       /* Remove from this list */
       list_del(&src->src.use_link);
@@ -1639,7 +1681,7 @@ write_jump(write_ctx *ctx, const nir_jump_instr *jmp)
    header.jump.instr_type = jmp->instr.type;
    header.jump.type = jmp->type;
 
-   blob_write_uint32(ctx->blob, header.u32);
+   write_packed_uint32(ctx, header.u32);
 }
 
 static nir_jump_instr *
@@ -1652,7 +1694,7 @@ read_jump(read_ctx *ctx, union packed_instr header)
 static void
 write_call(write_ctx *ctx, const nir_call_instr *call)
 {
-   blob_write_uint32(ctx->blob, write_lookup_object(ctx, call->callee));
+   write_object(ctx, call->callee);
 
    for (unsigned i = 0; i < call->num_params; i++)
       write_src(ctx, &call->params[i]);
@@ -1702,7 +1744,7 @@ write_instr(write_ctx *ctx, const nir_instr *instr)
       write_jump(ctx, nir_instr_as_jump(instr));
       break;
    case nir_instr_type_call:
-      blob_write_uint32(ctx->blob, instr->type);
+      write_packed_uint32(ctx, instr->type);
       write_call(ctx, nir_instr_as_call(instr));
       break;
    case nir_instr_type_parallel_copy:
@@ -1718,7 +1760,7 @@ read_instr(read_ctx *ctx, nir_block *block)
 {
    STATIC_ASSERT(sizeof(union packed_instr) == 4);
    union packed_instr header;
-   header.u32 = blob_read_uint32(ctx->blob);
+   header.u32 = read_packed_uint32(ctx);
    nir_instr *instr;
 
    switch (header.any.instr_type) {
@@ -1769,7 +1811,7 @@ static void
 write_block(write_ctx *ctx, const nir_block *block)
 {
    write_add_object(ctx, block);
-   blob_write_uint32(ctx->blob, exec_list_length(&block->instr_list));
+   blob_write_varint(ctx->blob, exec_list_length(&block->instr_list));
 
    ctx->last_instr_type = ~0;
    ctx->last_alu_header_offset = 0;
@@ -1791,7 +1833,7 @@ read_block(read_ctx *ctx, struct exec_list *cf_list)
       exec_node_data(nir_block, exec_list_get_tail(cf_list), cf_node.node);
 
    read_add_object(ctx, block);
-   unsigned num_instrs = blob_read_uint32(ctx->blob);
+   unsigned num_instrs = blob_read_varint(ctx->blob);
    for (unsigned i = 0; i < num_instrs;) {
       i += read_instr(ctx, block);
    }
@@ -1844,7 +1886,7 @@ read_loop(read_ctx *ctx, struct exec_list *cf_list)
 static void
 write_cf_node(write_ctx *ctx, nir_cf_node *cf)
 {
-   blob_write_uint32(ctx->blob, cf->type);
+   blob_write_uint8(ctx->blob, cf->type);
 
    switch (cf->type) {
    case nir_cf_node_block:
@@ -1864,7 +1906,7 @@ write_cf_node(write_ctx *ctx, nir_cf_node *cf)
 static void
 read_cf_node(read_ctx *ctx, struct exec_list *list)
 {
-   nir_cf_node_type type = blob_read_uint32(ctx->blob);
+   nir_cf_node_type type = blob_read_uint8(ctx->blob);
 
    switch (type) {
    case nir_cf_node_block:
@@ -1884,7 +1926,7 @@ read_cf_node(read_ctx *ctx, struct exec_list *list)
 static void
 write_cf_list(write_ctx *ctx, const struct exec_list *cf_list)
 {
-   blob_write_uint32(ctx->blob, exec_list_length(cf_list));
+   blob_write_varint(ctx->blob, exec_list_length(cf_list));
    foreach_list_typed(nir_cf_node, cf, node, cf_list) {
       write_cf_node(ctx, cf);
    }
@@ -1893,7 +1935,7 @@ write_cf_list(write_ctx *ctx, const struct exec_list *cf_list)
 static void
 read_cf_list(read_ctx *ctx, struct exec_list *cf_list)
 {
-   uint32_t num_cf_nodes = blob_read_uint32(ctx->blob);
+   uint32_t num_cf_nodes = blob_read_varint(ctx->blob);
    for (unsigned i = 0; i < num_cf_nodes; i++)
       read_cf_node(ctx, cf_list);
 }
@@ -1903,7 +1945,7 @@ write_function_impl(write_ctx *ctx, const nir_function_impl *fi)
 {
    write_var_list(ctx, &fi->locals);
    write_reg_list(ctx, &fi->registers);
-   blob_write_uint32(ctx->blob, fi->reg_alloc);
+   blob_write_varint(ctx->blob, fi->reg_alloc);
 
    write_cf_list(ctx, &fi->body);
    write_fixup_phis(ctx);
@@ -1917,7 +1959,7 @@ read_function_impl(read_ctx *ctx, nir_function *fxn)
 
    read_var_list(ctx, &fi->locals);
    read_reg_list(ctx, &fi->registers);
-   fi->reg_alloc = blob_read_uint32(ctx->blob);
+   fi->reg_alloc = blob_read_varint(ctx->blob);
 
    read_cf_list(ctx, &fi->body);
    read_fixup_phis(ctx);
@@ -1935,18 +1977,18 @@ write_function(write_ctx *ctx, const nir_function *fxn)
       flags |= 0x2;
    if (fxn->impl)
       flags |= 0x4;
-   blob_write_uint32(ctx->blob, flags);
+   blob_write_uint8(ctx->blob, flags);
    if (fxn->name)
-      blob_write_string(ctx->blob, fxn->name);
+      write_string(ctx, fxn->name);
 
    write_add_object(ctx, fxn);
 
-   blob_write_uint32(ctx->blob, fxn->num_params);
+   blob_write_varint(ctx->blob, fxn->num_params);
    for (unsigned i = 0; i < fxn->num_params; i++) {
       uint32_t val =
          ((uint32_t)fxn->params[i].num_components) |
          ((uint32_t)fxn->params[i].bit_size) << 8;
-      blob_write_uint32(ctx->blob, val);
+      blob_write_varint(ctx->blob, val);
    }
 
    /* At first glance, it looks like we should write the function_impl here.
@@ -1959,18 +2001,18 @@ write_function(write_ctx *ctx, const nir_function *fxn)
 static void
 read_function(read_ctx *ctx)
 {
-   uint32_t flags = blob_read_uint32(ctx->blob);
+   uint32_t flags = blob_read_uint8(ctx->blob);
    bool has_name = flags & 0x2;
-   char *name = has_name ? blob_read_string(ctx->blob) : NULL;
+   const char *name = has_name ? read_string(ctx) : NULL;
 
    nir_function *fxn = nir_function_create(ctx->nir, name);
 
    read_add_object(ctx, fxn);
 
-   fxn->num_params = blob_read_uint32(ctx->blob);
+   fxn->num_params = blob_read_varint(ctx->blob);
    fxn->params = ralloc_array(fxn, nir_parameter, fxn->num_params);
    for (unsigned i = 0; i < fxn->num_params; i++) {
-      uint32_t val = blob_read_uint32(ctx->blob);
+      uint32_t val = blob_read_varint(ctx->blob);
       fxn->params[i].num_components = val & 0xff;
       fxn->params[i].bit_size = (val >> 8) & 0xff;
    }
@@ -1992,6 +2034,9 @@ nir_serialize(struct blob *blob, const nir_shader *nir, bool strip)
 {
    write_ctx ctx = {0};
    ctx.remap_table = _mesa_pointer_hash_table_create(NULL);
+   ctx.string_table = _mesa_hash_table_create(NULL, _mesa_hash_string,
+                                              _mesa_key_string_equal);
+   ctx.type_table = _mesa_pointer_hash_table_create(NULL);
    ctx.blob = blob;
    ctx.nir = nir;
    ctx.strip = strip;
@@ -2005,23 +2050,23 @@ nir_serialize(struct blob *blob, const nir_shader *nir, bool strip)
       strings |= 0x1;
    if (!strip && info.label)
       strings |= 0x2;
-   blob_write_uint32(blob, strings);
+   blob_write_uint8(blob, strings);
    if (!strip && info.name)
-      blob_write_string(blob, info.name);
+      write_string(&ctx, info.name);
    if (!strip && info.label)
-      blob_write_string(blob, info.label);
+      write_string(&ctx, info.label);
    info.name = info.label = NULL;
    blob_write_bytes(blob, (uint8_t *) &info, sizeof(info));
 
    write_var_list(&ctx, &nir->variables);
 
-   blob_write_uint32(blob, nir->num_inputs);
-   blob_write_uint32(blob, nir->num_uniforms);
-   blob_write_uint32(blob, nir->num_outputs);
-   blob_write_uint32(blob, nir->num_shared);
-   blob_write_uint32(blob, nir->scratch_size);
+   blob_write_varint(blob, nir->num_inputs);
+   blob_write_varint(blob, nir->num_uniforms);
+   blob_write_varint(blob, nir->num_outputs);
+   blob_write_varint(blob, nir->num_shared);
+   blob_write_varint(blob, nir->scratch_size);
 
-   blob_write_uint32(blob, exec_list_length(&nir->functions));
+   blob_write_varint(blob, exec_list_length(&nir->functions));
    nir_foreach_function(fxn, nir) {
       write_function(&ctx, fxn);
    }
@@ -2031,13 +2076,15 @@ nir_serialize(struct blob *blob, const nir_shader *nir, bool strip)
          write_function_impl(&ctx, fxn->impl);
    }
 
-   blob_write_uint32(blob, nir->constant_data_size);
+   blob_write_varint(blob, nir->constant_data_size);
    if (nir->constant_data_size > 0)
       blob_write_bytes(blob, nir->constant_data, nir->constant_data_size);
 
-   *(uint32_t *)(blob->data + idx_size_offset) = ctx.next_idx;
+   blob_overwrite_uint32(blob, idx_size_offset, ctx.next_idx);
 
    _mesa_hash_table_destroy(ctx.remap_table, NULL);
+   _mesa_hash_table_destroy(ctx.string_table, NULL);
+   _mesa_hash_table_destroy(ctx.type_table, NULL);
    util_dynarray_fini(&ctx.phi_fixups);
 }
 
@@ -2049,12 +2096,14 @@ nir_deserialize(void *mem_ctx,
    read_ctx ctx = {0};
    ctx.blob = blob;
    list_inithead(&ctx.phi_srcs);
+   util_dynarray_init(&ctx.strings, NULL);
+   util_dynarray_init(&ctx.types, NULL);
    ctx.idx_table_len = blob_read_uint32(blob);
    ctx.idx_table = calloc(ctx.idx_table_len, sizeof(uintptr_t));
 
-   uint32_t strings = blob_read_uint32(blob);
-   char *name = (strings & 0x1) ? blob_read_string(blob) : NULL;
-   char *label = (strings & 0x2) ? blob_read_string(blob) : NULL;
+   uint32_t strings = blob_read_uint8(blob);
+   const char *name = (strings & 0x1) ? read_string(&ctx) : NULL;
+   const char *label = (strings & 0x2) ? read_string(&ctx) : NULL;
 
    struct shader_info info;
    blob_copy_bytes(blob, (uint8_t *) &info, sizeof(info));
@@ -2068,13 +2117,13 @@ nir_deserialize(void *mem_ctx,
 
    read_var_list(&ctx, &ctx.nir->variables);
 
-   ctx.nir->num_inputs = blob_read_uint32(blob);
-   ctx.nir->num_uniforms = blob_read_uint32(blob);
-   ctx.nir->num_outputs = blob_read_uint32(blob);
-   ctx.nir->num_shared = blob_read_uint32(blob);
-   ctx.nir->scratch_size = blob_read_uint32(blob);
+   ctx.nir->num_inputs = blob_read_varint(blob);
+   ctx.nir->num_uniforms = blob_read_varint(blob);
+   ctx.nir->num_outputs = blob_read_varint(blob);
+   ctx.nir->num_shared = blob_read_varint(blob);
+   ctx.nir->scratch_size = blob_read_varint(blob);
 
-   unsigned num_functions = blob_read_uint32(blob);
+   unsigned num_functions = blob_read_varint(blob);
    for (unsigned i = 0; i < num_functions; i++)
       read_function(&ctx);
 
@@ -2083,7 +2132,7 @@ nir_deserialize(void *mem_ctx,
          fxn->impl = read_function_impl(&ctx, fxn);
    }
 
-   ctx.nir->constant_data_size = blob_read_uint32(blob);
+   ctx.nir->constant_data_size = blob_read_varint(blob);
    if (ctx.nir->constant_data_size > 0) {
       ctx.nir->constant_data =
          ralloc_size(ctx.nir, ctx.nir->constant_data_size);
@@ -2092,6 +2141,8 @@ nir_deserialize(void *mem_ctx,
    }
 
    free(ctx.idx_table);
+   util_dynarray_fini(&ctx.strings);
+   util_dynarray_fini(&ctx.types);
 
    return ctx.nir;
 }
@@ -27,7 +27,9 @@
 
 #include "nir.h"
 #include "c11/threads.h"
+#include "util/u_dynarray.h"
 #include <assert.h>
+#include <stdlib.h>
 
 /*
  * This file checks for invalid IR indicating a bug somewhere in the compiler.
@@ -38,24 +40,46 @@
  */
 #ifndef NDEBUG
 
+/*
+ * The use list of an SSA def, or the use and def lists of a register, copied
+ * to validate_state::use_entries.  Every source (and register destination)
+ * found while walking the impl is looked up in the list of the value it
+ * points to, and at the end we verify that all of the entries were found.
+ * Since the walk visits each source once, that means the lists contain
+ * exactly the sources that point to the value.
+ */
+typedef struct {
+   /* range in validate_state::use_entries */
+   unsigned start, count;
+
+   /* number of entries found while walking the impl */
+   unsigned found;
+
+   /* whether the range has been sorted for binary search */
+   bool sorted;
+
+   /* the instruction defining an SSA def, for error messages */
+   nir_instr *instr;
+} use_list_state;
+
 /*
  * Per-register validation state.
  */
 
 typedef struct {
-   /*
-    * equivalent to the uses and defs in nir_register, but built up by the
-    * validator. At the end, we verify that the sets have the same entries.
-    */
-   struct set *uses, *if_uses, *defs;
-   nir_function_impl *where_defined; /* NULL for global registers */
+   nir_register *reg;
+
+   /* uses, if_uses and defs of the register */
+   use_list_state uses;
 } reg_validate_state;
 
 typedef struct {
    void *mem_ctx;
 
-   /* map of register -> validation state (struct above) */
-   struct hash_table *regs;
+   /* register validation state (struct above), indexed by
+    * nir_register::index
+    */
+   reg_validate_state *regs;
 
    /* the current shader being validated */
    nir_shader *shader;
@@ -81,8 +105,11 @@ typedef struct {
    /* the current function implementation being validated */
    nir_function_impl *impl;
 
-   /* Set of seen SSA sources */
-   struct set *ssa_srcs;
+   /* use lists of the SSA defs, indexed by nir_ssa_def::index */
+   use_list_state *ssa_uses;
+
+   /* entries of the use lists, see use_list_state */
+   struct util_dynarray use_entries;
 
    /* bitset of ssa definitions we have found; used to check uniqueness */
    BITSET_WORD *ssa_defs_found;
@@ -125,6 +152,79 @@ log_error(validate_state *state, const char *cond, const char *file, int line)
 static void validate_src(nir_src *src, validate_state *state,
                          unsigned bit_sizes, unsigned num_components);
 
+#define SET_PTR_BIT(ptr, bit) \
+   (void *)(((uintptr_t)(ptr)) | (((uintptr_t)1) << bit))
+
+static int
+compare_use_entries(const void *_a, const void *_b)
+{
+   uintptr_t a = *(const uintptr_t *)_a;
+   uintptr_t b = *(const uintptr_t *)_b;
+
+   return (a > b) - (a < b);
+}
+
+/* Starts a new use list at the end of use_entries. */
+static void
+begin_use_list(validate_state *state, use_list_state *list, nir_instr *instr)
+{
+   list->start = util_dynarray_num_elements(&state->use_entries, void *);
+   list->count = 0;
+   list->found = 0;
+   list->sorted = false;
+   list->instr = instr;
+}
+
+static void
+add_use_entry(validate_state *state, use_list_state *list, void *entry)
+{
+   util_dynarray_append(&state->use_entries, void *, entry);
+   list->count++;
+}
+
+/* Looks up entry in the list and counts it as found.  Most values have only a
+ * few uses, which are searched linearly.  Longer lists are sorted on the
+ * first lookup.
+ */
+static bool
+find_use(validate_state *state, use_list_state *list, void *entry)
+{
+   void **entries =
+      util_dynarray_element(&state->use_entries, void *, list->start);
+   bool found = false;
+
+   if (list->count <= 8) {
+      for (unsigned i = 0; i < list->count; i++) {
+         if (entries[i] == entry) {
+            found = true;
+            break;
+         }
+      }
+   } else {
+      if (!list->sorted) {
+         qsort(entries, list->count, sizeof(*entries), compare_use_entries);
+         list->sorted = true;
+      }
+      found = bsearch(&entry, entries, list->count, sizeof(*entries),
+                      compare_use_entries) != NULL;
+   }
+
+   if (found)
+      list->found++;
+
+   return found;
+}
+
+static reg_validate_state *
+get_reg_state(validate_state *state, nir_register *reg)
+{
+   if (reg->index >= state->impl->reg_alloc ||
+       state->regs[reg->index].reg != reg)
+      return NULL;
+
+   return &state->regs[reg->index];
+}
+
 static void
 validate_num_components(validate_state *state, unsigned num_components)
 {
@@ -136,22 +236,21 @@ validate_reg_src(nir_src *src, validate_state *state,
                  unsigned bit_sizes, unsigned num_components)
 {
    validate_assert(state, src->reg.reg != NULL);
+   if (src->reg.reg == NULL)
+      return;
 
-   struct hash_entry *entry;
-   entry = _mesa_hash_table_search(state->regs, src->reg.reg);
-   validate_assert(state, entry);
-
-   reg_validate_state *reg_state = (reg_validate_state *) entry->data;
+   reg_validate_state *reg_state = get_reg_state(state, src->reg.reg);
+   validate_assert(state, reg_state != NULL &&
+          "using a register declared in a different function");
 
-   if (state->instr) {
-      _mesa_set_add(reg_state->uses, src);
-   } else {
+   if (!state->instr)
       validate_assert(state, state->if_stmt);
-      _mesa_set_add(reg_state->if_uses, src);
-   }
 
-   validate_assert(state, reg_state->where_defined == state->impl &&
-          "using a register declared in a different function");
+   if (reg_state != NULL) {
+      validate_assert(state,
+         find_use(state, &reg_state->uses,
+                  state->instr ? (void *)src : SET_PTR_BIT(src, 0)));
+   }
 
    if (bit_sizes)
       validate_assert(state, src->reg.reg->bit_size & bit_sizes);
@@ -171,29 +270,25 @@ validate_reg_src(nir_src *src, validate_state *state,
    }
 }
 
-#define SET_PTR_BIT(ptr, bit) \
-   (void *)(((uintptr_t)(ptr)) | (((uintptr_t)1) << bit))
-
 static void
 validate_ssa_src(nir_src *src, validate_state *state,
                  unsigned bit_sizes, unsigned num_components)
 {
    validate_assert(state, src->ssa != NULL);
+   if (src->ssa == NULL)
+      return;
 
-   /* As we walk SSA defs, we add every use to this set.  We need to make sure
-    * our use is seen in a use list.
+   /* As we walk SSA defs, we record their use lists.  We need to make sure
+    * our use is seen in the use list of a def we already walked.
     */
-   struct set_entry *entry;
-   if (state->instr) {
-      entry = _mesa_set_search(state->ssa_srcs, src);
+   const unsigned index = src->ssa->index;
+   if (index < state->impl->ssa_alloc &&
+       BITSET_TEST(state->ssa_defs_found, index)) {
+      void *entry = state->instr ? (void *)src : SET_PTR_BIT(src, 0);
+      validate_assert(state, find_use(state, &state->ssa_uses[index], entry));
    } else {
-      entry = _mesa_set_search(state->ssa_srcs, SET_PTR_BIT(src, 0));
+      validate_assert(state, !"SSA source whose definition wasn't seen yet");
    }
-   validate_assert(state, entry);
-
-   /* This will let us prove that we've seen all the sources */
-   if (entry)
-      _mesa_set_remove(state->ssa_srcs, entry);
 
    if (bit_sizes)
       validate_assert(state, src->ssa->bit_size & bit_sizes);
@@ -245,17 +340,16 @@ validate_reg_dest(nir_reg_dest *dest, validate_state *state,
 
    validate_assert(state, dest->parent_instr == state->instr);
 
-   struct hash_entry *entry2;
-   entry2 = _mesa_hash_table_search(state->regs, dest->reg);
-
-   validate_assert(state, entry2);
-
-   reg_validate_state *reg_state = (reg_validate_state *) entry2->data;
-   _mesa_set_add(reg_state->defs, dest);
+   if (dest->reg == NULL)
+      return;
 
-   validate_assert(state, reg_state->where_defined == state->impl &&
+   reg_validate_state *reg_state = get_reg_state(state, dest->reg);
+   validate_assert(state, reg_state != NULL &&
           "writing to a register declared in a different function");
 
+   if (reg_state != NULL)
+      validate_assert(state, find_use(state, &reg_state->uses, dest));
+
    if (bit_sizes)
       validate_assert(state, dest->reg->bit_size & bit_sizes);
    if (num_components)
@@ -277,31 +371,34 @@ static void
 validate_ssa_def(nir_ssa_def *def, validate_state *state)
 {
    validate_assert(state, def->index < state->impl->ssa_alloc);
+   if (def->index >= state->impl->ssa_alloc)
+      return;
+
    validate_assert(state, !BITSET_TEST(state->ssa_defs_found, def->index));
    BITSET_SET(state->ssa_defs_found, def->index);
 
    validate_assert(state, def->parent_instr == state->instr);
    validate_num_components(state, def->num_components);
 
+   /* A nir_src should only appear once and only in one SSA def use list.
+    * Each source is only found once while walking the impl, so an entry
+    * appearing twice is caught by the found == count check at the end.
+    */
+   use_list_state *uses = &state->ssa_uses[def->index];
+   begin_use_list(state, uses, state->instr);
+
    list_validate(&def->uses);
    nir_foreach_use(src, def) {
       validate_assert(state, src->is_ssa);
       validate_assert(state, src->ssa == def);
-      bool already_seen = false;
-      _mesa_set_search_and_add(state->ssa_srcs, src, &already_seen);
-      /* A nir_src should only appear once and only in one SSA def use list */
-      validate_assert(state, !already_seen);
+      add_use_entry(state, uses, src);
    }
 
    list_validate(&def->if_uses);
    nir_foreach_if_use(src, def) {
       validate_assert(state, src->is_ssa);
       validate_assert(state, src->ssa == def);
-      bool already_seen = false;
-      _mesa_set_search_and_add(state->ssa_srcs, SET_PTR_BIT(src, 0),
-                               &already_seen);
-      /* A nir_src should only appear once and only in one SSA def use list */
-      validate_assert(state, !already_seen);
+      add_use_entry(state, uses, SET_PTR_BIT(src, 0));
    }
 }
 
@@ -1064,50 +1161,37 @@ prevalidate_reg_decl(nir_register *reg, validate_state *state)
    validate_assert(state, reg->index < state->impl->reg_alloc);
    validate_assert(state, !BITSET_TEST(state->regs_found, reg->index));
    validate_num_components(state, reg->num_components);
+   if (reg->index >= state->impl->reg_alloc ||
+       BITSET_TEST(state->regs_found, reg->index))
+      return;
+
    BITSET_SET(state->regs_found, reg->index);
 
    list_validate(&reg->uses);
    list_validate(&reg->defs);
    list_validate(&reg->if_uses);
 
-   reg_validate_state *reg_state = ralloc(state->regs, reg_validate_state);
-   reg_state->uses = _mesa_pointer_set_create(reg_state);
-   reg_state->if_uses = _mesa_pointer_set_create(reg_state);
-   reg_state->defs = _mesa_pointer_set_create(reg_state);
-
-   reg_state->where_defined = state->impl;
+   reg_validate_state *reg_state = &state->regs[reg->index];
+   reg_state->reg = reg;
+   begin_use_list(state, &reg_state->uses, NULL);
 
-   _mesa_hash_table_insert(state->regs, reg, reg_state);
+   nir_foreach_use(src, reg)
+      add_use_entry(state, &reg_state->uses, src);
+   nir_foreach_if_use(src, reg)
+      add_use_entry(state, &reg_state->uses, SET_PTR_BIT(src, 0));
+   nir_foreach_def(dest, reg)
+      add_use_entry(state, &reg_state->uses, dest);
 }
 
 static void
 postvalidate_reg_decl(nir_register *reg, validate_state *state)
 {
-   struct hash_entry *entry = _mesa_hash_table_search(state->regs, reg);
-
-   assume(entry);
-   reg_validate_state *reg_state = (reg_validate_state *) entry->data;
-
-   nir_foreach_use(src, reg) {
-      struct set_entry *entry = _mesa_set_search(reg_state->uses, src);
-      validate_assert(state, entry);
-      _mesa_set_remove(reg_state->uses, entry);
-   }
-   validate_assert(state, reg_state->uses->entries == 0);
-
-   nir_foreach_if_use(src, reg) {
-      struct set_entry *entry = _mesa_set_search(reg_state->if_uses, src);
-      validate_assert(state, entry);
-      _mesa_set_remove(reg_state->if_uses, entry);
-   }
-   validate_assert(state, reg_state->if_uses->entries == 0);
+   reg_validate_state *reg_state = get_reg_state(state, reg);
+   if (reg_state == NULL)
+      return;
 
-   nir_foreach_def(src, reg) {
-      struct set_entry *entry = _mesa_set_search(reg_state->defs, src);
-      validate_assert(state, entry);
-      _mesa_set_remove(reg_state->defs, entry);
-   }
-   validate_assert(state, reg_state->defs->entries == 0);
+   /* Every use and def in the register's lists was found in the impl. */
+   validate_assert(state, reg_state->uses.found == reg_state->uses.count);
 }
 
 static void
@@ -1158,15 +1242,6 @@ validate_var_decl(nir_variable *var, nir_variable_mode valid_modes,
 static void
 validate_function_impl(nir_function_impl *impl, validate_state *state)
 {
-   /* Resize the ssa_srcs set.  It's likely that the size of this set will
-    * never actually hit the number of SSA defs because we remove sources from
-    * the set as we visit them.  (It could actually be much larger because
-    * each SSA def can be used more than once.)  However, growing it now costs
-    * us very little (the extra memory is already dwarfed by the SSA defs
-    * themselves) and makes collisions much less likely.
-    */
-   _mesa_set_resize(state->ssa_srcs, impl->ssa_alloc);
-
    validate_assert(state, impl->function->impl == impl);
    validate_assert(state, impl->cf_node.parent == NULL);
 
@@ -1186,6 +1261,10 @@ validate_function_impl(nir_function_impl *impl, validate_state *state)
                                 BITSET_WORD, BITSET_WORDS(impl->reg_alloc));
    memset(state->regs_found, 0, BITSET_WORDS(impl->reg_alloc) *
                                 sizeof(BITSET_WORD));
+   state->regs = reralloc(state->mem_ctx, state->regs,
+                          reg_validate_state, impl->reg_alloc);
+   memset(state->regs, 0, impl->reg_alloc * sizeof(*state->regs));
+   util_dynarray_clear(&state->use_entries);
    exec_list_validate(&impl->registers);
    foreach_list_typed(nir_register, reg, node, &impl->registers) {
       prevalidate_reg_decl(reg, state);
@@ -1195,6 +1274,8 @@ validate_function_impl(nir_function_impl *impl, validate_state *state)
                                     BITSET_WORD, BITSET_WORDS(impl->ssa_alloc));
    memset(state->ssa_defs_found, 0, BITSET_WORDS(impl->ssa_alloc) *
                                     sizeof(BITSET_WORD));
+   state->ssa_uses = reralloc(state->mem_ctx, state->ssa_uses,
+                              use_list_state, impl->ssa_alloc);
    exec_list_validate(&impl->body);
    foreach_list_typed(nir_cf_node, node, node, &impl->body) {
       validate_cf_node(node, state);
@@ -1204,8 +1285,16 @@ validate_function_impl(nir_function_impl *impl, validate_state *state)
       postvalidate_reg_decl(reg, state);
    }
 
-   validate_assert(state, state->ssa_srcs->entries == 0);
-   _mesa_set_clear(state->ssa_srcs, NULL);
+   /* Every use in the use lists was found in the impl. */
+   for (unsigned i = 0; i < impl->ssa_alloc; i++) {
+      if (!BITSET_TEST(state->ssa_defs_found, i))
+         continue;
+
+      state->instr = state->ssa_uses[i].instr;
+      validate_assert(state, state->ssa_uses[i].found ==
+                             state->ssa_uses[i].count);
+   }
+   state->instr = NULL;
 }
 
 static void
@@ -1213,7 +1302,12 @@ validate_function(nir_function *func, validate_state *state)
 {
    if (func->impl != NULL) {
       validate_assert(state, func->impl->function == func);
-      validate_function_impl(func->impl, state);
+
+      /* Impls that didn't change since they were last validated are still
+       * valid.
+       */
+      if (func->impl->validated_change_count != func->impl->change_count)
+         validate_function_impl(func->impl, state);
    }
 }
 
@@ -1221,8 +1315,9 @@ static void
 init_validate_state(validate_state *state)
 {
    state->mem_ctx = ralloc_context(NULL);
-   state->regs = _mesa_pointer_hash_table_create(state->mem_ctx);
-   state->ssa_srcs = _mesa_pointer_set_create(state->mem_ctx);
+   state->regs = NULL;
+   state->ssa_uses = NULL;
+   util_dynarray_init(&state->use_entries, state->mem_ctx);
    state->ssa_defs_found = NULL;
    state->regs_found = NULL;
    state->var_defs = _mesa_pointer_hash_table_create(state->mem_ctx);
@@ -1310,6 +1405,11 @@ nir_validate_shader(nir_shader *shader, const char *when)
    if (_mesa_hash_table_num_entries(state.errors) > 0)
       dump_errors(&state, when);
 
+   nir_foreach_function(func, shader) {
+      if (func->impl)
+         func->impl->validated_change_count = func->impl->change_count;
+   }
+
    destroy_validate_state(&state);
 }
 
@@ -0,0 +1,495 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Times nir_opt_algebraic() in a typical optimization loop.
+ *
+ * Each shader is optimized twice: once forgetting the state that
+ * nir_algebraic_impl() keeps between calls, so that every call visits every
+ * instruction, and once incrementally.  The results are checked to be
+ * identical.
+ *
+ * Without arguments, fragment shaders of random ALU code with some control
+ * flow are generated.  Otherwise each file is read as a shader written by
+ * nir_serialize(), like the ones drivers store in the shader cache.  With
+ * -w, the generated shaders are written to files in this format.
+ *
+ * The times are the minimum of a few runs.
+ *
+ * Usage: algebraic_bench [-w] [-s scale] [-r runs] [file...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nir.h"
+#include "nir_builder.h"
+#include "nir_search.h"
+#include "nir_serialize.h"
+#include "util/blob.h"
+#include "util/os_file.h"
+#include "util/os_time.h"
+
+static const nir_shader_compiler_options options = {
+   .lower_fdiv = true,
+   .lower_flrp32 = true,
+   .lower_flrp64 = true,
+   .lower_fpow = true,
+   .lower_fsat = false,
+   .lower_sub = true,
+   .lower_scmp = true,
+   .lower_ldexp = true,
+   .fuse_ffma = true,
+};
+
+#define WINDOW 48
+
+struct gen {
+   nir_builder *b;
+   nir_ssa_def *f[WINDOW];
+   nir_ssa_def *i[WINDOW];
+   unsigned num_f, num_i;
+};
+
+static nir_ssa_def *
+pick(nir_ssa_def **pool, unsigned count)
+{
+   unsigned n = MIN2(count, WINDOW);
+
+   /* Mostly use recent values, like real code does. */
+   if (rand() % 4)
+      n = MIN2(n, 8);
+
+   return pool[(count - 1 - rand() % n) % WINDOW];
+}
+
+static nir_ssa_def *
+pick_f(struct gen *g)
+{
+   return pick(g->f, g->num_f);
+}
+
+static nir_ssa_def *
+pick_i(struct gen *g)
+{
+   return pick(g->i, g->num_i);
+}
+
+static void
+push_f(struct gen *g, nir_ssa_def *def)
+{
+   g->f[g->num_f++ % WINDOW] = def;
+}
+
+static void
+push_i(struct gen *g, nir_ssa_def *def)
+{
+   g->i[g->num_i++ % WINDOW] = def;
+}
+
+static nir_ssa_def *
+imm_f(struct gen *g)
+{
+   static const float values[] = { 0.0f, 1.0f, -1.0f, 2.0f, 0.5f, 4.0f, 3.0f };
+   return nir_imm_float(g->b, values[rand() % ARRAY_SIZE(values)]);
+}
+
+static nir_ssa_def *
+imm_i(struct gen *g)
+{
+   static const int values[] = { 0, 1, -1, 2, 4, 8, 16, 31, 0xff, 0xffff };
+   return nir_imm_int(g->b, values[rand() % ARRAY_SIZE(values)]);
+}
+
+static void
+gen_float_op(struct gen *g)
+{
+   nir_builder *b = g->b;
+   nir_ssa_def *a = pick_f(g), *v;
+
+   switch (rand() % 20) {
+   case 0: case 1: v = nir_fadd(b, a, pick_f(g)); break;
+   case 2: case 3: v = nir_fmul(b, a, pick_f(g)); break;
+   case 4: v = nir_ffma(b, a, pick_f(g), pick_f(g)); break;
+   case 5: v = nir_fadd(b, a, imm_f(g)); break;
+   case 6: v = nir_fmul(b, a, imm_f(g)); break;
+   case 7: v = nir_fneg(b, a); break;
+   case 8: v = nir_fabs(b, a); break;
+   case 9: v = nir_fsat(b, a); break;
+   case 10: v = nir_fmin(b, a, imm_f(g)); break;
+   case 11: v = nir_fmax(b, a, pick_f(g)); break;
+   case 12: v = nir_fsub(b, a, pick_f(g)); break;
+   case 13: v = nir_frcp(b, a); break;
+   case 14: v = nir_frsq(b, nir_fabs(b, a)); break;
+   case 15:
+      v = nir_bcsel(b, nir_flt(b, a, pick_f(g)), pick_f(g), imm_f(g));
+      break;
+   case 16: v = nir_b2f32(b, nir_fge(b, a, imm_f(g))); break;
+   case 17: v = nir_i2f32(b, pick_i(g)); break;
+   case 18: v = nir_fexp2(b, nir_fmul(b, nir_flog2(b, a), imm_f(g))); break;
+   default: v = nir_fneg(b, nir_fmul(b, nir_fneg(b, a), pick_f(g))); break;
+   }
+
+   push_f(g, v);
+}
+
+static void
+gen_int_op(struct gen *g)
+{
+   nir_builder *b = g->b;
+   nir_ssa_def *a = pick_i(g), *v;
+
+   switch (rand() % 14) {
+   case 0: case 1: v = nir_iadd(b, a, pick_i(g)); break;
+   case 2: v = nir_imul(b, a, imm_i(g)); break;
+   case 3: v = nir_ishl(b, a, imm_i(g)); break;
+   case 4: v = nir_ushr(b, a, imm_i(g)); break;
+   case 5: v = nir_iand(b, a, imm_i(g)); break;
+   case 6: v = nir_ior(b, a, pick_i(g)); break;
+   case 7: v = nir_ixor(b, a, pick_i(g)); break;
+   case 8: v = nir_ineg(b, a); break;
+   case 9: v = nir_inot(b, a); break;
+   case 10: v = nir_f2i32(b, pick_f(g)); break;
+   case 11: v = nir_iadd(b, a, imm_i(g)); break;
+   case 12:
+      v = nir_bcsel(b, nir_ieq(b, a, imm_i(g)), pick_i(g), a);
+      break;
+   default: v = nir_ishl(b, nir_ushr(b, a, imm_i(g)), imm_i(g)); break;
+   }
+
+   push_i(g, v);
+}
+
+static void
+gen_ops(struct gen *g, unsigned count, unsigned depth)
+{
+   for (unsigned n = 0; n < count; n++) {
+      if (depth < 3 && count > 16 && rand() % 32 == 0) {
+         nir_builder *b = g->b;
+         struct gen saved = *g, then_g;
+         unsigned arm = 1 + rand() % MIN2(count / 4, 64);
+
+         nir_push_if(b, nir_flt(b, pick_f(g), pick_f(g)));
+         gen_ops(g, arm, depth + 1);
+         then_g = *g;
+         *g = saved;
+
+         nir_push_else(b, NULL);
+         gen_ops(g, arm, depth + 1);
+         nir_pop_if(b, NULL);
+
+         /* Merge the most recent values of both sides. */
+         for (unsigned i = 0; i < 4; i++) {
+            nir_ssa_def *then_f = then_g.f[(then_g.num_f - 1 - i) % WINDOW];
+            nir_ssa_def *else_f = g->f[(g->num_f - 1 - i) % WINDOW];
+            nir_ssa_def *then_i = then_g.i[(then_g.num_i - 1 - i) % WINDOW];
+            nir_ssa_def *else_i = g->i[(g->num_i - 1 - i) % WINDOW];
+
+            saved.f[saved.num_f++ % WINDOW] = nir_if_phi(b, then_f, else_f);
+            if (i < 2)
+               saved.i[saved.num_i++ % WINDOW] = nir_if_phi(b, then_i, else_i);
+         }
+
+         *g = saved;
+         n += 2 * arm;
+      } else if (rand() % 3) {
+         gen_float_op(g);
+      } else {
+         gen_int_op(g);
+      }
+   }
+}
+
+static nir_shader *
+create_shader(unsigned num_ops, unsigned seed)
+{
+   nir_builder b;
+   struct gen g = { .b = &b };
+
+   nir_builder_init_simple_shader(&b, NULL, MESA_SHADER_FRAGMENT, &options);
+   srand(seed);
+
+   for (unsigned n = 0; n < 4; n++) {
+      nir_variable *in =
+         nir_variable_create(b.shader, nir_var_shader_in,
+                             n < 3 ? glsl_vec4_type() :
+                                     glsl_vector_type(GLSL_TYPE_INT, 4),
+                             "in");
+      in->data.location = VARYING_SLOT_VAR0 + n;
+      in->data.driver_location = n;
+
+      nir_ssa_def *v = nir_load_var(&b, in);
+      for (unsigned c = 0; c < 4; c++) {
+         if (n < 3)
+            push_f(&g, nir_channel(&b, v, c));
+         else
+            push_i(&g, nir_channel(&b, v, c));
+      }
+   }
+
+   gen_ops(&g, num_ops, 0);
+
+   /* Write everything that is still in the window, so that most of the
+    * code is live.
+    */
+   for (unsigned n = 0; n < WINDOW / 4; n++) {
+      nir_variable *out =
+         nir_variable_create(b.shader, nir_var_shader_out,
+                             glsl_vec4_type(), "out");
+      out->data.location = FRAG_RESULT_DATA0 + n;
+      out->data.driver_location = n;
+
+      nir_ssa_def *c[4];
+      for (unsigned i = 0; i < 4; i++) {
+         c[i] = g.f[(n * 4 + i) % WINDOW];
+         if (i == 3)
+            c[i] = nir_fadd(&b, c[i], nir_i2f32(&b, g.i[n % WINDOW]));
+      }
+      nir_store_var(&b, out, nir_vec(&b, c, 4), 0xf);
+   }
+
+   return b.shader;
+}
+
+struct stats {
+   int64_t algebraic_time;
+   int64_t total_time;
+   unsigned algebraic_calls;
+};
+
+static bool
+run_algebraic(nir_shader *s, bool (*pass)(nir_shader *), bool incremental,
+              struct stats *stats)
+{
+   if (!incremental) {
+      nir_foreach_function(function, s) {
+         if (function->impl)
+            nir_algebraic_impl_reset(function->impl);
+      }
+   }
+
+   int64_t start = os_time_get_nano();
+   bool progress = pass(s);
+   stats->algebraic_time += os_time_get_nano() - start;
+   stats->algebraic_calls++;
+   return progress;
+}
+
+/* Roughly what the state tracker and most drivers do. */
+static void
+optimize(nir_shader *s, bool incremental, struct stats *stats)
+{
+   int64_t start = os_time_get_nano();
+   bool progress;
+
+   do {
+      progress = false;
+      progress |= nir_copy_prop(s);
+      progress |= nir_opt_remove_phis(s);
+      progress |= nir_opt_dce(s);
+      progress |= nir_opt_dead_cf(s);
+      progress |= nir_opt_cse(s);
+      progress |= nir_opt_peephole_select(s, 8, true, true);
+      progress |= run_algebraic(s, nir_opt_algebraic, incremental, stats);
+      progress |= nir_opt_constant_folding(s);
+      progress |= nir_opt_undef(s);
+   } while (progress);
+
+   do {
+      progress = false;
+      progress |= run_algebraic(s, nir_opt_algebraic_late, incremental, stats);
+      progress |= nir_opt_constant_folding(s);
+      progress |= nir_copy_prop(s);
+      progress |= nir_opt_dce(s);
+      progress |= nir_opt_cse(s);
+   } while (progress);
+
+   stats->total_time += os_time_get_nano() - start;
+}
+
+static unsigned
+count_instrs(nir_shader *s)
+{
+   unsigned count = 0;
+
+   nir_foreach_function(function, s) {
+      if (!function->impl)
+         continue;
+
+      nir_foreach_block(block, function->impl) {
+         nir_foreach_instr(instr, block)
+            count++;
+      }
+   }
+
+   return count;
+}
+
+static unsigned num_runs = 5;
+
+static nir_shader *
+optimize_best_of(nir_shader *s, bool incremental, struct stats *best)
+{
+   nir_shader *result = NULL;
+
+   for (unsigned i = 0; i < num_runs; i++) {
+      nir_shader *clone = nir_shader_clone(NULL, s);
+      struct stats stats = {0};
+
+      optimize(clone, incremental, &stats);
+
+      if (!result || stats.algebraic_time < best->algebraic_time)
+         best->algebraic_time = stats.algebraic_time;
+      if (!result || stats.total_time < best->total_time)
+         best->total_time = stats.total_time;
+      best->algebraic_calls = stats.algebraic_calls;
+
+      ralloc_free(result);
+      result = clone;
+   }
+
+   return result;
+}
+
+static void
+run(const char *name, nir_shader *s)
+{
+   struct stats full_stats = {0}, incremental_stats = {0};
+   unsigned num_instrs = count_instrs(s);
+
+   nir_shader *full = optimize_best_of(s, false, &full_stats);
+   nir_shader *incremental = optimize_best_of(s, true, &incremental_stats);
+
+   struct blob a, b;
+   blob_init(&a);
+   blob_init(&b);
+   nir_serialize(&a, full, false);
+   nir_serialize(&b, incremental, false);
+   bool same = a.size == b.size && memcmp(a.data, b.data, a.size) == 0;
+   blob_finish(&a);
+   blob_finish(&b);
+
+   printf("%-24s %6u -> %6u instrs  %3u calls  "
+          "algebraic %8.2f -> %8.2f ms  loop %8.2f -> %8.2f ms  %s\n",
+          name, num_instrs, count_instrs(full),
+          full_stats.algebraic_calls,
+          full_stats.algebraic_time / 1e6,
+          incremental_stats.algebraic_time / 1e6,
+          full_stats.total_time / 1e6,
+          incremental_stats.total_time / 1e6,
+          same ? "same" : "DIFFERENT");
+
+   ralloc_free(full);
+   ralloc_free(incremental);
+}
+
+static void
+write_shader(const char *filename, nir_shader *s)
+{
+   struct blob blob;
+   FILE *f = fopen(filename, "wb");
+
+   if (!f) {
+      fprintf(stderr, "Couldn't open %s\n", filename);
+      return;
+   }
+
+   blob_init(&blob);
+   nir_serialize(&blob, s, false);
+   fwrite(blob.data, 1, blob.size, f);
+   blob_finish(&blob);
+   fclose(f);
+}
+
+static void
+replay(const char *filename)
+{
+   size_t size;
+   char *data = os_read_file(filename, &size);
+   struct blob_reader blob;
+
+   if (!data) {
+      fprintf(stderr, "Couldn't read %s\n", filename);
+      return;
+   }
+
+   blob_reader_init(&blob, data, size);
+   nir_shader *s = nir_deserialize(NULL, &options, &blob);
+
+   if (blob.overrun) {
+      fprintf(stderr, "%s is not a valid shader\n", filename);
+   } else {
+      run(filename, s);
+   }
+
+   ralloc_free(s);
+   free(data);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned scale = 1;
+   bool write = false;
+   int i;
+
+   for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+      if (strcmp(argv[i], "-w") == 0)
+         write = true;
+      else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+         scale = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+         num_runs = atoi(argv[++i]);
+   }
+
+   num_runs = MAX2(num_runs, 1);
+
+   glsl_type_singleton_init_or_ref();
+
+   if (i < argc) {
+      for (; i < argc; i++)
+         replay(argv[i]);
+   } else {
+      static const unsigned sizes[] = { 200, 1000, 1000, 5000, 5000, 20000 };
+
+      for (unsigned j = 0; j < ARRAY_SIZE(sizes); j++) {
+         unsigned num_ops = sizes[j] * scale;
+         nir_shader *s = create_shader(num_ops, j);
+         char name[64];
+
+         snprintf(name, sizeof(name), "%u ops, seed %u", num_ops, j);
+
+         if (write) {
+            char filename[64];
+            snprintf(filename, sizeof(filename), "algebraic_%u.nir", j);
+            write_shader(filename, s);
+         }
+
+         run(name, s);
+         ralloc_free(s);
+      }
+   }
+
+   glsl_type_singleton_decref();
+   return 0;
+}
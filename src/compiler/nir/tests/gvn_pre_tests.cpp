@@ -0,0 +1,208 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include "nir.h"
+#include "nir_builder.h"
+
+class nir_opt_gvn_pre_test : public ::testing::Test {
+protected:
+   nir_opt_gvn_pre_test();
+   ~nir_opt_gvn_pre_test();
+
+   unsigned count_alu(nir_block *block, nir_op op);
+
+   nir_builder bld;
+
+   nir_ssa_def *in_def;
+   nir_variable *out_var;
+};
+
+nir_opt_gvn_pre_test::nir_opt_gvn_pre_test()
+{
+   glsl_type_singleton_init_or_ref();
+
+   static const nir_shader_compiler_options options = { };
+   nir_builder_init_simple_shader(&bld, NULL, MESA_SHADER_FRAGMENT, &options);
+
+   nir_variable *var = nir_variable_create(bld.shader, nir_var_shader_in, glsl_int_type(), "in");
+   in_def = nir_load_var(&bld, var);
+
+   out_var = nir_variable_create(bld.shader, nir_var_shader_out, glsl_int_type(), "out");
+}
+
+nir_opt_gvn_pre_test::~nir_opt_gvn_pre_test()
+{
+   ralloc_free(bld.shader);
+   glsl_type_singleton_decref();
+}
+
+unsigned
+nir_opt_gvn_pre_test::count_alu(nir_block *block, nir_op op)
+{
+   unsigned count = 0;
+   nir_foreach_instr(instr, block) {
+      if (instr->type == nir_instr_type_alu &&
+          nir_instr_as_alu(instr)->op == op)
+         count++;
+   }
+   return count;
+}
+
+TEST_F(nir_opt_gvn_pre_test, hoist_from_both_arms)
+{
+   /* The address-like chain in both arms is hoisted in front of the if:
+    *
+    * if (in == 0) {
+    *    out = in * 3 + 1;
+    * } else {
+    *    out = (in * 3 + 1) << 2;
+    * }
+    */
+   nir_ssa_def *cond = nir_ieq(&bld, in_def, nir_imm_int(&bld, 0));
+   nir_block *before = nir_cursor_current_block(bld.cursor);
+
+   nir_if *nif = nir_push_if(&bld, cond);
+   nir_ssa_def *a = nir_iadd(&bld, nir_imul(&bld, in_def, nir_imm_int(&bld, 3)),
+                             nir_imm_int(&bld, 1));
+   nir_store_var(&bld, out_var, a, 1);
+   nir_push_else(&bld, nif);
+   nir_ssa_def *b = nir_iadd(&bld, nir_imul(&bld, in_def, nir_imm_int(&bld, 3)),
+                             nir_imm_int(&bld, 1));
+   nir_store_var(&bld, out_var, nir_ishl(&bld, b, nir_imm_int(&bld, 2)), 1);
+   nir_pop_if(&bld, nif);
+
+   nir_validate_shader(bld.shader, NULL);
+
+   ASSERT_TRUE(nir_opt_gvn_pre(bld.shader));
+   nir_validate_shader(bld.shader, NULL);
+
+   EXPECT_EQ(count_alu(before, nir_op_imul), 1);
+   EXPECT_EQ(count_alu(before, nir_op_iadd), 1);
+   EXPECT_EQ(count_alu(nir_if_first_then_block(nif), nir_op_imul), 0);
+   EXPECT_EQ(count_alu(nir_if_first_else_block(nif), nir_op_imul), 0);
+   EXPECT_EQ(count_alu(nir_if_first_else_block(nif), nir_op_iadd), 0);
+   EXPECT_EQ(count_alu(nir_if_first_else_block(nif), nir_op_ishl), 1);
+
+   EXPECT_FALSE(nir_opt_gvn_pre(bld.shader));
+}
+
+TEST_F(nir_opt_gvn_pre_test, partially_redundant_after_if)
+{
+   /* The multiplication after the if is redundant on the then path.  It is
+    * moved to the end of the else arm and merged with a phi:
+    *
+    * if (in == 0) {
+    *    out = in * 5;
+    * } else {
+    *    if (in == 1)
+    *       out = 1;
+    * }
+    * out = in * 5;
+    */
+   nir_ssa_def *five = nir_imm_int(&bld, 5);
+   nir_ssa_def *cond = nir_ieq(&bld, in_def, nir_imm_int(&bld, 0));
+
+   nir_if *nif = nir_push_if(&bld, cond);
+   nir_store_var(&bld, out_var, nir_imul(&bld, in_def, five), 1);
+   nir_push_else(&bld, nif);
+   nir_ssa_def *one = nir_imm_int(&bld, 1);
+   nir_push_if(&bld, nir_ieq(&bld, in_def, one));
+   nir_store_var(&bld, out_var, one, 1);
+   nir_pop_if(&bld, NULL);
+   nir_pop_if(&bld, nif);
+   nir_ssa_def *mul = nir_imul(&bld, in_def, five);
+   nir_store_var(&bld, out_var, mul, 1);
+
+   nir_block *after = nir_cf_node_as_block(nir_cf_node_next(&nif->cf_node));
+
+   nir_validate_shader(bld.shader, NULL);
+
+   ASSERT_TRUE(nir_opt_gvn_pre(bld.shader));
+   nir_validate_shader(bld.shader, NULL);
+
+   EXPECT_EQ(count_alu(after, nir_op_imul), 0);
+   EXPECT_EQ(count_alu(nir_if_first_then_block(nif), nir_op_imul), 1);
+   EXPECT_EQ(count_alu(nir_if_last_else_block(nif), nir_op_imul), 1);
+
+   nir_instr *first = nir_block_first_instr(after);
+   ASSERT_EQ(first->type, nir_instr_type_phi);
+   EXPECT_EQ(exec_list_length(&nir_instr_as_phi(first)->srcs), 2);
+
+   EXPECT_FALSE(nir_opt_gvn_pre(bld.shader));
+}
+
+TEST_F(nir_opt_gvn_pre_test, partially_redundant_single_block_arm)
+{
+   /* With nothing else in the else arm, the multiplication is computed in
+    * front of the if instead:
+    *
+    * if (in == 0) {
+    *    out = in * 5;
+    * }
+    * out = in * 5;
+    */
+   nir_ssa_def *five = nir_imm_int(&bld, 5);
+   nir_ssa_def *cond = nir_ieq(&bld, in_def, nir_imm_int(&bld, 0));
+   nir_block *before = nir_cursor_current_block(bld.cursor);
+
+   nir_if *nif = nir_push_if(&bld, cond);
+   nir_store_var(&bld, out_var, nir_imul(&bld, in_def, five), 1);
+   nir_pop_if(&bld, nif);
+   nir_store_var(&bld, out_var, nir_imul(&bld, in_def, five), 1);
+
+   nir_block *after = nir_cf_node_as_block(nir_cf_node_next(&nif->cf_node));
+
+   nir_validate_shader(bld.shader, NULL);
+
+   ASSERT_TRUE(nir_opt_gvn_pre(bld.shader));
+   nir_validate_shader(bld.shader, NULL);
+
+   EXPECT_EQ(count_alu(before, nir_op_imul), 1);
+   EXPECT_EQ(count_alu(nir_if_first_then_block(nif), nir_op_imul), 0);
+   EXPECT_EQ(count_alu(nir_if_first_else_block(nif), nir_op_imul), 0);
+   EXPECT_EQ(count_alu(after, nir_op_imul), 0);
+   EXPECT_NE(nir_block_first_instr(after)->type, nir_instr_type_phi);
+
+   EXPECT_FALSE(nir_opt_gvn_pre(bld.shader));
+}
+
+TEST_F(nir_opt_gvn_pre_test, derivative_stays_uniform)
+{
+   /* Derivatives must not be moved into non-uniform control flow. */
+   nir_ssa_def *f = nir_i2f32(&bld, in_def);
+   nir_ssa_def *cond = nir_ieq(&bld, in_def, nir_imm_int(&bld, 0));
+
+   nir_if *nif = nir_push_if(&bld, cond);
+   nir_store_var(&bld, out_var, nir_f2i32(&bld, nir_fddx(&bld, f)), 1);
+   nir_pop_if(&bld, nif);
+   nir_store_var(&bld, out_var, nir_f2i32(&bld, nir_fddx(&bld, f)), 1);
+
+   nir_validate_shader(bld.shader, NULL);
+
+   nir_opt_gvn_pre(bld.shader);
+   nir_validate_shader(bld.shader, NULL);
+
+   nir_block *after = nir_cf_node_as_block(nir_cf_node_next(&nif->cf_node));
+   EXPECT_EQ(count_alu(after, nir_op_fddx), 1);
+   EXPECT_EQ(count_alu(nir_if_first_else_block(nif), nir_op_fddx), 0);
+}
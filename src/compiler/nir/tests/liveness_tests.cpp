@@ -0,0 +1,289 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <vector>
+#include <gtest/gtest.h>
+#include "nir.h"
+#include "nir_builder.h"
+
+class nir_liveness_test : public ::testing::Test {
+protected:
+   nir_liveness_test();
+   ~nir_liveness_test();
+
+   bool live_in(nir_block *block, nir_ssa_def *def);
+   bool live_out(nir_block *block, nir_ssa_def *def);
+   std::vector<unsigned> get_liveness();
+
+   nir_builder bld;
+
+   nir_ssa_def *in_def;
+   nir_variable *out_var;
+};
+
+nir_liveness_test::nir_liveness_test()
+{
+   glsl_type_singleton_init_or_ref();
+
+   static const nir_shader_compiler_options options = { };
+   nir_builder_init_simple_shader(&bld, NULL, MESA_SHADER_VERTEX, &options);
+
+   nir_variable *var = nir_variable_create(bld.shader, nir_var_shader_in, glsl_int_type(), "in");
+   in_def = nir_load_var(&bld, var);
+
+   out_var = nir_variable_create(bld.shader, nir_var_shader_out, glsl_int_type(), "out");
+}
+
+nir_liveness_test::~nir_liveness_test()
+{
+   ralloc_free(bld.shader);
+   glsl_type_singleton_decref();
+}
+
+bool
+nir_liveness_test::live_in(nir_block *block, nir_ssa_def *def)
+{
+   return BITSET_TEST(block->live_in, def->live_index);
+}
+
+bool
+nir_liveness_test::live_out(nir_block *block, nir_ssa_def *def)
+{
+   return BITSET_TEST(block->live_out, def->live_index);
+}
+
+static bool
+add_live_index(nir_ssa_def *def, void *indices)
+{
+   ((std::vector<unsigned> *)indices)->push_back(def->live_index);
+   return true;
+}
+
+/* Returns the live indices in the order of the defs, followed by the
+ * live-in and live-out sets of each block.
+ */
+std::vector<unsigned>
+nir_liveness_test::get_liveness()
+{
+   std::vector<unsigned> liveness;
+   unsigned num_defs = 1;
+
+   nir_foreach_block(block, bld.impl) {
+      nir_foreach_instr(instr, block)
+         nir_foreach_ssa_def(instr, add_live_index, &liveness);
+   }
+   for (unsigned index : liveness)
+      num_defs = MAX2(num_defs, index + 1);
+
+   nir_foreach_block(block, bld.impl) {
+      for (unsigned i = 0; i < BITSET_WORDS(num_defs); i++) {
+         liveness.push_back(block->live_in[i]);
+         liveness.push_back(block->live_out[i]);
+      }
+   }
+   return liveness;
+}
+
+TEST_F(nir_liveness_test, loop)
+{
+   /* A value used in a loop is live around the whole loop, and the phi in
+    * the loop header is live out of the predecessors it gets values from:
+    *
+    * block block_0:
+    * vec1 32 ssa_1 = iadd ssa_0, ssa_0
+    * loop {
+    *    block block_1:
+    *    vec1 32 ssa_3 = phi block_0: ssa_0, block_4: ssa_4
+    *    vec1 32 ssa_2 = ilt ssa_3, ssa_1
+    *    if ssa_2 {
+    *       block block_2:
+    *       break
+    *    } else {
+    *       block block_3:
+    *    }
+    *    block block_4:
+    *    vec1 32 ssa_4 = iadd ssa_3, ssa_1
+    * }
+    * block block_5:
+    */
+   nir_ssa_def *limit = nir_iadd(&bld, in_def, in_def);
+   nir_block *before = nir_cursor_current_block(bld.cursor);
+
+   nir_loop *loop = nir_push_loop(&bld);
+   nir_block *header = nir_loop_first_block(loop);
+
+   nir_phi_instr *phi = nir_phi_instr_create(bld.shader);
+   nir_ssa_dest_init(&phi->instr, &phi->dest, 1, 32, NULL);
+   nir_ssa_def *counter = &phi->dest.ssa;
+
+   nir_push_if(&bld, nir_ilt(&bld, counter, limit));
+   nir_jump(&bld, nir_jump_break);
+   nir_pop_if(&bld, NULL);
+
+   nir_ssa_def *next = nir_iadd(&bld, counter, limit);
+   nir_block *latch = nir_cursor_current_block(bld.cursor);
+   nir_pop_loop(&bld, loop);
+
+   nir_instr_insert(nir_before_block(header), &phi->instr);
+
+   nir_phi_src *src = ralloc(phi, nir_phi_src);
+   src->pred = before;
+   src->src = nir_src_for_ssa(in_def);
+   list_addtail(&src->src.use_link, &in_def->uses);
+   src->src.parent_instr = &phi->instr;
+   exec_list_push_tail(&phi->srcs, &src->node);
+
+   src = ralloc(phi, nir_phi_src);
+   src->pred = latch;
+   src->src = nir_src_for_ssa(next);
+   list_addtail(&src->src.use_link, &next->uses);
+   src->src.parent_instr = &phi->instr;
+   exec_list_push_tail(&phi->srcs, &src->node);
+
+   nir_validate_shader(bld.shader, NULL);
+
+   nir_metadata_require(bld.impl, nir_metadata_live_ssa_defs);
+
+   EXPECT_TRUE(live_out(before, limit));
+   EXPECT_TRUE(live_in(header, limit));
+   EXPECT_TRUE(live_in(latch, limit));
+   EXPECT_TRUE(live_out(latch, limit));
+
+   EXPECT_TRUE(live_out(before, in_def));
+   EXPECT_FALSE(live_in(header, in_def));
+
+   EXPECT_TRUE(live_in(header, counter));
+   EXPECT_TRUE(live_out(latch, next));
+   EXPECT_FALSE(live_in(header, next));
+   EXPECT_FALSE(live_out(before, counter));
+
+   nir_block *after = nir_cf_node_as_block(nir_cf_node_next(&loop->cf_node));
+   EXPECT_FALSE(live_in(after, limit));
+}
+
+TEST_F(nir_liveness_test, update_def)
+{
+   /* After the use in the then block is rewritten to a value defined there,
+    * nir_live_ssa_def_update() shrinks the live range to what
+    * nir_live_ssa_defs_impl() finds.
+    */
+   nir_ssa_def *value = nir_iadd(&bld, in_def, in_def);
+   nir_block *before = nir_cursor_current_block(bld.cursor);
+
+   nir_if *nif = nir_push_if(&bld, nir_ieq(&bld, in_def, nir_imm_int(&bld, 0)));
+   nir_ssa_def *local = nir_ineg(&bld, in_def);
+   nir_ssa_def *use = nir_iadd(&bld, value, value);
+   nir_store_var(&bld, out_var, use, 1);
+   nir_pop_if(&bld, nif);
+
+   nir_block *then_block = nir_if_first_then_block(nif);
+
+   nir_metadata_require(bld.impl, nir_metadata_live_ssa_defs);
+
+   EXPECT_TRUE(live_out(before, value));
+   EXPECT_TRUE(live_in(then_block, value));
+
+   nir_alu_instr *alu = nir_instr_as_alu(use->parent_instr);
+   nir_instr_rewrite_src(&alu->instr, &alu->src[0].src, nir_src_for_ssa(local));
+   nir_instr_rewrite_src(&alu->instr, &alu->src[1].src, nir_src_for_ssa(local));
+
+   nir_live_ssa_def_update(value);
+   nir_live_ssa_def_update(local);
+
+   EXPECT_FALSE(live_out(before, value));
+   EXPECT_FALSE(live_in(then_block, value));
+   EXPECT_FALSE(live_in(then_block, local));
+   EXPECT_TRUE(live_out(before, in_def));
+
+   nir_metadata_preserve(bld.impl, nir_metadata_none);
+   nir_metadata_require(bld.impl, nir_metadata_live_ssa_defs);
+
+   EXPECT_FALSE(live_out(before, value));
+   EXPECT_FALSE(live_in(then_block, value));
+   EXPECT_TRUE(live_out(before, in_def));
+}
+
+TEST_F(nir_liveness_test, sink)
+{
+   /* nir_opt_sink() keeps the liveness valid.  The defs that it moves past
+    * get the same indices and live ranges as when everything is recomputed.
+    */
+   nir_ssa_def *imm = nir_imm_int(&bld, 5);
+   nir_ssa_def *value = nir_iadd(&bld, in_def, in_def);
+   nir_ssa_def *cmp = nir_ilt(&bld, in_def, value);
+
+   /* Enough values in between for the indices to cross a bitset word. */
+   for (unsigned i = 0; i < 40; i++)
+      value = nir_iadd(&bld, value, in_def);
+   nir_ssa_def *other = nir_ineg(&bld, in_def);
+
+   nir_if *nif = nir_push_if(&bld, nir_ieq(&bld, other, value));
+   nir_store_var(&bld, out_var, nir_bcsel(&bld, cmp, imm, value), 1);
+   nir_pop_if(&bld, nif);
+   nir_store_var(&bld, out_var, other, 1);
+
+   /* Updating the liveness has to stay cheaper than recomputing it, so the
+    * shader needs to be larger than the distance that the defs move.
+    */
+   nir_ssa_def *tail = other;
+   for (unsigned i = 0; i < 100; i++)
+      tail = nir_iadd(&bld, tail, in_def);
+   nir_store_var(&bld, out_var, tail, 1);
+
+   nir_block *then_block = nir_if_first_then_block(nif);
+
+   nir_metadata_require(bld.impl, nir_metadata_live_ssa_defs);
+   ASSERT_TRUE(nir_opt_sink(bld.shader, (nir_move_options)
+                            (nir_move_const_undef | nir_move_comparisons)));
+   EXPECT_TRUE(bld.impl->valid_metadata & nir_metadata_live_ssa_defs);
+   EXPECT_EQ(imm->parent_instr->block, then_block);
+   EXPECT_EQ(cmp->parent_instr->block, then_block);
+
+   std::vector<unsigned> liveness = get_liveness();
+
+   nir_metadata_preserve(bld.impl, nir_metadata_none);
+   nir_metadata_require(bld.impl, nir_metadata_live_ssa_defs);
+
+   EXPECT_EQ(liveness, get_liveness());
+}
+
+TEST_F(nir_liveness_test, sink_over_budget)
+{
+   /* Once moving the defs costs more than recomputing the liveness would,
+    * nir_opt_sink() drops it instead of updating it.
+    */
+   nir_ssa_def *imm = nir_imm_int(&bld, 5);
+   nir_ssa_def *value = nir_iadd(&bld, in_def, in_def);
+
+   for (unsigned i = 0; i < 40; i++)
+      value = nir_iadd(&bld, value, in_def);
+
+   nir_if *nif = nir_push_if(&bld, nir_ieq(&bld, in_def, value));
+   nir_store_var(&bld, out_var, nir_iadd(&bld, imm, value), 1);
+   nir_pop_if(&bld, nif);
+
+   nir_metadata_require(bld.impl, nir_metadata_live_ssa_defs);
+   ASSERT_TRUE(nir_opt_sink(bld.shader, nir_move_const_undef));
+   EXPECT_EQ(imm->parent_instr->block, nir_if_first_then_block(nif));
+   EXPECT_FALSE(bld.impl->valid_metadata & nir_metadata_live_ssa_defs);
+   EXPECT_TRUE(bld.impl->valid_metadata & nir_metadata_block_index);
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include "nir.h"
+#include "nir_builder.h"
+#include "nir_serialize.h"
+#include "util/u_queue.h"
+
+class nir_parallel_test : public ::testing::Test {
+protected:
+   nir_parallel_test();
+   ~nir_parallel_test();
+
+   void create_function(unsigned index);
+   void expect_same(nir_shader *a, nir_shader *b);
+
+   nir_shader *shader;
+   struct util_queue queue;
+};
+
+nir_parallel_test::nir_parallel_test()
+{
+   glsl_type_singleton_init_or_ref();
+
+   static const nir_shader_compiler_options options = { };
+   shader = nir_shader_create(NULL, MESA_SHADER_KERNEL, &options, NULL);
+
+   util_queue_init(&queue, "nir", 8, 4, UTIL_QUEUE_INIT_RESIZE_IF_FULL);
+}
+
+nir_parallel_test::~nir_parallel_test()
+{
+   util_queue_destroy(&queue);
+   ralloc_free(shader);
+   glsl_type_singleton_decref();
+}
+
+/* A function with local variables, control flow and redundant ALU that
+ * every pass in opt_impl() has something to do with.
+ */
+void
+nir_parallel_test::create_function(unsigned index)
+{
+   nir_function *func =
+      nir_function_create(shader, ralloc_asprintf(shader, "func%u", index));
+   func->num_params = 2;
+   func->params = ralloc_array(shader, nir_parameter, 2);
+   for (unsigned i = 0; i < 2; i++) {
+      func->params[i].num_components = 1;
+      func->params[i].bit_size = 32;
+   }
+
+   nir_builder b;
+   nir_builder_init(&b, nir_function_impl_create(func));
+   b.cursor = nir_after_cf_list(&b.impl->body);
+
+   nir_variable *acc =
+      nir_local_variable_create(b.impl, glsl_uint_type(), "acc");
+   nir_ssa_def *x = nir_load_param(&b, 0);
+   nir_store_var(&b, acc, x, 1);
+
+   for (unsigned i = 0; i < 20 + index * 7; i++) {
+      nir_ssa_def *v = nir_load_var(&b, acc);
+      nir_ssa_def *sum = nir_iadd(&b, nir_imul(&b, v, nir_imm_int(&b, 1)),
+                                  nir_iadd(&b, v, nir_imm_int(&b, i)));
+
+      nir_push_if(&b, nir_ult(&b, sum, nir_imm_int(&b, 1000 + i)));
+      nir_store_var(&b, acc, nir_iadd(&b, sum, nir_imm_int(&b, i)), 1);
+      nir_push_else(&b, NULL);
+      nir_store_var(&b, acc, nir_iadd(&b, sum, nir_imm_int(&b, i)), 1);
+      nir_pop_if(&b, NULL);
+
+      /* Dead control flow */
+      nir_push_if(&b, nir_imm_false(&b));
+      nir_store_var(&b, acc, x, 1);
+      nir_pop_if(&b, NULL);
+   }
+
+   nir_ssa_def *ptr = nir_load_param(&b, 1);
+   nir_store_deref(&b, nir_build_deref_cast(&b, ptr, nir_var_mem_global,
+                                            glsl_uint_type(), 4),
+                   nir_load_var(&b, acc), 1);
+}
+
+void
+nir_parallel_test::expect_same(nir_shader *a, nir_shader *b)
+{
+   struct blob blob_a, blob_b;
+
+   blob_init(&blob_a);
+   blob_init(&blob_b);
+   nir_serialize(&blob_a, a, false);
+   nir_serialize(&blob_b, b, false);
+
+   ASSERT_EQ(blob_a.size, blob_b.size);
+   EXPECT_EQ(memcmp(blob_a.data, blob_b.data, blob_a.size), 0);
+
+   blob_finish(&blob_a);
+   blob_finish(&blob_b);
+}
+
+static bool
+opt_impl(nir_function_impl *impl)
+{
+   bool progress, any_progress = false;
+
+   do {
+      progress = false;
+      progress |= nir_lower_vars_to_ssa_impl(impl);
+      progress |= nir_copy_prop_impl(impl);
+      progress |= nir_opt_remove_phis_impl(impl);
+      progress |= nir_opt_dce_impl(impl);
+      progress |= nir_opt_dead_cf_impl(impl);
+      progress |= nir_opt_cse_impl(impl);
+      progress |= nir_opt_algebraic_impl(impl);
+      any_progress |= progress;
+   } while (progress);
+
+   return any_progress;
+}
+
+TEST_F(nir_parallel_test, same_as_serial)
+{
+   for (unsigned i = 0; i < 16; i++)
+      create_function(i);
+   nir_validate_shader(shader, NULL);
+
+   nir_shader *serial = nir_shader_clone(NULL, shader);
+
+   bool progress = false;
+   NIR_PASS_PARALLEL(progress, shader, &queue, opt_impl);
+   EXPECT_TRUE(progress);
+
+   EXPECT_TRUE(nir_shader_foreach_impl_parallel(serial, NULL, opt_impl));
+
+   expect_same(shader, serial);
+
+   /* Nothing left to do. */
+   EXPECT_FALSE(nir_shader_foreach_impl_parallel(shader, &queue, opt_impl));
+
+   ralloc_free(serial);
+}
+
+/* The calling thread can be a job of the same queue and does the work itself
+ * if all threads are busy.
+ */
+struct nested_job {
+   nir_shader *shader;
+   struct util_queue *queue;
+   bool progress;
+};
+
+static void
+run_nested(void *data, int thread_index)
+{
+   struct nested_job *job = (struct nested_job *)data;
+   job->progress =
+      nir_shader_foreach_impl_parallel(job->shader, job->queue, opt_impl);
+}
+
+TEST_F(nir_parallel_test, from_queue_job)
+{
+   for (unsigned i = 0; i < 8; i++)
+      create_function(i);
+
+   nir_shader *shaders[4];
+   struct nested_job jobs[4];
+   struct util_queue_fence fences[4];
+
+   for (unsigned i = 0; i < 4; i++) {
+      shaders[i] = nir_shader_clone(NULL, shader);
+      jobs[i] = { shaders[i], &queue, false };
+      util_queue_fence_init(&fences[i]);
+      util_queue_add_job(&queue, &jobs[i], &fences[i], run_nested, NULL, 0);
+   }
+
+   NIR_PASS_V(shader, nir_shader_foreach_impl_parallel, NULL, opt_impl);
+
+   for (unsigned i = 0; i < 4; i++) {
+      util_queue_fence_wait(&fences[i]);
+      util_queue_fence_destroy(&fences[i]);
+      EXPECT_TRUE(jobs[i].progress);
+      nir_validate_shader(shaders[i], NULL);
+
+      expect_same(shaders[i], shader);
+      ralloc_free(shaders[i]);
+   }
+}
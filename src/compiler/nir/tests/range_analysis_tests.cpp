@@ -0,0 +1,155 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include "nir.h"
+#include "nir_builder.h"
+#include "nir_range_analysis.h"
+
+class nir_range_analysis_test : public ::testing::Test {
+protected:
+   nir_range_analysis_test();
+   ~nir_range_analysis_test();
+
+   void check_defs(nir_ssa_def *changed);
+   enum ssa_ranges range_of(nir_ssa_def *def);
+
+   nir_builder bld;
+
+   nir_ssa_def *in_def;
+   nir_variable *out_var;
+};
+
+nir_range_analysis_test::nir_range_analysis_test()
+{
+   glsl_type_singleton_init_or_ref();
+
+   static const nir_shader_compiler_options options = { };
+   nir_builder_init_simple_shader(&bld, NULL, MESA_SHADER_FRAGMENT, &options);
+
+   nir_variable *var = nir_variable_create(bld.shader, nir_var_shader_in, glsl_float_type(), "in");
+   in_def = nir_load_var(&bld, var);
+
+   out_var = nir_variable_create(bld.shader, nir_var_shader_out, glsl_float_type(), "out");
+}
+
+nir_range_analysis_test::~nir_range_analysis_test()
+{
+   ralloc_free(bld.shader);
+   glsl_type_singleton_decref();
+}
+
+/* Checks every value with its index as the signature, or a different one for
+ * changed.
+ */
+void
+nir_range_analysis_test::check_defs(nir_ssa_def *changed)
+{
+   struct nir_range_cache *cache = nir_range_cache_get(bld.impl);
+
+   nir_foreach_block(block, bld.impl) {
+      nir_foreach_instr(instr, block) {
+         nir_ssa_def *def = nir_instr_ssa_def(instr);
+         if (def)
+            nir_range_cache_check_def(cache, def, def->index + (def == changed ? 1000 : 1));
+      }
+   }
+}
+
+/* The range of def as seen by a float user that isn't inserted. */
+enum ssa_ranges
+nir_range_analysis_test::range_of(nir_ssa_def *def)
+{
+   nir_alu_instr *user = nir_alu_instr_create(bld.shader, nir_op_fneg);
+   user->src[0].src = nir_src_for_ssa(def);
+
+   return nir_analyze_range(nir_range_cache_get(bld.impl), user, 0).range;
+}
+
+TEST_F(nir_range_analysis_test, check_def)
+{
+   nir_ssa_def *abs = nir_fabs(&bld, in_def);
+   nir_ssa_def *sum = nir_fadd(&bld, abs, nir_imm_float(&bld, 1.0f));
+   nir_store_var(&bld, out_var, sum, 1);
+
+   check_defs(NULL);
+   EXPECT_EQ(range_of(sum), gt_zero);
+
+   /* Changing an instruction in place without a new signature keeps what
+    * was known about it and everything computed from it.
+    */
+   nir_alu_instr *abs_alu = nir_instr_as_alu(abs->parent_instr);
+   abs_alu->op = nir_op_fneg;
+   check_defs(NULL);
+   EXPECT_EQ(range_of(sum), gt_zero);
+
+   check_defs(abs);
+   EXPECT_EQ(range_of(sum), unknown);
+}
+
+TEST_F(nir_range_analysis_test, invalidate_users)
+{
+   nir_ssa_def *abs = nir_fabs(&bld, in_def);
+   nir_ssa_def *sum = nir_fadd(&bld, abs, nir_imm_float(&bld, 1.0f));
+   nir_ssa_def *prod = nir_fmul(&bld, sum, nir_imm_float(&bld, 2.0f));
+   nir_store_var(&bld, out_var, prod, 1);
+
+   check_defs(NULL);
+   EXPECT_EQ(range_of(prod), ge_zero);
+
+   bld.cursor = nir_after_instr(abs->parent_instr);
+   nir_ssa_def *neg = nir_fneg(&bld, in_def);
+   nir_ssa_def_rewrite_uses(abs, nir_src_for_ssa(neg));
+   nir_instr_remove(abs->parent_instr);
+   nir_range_cache_invalidate_users(nir_range_cache_get(bld.impl), neg);
+
+   EXPECT_EQ(range_of(prod), unknown);
+}
+
+TEST_F(nir_range_analysis_test, algebraic)
+{
+   /* fabs(a) is a when a isn't negative, which nir_opt_algebraic() only
+    * finds once in_def + 1.0 becomes fabs(in_def) + 1.0.
+    */
+   nir_ssa_def *sum = nir_fadd(&bld, in_def, nir_imm_float(&bld, 1.0f));
+   nir_ssa_def *abs = nir_fabs(&bld, sum);
+   nir_store_var(&bld, out_var, abs, 1);
+
+   EXPECT_FALSE(nir_opt_algebraic(bld.shader));
+
+   nir_alu_instr *sum_alu = nir_instr_as_alu(sum->parent_instr);
+   bld.cursor = nir_before_instr(&sum_alu->instr);
+   nir_instr_rewrite_src(&sum_alu->instr, &sum_alu->src[0].src,
+                         nir_src_for_ssa(nir_fabs(&bld, in_def)));
+
+   EXPECT_TRUE(nir_opt_algebraic(bld.shader));
+   nir_validate_shader(bld.shader, NULL);
+
+   nir_foreach_block(block, bld.impl) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type == nir_instr_type_intrinsic &&
+             nir_instr_as_intrinsic(instr)->intrinsic == nir_intrinsic_store_deref) {
+            EXPECT_EQ(nir_instr_as_intrinsic(instr)->src[1].ssa, sum);
+         }
+      }
+   }
+}
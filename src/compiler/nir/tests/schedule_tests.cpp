@@ -0,0 +1,268 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include "nir.h"
+#include "nir_builder.h"
+#include "nir_schedule.h"
+
+class nir_schedule_test : public ::testing::Test {
+protected:
+   nir_schedule_test();
+   ~nir_schedule_test();
+
+   void build_chain_and_load();
+   unsigned instr_index(nir_instr *instr);
+
+   nir_builder bld;
+
+   nir_ssa_def *in_def;
+   nir_variable *out_var;
+
+   nir_instr *chain_start;
+   nir_instr *load;
+};
+
+nir_schedule_test::nir_schedule_test()
+{
+   glsl_type_singleton_init_or_ref();
+
+   static const nir_shader_compiler_options options = { };
+   nir_builder_init_simple_shader(&bld, NULL, MESA_SHADER_FRAGMENT, &options);
+
+   nir_variable *var = nir_variable_create(bld.shader, nir_var_shader_in, glsl_float_type(), "in");
+   in_def = nir_load_var(&bld, var);
+
+   out_var = nir_variable_create(bld.shader, nir_var_shader_out, glsl_float_type(), "out");
+}
+
+nir_schedule_test::~nir_schedule_test()
+{
+   ralloc_free(bld.shader);
+   glsl_type_singleton_decref();
+}
+
+/* A chain of ALU followed by an independent UBO load, both of which end up
+ * in the output.
+ */
+void
+nir_schedule_test::build_chain_and_load()
+{
+   nir_ssa_def *two = nir_imm_float(&bld, 2.0f);
+   nir_ssa_def *v = nir_fmul(&bld, in_def, two);
+   chain_start = v->parent_instr;
+   for (unsigned i = 0; i < 8; i++)
+      v = nir_fmul(&bld, v, two);
+
+   nir_intrinsic_instr *intr =
+      nir_intrinsic_instr_create(bld.shader, nir_intrinsic_load_ubo);
+   intr->num_components = 1;
+   intr->src[0] = nir_src_for_ssa(nir_imm_int(&bld, 0));
+   intr->src[1] = nir_src_for_ssa(nir_imm_int(&bld, 0));
+   nir_intrinsic_set_align(intr, 4, 0);
+   nir_ssa_dest_init(&intr->instr, &intr->dest, 1, 32, NULL);
+   nir_builder_instr_insert(&bld, &intr->instr);
+   load = &intr->instr;
+
+   nir_store_var(&bld, out_var, nir_fadd(&bld, v, &intr->dest.ssa), 1);
+
+   nir_validate_shader(bld.shader, NULL);
+}
+
+unsigned
+nir_schedule_test::instr_index(nir_instr *instr)
+{
+   unsigned index = 0;
+   nir_foreach_instr(other, instr->block) {
+      if (other == instr)
+         return index;
+      index++;
+   }
+   return ~0u;
+}
+
+TEST_F(nir_schedule_test, default_latencies)
+{
+   build_chain_and_load();
+
+   nir_schedule_options options = { };
+   options.threshold = 64;
+   nir_schedule(bld.shader, &options);
+   nir_validate_shader(bld.shader, NULL);
+
+   EXPECT_GT(instr_index(load), instr_index(chain_start));
+}
+
+TEST_F(nir_schedule_test, load_latency)
+{
+   build_chain_and_load();
+
+   static const nir_schedule_latencies latencies = {
+      .alu = 1,
+      .alu_complex = 4,
+      .tex = 100,
+      .load = 100,
+      .intrinsic = 1,
+   };
+   nir_schedule_options options = { };
+   options.threshold = 64;
+   options.latencies = &latencies;
+   nir_schedule(bld.shader, &options);
+   nir_validate_shader(bld.shader, NULL);
+
+   EXPECT_LT(instr_index(load), instr_index(chain_start));
+}
+
+TEST_F(nir_schedule_test, stages)
+{
+   build_chain_and_load();
+
+   static const nir_schedule_latencies latencies = {
+      .alu = 1,
+      .alu_complex = 4,
+      .tex = 100,
+      .load = 100,
+      .intrinsic = 1,
+   };
+   nir_schedule_options options = { };
+   options.threshold = 64;
+   options.latencies = &latencies;
+   options.stages = 1 << MESA_SHADER_VERTEX;
+
+   unsigned load_index = instr_index(load);
+   nir_schedule(bld.shader, &options);
+   EXPECT_EQ(instr_index(load), load_index);
+}
+
+static int
+half_pressure_cb(unsigned num_components, unsigned bit_size, void *data)
+{
+   unsigned *bit_sizes = (unsigned *)data;
+   *bit_sizes |= bit_size;
+   return num_components * (bit_size == 16 ? 1 : 2);
+}
+
+TEST_F(nir_schedule_test, pressure_cb)
+{
+   nir_ssa_def *h = nir_f2f16(&bld, in_def);
+   h = nir_fmul(&bld, h, h);
+   nir_store_var(&bld, out_var, nir_f2f32(&bld, h), 1);
+   nir_validate_shader(bld.shader, NULL);
+
+   unsigned bit_sizes = 0;
+   nir_schedule_options options = { };
+   options.threshold = 64;
+   options.pressure_cb = half_pressure_cb;
+   options.pressure_cb_data = &bit_sizes;
+   nir_schedule(bld.shader, &options);
+   nir_validate_shader(bld.shader, NULL);
+
+   EXPECT_EQ(bit_sizes, 16u | 32u);
+}
+
+TEST_F(nir_schedule_test, ssa_phis)
+{
+   /* Phis stay at the top of their block when scheduling SSA. */
+   nir_variable *acc = nir_local_variable_create(bld.impl, glsl_float_type(), "acc");
+   nir_store_var(&bld, acc, nir_imm_float(&bld, 0.0f), 1);
+
+   nir_loop *loop = nir_push_loop(&bld);
+   nir_ssa_def *next = nir_fadd(&bld, nir_load_var(&bld, acc), in_def);
+   nir_ssa_def *scaled = nir_fmul(&bld, next, nir_imm_float(&bld, 0.5f));
+   nir_push_if(&bld, nir_flt(&bld, nir_imm_float(&bld, 100.0f), scaled));
+   nir_jump(&bld, nir_jump_break);
+   nir_pop_if(&bld, NULL);
+   nir_store_var(&bld, acc, scaled, 1);
+   nir_pop_loop(&bld, loop);
+
+   nir_store_var(&bld, out_var, nir_load_var(&bld, acc), 1);
+   nir_lower_vars_to_ssa(bld.shader);
+   nir_validate_shader(bld.shader, NULL);
+
+   nir_block *header = nir_loop_first_block(loop);
+   nir_instr *phi = nir_block_first_instr(header);
+   ASSERT_EQ(phi->type, nir_instr_type_phi);
+
+   nir_schedule_options options = { };
+   options.threshold = 64;
+   nir_schedule(bld.shader, &options);
+   nir_validate_shader(bld.shader, NULL);
+
+   EXPECT_EQ(nir_block_first_instr(header), phi);
+}
+
+TEST_F(nir_schedule_test, phi_use_pressure)
+{
+   /* A value that is only read by a phi stays live until the end of the
+    * predecessor.  At the start of the latch, u (1 channel), x (4) and next
+    * (4, read by the phi in the loop header) are live, which is above the
+    * threshold.  So the pressure heuristic picks the dot product, which frees
+    * x, ahead of the long-latency load.
+    */
+   nir_ssa_def *u = nir_f2u32(&bld, in_def);
+   nir_variable *acc = nir_local_variable_create(bld.impl, glsl_vec4_type(), "acc");
+   nir_store_var(&bld, acc, nir_imm_vec4(&bld, 0.0f, 0.0f, 0.0f, 0.0f), 0xf);
+
+   nir_loop *loop = nir_push_loop(&bld);
+   nir_ssa_def *next = nir_fadd(&bld, nir_load_var(&bld, acc),
+                                nir_vec4(&bld, in_def, in_def, in_def, in_def));
+   nir_ssa_def *x = nir_fmul(&bld, next, next);
+   nir_push_if(&bld, nir_flt(&bld, nir_imm_float(&bld, 100.0f),
+                             nir_channel(&bld, next, 0)));
+   nir_jump(&bld, nir_jump_break);
+   nir_pop_if(&bld, NULL);
+
+   nir_ssa_def *dot = nir_fdot4(&bld, x, x);
+
+   nir_intrinsic_instr *intr =
+      nir_intrinsic_instr_create(bld.shader, nir_intrinsic_load_ubo);
+   intr->num_components = 1;
+   intr->src[0] = nir_src_for_ssa(u);
+   intr->src[1] = nir_src_for_ssa(u);
+   nir_intrinsic_set_align(intr, 4, 0);
+   nir_ssa_dest_init(&intr->instr, &intr->dest, 1, 32, NULL);
+   nir_builder_instr_insert(&bld, &intr->instr);
+
+   /* u stays live after the load. */
+   nir_ssa_def *loaded = nir_fadd(&bld, &intr->dest.ssa, nir_u2f32(&bld, u));
+   nir_store_var(&bld, out_var, nir_fadd(&bld, dot, loaded), 1);
+   nir_store_var(&bld, acc, next, 0xf);
+   nir_pop_loop(&bld, loop);
+
+   nir_lower_vars_to_ssa(bld.shader);
+   nir_validate_shader(bld.shader, NULL);
+
+   static const nir_schedule_latencies latencies = {
+      .alu = 1,
+      .alu_complex = 4,
+      .tex = 100,
+      .load = 100,
+      .intrinsic = 1,
+   };
+   nir_schedule_options options = { };
+   options.threshold = 8;
+   options.latencies = &latencies;
+   nir_schedule(bld.shader, &options);
+   nir_validate_shader(bld.shader, NULL);
+
+   EXPECT_LT(instr_index(dot->parent_instr), instr_index(&intr->instr));
+}
@@ -0,0 +1,451 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Measures the size of nir_serialize() blobs and the time to write and
+ * read them.
+ *
+ * For each shader, this prints the size of the blob with and without
+ * stripping, and the time nir_serialize() and nir_deserialize() take.  The
+ * deserialized shader is checked to serialize to the same blob again.
+ *
+ * Without arguments, fragment shaders of random ALU, uniform and texture
+ * code with some control flow are generated.  For those, "delta" is the
+ * number of bytes of the blob of a variant with one more instruction at the
+ * start that can't be found in the blob of the original shader, in 8-byte
+ * pieces, like the near-identical variants drivers compile for different
+ * states.  Otherwise each file is read as a shader written by
+ * nir_serialize().
+ *
+ * The times are the minimum of a few runs.
+ *
+ * serialize_bench_v1.sh runs this against the serializer from before the
+ * varint stream format, to compare with the old numbers.
+ *
+ * Usage: serialize_bench [-s scale] [-r runs] [file...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nir.h"
+#include "nir_builder.h"
+#include "nir_serialize.h"
+#include "util/blob.h"
+#include "util/os_file.h"
+#include "util/os_time.h"
+
+static const nir_shader_compiler_options options = { 0 };
+
+#define WINDOW 32
+#define NUM_PARAMS 64
+#define NUM_SAMPLERS 4
+
+struct gen {
+   nir_builder *b;
+   nir_variable *params;
+   nir_variable *samplers[NUM_SAMPLERS];
+   nir_ssa_def *f[WINDOW];
+   unsigned num_f;
+};
+
+static nir_ssa_def *
+pick(struct gen *g)
+{
+   unsigned n = MIN2(g->num_f, WINDOW);
+
+   /* Mostly use recent values, like real code does. */
+   if (rand() % 4)
+      n = MIN2(n, 8);
+
+   return g->f[(g->num_f - 1 - rand() % n) % WINDOW];
+}
+
+static void
+push(struct gen *g, nir_ssa_def *def)
+{
+   g->f[g->num_f++ % WINDOW] = def;
+}
+
+static nir_ssa_def *
+load_param(struct gen *g)
+{
+   nir_builder *b = g->b;
+   nir_deref_instr *deref = nir_build_deref_var(b, g->params);
+   nir_ssa_def *v;
+
+   if (rand() % 4) {
+      deref = nir_build_deref_array_imm(b, deref, rand() % NUM_PARAMS);
+   } else {
+      nir_ssa_def *index = nir_iand(b, nir_f2i32(b, pick(g)),
+                                    nir_imm_int(b, NUM_PARAMS - 1));
+      deref = nir_build_deref_array(b, deref, index);
+   }
+
+   v = nir_load_deref(b, deref);
+   return nir_channel(b, v, rand() % 4);
+}
+
+static void
+gen_tex(struct gen *g)
+{
+   nir_builder *b = g->b;
+   nir_variable *sampler = g->samplers[rand() % NUM_SAMPLERS];
+   nir_tex_instr *tex = nir_tex_instr_create(b->shader, 2);
+
+   tex->op = nir_texop_tex;
+   tex->sampler_dim = GLSL_SAMPLER_DIM_2D;
+   tex->coord_components = 2;
+   tex->dest_type = nir_type_float;
+   tex->src[0].src_type = nir_tex_src_texture_deref;
+   tex->src[0].src = nir_src_for_ssa(&nir_build_deref_var(b, sampler)->dest.ssa);
+   tex->src[1].src_type = nir_tex_src_coord;
+   tex->src[1].src = nir_src_for_ssa(nir_vec2(b, pick(g), pick(g)));
+   nir_ssa_dest_init(&tex->instr, &tex->dest, 4, 32, NULL);
+   nir_builder_instr_insert(b, &tex->instr);
+
+   for (unsigned c = 0; c < 4; c++)
+      push(g, nir_channel(b, &tex->dest.ssa, c));
+}
+
+static void
+gen_op(struct gen *g)
+{
+   nir_builder *b = g->b;
+   nir_ssa_def *a = pick(g), *v;
+
+   switch (rand() % 16) {
+   case 0: case 1: case 2: v = nir_fadd(b, a, pick(g)); break;
+   case 3: case 4: case 5: v = nir_fmul(b, a, pick(g)); break;
+   case 6: v = nir_ffma(b, a, pick(g), pick(g)); break;
+   case 7: v = nir_fmul(b, a, load_param(g)); break;
+   case 8: v = nir_fadd(b, a, load_param(g)); break;
+   case 9: v = nir_fmul(b, a, nir_imm_float(b, (rand() % 64) / 8.0f)); break;
+   case 10: v = nir_fmax(b, a, nir_imm_float(b, 0.0f)); break;
+   case 11: v = nir_fsat(b, a); break;
+   case 12: v = nir_frsq(b, nir_fabs(b, a)); break;
+   case 13:
+      v = nir_bcsel(b, nir_flt(b, a, pick(g)), pick(g), load_param(g));
+      break;
+   case 14:
+      gen_tex(g);
+      return;
+   default: v = nir_fneg(b, nir_fmul(b, a, pick(g))); break;
+   }
+
+   push(g, v);
+}
+
+static void
+gen_ops(struct gen *g, unsigned count, unsigned depth)
+{
+   for (unsigned n = 0; n < count; n++) {
+      if (depth < 3 && count > 16 && rand() % 32 == 0) {
+         nir_builder *b = g->b;
+         struct gen saved = *g, then_g;
+         unsigned arm = 1 + rand() % MIN2(count / 4, 64);
+
+         nir_push_if(b, nir_flt(b, pick(g), pick(g)));
+         gen_ops(g, arm, depth + 1);
+         then_g = *g;
+         *g = saved;
+
+         nir_push_else(b, NULL);
+         gen_ops(g, arm, depth + 1);
+         nir_pop_if(b, NULL);
+
+         /* Merge the most recent values of both sides. */
+         for (unsigned i = 0; i < 4; i++) {
+            nir_ssa_def *then_f = then_g.f[(then_g.num_f - 1 - i) % WINDOW];
+            nir_ssa_def *else_f = g->f[(g->num_f - 1 - i) % WINDOW];
+
+            saved.f[saved.num_f++ % WINDOW] = nir_if_phi(b, then_f, else_f);
+         }
+
+         *g = saved;
+         n += 2 * arm;
+      } else {
+         gen_op(g);
+      }
+   }
+}
+
+/* With extra set, one more instruction that ends up in an output is added
+ * at the start.  Everything else is the same.
+ */
+static nir_shader *
+create_shader(unsigned num_ops, unsigned seed, bool extra)
+{
+   static const char *in_names[] = {
+      "v_texcoord", "v_normal", "v_position", "v_color",
+   };
+   nir_builder b;
+   struct gen g = { .b = &b };
+
+   nir_builder_init_simple_shader(&b, NULL, MESA_SHADER_FRAGMENT, &options);
+   b.shader->info.name = ralloc_strdup(b.shader, "serialize_bench");
+   srand(seed);
+
+   g.params = nir_variable_create(b.shader, nir_var_uniform,
+                                  glsl_array_type(glsl_vec4_type(),
+                                                  NUM_PARAMS, 0),
+                                  "u_params");
+
+   for (unsigned n = 0; n < NUM_SAMPLERS; n++) {
+      char name[16];
+      snprintf(name, sizeof(name), "u_tex%u", n);
+      g.samplers[n] =
+         nir_variable_create(b.shader, nir_var_uniform,
+                             glsl_sampler_type(GLSL_SAMPLER_DIM_2D, false,
+                                               false, GLSL_TYPE_FLOAT),
+                             name);
+      g.samplers[n]->data.binding = n;
+   }
+
+   nir_ssa_def *first = NULL;
+   for (unsigned n = 0; n < ARRAY_SIZE(in_names); n++) {
+      nir_variable *in =
+         nir_variable_create(b.shader, nir_var_shader_in, glsl_vec4_type(),
+                             in_names[n]);
+      in->data.location = VARYING_SLOT_VAR0 + n;
+      in->data.driver_location = n;
+
+      nir_ssa_def *v = nir_load_var(&b, in);
+      for (unsigned c = 0; c < 4; c++)
+         push(&g, nir_channel(&b, v, c));
+
+      if (n == 0)
+         first = nir_channel(&b, v, 0);
+   }
+
+   nir_ssa_def *extra_def = first;
+   if (extra)
+      extra_def = nir_fmul(&b, first, nir_imm_float(&b, 2.0f));
+
+   gen_ops(&g, num_ops, 0);
+
+   /* Write everything that is still in the window, so that most of the
+    * code is live.
+    */
+   for (unsigned n = 0; n < WINDOW / 4; n++) {
+      nir_variable *out =
+         nir_variable_create(b.shader, nir_var_shader_out,
+                             glsl_vec4_type(), "out_color");
+      out->data.location = FRAG_RESULT_DATA0 + n;
+      out->data.driver_location = n;
+
+      nir_ssa_def *c[4];
+      for (unsigned i = 0; i < 4; i++)
+         c[i] = g.f[(n * 4 + i) % WINDOW];
+      if (n == 0)
+         c[3] = nir_fadd(&b, c[3], extra_def);
+      nir_store_var(&b, out, nir_vec(&b, c, 4), 0xf);
+   }
+
+   nir_validate_shader(b.shader, "generated");
+   return b.shader;
+}
+
+static unsigned
+count_instrs(nir_shader *s)
+{
+   unsigned count = 0;
+
+   nir_foreach_function(function, s) {
+      if (!function->impl)
+         continue;
+
+      nir_foreach_block(block, function->impl) {
+         nir_foreach_instr(instr, block)
+            count++;
+      }
+   }
+
+   return count;
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+   uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+   return x < y ? -1 : x > y;
+}
+
+/* The number of bytes of b that aren't part of an 8-byte sequence that
+ * also occurs in a.
+ */
+static size_t
+delta_size(const struct blob *a, const struct blob *b)
+{
+   if (a->size < 8 || b->size < 8)
+      return b->size;
+
+   size_t num = a->size - 7;
+   uint64_t *pieces = malloc(num * sizeof(*pieces));
+   for (size_t i = 0; i < num; i++)
+      memcpy(&pieces[i], a->data + i, 8);
+   qsort(pieces, num, sizeof(*pieces), compare_u64);
+
+   size_t delta = 0, i = 0;
+   while (i + 8 <= b->size) {
+      uint64_t piece;
+      memcpy(&piece, b->data + i, 8);
+      if (bsearch(&piece, pieces, num, sizeof(*pieces), compare_u64)) {
+         i += 8;
+      } else {
+         delta++;
+         i++;
+      }
+   }
+   delta += b->size - i;
+
+   free(pieces);
+   return delta;
+}
+
+static unsigned num_runs = 5;
+
+static void
+run(const char *name, nir_shader *s, nir_shader *variant)
+{
+   int64_t serialize_time = INT64_MAX, deserialize_time = INT64_MAX;
+   struct blob blob, stripped;
+
+   blob_init(&stripped);
+   nir_serialize(&stripped, s, true);
+
+   for (unsigned i = 0; i < num_runs; i++) {
+      blob_init(&blob);
+
+      int64_t start = os_time_get_nano();
+      nir_serialize(&blob, s, false);
+      serialize_time = MIN2(serialize_time, os_time_get_nano() - start);
+
+      if (i + 1 < num_runs)
+         blob_finish(&blob);
+   }
+
+   nir_shader *copy = NULL;
+   for (unsigned i = 0; i < num_runs; i++) {
+      struct blob_reader reader;
+      blob_reader_init(&reader, blob.data, blob.size);
+
+      ralloc_free(copy);
+
+      int64_t start = os_time_get_nano();
+      copy = nir_deserialize(NULL, &options, &reader);
+      deserialize_time = MIN2(deserialize_time, os_time_get_nano() - start);
+   }
+
+   struct blob again;
+   blob_init(&again);
+   nir_serialize(&again, copy, false);
+   bool same = again.size == blob.size &&
+               memcmp(again.data, blob.data, blob.size) == 0;
+   blob_finish(&again);
+   ralloc_free(copy);
+
+   char delta[32] = "-";
+   if (variant) {
+      struct blob variant_blob;
+      blob_init(&variant_blob);
+      nir_serialize(&variant_blob, variant, false);
+      snprintf(delta, sizeof(delta), "%zu", delta_size(&blob, &variant_blob));
+      blob_finish(&variant_blob);
+   }
+
+   printf("%-24s %6u instrs  %8zu bytes  %8zu stripped  %7s delta  "
+          "serialize %7.2f ms  deserialize %7.2f ms  %s\n",
+          name, count_instrs(s), blob.size, stripped.size, delta,
+          serialize_time / 1e6, deserialize_time / 1e6,
+          same ? "same" : "DIFFERENT");
+
+   blob_finish(&blob);
+   blob_finish(&stripped);
+}
+
+static void
+replay(const char *filename)
+{
+   size_t size;
+   char *data = os_read_file(filename, &size);
+   struct blob_reader blob;
+
+   if (!data) {
+      fprintf(stderr, "Couldn't read %s\n", filename);
+      return;
+   }
+
+   blob_reader_init(&blob, data, size);
+   nir_shader *s = nir_deserialize(NULL, &options, &blob);
+
+   if (blob.overrun) {
+      fprintf(stderr, "%s is not a valid shader\n", filename);
+   } else {
+      run(filename, s, NULL);
+   }
+
+   ralloc_free(s);
+   free(data);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned scale = 1;
+   int i;
+
+   for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+      if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+         scale = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+         num_runs = atoi(argv[++i]);
+   }
+
+   num_runs = MAX2(num_runs, 1);
+
+   glsl_type_singleton_init_or_ref();
+
+   if (i < argc) {
+      for (; i < argc; i++)
+         replay(argv[i]);
+   } else {
+      static const unsigned sizes[] = { 100, 500, 2000, 2000, 10000, 40000 };
+
+      for (unsigned j = 0; j < ARRAY_SIZE(sizes); j++) {
+         unsigned num_ops = sizes[j] * scale;
+         nir_shader *s = create_shader(num_ops, j, false);
+         nir_shader *variant = create_shader(num_ops, j, true);
+         char name[64];
+
+         snprintf(name, sizeof(name), "%u ops, seed %u", num_ops, j);
+         run(name, s, variant);
+
+         ralloc_free(s);
+         ralloc_free(variant);
+      }
+   }
+
+   glsl_type_singleton_decref();
+   return 0;
+}
@@ -0,0 +1,46 @@
+#!/bin/sh
+# Runs nir_serialize_bench against nir_serialize.c from before the varint
+# stream format, to get the numbers of the old format for comparison.
+#
+# The old nir_serialize.c is taken from git, compiled with the flags of the
+# current one and linked into the bench ahead of libnir, so everything else
+# is the same as in the current build.
+#
+# Usage: serialize_bench_v1.sh <meson build dir> [serialize_bench args...]
+
+set -e
+
+if [ $# -lt 1 ]; then
+   echo "Usage: $0 <meson build dir> [serialize_bench args...]" >&2
+   exit 1
+fi
+
+build=$(cd "$1" && pwd)
+shift
+top=$(git -C "$(dirname "$0")" rev-parse --show-toplevel)
+serialize=src/compiler/nir/nir_serialize.c
+bench=src/compiler/nir/nir_serialize_bench
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# The first commit using blob_write_varint() is the one that changed the
+# format, so its parent has the old one.
+commit=$(git -C "$top" log --reverse --format=%H -S blob_write_varint -- \
+         "$serialize" | head -n 1)
+git -C "$top" show "$commit^:$serialize" > "$tmp/nir_serialize_v1.c"
+
+cd "$build"
+ninja "$bench" > /dev/null
+
+compile=$(ninja -t commands src/compiler/nir/libnir.a |
+          grep -- "-c [^ ]*/nir_serialize\.c$" |
+          sed -e "s| -MD -MQ [^ ]* -MF [^ ]*||" \
+              -e "s| -o [^ ]*| -o $tmp/nir_serialize_v1.o|" \
+              -e "s| -c [^ ]*| -c $tmp/nir_serialize_v1.c|")
+link=$(ninja -t commands "$bench" | tail -n 1 |
+       sed -e "s| -o $bench | -o $tmp/bench_v1 $tmp/nir_serialize_v1.o |")
+
+eval "$compile"
+eval "$link"
+"$tmp/bench_v1" "$@"
@@ -34,7 +34,7 @@ protected:
    nir_serialize_test();
    ~nir_serialize_test();
 
-   void serialize();
+   void serialize(bool strip = false);
    nir_alu_instr *get_last_alu(nir_shader *);
    void ASSERT_SWIZZLE_EQ(nir_alu_instr *, nir_alu_instr *, unsigned count, unsigned src);
 
@@ -71,13 +71,13 @@ nir_serialize_test::~nir_serialize_test()
 }
 
 void
-nir_serialize_test::serialize() {
+nir_serialize_test::serialize(bool strip) {
    struct blob blob;
    struct blob_reader reader;
 
    blob_init(&blob);
 
-   nir_serialize(&blob, b->shader, false);
+   nir_serialize(&blob, b->shader, strip);
    blob_reader_init(&reader, blob.data, blob.size);
    nir_shader *cloned = nir_deserialize(mem_ctx, &options, &reader);
    blob_finish(&blob);
@@ -282,3 +282,100 @@ TEST_P(nir_serialize_all_but_one_test, single_channel)
 
    ASSERT_SWIZZLE_EQ(vec_alu, vec_alu_dup, 1, 0);
 }
+
+TEST_F(nir_serialize_test, names_and_types)
+{
+   /* Strings and types are only written once per blob, so check that
+    * repeated ones come back right.
+    */
+   const struct glsl_type *vec4_array = glsl_array_type(glsl_vec4_type(), 4, 0);
+   nir_variable *a = nir_variable_create(b->shader, nir_var_mem_shared,
+                                         vec4_array, "a");
+   nir_variable *c = nir_variable_create(b->shader, nir_var_mem_shared,
+                                         glsl_vec4_type(), "c");
+   nir_variable *a2 = nir_variable_create(b->shader, nir_var_mem_shared,
+                                          vec4_array, "a");
+
+   nir_ssa_def *v = nir_load_deref(b, nir_build_deref_array_imm(b, nir_build_deref_var(b, a), 1));
+   nir_store_var(b, c, v, 0xf);
+   nir_store_deref(b, nir_build_deref_array_imm(b, nir_build_deref_var(b, a2), 2), v, 0xf);
+
+   serialize();
+
+   nir_variable *vars[3];
+   unsigned num_vars = 0;
+   nir_foreach_variable_with_modes(var, dup, nir_var_mem_shared)
+      vars[num_vars++] = var;
+
+   ASSERT_EQ(num_vars, 3);
+   EXPECT_STREQ(vars[0]->name, "a");
+   EXPECT_STREQ(vars[1]->name, "c");
+   EXPECT_STREQ(vars[2]->name, "a");
+   EXPECT_NE(vars[0]->name, vars[2]->name);
+   EXPECT_EQ(vars[0]->type, vec4_array);
+   EXPECT_EQ(vars[1]->type, glsl_vec4_type());
+   EXPECT_EQ(vars[2]->type, vec4_array);
+
+   ralloc_free(dup);
+   serialize(true);
+
+   nir_foreach_variable_with_modes(var, dup, nir_var_mem_shared) {
+      EXPECT_EQ(var->name, nullptr);
+      EXPECT_NE(var->type, nullptr);
+   }
+}
+
+TEST_F(nir_serialize_test, clone)
+{
+   /* nir_shader_clone() remaps SSA defs and registers by index, so also give
+    * it a shader where two defs share an index and one is out of range.
+    */
+   nir_variable *out = nir_variable_create(b->shader, nir_var_shader_out,
+                                           glsl_uint_type(), "out");
+   nir_variable *acc = nir_local_variable_create(b->impl, glsl_uint_type(),
+                                                 "acc");
+   nir_ssa_def *x = nir_load_local_invocation_index(b);
+   nir_ssa_def *y = nir_iadd(b, x, nir_imm_int(b, 1));
+   nir_store_var(b, acc, x, 1);
+
+   nir_loop *loop = nir_push_loop(b);
+   nir_ssa_def *v = nir_load_var(b, acc);
+   nir_push_if(b, nir_ult(b, v, y));
+   nir_jump(b, nir_jump_break);
+   nir_pop_if(b, NULL);
+   nir_store_var(b, acc, nir_imul(b, v, y), 1);
+   nir_pop_loop(b, loop);
+
+   nir_register *reg = nir_local_reg_create(b->impl);
+   reg->num_components = 1;
+   reg->bit_size = 32;
+   nir_alu_instr *mov = nir_alu_instr_create(b->shader, nir_op_mov);
+   mov->dest.dest = nir_dest_for_reg(reg);
+   mov->dest.write_mask = 1;
+   mov->src[0].src = nir_src_for_ssa(nir_load_var(b, acc));
+   nir_builder_instr_insert(b, &mov->instr);
+
+   nir_store_var(b, out, nir_iadd(b, nir_ssa_for_src(b, nir_src_for_reg(reg), 1), y), 1);
+   NIR_PASS_V(b->shader, nir_lower_vars_to_ssa);
+
+   x->index = y->index;
+   nir_foreach_instr(instr, nir_loop_first_block(loop)) {
+      if (instr->type == nir_instr_type_phi)
+         nir_instr_as_phi(instr)->dest.ssa.index = b->impl->ssa_alloc + 10;
+   }
+
+   dup = nir_shader_clone(mem_ctx, b->shader);
+   nir_validate_shader(dup, "cloned");
+
+   struct blob blob_a, blob_b;
+   blob_init(&blob_a);
+   blob_init(&blob_b);
+   nir_serialize(&blob_a, b->shader, false);
+   nir_serialize(&blob_b, dup, false);
+
+   ASSERT_EQ(blob_a.size, blob_b.size);
+   EXPECT_EQ(memcmp(blob_a.data, blob_b.data, blob_a.size), 0);
+
+   blob_finish(&blob_a);
+   blob_finish(&blob_b);
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include "nir.h"
+#include "nir_builder.h"
+
+class nir_validate_test : public ::testing::Test {
+protected:
+   nir_validate_test();
+   ~nir_validate_test();
+
+   nir_builder bld;
+
+   nir_ssa_def *in_def;
+   nir_variable *out_var;
+};
+
+nir_validate_test::nir_validate_test()
+{
+   glsl_type_singleton_init_or_ref();
+
+   static const nir_shader_compiler_options options = { };
+   nir_builder_init_simple_shader(&bld, NULL, MESA_SHADER_VERTEX, &options);
+
+   nir_variable *var = nir_variable_create(bld.shader, nir_var_shader_in, glsl_int_type(), "in");
+   in_def = nir_load_var(&bld, var);
+
+   out_var = nir_variable_create(bld.shader, nir_var_shader_out, glsl_int_type(), "out");
+}
+
+nir_validate_test::~nir_validate_test()
+{
+   ralloc_free(bld.shader);
+   glsl_type_singleton_decref();
+}
+
+#ifndef NDEBUG
+
+TEST_F(nir_validate_test, change_count)
+{
+   nir_function_impl *impl = bld.impl;
+
+   nir_validate_shader(bld.shader, NULL);
+   EXPECT_EQ(impl->validated_change_count, impl->change_count);
+
+   /* A pass that preserves all metadata didn't change anything. */
+   unsigned count = impl->change_count;
+   nir_metadata_preserve(impl, nir_metadata_all);
+   EXPECT_EQ(impl->change_count, count);
+
+   nir_ssa_def *sum = nir_iadd(&bld, in_def, in_def);
+   EXPECT_NE(impl->change_count, count);
+
+   count = impl->change_count;
+   nir_store_var(&bld, out_var, sum, 1);
+   EXPECT_NE(impl->change_count, count);
+
+   count = impl->change_count;
+   nir_ssa_def_rewrite_uses(sum, nir_src_for_ssa(in_def));
+   EXPECT_NE(impl->change_count, count);
+
+   count = impl->change_count;
+   nir_instr_remove(sum->parent_instr);
+   EXPECT_NE(impl->change_count, count);
+
+   count = impl->change_count;
+   nir_metadata_preserve(impl, nir_metadata_block_index);
+   EXPECT_NE(impl->change_count, count);
+
+   count = impl->change_count;
+   nir_push_if(&bld, nir_ieq(&bld, in_def, nir_imm_int(&bld, 0)));
+   nir_pop_if(&bld, NULL);
+   EXPECT_NE(impl->change_count, count);
+
+   EXPECT_NE(impl->validated_change_count, impl->change_count);
+   nir_validate_shader(bld.shader, NULL);
+   EXPECT_EQ(impl->validated_change_count, impl->change_count);
+}
+
+TEST_F(nir_validate_test, use_lists)
+{
+   /* Enough uses of in_def that its use list is sorted for the lookups. */
+   nir_ssa_def *sum = in_def;
+   for (unsigned i = 0; i < 12; i++)
+      sum = nir_iadd(&bld, sum, in_def);
+
+   nir_register *reg = nir_local_reg_create(bld.impl);
+   reg->num_components = 1;
+   reg->bit_size = 32;
+   nir_alu_instr *mov = nir_alu_instr_create(bld.shader, nir_op_mov);
+   mov->dest.dest = nir_dest_for_reg(reg);
+   mov->dest.write_mask = 1;
+   mov->src[0].src = nir_src_for_ssa(sum);
+   nir_builder_instr_insert(&bld, &mov->instr);
+
+   nir_ssa_def *cond = nir_ieq(&bld, nir_ssa_for_src(&bld, nir_src_for_reg(reg), 1), in_def);
+   nir_push_if(&bld, cond);
+   nir_store_var(&bld, out_var, sum, 1);
+   nir_pop_if(&bld, NULL);
+
+   nir_validate_shader(bld.shader, NULL);
+
+   /* Point a source at another value without updating the use lists. */
+   nir_alu_instr *alu = nir_instr_as_alu(sum->parent_instr);
+   ASSERT_EQ(alu->src[1].src.ssa, in_def);
+   alu->src[1].src.ssa = cond;
+   nir_function_impl_changed(bld.impl);
+
+   EXPECT_DEATH(nir_validate_shader(bld.shader, NULL),
+                "NIR validation failed");
+
+   alu->src[1].src.ssa = in_def;
+   nir_validate_shader(bld.shader, NULL);
+}
+
+#endif
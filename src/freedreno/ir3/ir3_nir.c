@@ -28,6 +28,8 @@
 #include "util/debug.h"
 #include "util/u_math.h"
 
+#include "compiler/nir/nir_schedule.h"
+
 #include "ir3_nir.h"
 #include "ir3_compiler.h"
 #include "ir3_shader.h"
@@ -375,6 +377,39 @@ ir3_nir_lower_layer_id(nir_shader *nir)
 	return progress;
 }
 
+/* Count pressure in half-register channels: a 32-bit value takes two and a
+ * 64-bit value four.  Booleans and 8-bit values still take a whole one.
+ */
+static int
+ir3_nir_schedule_pressure(unsigned num_components, unsigned bit_size,
+		void *data)
+{
+	return num_components * DIV_ROUND_UP(bit_size, 16);
+}
+
+static const nir_schedule_latencies ir3_nir_schedule_latencies = {
+	.alu = 1,
+	.alu_complex = 10,	/* cat4 (sfu) */
+	.tex = 100,			/* cat5 */
+	.load = 100,		/* cat6 ldg/ldib/ldc */
+	.intrinsic = 1,
+};
+
+static void
+ir3_nir_schedule(nir_shader *s)
+{
+	const nir_schedule_options options = {
+		/* Aim for 32 live full vec4 registers, which keeps enough waves in
+		 * flight to hide the latency of what gets scheduled early.
+		 */
+		.threshold = 32 * 4 * 2,
+		.pressure_cb = ir3_nir_schedule_pressure,
+		.latencies = &ir3_nir_schedule_latencies,
+	};
+
+	nir_schedule(s, &options);
+}
+
 void
 ir3_nir_lower_variant(struct ir3_shader_variant *so, nir_shader *s)
 {
@@ -482,6 +517,9 @@ ir3_nir_lower_variant(struct ir3_shader_variant *so, nir_shader *s)
 
 	OPT_V(s, nir_opt_sink, nir_move_const_undef);
 
+	if (ir3_shader_debug & IR3_DBG_NIRSCHED)
+		ir3_nir_schedule(s);
+
 	if (ir3_shader_debug & IR3_DBG_DISASM) {
 		debug_printf("----------------------\n");
 		nir_print_shader(s, stdout);
@@ -47,6 +47,7 @@
 #include "cso_cache/cso_context.h"
 #include "cso_cache/cso_cache.h"
 #include "cso_cache/cso_hash.h"
+#include "cso_cache/cso_screen_cache.h"
 #include "cso_context.h"
 
 
@@ -64,6 +65,8 @@ struct sampler_info
 struct cso_context {
    struct pipe_context *pipe;
    struct cso_cache *cache;
+   /** Shared by all contexts of the screen, or NULL. */
+   struct cso_screen_cache *screen_cache;
 
    struct u_vbuf *vbuf;
    struct u_vbuf *vbuf_current;
@@ -324,6 +327,10 @@ cso_create_context(struct pipe_context *pipe, unsigned flags)
 
    cso_init_vbuf(ctx, flags);
 
+   if ((flags & CSO_SHARED_STATE_CACHE) &&
+       pipe->screen->get_param(pipe->screen, PIPE_CAP_SHAREABLE_CSOS))
+      ctx->screen_cache = cso_screen_cache_reference(pipe->screen);
+
    /* Enable for testing: */
    if (0) cso_set_maximum_cache_size( ctx->cache, 4 );
 
@@ -446,6 +453,9 @@ void cso_destroy_context( struct cso_context *ctx )
       ctx->cache = NULL;
    }
 
+   /* After cso_cache_delete, which released the shared CSOs. */
+   cso_screen_cache_unreference(ctx->screen_cache);
+
    if (ctx->vbuf)
       u_vbuf_destroy(ctx->vbuf);
    FREE( ctx );
@@ -483,8 +493,16 @@ enum pipe_error cso_set_blend(struct cso_context *ctx,
 
       memset(&cso->state, 0, sizeof cso->state);
       memcpy(&cso->state, templ, key_size);
-      cso->data = ctx->pipe->create_blend_state(ctx->pipe, &cso->state);
-      cso->delete_state = (cso_state_callback)ctx->pipe->delete_blend_state;
+      if (ctx->screen_cache) {
+         cso->data = cso_screen_cache_acquire(ctx->screen_cache, ctx->pipe,
+                                              CSO_BLEND, hash_key,
+                                              &cso->state, key_size);
+         cso->delete_state = cso->data ? cso_screen_cache_release : NULL;
+      } else {
+         cso->data = ctx->pipe->create_blend_state(ctx->pipe, &cso->state);
+         cso->delete_state =
+            (cso_state_callback)ctx->pipe->delete_blend_state;
+      }
       cso->context = ctx->pipe;
 
       iter = cso_insert_state(ctx->cache, hash_key, CSO_BLEND, cso);
@@ -544,10 +562,18 @@ cso_set_depth_stencil_alpha(struct cso_context *ctx,
          return PIPE_ERROR_OUT_OF_MEMORY;
 
       memcpy(&cso->state, templ, sizeof(*templ));
-      cso->data = ctx->pipe->create_depth_stencil_alpha_state(ctx->pipe,
-                                                              &cso->state);
-      cso->delete_state =
-         (cso_state_callback)ctx->pipe->delete_depth_stencil_alpha_state;
+      if (ctx->screen_cache) {
+         cso->data = cso_screen_cache_acquire(ctx->screen_cache, ctx->pipe,
+                                              CSO_DEPTH_STENCIL_ALPHA,
+                                              hash_key, &cso->state,
+                                              key_size);
+         cso->delete_state = cso->data ? cso_screen_cache_release : NULL;
+      } else {
+         cso->data = ctx->pipe->create_depth_stencil_alpha_state(ctx->pipe,
+                                                                 &cso->state);
+         cso->delete_state =
+            (cso_state_callback)ctx->pipe->delete_depth_stencil_alpha_state;
+      }
       cso->context = ctx->pipe;
 
       iter = cso_insert_state(ctx->cache, hash_key,
@@ -613,9 +639,17 @@ enum pipe_error cso_set_rasterizer(struct cso_context *ctx,
          return PIPE_ERROR_OUT_OF_MEMORY;
 
       memcpy(&cso->state, templ, sizeof(*templ));
-      cso->data = ctx->pipe->create_rasterizer_state(ctx->pipe, &cso->state);
-      cso->delete_state =
-         (cso_state_callback)ctx->pipe->delete_rasterizer_state;
+      if (ctx->screen_cache) {
+         cso->data = cso_screen_cache_acquire(ctx->screen_cache, ctx->pipe,
+                                              CSO_RASTERIZER, hash_key,
+                                              &cso->state, key_size);
+         cso->delete_state = cso->data ? cso_screen_cache_release : NULL;
+      } else {
+         cso->data = ctx->pipe->create_rasterizer_state(ctx->pipe,
+                                                        &cso->state);
+         cso->delete_state =
+            (cso_state_callback)ctx->pipe->delete_rasterizer_state;
+      }
       cso->context = ctx->pipe;
 
       iter = cso_insert_state(ctx->cache, hash_key, CSO_RASTERIZER, cso);
@@ -1249,9 +1283,17 @@ cso_single_sampler(struct cso_context *ctx, enum pipe_shader_type shader_stage,
             return;
 
          memcpy(&cso->state, templ, sizeof(*templ));
-         cso->data = ctx->pipe->create_sampler_state(ctx->pipe, &cso->state);
-         cso->delete_state =
-            (cso_state_callback) ctx->pipe->delete_sampler_state;
+         if (ctx->screen_cache) {
+            cso->data = cso_screen_cache_acquire(ctx->screen_cache, ctx->pipe,
+                                                 CSO_SAMPLER, hash_key,
+                                                 &cso->state, key_size);
+            cso->delete_state = cso->data ? cso_screen_cache_release : NULL;
+         } else {
+            cso->data = ctx->pipe->create_sampler_state(ctx->pipe,
+                                                        &cso->state);
+            cso->delete_state =
+               (cso_state_callback) ctx->pipe->delete_sampler_state;
+         }
          cso->context = ctx->pipe;
          cso->hash_key = hash_key;
 
@@ -44,6 +44,10 @@ struct u_vbuf;
 
 #define CSO_NO_USER_VERTEX_BUFFERS (1 << 0)
 #define CSO_NO_64B_VERTEX_BUFFERS  (1 << 1)
+/* Share blend, DSA, rasterizer and sampler CSOs with the other contexts of
+ * the screen, if the driver supports PIPE_CAP_SHAREABLE_CSOS.
+ */
+#define CSO_SHARED_STATE_CACHE     (1 << 2)
 
 struct cso_context *cso_create_context(struct pipe_context *pipe,
                                        unsigned flags);
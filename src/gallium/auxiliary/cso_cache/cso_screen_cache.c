@@ -0,0 +1,316 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The Mesa authors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "pipe/p_screen.h"
+#include "util/hash_table.h"
+#include "util/u_memory.h"
+#include "util/u_thread.h"
+
+#include "cso_screen_cache.h"
+
+
+struct cso_screen_entry {
+   enum cso_cache_type type;
+   unsigned hash_key;
+   unsigned key_size;
+   const void *templ;
+
+   /** Number of per-context CSOs pointing at this driver object. */
+   unsigned refcount;
+   void *handle;
+};
+
+struct cso_screen_cache {
+   struct pipe_screen *screen;
+
+   /** Number of cso_contexts using this cache. */
+   unsigned refcount;
+
+   /** cso_screen_entry -> cso_screen_entry, keyed by type and template. */
+   struct hash_table *states;
+
+   /** Driver handle -> cso_screen_entry. */
+   struct hash_table *handles;
+};
+
+/* All screen caches of the process share one lock.  It is only taken when
+ * a cso_context misses in its own cache or deletes a CSO, which is rare.
+ */
+static mtx_t cso_screen_cache_mutex = _MTX_INITIALIZER_NP;
+
+/** pipe_screen -> cso_screen_cache */
+static struct hash_table *cso_screen_caches;
+
+
+static uint32_t
+entry_hash(const void *key)
+{
+   const struct cso_screen_entry *entry = key;
+   return entry->hash_key ^ ((uint32_t)entry->type * 0x9e3779b1);
+}
+
+static bool
+entry_equal(const void *a, const void *b)
+{
+   const struct cso_screen_entry *ea = a, *eb = b;
+
+   return ea->type == eb->type &&
+          ea->key_size == eb->key_size &&
+          memcmp(ea->templ, eb->templ, ea->key_size) == 0;
+}
+
+static void
+delete_driver_state(struct pipe_context *pipe, enum cso_cache_type type,
+                    void *handle)
+{
+   switch (type) {
+   case CSO_BLEND:
+      pipe->delete_blend_state(pipe, handle);
+      break;
+   case CSO_DEPTH_STENCIL_ALPHA:
+      pipe->delete_depth_stencil_alpha_state(pipe, handle);
+      break;
+   case CSO_RASTERIZER:
+      pipe->delete_rasterizer_state(pipe, handle);
+      break;
+   case CSO_SAMPLER:
+      pipe->delete_sampler_state(pipe, handle);
+      break;
+   default:
+      assert(0);
+   }
+}
+
+static void *
+create_driver_state(struct pipe_context *pipe, enum cso_cache_type type,
+                    const void *templ)
+{
+   switch (type) {
+   case CSO_BLEND:
+      return pipe->create_blend_state(pipe, templ);
+   case CSO_DEPTH_STENCIL_ALPHA:
+      return pipe->create_depth_stencil_alpha_state(pipe, templ);
+   case CSO_RASTERIZER:
+      return pipe->create_rasterizer_state(pipe, templ);
+   case CSO_SAMPLER:
+      return pipe->create_sampler_state(pipe, templ);
+   default:
+      assert(0);
+      return NULL;
+   }
+}
+
+
+/**
+ * Get the screen cache of \p screen, creating it if this is the first
+ * cso_context of the screen asking for it.
+ */
+struct cso_screen_cache *
+cso_screen_cache_reference(struct pipe_screen *screen)
+{
+   struct cso_screen_cache *sc = NULL;
+   struct hash_entry *he;
+
+   mtx_lock(&cso_screen_cache_mutex);
+
+   if (!cso_screen_caches) {
+      cso_screen_caches = _mesa_pointer_hash_table_create(NULL);
+      if (!cso_screen_caches)
+         goto out;
+   }
+
+   he = _mesa_hash_table_search(cso_screen_caches, screen);
+   if (he) {
+      sc = he->data;
+      sc->refcount++;
+      goto out;
+   }
+
+   sc = CALLOC_STRUCT(cso_screen_cache);
+   if (!sc)
+      goto out;
+
+   sc->screen = screen;
+   sc->refcount = 1;
+   sc->states = _mesa_hash_table_create(NULL, entry_hash, entry_equal);
+   sc->handles = _mesa_pointer_hash_table_create(NULL);
+   if (!sc->states || !sc->handles ||
+       !_mesa_hash_table_insert(cso_screen_caches, screen, sc)) {
+      _mesa_hash_table_destroy(sc->states, NULL);
+      _mesa_hash_table_destroy(sc->handles, NULL);
+      FREE(sc);
+      sc = NULL;
+   }
+
+out:
+   mtx_unlock(&cso_screen_cache_mutex);
+   return sc;
+}
+
+void
+cso_screen_cache_unreference(struct cso_screen_cache *sc)
+{
+   if (!sc)
+      return;
+
+   mtx_lock(&cso_screen_cache_mutex);
+
+   if (--sc->refcount == 0) {
+      /* Every cso_context releases its CSOs before dropping the cache. */
+      assert(sc->states->entries == 0);
+
+      _mesa_hash_table_remove_key(cso_screen_caches, sc->screen);
+      _mesa_hash_table_destroy(sc->states, NULL);
+      _mesa_hash_table_destroy(sc->handles, NULL);
+      FREE(sc);
+
+      if (cso_screen_caches->entries == 0) {
+         _mesa_hash_table_destroy(cso_screen_caches, NULL);
+         cso_screen_caches = NULL;
+      }
+   }
+
+   mtx_unlock(&cso_screen_cache_mutex);
+}
+
+/**
+ * Return the driver object for the given template, taking a reference.
+ *
+ * \p templ must point to a complete state struct of the given type, of
+ * which only the first \p key_size bytes are compared.  On a miss the
+ * object is created with \p pipe.  Returns NULL on failure.
+ */
+void *
+cso_screen_cache_acquire(struct cso_screen_cache *sc,
+                         struct pipe_context *pipe,
+                         enum cso_cache_type type,
+                         unsigned hash_key,
+                         const void *templ, unsigned key_size)
+{
+   struct cso_screen_entry key = {type, hash_key, key_size, templ};
+   struct cso_screen_entry *entry;
+   struct hash_entry *he;
+   void *handle;
+
+   mtx_lock(&cso_screen_cache_mutex);
+   he = _mesa_hash_table_search_pre_hashed(sc->states, entry_hash(&key), &key);
+   if (he) {
+      entry = he->data;
+      entry->refcount++;
+      mtx_unlock(&cso_screen_cache_mutex);
+      return entry->handle;
+   }
+   mtx_unlock(&cso_screen_cache_mutex);
+
+   /* Create the driver object without holding the lock, so that contexts
+    * creating unrelated state don't serialize on the driver.
+    */
+   handle = create_driver_state(pipe, type, templ);
+   if (!handle)
+      return NULL;
+
+   entry = MALLOC(sizeof(*entry) + key_size);
+   if (!entry) {
+      delete_driver_state(pipe, type, handle);
+      return NULL;
+   }
+
+   memcpy(entry + 1, templ, key_size);
+   entry->type = type;
+   entry->hash_key = hash_key;
+   entry->key_size = key_size;
+   entry->templ = entry + 1;
+   entry->refcount = 1;
+   entry->handle = handle;
+
+   mtx_lock(&cso_screen_cache_mutex);
+   he = _mesa_hash_table_search_pre_hashed(sc->states, entry_hash(entry),
+                                           entry);
+   if (he) {
+      /* Another context created the same state in the meantime. */
+      struct cso_screen_entry *other = he->data;
+
+      other->refcount++;
+      mtx_unlock(&cso_screen_cache_mutex);
+
+      delete_driver_state(pipe, type, handle);
+      FREE(entry);
+      return other->handle;
+   }
+
+   if (!_mesa_hash_table_insert(sc->states, entry, entry)) {
+      mtx_unlock(&cso_screen_cache_mutex);
+      delete_driver_state(pipe, type, handle);
+      FREE(entry);
+      return NULL;
+   }
+   if (!_mesa_hash_table_insert(sc->handles, handle, entry)) {
+      _mesa_hash_table_remove_key(sc->states, entry);
+      mtx_unlock(&cso_screen_cache_mutex);
+      delete_driver_state(pipe, type, handle);
+      FREE(entry);
+      return NULL;
+   }
+   mtx_unlock(&cso_screen_cache_mutex);
+
+   return handle;
+}
+
+/**
+ * Drop a reference to a driver object returned by cso_screen_cache_acquire,
+ * deleting it with \p pipe if it was the last one.
+ */
+void
+cso_screen_cache_release(void *pipe, void *handle)
+{
+   struct pipe_context *ctx = (struct pipe_context *)pipe;
+   struct cso_screen_cache *sc;
+   struct cso_screen_entry *entry;
+   struct hash_entry *he;
+
+   mtx_lock(&cso_screen_cache_mutex);
+
+   he = _mesa_hash_table_search(cso_screen_caches, ctx->screen);
+   assert(he);
+   sc = he->data;
+
+   he = _mesa_hash_table_search(sc->handles, handle);
+   assert(he);
+   entry = he->data;
+
+   if (--entry->refcount) {
+      mtx_unlock(&cso_screen_cache_mutex);
+      return;
+   }
+
+   _mesa_hash_table_remove(sc->handles, he);
+   _mesa_hash_table_remove_key(sc->states, entry);
+   mtx_unlock(&cso_screen_cache_mutex);
+
+   delete_driver_state(ctx, entry->type, handle);
+   FREE(entry);
+}
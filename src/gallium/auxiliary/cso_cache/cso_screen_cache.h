@@ -0,0 +1,73 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The Mesa authors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Screen-level cache of driver CSOs shared by all cso_contexts of a screen.
+ *
+ * Each cso_context still keeps its own cso_cache, so lookups of already
+ * seen state don't take any lock.  Only when a context misses in its own
+ * cache does it go to the screen cache, which either returns an existing
+ * driver object with an extra reference or creates a new one.  Driver
+ * objects are deleted when the last context referencing them drops them.
+ *
+ * This is only valid for drivers whose blend, depth-stencil-alpha,
+ * rasterizer and sampler objects may be bound and deleted by any context
+ * of the screen, which they advertise with PIPE_CAP_SHAREABLE_CSOS.
+ */
+
+#ifndef CSO_SCREEN_CACHE_H
+#define CSO_SCREEN_CACHE_H
+
+#include "pipe/p_context.h"
+#include "cso_cache.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+struct cso_screen_cache;
+
+struct cso_screen_cache *cso_screen_cache_reference(struct pipe_screen *screen);
+void cso_screen_cache_unreference(struct cso_screen_cache *sc);
+
+void *cso_screen_cache_acquire(struct cso_screen_cache *sc,
+                               struct pipe_context *pipe,
+                               enum cso_cache_type type,
+                               unsigned hash_key,
+                               const void *templ, unsigned key_size);
+
+/* Matches cso_state_callback, so that it can be used as the delete_state
+ * callback of per-context CSOs.
+ */
+void cso_screen_cache_release(void *pipe, void *handle);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif
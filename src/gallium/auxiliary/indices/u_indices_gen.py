@@ -69,6 +69,7 @@ intype_idx = dict(ubyte='IN_UBYTE', ushort='IN_USHORT', uint='IN_UINT')
 outtype_idx = dict(ushort='OUT_USHORT', uint='OUT_UINT')
 pv_idx = dict(first='PV_FIRST', last='PV_LAST')
 pr_idx = dict(prdisable='PR_DISABLE', prenable='PR_ENABLE')
+index_size = dict(ubyte='1', ushort='2', uint='4')
 
 def prolog():
     print('''/* File automatically generated by u_indices_gen.py */''')
@@ -82,6 +83,7 @@ def prolog():
 
 #include "indices/u_indices_priv.h"
 #include "util/u_debug.h"
+#include "util/u_index_scan.h"
 #include "util/u_memory.h"
 
 
@@ -208,9 +210,20 @@ def preamble(intype, outtype, inpv, outpv, pr, prim):
 def postamble():
     print('}')
 
+# List primitives whose vertex order doesn't change are straight copies,
+# possibly with a different index size.
+def copy(intype, outtype):
+    print('  (void)i;')
+    print('  util_index_copy(in + start, ' + index_size[intype] + ', out, ' +
+          index_size[outtype] + ', out_nr);')
+
 
 def points(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='points')
+    if intype != GENERATE:
+        copy(intype, outtype)
+        postamble()
+        return
     print('  for (i = start, j = 0; j < out_nr; j++, i++) { ')
     do_point( intype, outtype, 'out+j',  'i' );
     print('   }')
@@ -218,6 +231,10 @@ def points(intype, outtype, inpv, outpv, pr):
 
 def lines(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='lines')
+    if intype != GENERATE and inpv == outpv:
+        copy(intype, outtype)
+        postamble()
+        return
     print('  for (i = start, j = 0; j < out_nr; j+=2, i+=2) { ')
     do_line( intype, outtype, 'out+j',  'i', 'i+1', inpv, outpv );
     print('   }')
@@ -240,6 +257,10 @@ def lineloop(intype, outtype, inpv, outpv, pr):
 
 def tris(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='tris')
+    if intype != GENERATE and inpv == outpv:
+        copy(intype, outtype)
+        postamble()
+        return
     print('  for (i = start, j = 0; j < out_nr; j+=3, i+=3) { ')
     do_tri( intype, outtype, 'out+j',  'i', 'i+1', 'i+2', inpv, outpv );
     print('   }')
@@ -303,6 +324,13 @@ def polygon(intype, outtype, inpv, outpv, pr):
 
 def quads(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='quads')
+    if intype != GENERATE and pr == PRDISABLE and inpv == outpv:
+        print('  (void)i;')
+        print('  util_index_quads_to_tris(in + start, ' + index_size[intype] +
+              ', out, ' + index_size[outtype] + ', out_nr / 6, ' +
+              ('true' if inpv == LAST else 'false') + ');')
+        postamble()
+        return
     print('  for (i = start, j = 0; j < out_nr; j+=6, i+=4) { ')
     if pr == PRENABLE:
         print('restart:')
@@ -377,6 +405,10 @@ def quadstrip(intype, outtype, inpv, outpv, pr):
 
 def linesadj(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='linesadj')
+    if intype != GENERATE and inpv == outpv:
+        copy(intype, outtype)
+        postamble()
+        return
     print('  for (i = start, j = 0; j < out_nr; j+=4, i+=4) { ')
     do_lineadj( intype, outtype, 'out+j',  'i+0', 'i+1', 'i+2', 'i+3', inpv, outpv )
     print('  }')
@@ -393,6 +425,10 @@ def linestripadj(intype, outtype, inpv, outpv, pr):
 
 def trisadj(intype, outtype, inpv, outpv, pr):
     preamble(intype, outtype, inpv, outpv, pr, prim='trisadj')
+    if intype != GENERATE and inpv == outpv:
+        copy(intype, outtype)
+        postamble()
+        return
     print('  for (i = start, j = 0; j < out_nr; j+=6, i+=6) { ')
     do_triadj( intype, outtype, 'out+j',  'i+0', 'i+1', 'i+2', 'i+3',
                'i+4', 'i+5', inpv, outpv )
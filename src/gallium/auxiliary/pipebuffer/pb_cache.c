@@ -28,9 +28,25 @@
 
 #include "pb_cache.h"
 #include "util/u_memory.h"
+#include "util/u_math.h"
+#include "util/u_thread.h"
 #include "util/os_time.h"
+#include "util/timespec.h"
 
 
+static inline unsigned
+pb_cache_size_class(pb_size size)
+{
+   return size ? MIN2(util_logbase2_64(size), PB_CACHE_NUM_SIZE_CLASSES - 1)
+               : 0;
+}
+
+static inline struct list_head *
+pb_cache_bucket(struct pb_cache *mgr, unsigned heap, unsigned size_class)
+{
+   return &mgr->buckets[heap * PB_CACHE_NUM_SIZE_CLASSES + size_class];
+}
+
 /**
  * Actually destroy the buffer.
  */
@@ -43,6 +59,7 @@ destroy_buffer_locked(struct pb_cache_entry *entry)
    assert(!pipe_is_referenced(&buf->reference));
    if (entry->head.next) {
       list_del(&entry->head);
+      list_del(&entry->lru);
       assert(mgr->num_buffers);
       --mgr->num_buffers;
       mgr->cache_size -= buf->size;
@@ -51,19 +68,19 @@ destroy_buffer_locked(struct pb_cache_entry *entry)
 }
 
 /**
- * Free as many cache buffers from the list head as possible.
+ * Free as many cache buffers from the LRU list head as possible.
  */
 static void
-release_expired_buffers_locked(struct list_head *cache,
+release_expired_buffers_locked(struct list_head *lru,
                                int64_t current_time)
 {
    struct list_head *curr, *next;
    struct pb_cache_entry *entry;
 
-   curr = cache->next;
+   curr = lru->next;
    next = curr->next;
-   while (curr != cache) {
-      entry = LIST_ENTRY(struct pb_cache_entry, curr, head);
+   while (curr != lru) {
+      entry = LIST_ENTRY(struct pb_cache_entry, curr, lru);
 
       if (!os_time_timeout(entry->start, entry->end, current_time))
          break;
@@ -75,6 +92,16 @@ release_expired_buffers_locked(struct list_head *cache,
    }
 }
 
+static void
+release_all_expired_buffers_locked(struct pb_cache *mgr)
+{
+   int64_t current_time = os_time_get();
+   unsigned i;
+
+   for (i = 0; i < mgr->num_heaps; i++)
+      release_expired_buffers_locked(&mgr->lru[i], current_time);
+}
+
 /**
  * Add a buffer to the cache. This is typically done when the buffer is
  * being released.
@@ -83,17 +110,13 @@ void
 pb_cache_add_buffer(struct pb_cache_entry *entry)
 {
    struct pb_cache *mgr = entry->mgr;
-   struct list_head *cache = &mgr->buckets[entry->bucket_index];
    struct pb_buffer *buf = entry->buffer;
-   unsigned i;
 
    mtx_lock(&mgr->mutex);
    assert(!pipe_is_referenced(&buf->reference));
 
-   int64_t current_time = os_time_get();
-
-   for (i = 0; i < mgr->num_heaps; i++)
-      release_expired_buffers_locked(&mgr->buckets[i], current_time);
+   if (!mgr->release_thread_running)
+      release_all_expired_buffers_locked(mgr);
 
    /* Directly release any buffer that exceeds the limit. */
    if (mgr->cache_size + buf->size > mgr->max_cache_size) {
@@ -102,9 +125,17 @@ pb_cache_add_buffer(struct pb_cache_entry *entry)
       return;
    }
 
+   entry->size_class = pb_cache_size_class(buf->size);
    entry->start = os_time_get();
    entry->end = entry->start + mgr->usecs;
-   list_addtail(&entry->head, cache);
+   list_addtail(&entry->head,
+                pb_cache_bucket(mgr, entry->bucket_index, entry->size_class));
+   list_addtail(&entry->lru, &mgr->lru[entry->bucket_index]);
+   /* The release thread sleeps while the cache is empty.  Buffers added
+    * later expire later, so it only needs a wakeup for the first one.
+    */
+   if (mgr->release_thread_running && mgr->num_buffers == 0)
+      cnd_signal(&mgr->release_cond);
    ++mgr->num_buffers;
    mgr->cache_size += buf->size;
    mtx_unlock(&mgr->mutex);
@@ -142,64 +173,42 @@ pb_cache_is_buffer_compat(struct pb_cache_entry *entry,
 /**
  * Find a compatible buffer in the cache, return it, and remove it
  * from the cache.
+ *
+ * Only the size classes that can hold a compatible buffer are visited,
+ * smallest first.  Within a class, the oldest buffers are tried first as
+ * they are the most likely to be idle.
  */
 struct pb_buffer *
 pb_cache_reclaim_buffer(struct pb_cache *mgr, pb_size size,
                         unsigned alignment, unsigned usage,
                         unsigned bucket_index)
 {
-   struct pb_cache_entry *entry;
-   struct pb_cache_entry *cur_entry;
-   struct list_head *cur, *next;
-   int64_t now;
-   int ret = 0;
+   struct pb_cache_entry *entry = NULL;
+   unsigned first_class, last_class, c;
 
    assert(bucket_index < mgr->num_heaps);
-   struct list_head *cache = &mgr->buckets[bucket_index];
 
-   mtx_lock(&mgr->mutex);
+   if (usage & mgr->bypass_usage)
+      return NULL;
 
-   entry = NULL;
-   cur = cache->next;
-   next = cur->next;
-
-   /* search in the expired buffers, freeing them in the process */
-   now = os_time_get();
-   while (cur != cache) {
-      cur_entry = LIST_ENTRY(struct pb_cache_entry, cur, head);
-
-      if (!entry && (ret = pb_cache_is_buffer_compat(cur_entry, size,
-                                                     alignment, usage)) > 0)
-         entry = cur_entry;
-      else if (os_time_timeout(cur_entry->start, cur_entry->end, now))
-         destroy_buffer_locked(cur_entry);
-      else
-         /* This buffer (and all hereafter) are still hot in cache */
-         break;
+   first_class = pb_cache_size_class(size);
+   last_class = pb_cache_size_class((pb_size)(mgr->size_factor * size));
 
-      /* the buffer is busy (and probably all remaining ones too) */
-      if (ret == -1)
-         break;
+   mtx_lock(&mgr->mutex);
 
-      cur = next;
-      next = cur->next;
-   }
+   for (c = first_class; c <= last_class && !entry; c++) {
+      struct list_head *cache = pb_cache_bucket(mgr, bucket_index, c);
 
-   /* keep searching in the hot buffers */
-   if (!entry && ret != -1) {
-      while (cur != cache) {
-         cur_entry = LIST_ENTRY(struct pb_cache_entry, cur, head);
-         ret = pb_cache_is_buffer_compat(cur_entry, size, alignment, usage);
+      list_for_each_entry(struct pb_cache_entry, cur, cache, head) {
+         int ret = pb_cache_is_buffer_compat(cur, size, alignment, usage);
 
          if (ret > 0) {
-            entry = cur_entry;
+            entry = cur;
             break;
          }
+         /* the buffer is busy (and probably all younger ones too) */
          if (ret == -1)
             break;
-         /* no need to check the timeout here */
-         cur = next;
-         next = cur->next;
       }
    }
 
@@ -209,6 +218,7 @@ pb_cache_reclaim_buffer(struct pb_cache *mgr, pb_size size,
 
       mgr->cache_size -= buf->size;
       list_del(&entry->head);
+      list_del(&entry->lru);
       --mgr->num_buffers;
       mtx_unlock(&mgr->mutex);
       /* Increase refcount */
@@ -232,12 +242,12 @@ pb_cache_release_all_buffers(struct pb_cache *mgr)
 
    mtx_lock(&mgr->mutex);
    for (i = 0; i < mgr->num_heaps; i++) {
-      struct list_head *cache = &mgr->buckets[i];
+      struct list_head *cache = &mgr->lru[i];
 
       curr = cache->next;
       next = curr->next;
       while (curr != cache) {
-         buf = LIST_ENTRY(struct pb_cache_entry, curr, head);
+         buf = LIST_ENTRY(struct pb_cache_entry, curr, lru);
          destroy_buffer_locked(buf);
          curr = next;
          next = curr->next;
@@ -285,12 +295,21 @@ pb_cache_init(struct pb_cache *mgr, uint num_heaps,
 {
    unsigned i;
 
-   mgr->buckets = CALLOC(num_heaps, sizeof(struct list_head));
-   if (!mgr->buckets)
+   mgr->buckets = CALLOC(num_heaps * PB_CACHE_NUM_SIZE_CLASSES,
+                         sizeof(struct list_head));
+   mgr->lru = CALLOC(num_heaps, sizeof(struct list_head));
+   if (!mgr->buckets || !mgr->lru) {
+      FREE(mgr->buckets);
+      FREE(mgr->lru);
+      mgr->buckets = NULL;
+      mgr->lru = NULL;
       return;
+   }
 
-   for (i = 0; i < num_heaps; i++)
+   for (i = 0; i < num_heaps * PB_CACHE_NUM_SIZE_CLASSES; i++)
       list_inithead(&mgr->buckets[i]);
+   for (i = 0; i < num_heaps; i++)
+      list_inithead(&mgr->lru[i]);
 
    (void) mtx_init(&mgr->mutex, mtx_plain);
    mgr->cache_size = 0;
@@ -302,6 +321,76 @@ pb_cache_init(struct pb_cache *mgr, uint num_heaps,
    mgr->size_factor = size_factor;
    mgr->destroy_buffer = destroy_buffer;
    mgr->can_reclaim = can_reclaim;
+   mgr->release_thread_running = false;
+   mgr->release_thread_exit = false;
+}
+
+static int
+pb_cache_release_thread_func(void *data)
+{
+   struct pb_cache *mgr = (struct pb_cache *)data;
+
+   u_thread_setname("pb_cache");
+
+   mtx_lock(&mgr->mutex);
+   while (!mgr->release_thread_exit) {
+      struct timespec now, timeout;
+      int64_t current_time = os_time_get();
+      int64_t next_end = INT64_MAX;
+
+      release_all_expired_buffers_locked(mgr);
+
+      /* Sleep until the oldest buffer of any heap expires, or until a
+       * buffer is added if there are none.
+       */
+      for (unsigned i = 0; i < mgr->num_heaps; i++) {
+         if (!list_is_empty(&mgr->lru[i])) {
+            struct pb_cache_entry *entry =
+               LIST_ENTRY(struct pb_cache_entry, mgr->lru[i].next, lru);
+            next_end = MIN2(next_end, entry->end);
+         }
+      }
+
+      if (next_end == INT64_MAX) {
+         cnd_wait(&mgr->release_cond, &mgr->mutex);
+         continue;
+      }
+
+      timespec_get(&now, TIME_UTC);
+      timespec_add_nsec(&timeout, &now,
+                        MAX2(next_end - current_time, 0) * 1000);
+      cnd_timedwait(&mgr->release_cond, &mgr->mutex, &timeout);
+   }
+   mtx_unlock(&mgr->mutex);
+   return 0;
+}
+
+/**
+ * Release expired buffers on a background thread instead of on the
+ * calling thread in pb_cache_add_buffer().
+ *
+ * destroy_buffer will be called from that thread, with the cache mutex
+ * held as usual.  Returns false if the thread couldn't be started, in
+ * which case expired buffers keep being released inline.
+ */
+bool
+pb_cache_enable_async_release(struct pb_cache *mgr)
+{
+   if (!mgr->buckets || mgr->release_thread_running)
+      return mgr->release_thread_running;
+
+   if (cnd_init(&mgr->release_cond) != thrd_success)
+      return false;
+
+   mgr->release_thread_exit = false;
+   if (thrd_create(&mgr->release_thread, pb_cache_release_thread_func,
+                   mgr) != thrd_success) {
+      cnd_destroy(&mgr->release_cond);
+      return false;
+   }
+
+   mgr->release_thread_running = true;
+   return true;
 }
 
 /**
@@ -310,8 +399,21 @@ pb_cache_init(struct pb_cache *mgr, uint num_heaps,
 void
 pb_cache_deinit(struct pb_cache *mgr)
 {
+   if (mgr->release_thread_running) {
+      mtx_lock(&mgr->mutex);
+      mgr->release_thread_exit = true;
+      cnd_signal(&mgr->release_cond);
+      mtx_unlock(&mgr->mutex);
+
+      thrd_join(mgr->release_thread, NULL);
+      cnd_destroy(&mgr->release_cond);
+      mgr->release_thread_running = false;
+   }
+
    pb_cache_release_all_buffers(mgr);
    mtx_destroy(&mgr->mutex);
    FREE(mgr->buckets);
+   FREE(mgr->lru);
    mgr->buckets = NULL;
+   mgr->lru = NULL;
 }
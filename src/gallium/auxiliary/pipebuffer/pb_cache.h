@@ -38,19 +38,32 @@
  */
 struct pb_cache_entry
 {
-   struct list_head head;
+   struct list_head head;    /**< Link in the size class list */
+   struct list_head lru;     /**< Link in the per-heap LRU list */
    struct pb_buffer *buffer; /**< Pointer to the structure this is part of. */
    struct pb_cache *mgr;
    int64_t start, end; /**< Caching time interval */
    unsigned bucket_index;
+   unsigned size_class;
 };
 
+/**
+ * Buffers of each heap are sorted into power-of-two size classes, so that
+ * a lookup only visits buffers of roughly the requested size.
+ */
+#define PB_CACHE_NUM_SIZE_CLASSES 64
+
 struct pb_cache
 {
    /* The cache is divided into buckets for minimizing cache misses.
     * The driver controls which buffer goes into which bucket.
+    *
+    * Each bucket (heap) has one list per size class, indexed with
+    * heap * PB_CACHE_NUM_SIZE_CLASSES + size_class, and an LRU list of all
+    * its buffers for expiration.  All lists are oldest-first.
     */
    struct list_head *buckets;
+   struct list_head *lru;
 
    mtx_t mutex;
    uint64_t cache_size;
@@ -63,6 +76,14 @@ struct pb_cache
 
    void (*destroy_buffer)(struct pb_buffer *buf);
    bool (*can_reclaim)(struct pb_buffer *buf);
+
+   /* Expired buffers are released by this thread when it's running,
+    * see pb_cache_enable_async_release().
+    */
+   bool release_thread_running;
+   bool release_thread_exit;
+   thrd_t release_thread;
+   cnd_t release_cond;
 };
 
 void pb_cache_add_buffer(struct pb_cache_entry *entry);
@@ -77,6 +98,7 @@ void pb_cache_init(struct pb_cache *mgr, uint num_heaps,
                    unsigned bypass_usage, uint64_t maximum_cache_size,
                    void (*destroy_buffer)(struct pb_buffer *buf),
                    bool (*can_reclaim)(struct pb_buffer *buf));
+bool pb_cache_enable_async_release(struct pb_cache *mgr);
 void pb_cache_deinit(struct pb_cache *mgr);
 
 #endif
@@ -0,0 +1,448 @@
+/*
+ * Copyright 2026 The Mesa authors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHOR(S) AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "pipe/p_compiler.h"
+#include "util/bitscan.h"
+#include "util/u_debug.h"
+#include "util/u_math.h"
+#include "util/u_sse.h"
+
+#include "u_index_scan.h"
+
+
+static inline unsigned
+get_index(const void *indices, unsigned index_size, unsigned i)
+{
+   switch (index_size) {
+   case 1: return ((const uint8_t *)indices)[i];
+   case 2: return ((const uint16_t *)indices)[i];
+   default: return ((const uint32_t *)indices)[i];
+   }
+}
+
+static inline void
+put_index(void *indices, unsigned index_size, unsigned i, unsigned value)
+{
+   switch (index_size) {
+   case 1: ((uint8_t *)indices)[i] = value; break;
+   case 2: ((uint16_t *)indices)[i] = value; break;
+   default: ((uint32_t *)indices)[i] = value; break;
+   }
+}
+
+static inline unsigned
+index_mask(unsigned index_size)
+{
+   return index_size == 4 ? ~0u : (1u << (index_size * 8)) - 1;
+}
+
+
+/**
+ * Compute the minimum and maximum index of an index list, skipping restart
+ * indices if primitive restart is enabled.
+ *
+ * Returns 0 for both if \p count is 0.  If all indices are restart indices,
+ * the minimum is the largest representable index and the maximum is 0.
+ */
+void
+util_index_minmax(const void *indices, unsigned index_size, unsigned count,
+                  bool primitive_restart, unsigned restart_index,
+                  unsigned *out_min_index, unsigned *out_max_index)
+{
+   unsigned min = index_mask(index_size);
+   unsigned max = 0;
+   unsigned i = 0;
+
+   assert(index_size == 1 || index_size == 2 || index_size == 4);
+
+   if (!count) {
+      *out_min_index = 0;
+      *out_max_index = 0;
+      return;
+   }
+
+   /* A restart index that doesn't fit can't match any index. */
+   if (restart_index > index_mask(index_size))
+      primitive_restart = false;
+
+#if defined(PIPE_ARCH_SSE)
+   {
+      /* Restart indices are replaced with the neutral element of min and
+       * max respectively.  "enable" makes the restart mask all zeros when
+       * primitive restart is disabled, which avoids duplicating the loops.
+       */
+      const __m128i enable = _mm_set1_epi32(primitive_restart ? ~0 : 0);
+      union m128i vmin, vmax;
+
+      if (index_size == 4) {
+         /* SSE2 only has signed 32-bit compares, so bias everything. */
+         const uint32_t *ui = (const uint32_t *)indices;
+         const __m128i bias = _mm_set1_epi32(0x80000000);
+         const __m128i vrestart = _mm_set1_epi32(restart_index);
+
+         vmin.m = _mm_set1_epi32(0x7fffffff);
+         vmax.m = bias;
+
+         for (; i + 4 <= count; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(ui + i));
+            __m128i m = _mm_and_si128(_mm_cmpeq_epi32(v, vrestart), enable);
+            __m128i lo = _mm_xor_si128(_mm_or_si128(v, m), bias);
+            __m128i hi = _mm_xor_si128(_mm_andnot_si128(m, v), bias);
+
+            m = _mm_cmpgt_epi32(vmin.m, lo);
+            vmin.m = _mm_or_si128(_mm_and_si128(m, lo),
+                                  _mm_andnot_si128(m, vmin.m));
+            m = _mm_cmpgt_epi32(hi, vmax.m);
+            vmax.m = _mm_or_si128(_mm_and_si128(m, hi),
+                                  _mm_andnot_si128(m, vmax.m));
+         }
+
+         for (unsigned c = 0; c < 4; c++) {
+            min = MIN2(min, vmin.ui[c] ^ 0x80000000);
+            max = MAX2(max, vmax.ui[c] ^ 0x80000000);
+         }
+      } else if (index_size == 2) {
+         const uint16_t *us = (const uint16_t *)indices;
+         const __m128i bias = _mm_set1_epi16(-0x8000);
+         const __m128i vrestart = _mm_set1_epi16(restart_index);
+
+         vmin.m = _mm_set1_epi16(0x7fff);
+         vmax.m = bias;
+
+         for (; i + 8 <= count; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(us + i));
+            __m128i m = _mm_and_si128(_mm_cmpeq_epi16(v, vrestart), enable);
+            __m128i lo = _mm_xor_si128(_mm_or_si128(v, m), bias);
+            __m128i hi = _mm_xor_si128(_mm_andnot_si128(m, v), bias);
+
+            vmin.m = _mm_min_epi16(vmin.m, lo);
+            vmax.m = _mm_max_epi16(vmax.m, hi);
+         }
+
+         for (unsigned c = 0; c < 8; c++) {
+            min = MIN2(min, vmin.us[c] ^ 0x8000u);
+            max = MAX2(max, vmax.us[c] ^ 0x8000u);
+         }
+      } else {
+         const uint8_t *ub = (const uint8_t *)indices;
+         const __m128i vrestart = _mm_set1_epi8(restart_index);
+
+         vmin.m = _mm_set1_epi8(-1);
+         vmax.m = _mm_setzero_si128();
+
+         for (; i + 16 <= count; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(ub + i));
+            __m128i m = _mm_and_si128(_mm_cmpeq_epi8(v, vrestart), enable);
+
+            vmin.m = _mm_min_epu8(vmin.m, _mm_or_si128(v, m));
+            vmax.m = _mm_max_epu8(vmax.m, _mm_andnot_si128(m, v));
+         }
+
+         for (unsigned c = 0; c < 16; c++) {
+            min = MIN2(min, vmin.ub[c]);
+            max = MAX2(max, vmax.ub[c]);
+         }
+      }
+   }
+#endif
+
+   for (; i < count; i++) {
+      unsigned index = get_index(indices, index_size, i);
+
+      if (primitive_restart && index == restart_index)
+         continue;
+      min = MIN2(min, index);
+      max = MAX2(max, index);
+   }
+
+   *out_min_index = min;
+   *out_max_index = max;
+}
+
+
+/**
+ * Return the position of the first occurrence of \p value in an index list,
+ * or \p count if there is none.
+ */
+unsigned
+util_index_find(const void *indices, unsigned index_size, unsigned count,
+                unsigned value)
+{
+   unsigned i = 0;
+
+   assert(index_size == 1 || index_size == 2 || index_size == 4);
+
+   if (value > index_mask(index_size))
+      return count;
+
+#if defined(PIPE_ARCH_SSE)
+   {
+      /* Number of indices per vector, and the value splatted to the index
+       * size.  movemask returns one bit per byte, so the position of the
+       * first set bit divided by the index size is the match.
+       */
+      const unsigned step = 16 / index_size;
+      const uint8_t *bytes = (const uint8_t *)indices;
+      __m128i v;
+
+      if (index_size == 4)
+         v = _mm_set1_epi32(value);
+      else if (index_size == 2)
+         v = _mm_set1_epi16(value);
+      else
+         v = _mm_set1_epi8(value);
+
+      for (; i + step <= count; i += step) {
+         __m128i data = _mm_loadu_si128((const __m128i *)
+                                        (bytes + i * index_size));
+         __m128i eq;
+         int mask;
+
+         if (index_size == 4)
+            eq = _mm_cmpeq_epi32(data, v);
+         else if (index_size == 2)
+            eq = _mm_cmpeq_epi16(data, v);
+         else
+            eq = _mm_cmpeq_epi8(data, v);
+
+         mask = _mm_movemask_epi8(eq);
+         if (mask)
+            return i + (ffs(mask) - 1) / index_size;
+      }
+   }
+#endif
+
+   for (; i < count; i++) {
+      if (get_index(indices, index_size, i) == value)
+         return i;
+   }
+   return count;
+}
+
+
+/**
+ * Copy an index list, converting between index sizes.  Indices are
+ * truncated when converting to a smaller size.
+ */
+void
+util_index_copy(const void *src, unsigned src_index_size,
+                void *dst, unsigned dst_index_size, unsigned count)
+{
+   unsigned i = 0;
+
+   if (src_index_size == dst_index_size) {
+      memcpy(dst, src, count * src_index_size);
+      return;
+   }
+
+#if defined(PIPE_ARCH_SSE)
+   {
+      const __m128i zero = _mm_setzero_si128();
+
+      if (src_index_size == 1 && dst_index_size == 2) {
+         const uint8_t *s = (const uint8_t *)src;
+         uint16_t *d = (uint16_t *)dst;
+
+         for (; i + 16 <= count; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+
+            _mm_storeu_si128((__m128i *)(d + i), _mm_unpacklo_epi8(v, zero));
+            _mm_storeu_si128((__m128i *)(d + i + 8),
+                             _mm_unpackhi_epi8(v, zero));
+         }
+      } else if (src_index_size == 1 && dst_index_size == 4) {
+         const uint8_t *s = (const uint8_t *)src;
+         uint32_t *d = (uint32_t *)dst;
+
+         for (; i + 16 <= count; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+            __m128i lo = _mm_unpacklo_epi8(v, zero);
+            __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+            _mm_storeu_si128((__m128i *)(d + i), _mm_unpacklo_epi16(lo, zero));
+            _mm_storeu_si128((__m128i *)(d + i + 4),
+                             _mm_unpackhi_epi16(lo, zero));
+            _mm_storeu_si128((__m128i *)(d + i + 8),
+                             _mm_unpacklo_epi16(hi, zero));
+            _mm_storeu_si128((__m128i *)(d + i + 12),
+                             _mm_unpackhi_epi16(hi, zero));
+         }
+      } else if (src_index_size == 2 && dst_index_size == 4) {
+         const uint16_t *s = (const uint16_t *)src;
+         uint32_t *d = (uint32_t *)dst;
+
+         for (; i + 8 <= count; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+
+            _mm_storeu_si128((__m128i *)(d + i), _mm_unpacklo_epi16(v, zero));
+            _mm_storeu_si128((__m128i *)(d + i + 4),
+                             _mm_unpackhi_epi16(v, zero));
+         }
+      }
+   }
+#endif
+
+   for (; i < count; i++) {
+      put_index(dst, dst_index_size, i,
+                get_index(src, src_index_size, i));
+   }
+}
+
+
+/**
+ * Copy an index list, replacing every \p restart_index with the all-ones
+ * index of the destination size.  The destination must not be smaller than
+ * the source.
+ */
+void
+util_index_translate_restart(const void *src, unsigned src_index_size,
+                             void *dst, unsigned dst_index_size,
+                             unsigned count, unsigned restart_index)
+{
+   const unsigned dst_restart = index_mask(dst_index_size);
+   unsigned i = 0;
+
+   assert(dst_index_size >= src_index_size);
+
+   if (restart_index > index_mask(src_index_size)) {
+      util_index_copy(src, src_index_size, dst, dst_index_size, count);
+      return;
+   }
+
+#if defined(PIPE_ARCH_SSE)
+   /* OR-ing the compare mask into the index turns matches into all ones. */
+   if (src_index_size == 1 && dst_index_size == 2) {
+      const uint8_t *s = (const uint8_t *)src;
+      uint16_t *d = (uint16_t *)dst;
+      const __m128i vrestart = _mm_set1_epi8(restart_index);
+
+      for (; i + 16 <= count; i += 16) {
+         __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+         __m128i m = _mm_cmpeq_epi8(v, vrestart);
+
+         v = _mm_or_si128(v, m);
+         _mm_storeu_si128((__m128i *)(d + i), _mm_unpacklo_epi8(v, m));
+         _mm_storeu_si128((__m128i *)(d + i + 8), _mm_unpackhi_epi8(v, m));
+      }
+   } else if (src_index_size == 2 && dst_index_size == 2) {
+      const uint16_t *s = (const uint16_t *)src;
+      uint16_t *d = (uint16_t *)dst;
+      const __m128i vrestart = _mm_set1_epi16(restart_index);
+
+      for (; i + 8 <= count; i += 8) {
+         __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+
+         v = _mm_or_si128(v, _mm_cmpeq_epi16(v, vrestart));
+         _mm_storeu_si128((__m128i *)(d + i), v);
+      }
+   } else if (src_index_size == 4 && dst_index_size == 4) {
+      const uint32_t *s = (const uint32_t *)src;
+      uint32_t *d = (uint32_t *)dst;
+      const __m128i vrestart = _mm_set1_epi32(restart_index);
+
+      for (; i + 4 <= count; i += 4) {
+         __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+
+         v = _mm_or_si128(v, _mm_cmpeq_epi32(v, vrestart));
+         _mm_storeu_si128((__m128i *)(d + i), v);
+      }
+   }
+#endif
+
+   for (; i < count; i++) {
+      unsigned index = get_index(src, src_index_size, i);
+
+      put_index(dst, dst_index_size, i,
+                index == restart_index ? dst_restart : index);
+   }
+}
+
+
+/**
+ * Convert a list of quads into a list of triangles with the same
+ * provoking vertex convention, i.e. (v0 v1 v2) (v0 v2 v3) for first and
+ * (v0 v1 v3) (v1 v2 v3) for last provoking vertex.
+ */
+void
+util_index_quads_to_tris(const void *src, unsigned src_index_size,
+                         void *dst, unsigned dst_index_size,
+                         unsigned num_quads, bool last_pv)
+{
+   unsigned q = 0;
+
+#if defined(PIPE_ARCH_SSE)
+   /* The first triangle and the first vertex of the second one are written
+    * as one vector, the remaining two indices as a second store.  The
+    * second vector is [v2 v3] in both conventions.
+    */
+   if (src_index_size == 4 && dst_index_size == 4) {
+      const uint32_t *s = (const uint32_t *)src;
+      uint32_t *d = (uint32_t *)dst;
+
+      for (; q < num_quads; q++) {
+         __m128i v = _mm_loadu_si128((const __m128i *)(s + q * 4));
+         __m128i t0 = last_pv ?
+            _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 3, 1, 0)) :
+            _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 2, 1, 0));
+         __m128i t1 = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 2, 3, 2));
+
+         _mm_storeu_si128((__m128i *)(d + q * 6), t0);
+         _mm_storel_epi64((__m128i *)(d + q * 6 + 4), t1);
+      }
+      return;
+   } else if (src_index_size == 2 && dst_index_size == 2) {
+      const uint16_t *s = (const uint16_t *)src;
+      uint16_t *d = (uint16_t *)dst;
+
+      for (; q < num_quads; q++) {
+         __m128i v = _mm_loadl_epi64((const __m128i *)(s + q * 4));
+         __m128i t0 = last_pv ?
+            _mm_shufflelo_epi16(v, _MM_SHUFFLE(1, 3, 1, 0)) :
+            _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 2, 1, 0));
+         uint32_t t1 = _mm_cvtsi128_si32(
+            _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 2, 3, 2)));
+
+         _mm_storel_epi64((__m128i *)(d + q * 6), t0);
+         memcpy(d + q * 6 + 4, &t1, sizeof(t1));
+      }
+      return;
+   }
+#endif
+
+   for (; q < num_quads; q++) {
+      unsigned v0 = get_index(src, src_index_size, q * 4 + 0);
+      unsigned v1 = get_index(src, src_index_size, q * 4 + 1);
+      unsigned v2 = get_index(src, src_index_size, q * 4 + 2);
+      unsigned v3 = get_index(src, src_index_size, q * 4 + 3);
+
+      put_index(dst, dst_index_size, q * 6 + 0, v0);
+      put_index(dst, dst_index_size, q * 6 + 1, v1);
+      put_index(dst, dst_index_size, q * 6 + 2, last_pv ? v3 : v2);
+      put_index(dst, dst_index_size, q * 6 + 3, last_pv ? v1 : v0);
+      put_index(dst, dst_index_size, q * 6 + 4, v2);
+      put_index(dst, dst_index_size, q * 6 + 5, v3);
+   }
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2026 The Mesa authors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHOR(S) AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Helpers for scanning and rewriting index buffers on the CPU.
+ *
+ * These are used by u_vbuf, u_prim_restart and the generated u_indices
+ * translate functions.  They have SSE2 paths for the common index sizes and
+ * fall back to plain C loops everywhere else.
+ */
+
+#ifndef U_INDEX_SCAN_H
+#define U_INDEX_SCAN_H
+
+#include "pipe/p_compiler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void
+util_index_minmax(const void *indices, unsigned index_size, unsigned count,
+                  bool primitive_restart, unsigned restart_index,
+                  unsigned *out_min_index, unsigned *out_max_index);
+
+unsigned
+util_index_find(const void *indices, unsigned index_size, unsigned count,
+                unsigned value);
+
+void
+util_index_translate_restart(const void *src, unsigned src_index_size,
+                             void *dst, unsigned dst_index_size,
+                             unsigned count, unsigned restart_index);
+
+void
+util_index_copy(const void *src, unsigned src_index_size,
+                void *dst, unsigned dst_index_size, unsigned count);
+
+void
+util_index_quads_to_tris(const void *src, unsigned src_index_size,
+                         void *dst, unsigned dst_index_size,
+                         unsigned num_quads, bool last_pv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
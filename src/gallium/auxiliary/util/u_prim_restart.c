@@ -26,6 +26,7 @@
 
 
 #include "u_inlines.h"
+#include "util/u_index_scan.h"
 #include "util/u_memory.h"
 #include "u_prim_restart.h"
 
@@ -113,32 +114,9 @@ util_translate_prim_restart_ib(struct pipe_context *context,
    if (!src_map)
       goto error;
 
-   if (src_index_size == 1 && dst_index_size == 2) {
-      uint8_t *src = (uint8_t *) src_map;
-      uint16_t *dst = (uint16_t *) dst_map;
-      unsigned i;
-      for (i = 0; i < count; i++) {
-         dst[i] = (src[i] == info->restart_index) ? 0xffff : src[i];
-      }
-   }
-   else if (src_index_size == 2 && dst_index_size == 2) {
-      uint16_t *src = (uint16_t *) src_map;
-      uint16_t *dst = (uint16_t *) dst_map;
-      unsigned i;
-      for (i = 0; i < count; i++) {
-         dst[i] = (src[i] == info->restart_index) ? 0xffff : src[i];
-      }
-   }
-   else {
-      uint32_t *src = (uint32_t *) src_map;
-      uint32_t *dst = (uint32_t *) dst_map;
-      unsigned i;
-      assert(src_index_size == 4);
-      assert(dst_index_size == 4);
-      for (i = 0; i < count; i++) {
-         dst[i] = (src[i] == info->restart_index) ? 0xffffffff : src[i];
-      }
-   }
+   util_index_translate_restart(src_map, src_index_size,
+                                dst_map, dst_index_size,
+                                count, info->restart_index);
 
    if (src_transfer)
       pipe_buffer_unmap(context, src_transfer);
@@ -255,43 +233,28 @@ util_draw_vbo_without_prim_restart(struct pipe_context *context,
          + info_start * info->index_size;
    }
 
-#define SCAN_INDEXES(TYPE) \
-   for (i = 0; i <= info_count; i++) { \
-      if (i == info_count || \
-          ((const TYPE *) src_map)[i] == info->restart_index) { \
-         /* cut / restart */ \
-         if (count > 0) { \
-            if (!add_range(&ranges, info_start + start, count)) { \
-               if (src_transfer) \
-                  pipe_buffer_unmap(context, src_transfer); \
-               return PIPE_ERROR_OUT_OF_MEMORY; \
-            } \
-         } \
-         start = i + 1; \
-         count = 0; \
-      } \
-      else { \
-         count++; \
-      } \
-   }
-
-   start = 0;
-   count = 0;
-   switch (info->index_size) {
-   case 1:
-      SCAN_INDEXES(uint8_t);
-      break;
-   case 2:
-      SCAN_INDEXES(uint16_t);
-      break;
-   case 4:
-      SCAN_INDEXES(uint32_t);
-      break;
-   default:
+   if (info->index_size != 1 && info->index_size != 2 &&
+       info->index_size != 4) {
       assert(!"Bad index size");
+      if (src_transfer)
+         pipe_buffer_unmap(context, src_transfer);
       return PIPE_ERROR_BAD_INPUT;
    }
 
+   for (start = 0; start < info_count; start += count + 1) {
+      count = util_index_find((const uint8_t *) src_map +
+                              start * info->index_size,
+                              info->index_size, info_count - start,
+                              info->restart_index);
+      if (count > 0) {
+         if (!add_range(&ranges, info_start + start, count)) {
+            if (src_transfer)
+               pipe_buffer_unmap(context, src_transfer);
+            return PIPE_ERROR_OUT_OF_MEMORY;
+         }
+      }
+   }
+
    /* unmap index buffer */
    if (src_transfer)
       pipe_buffer_unmap(context, src_transfer);
@@ -440,6 +440,9 @@ u_pipe_screen_get_param_defaults(struct pipe_screen *pscreen,
    case PIPE_CAP_NO_CLIP_ON_COPY_TEX:
       return 0;
 
+   case PIPE_CAP_SHAREABLE_CSOS:
+      return 0;
+
    default:
       unreachable("bad PIPE_CAP_*");
    }
@@ -2002,6 +2002,8 @@ struct tc_flush_payload {
    struct threaded_context *tc;
    struct pipe_fence_handle *fence;
    unsigned flags;
+   uint64_t stream_upload_mark;
+   uint64_t const_upload_mark;
 };
 
 static void
@@ -2019,13 +2021,49 @@ tc_flush_queries(struct threaded_context *tc)
    }
 }
 
+/**
+ * Flush the driver context.  If the uploaders are ring buffers, hand them
+ * the flush fence so that the space suballocated before the marks can be
+ * reused once the GPU is done with it.
+ */
+static void
+tc_flush_and_fence_uploads(struct threaded_context *tc,
+                           struct pipe_fence_handle **fence, unsigned flags,
+                           uint64_t stream_upload_mark,
+                           uint64_t const_upload_mark)
+{
+   struct pipe_context *pipe = tc->pipe;
+   struct pipe_screen *screen = pipe->screen;
+   struct u_upload_mgr *stream = tc->base.stream_uploader;
+   struct u_upload_mgr *cnst = tc->base.const_uploader;
+   struct pipe_fence_handle *upload_fence = NULL;
+
+   if (!u_upload_ring_enabled(stream) && !u_upload_ring_enabled(cnst)) {
+      pipe->flush(pipe, fence, flags);
+      return;
+   }
+
+   if (!fence)
+      fence = &upload_fence;
+
+   pipe->flush(pipe, fence, flags);
+
+   if (*fence) {
+      u_upload_ring_fence(stream, stream_upload_mark, *fence);
+      if (cnst != stream)
+         u_upload_ring_fence(cnst, const_upload_mark, *fence);
+   }
+   screen->fence_reference(screen, &upload_fence, NULL);
+}
+
 static void
 tc_call_flush(struct pipe_context *pipe, union tc_payload *payload)
 {
    struct tc_flush_payload *p = (struct tc_flush_payload *)payload;
    struct pipe_screen *screen = pipe->screen;
 
-   pipe->flush(pipe, p->fence ? &p->fence : NULL, p->flags);
+   tc_flush_and_fence_uploads(p->tc, p->fence ? &p->fence : NULL, p->flags,
+                              p->stream_upload_mark, p->const_upload_mark);
    screen->fence_reference(screen, &p->fence, NULL);
 
    if (!(p->flags & PIPE_FLUSH_DEFERRED))
@@ -2076,6 +2114,8 @@ tc_flush(struct pipe_context *_pipe, struct pipe_fence_handle **fence,
       p->tc = tc;
       p->fence = fence ? *fence : NULL;
       p->flags = flags | TC_FLUSH_ASYNC;
+      p->stream_upload_mark = u_upload_ring_mark(tc->base.stream_uploader);
+      p->const_upload_mark = u_upload_ring_mark(tc->base.const_uploader);
 
       if (!(flags & PIPE_FLUSH_DEFERRED))
          tc_batch_flush(tc);
@@ -2088,7 +2128,9 @@ out_of_memory:
 
    if (!(flags & PIPE_FLUSH_DEFERRED))
       tc_flush_queries(tc);
-   pipe->flush(pipe, fence, flags);
+   tc_flush_and_fence_uploads(tc, fence, flags,
+                              u_upload_ring_mark(tc->base.stream_uploader),
+                              u_upload_ring_mark(tc->base.const_uploader));
 }
 
 /* This is actually variable-sized, because indirect isn't allocated if it's
@@ -2668,7 +2710,8 @@ threaded_context_create(struct pipe_context *pipe,
     * from the queue before being executed, so keep one tc_batch slot for that
     * execution. Also, keep one unused slot for an unflushed batch.
     */
-   if (!util_queue_init(&tc->queue, "gdrv", TC_MAX_BATCHES - 2, 1, 0))
+   if (!util_queue_init(&tc->queue, "gdrv", TC_MAX_BATCHES - 2, 1,
+                        UTIL_QUEUE_INIT_DEDICATED_THREADS))
       goto fail;
 
    for (unsigned i = 0; i < TC_MAX_BATCHES; i++) {
@@ -34,10 +34,15 @@
 #include "pipe/p_context.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
+#include "util/u_atomic.h"
 
 #include "u_upload_mgr.h"
 
 
+/* Number of pending fences a ring buffer uploader can track. */
+#define U_UPLOAD_RING_FENCES 32
+
+
 struct u_upload_mgr {
    struct pipe_context *pipe;
 
@@ -55,6 +60,30 @@ struct u_upload_mgr {
    unsigned offset; /* Aligned offset to the upload buffer, pointing
                      * at the first unused byte. */
    unsigned flushed_size; /* Size we have flushed by transfer_flush_region. */
+
+   /* Ring buffer mode, see u_upload_enable_ring().
+    *
+    * Positions are absolute byte counts that never wrap.  The buffer offset
+    * of a position is (pos - ring_base) % buffer_size.
+    */
+   bool ring;
+   uint64_t ring_base; /* Position of offset 0 of the current buffer. */
+   uint64_t ring_head; /* Position of the first unused byte. */
+   uint64_t ring_tail; /* Position of the oldest byte that may still be in
+                        * use.  Only updated atomically. */
+
+   /* Single producer, single consumer queue of fences guarding ring
+    * space.  The fencing thread owns ring_fence_write, the uploading thread
+    * owns ring_fence_read.
+    */
+   struct {
+      struct pipe_fence_handle *fence;
+      uint64_t mark;
+   } ring_fences[U_UPLOAD_RING_FENCES];
+   unsigned ring_fence_write;
+   unsigned ring_fence_read;
+
+   struct u_upload_stats stats;
 };
 
 
@@ -113,6 +142,9 @@ u_upload_clone(struct pipe_context *pipe, struct u_upload_mgr *upload)
             upload->map_flags & PIPE_TRANSFER_FLUSH_EXPLICIT)
       u_upload_enable_flush_explicit(result);
 
+   if (upload->ring)
+      u_upload_enable_ring(result);
+
    return result;
 }
 
@@ -120,6 +152,7 @@ void
 u_upload_enable_flush_explicit(struct u_upload_mgr *upload)
 {
    assert(upload->map_persistent);
+   assert(!upload->ring);
    upload->map_flags &= ~PIPE_TRANSFER_COHERENT;
    upload->map_flags |= PIPE_TRANSFER_FLUSH_EXPLICIT;
 }
@@ -127,6 +160,7 @@ u_upload_enable_flush_explicit(struct u_upload_mgr *upload)
 void
 u_upload_disable_persistent(struct u_upload_mgr *upload)
 {
+   assert(!upload->ring);
    upload->map_persistent = FALSE;
    upload->map_flags &= ~(PIPE_TRANSFER_COHERENT | PIPE_TRANSFER_PERSISTENT);
    upload->map_flags |= PIPE_TRANSFER_FLUSH_EXPLICIT;
@@ -176,9 +210,157 @@ u_upload_release_buffer(struct u_upload_mgr *upload)
 }
 
 
+bool
+u_upload_enable_ring(struct u_upload_mgr *upload)
+{
+   if (!upload->map_persistent ||
+       upload->map_flags & PIPE_TRANSFER_FLUSH_EXPLICIT)
+      return false;
+
+   /* Everything suballocated so far may still be in use. */
+   upload->ring = true;
+   upload->ring_base = 0;
+   upload->ring_head = upload->buffer ? upload->offset : 0;
+   p_atomic_set(&upload->ring_tail, 0);
+   return true;
+}
+
+bool
+u_upload_ring_enabled(const struct u_upload_mgr *upload)
+{
+   return upload->ring;
+}
+
+uint64_t
+u_upload_ring_mark(struct u_upload_mgr *upload)
+{
+   return upload->ring_head;
+}
+
+void
+u_upload_ring_retire(struct u_upload_mgr *upload, uint64_t mark)
+{
+   uint64_t tail = p_atomic_read(&upload->ring_tail);
+
+   /* Only ever move the tail forward. */
+   while (mark > tail) {
+      uint64_t old = p_atomic_cmpxchg(&upload->ring_tail, tail, mark);
+      if (old == tail)
+         break;
+      tail = old;
+   }
+}
+
+void
+u_upload_ring_fence(struct u_upload_mgr *upload, uint64_t mark,
+                    struct pipe_fence_handle *fence)
+{
+   struct pipe_screen *screen = upload->pipe->screen;
+   unsigned write = upload->ring_fence_write;
+   unsigned read = p_atomic_read(&upload->ring_fence_read);
+
+   if (!upload->ring || !fence)
+      return;
+
+   /* If the queue is full, drop the fence.  Fences of a context signal in
+    * order, so a later fence retires this mark as well.
+    */
+   if (write - read >= U_UPLOAD_RING_FENCES)
+      return;
+
+   upload->ring_fences[write % U_UPLOAD_RING_FENCES].fence = NULL;
+   screen->fence_reference(screen,
+                           &upload->ring_fences[write % U_UPLOAD_RING_FENCES].fence,
+                           fence);
+   upload->ring_fences[write % U_UPLOAD_RING_FENCES].mark = mark;
+
+   /* Release semantics: publish the slot before the new write index. */
+   p_atomic_set(&upload->ring_fence_write, write + 1);
+}
+
+/* Retire the space guarded by signalled fences and return the ring tail. */
+static uint64_t
+u_upload_ring_reclaim(struct u_upload_mgr *upload)
+{
+   struct pipe_screen *screen = upload->pipe->screen;
+   unsigned read = upload->ring_fence_read;
+   unsigned write = p_atomic_read(&upload->ring_fence_write);
+
+   while (read != write) {
+      unsigned slot = read % U_UPLOAD_RING_FENCES;
+
+      if (!screen->fence_finish(screen, NULL,
+                                upload->ring_fences[slot].fence, 0))
+         break;
+
+      u_upload_ring_retire(upload, upload->ring_fences[slot].mark);
+      screen->fence_reference(screen, &upload->ring_fences[slot].fence, NULL);
+      p_atomic_set(&upload->ring_fence_read, ++read);
+   }
+
+   return p_atomic_read(&upload->ring_tail);
+}
+
+/* Try to suballocate from the current buffer by wrapping around the ring.
+ * Returns the buffer offset, or ~0 if there isn't enough retired space.
+ */
+static unsigned
+u_upload_ring_alloc(struct u_upload_mgr *upload,
+                    unsigned min_out_offset,
+                    unsigned size,
+                    unsigned alignment)
+{
+   const unsigned buffer_size = upload->buffer_size;
+   uint64_t lap, start;
+   unsigned offset;
+   bool wrapped;
+
+   if (!buffer_size)
+      return ~0;
+
+   offset = (upload->ring_head - upload->ring_base) % buffer_size;
+   lap = upload->ring_head - offset;
+   /* A head at the very end of the buffer starts the next lap. */
+   wrapped = offset == 0 && upload->ring_head != upload->ring_base;
+   offset = align(MAX2(min_out_offset, offset), alignment);
+
+   if (offset + size > buffer_size) {
+      /* Wrap around, skipping the rest of the buffer. */
+      offset = align(min_out_offset, alignment);
+      if (offset + size > buffer_size)
+         return ~0;
+      lap += buffer_size;
+      wrapped = true;
+   }
+   start = lap + offset;
+
+   if (start + size - u_upload_ring_reclaim(upload) > buffer_size)
+      return ~0;
+
+   if (wrapped)
+      upload->stats.allocations_avoided++;
+
+   upload->ring_head = start + size;
+   return offset;
+}
+
+void
+u_upload_get_stats(const struct u_upload_mgr *upload,
+                   struct u_upload_stats *stats)
+{
+   *stats = upload->stats;
+}
+
 void
 u_upload_destroy(struct u_upload_mgr *upload)
 {
+   struct pipe_screen *screen = upload->pipe->screen;
+
+   while (upload->ring_fence_read != upload->ring_fence_write) {
+      unsigned slot = upload->ring_fence_read++ % U_UPLOAD_RING_FENCES;
+      screen->fence_reference(screen, &upload->ring_fences[slot].fence, NULL);
+   }
+
    u_upload_release_buffer(upload);
    FREE(upload);
 }
@@ -231,6 +413,15 @@ u_upload_alloc_buffer(struct u_upload_mgr *upload, unsigned min_size)
 
    upload->buffer_size = size;
    upload->offset = 0;
+   upload->stats.buffers_allocated++;
+
+   if (upload->ring) {
+      /* Nothing in the new buffer is in use.  Marks that refer to the old
+       * buffer are all before the new base and won't move the tail.
+       */
+      upload->ring_base = upload->ring_head;
+      p_atomic_set(&upload->ring_tail, upload->ring_head);
+   }
    return size;
 }
 
@@ -244,9 +435,25 @@ u_upload_alloc(struct u_upload_mgr *upload,
                void **ptr)
 {
    unsigned buffer_size = upload->buffer_size;
-   unsigned offset = MAX2(min_out_offset, upload->offset);
+   unsigned offset;
+
+   if (upload->ring) {
+      offset = u_upload_ring_alloc(upload, min_out_offset, size, alignment);
+      if (unlikely(offset == ~0u)) {
+         offset = align(min_out_offset, alignment);
+         buffer_size = u_upload_alloc_buffer(upload, offset + size);
+         if (unlikely(!buffer_size)) {
+            *out_offset = ~0;
+            pipe_resource_reference(outbuf, NULL);
+            *ptr = NULL;
+            return;
+         }
+         upload->ring_head = upload->ring_base + offset + size;
+      }
+      goto map;
+   }
 
-   offset = align(offset, alignment);
+   offset = align(MAX2(min_out_offset, upload->offset), alignment);
 
    /* Make sure we have enough space in the upload buffer
     * for the sub-allocation.
@@ -264,10 +471,16 @@ u_upload_alloc(struct u_upload_mgr *upload,
       }
    }
 
+map:
    if (unlikely(!upload->map)) {
+      /* The ring wraps around to the start of the buffer, so it needs all
+       * of it mapped.
+       */
+      unsigned map_offset = upload->ring ? 0 : offset;
+
       upload->map = pipe_buffer_map_range(upload->pipe, upload->buffer,
-                                          offset,
-                                          buffer_size - offset,
+                                          map_offset,
+                                          buffer_size - map_offset,
                                           upload->map_flags,
                                           &upload->transfer);
       if (unlikely(!upload->map)) {
@@ -278,7 +491,7 @@ u_upload_alloc(struct u_upload_mgr *upload,
          return;
       }
 
-      upload->map -= offset;
+      upload->map -= map_offset;
    }
 
    assert(offset < buffer_size);
@@ -291,6 +504,7 @@ u_upload_alloc(struct u_upload_mgr *upload,
    *out_offset = offset;
 
    upload->offset = offset + size;
+   upload->stats.bytes_uploaded += size;
 }
 
 void
@@ -37,6 +37,18 @@
 
 struct pipe_context;
 struct pipe_resource;
+struct pipe_fence_handle;
+
+/**
+ * Upload manager statistics, see u_upload_get_stats().
+ */
+struct u_upload_stats {
+   uint64_t bytes_uploaded;      /**< Sum of all suballocation sizes. */
+   uint64_t buffers_allocated;   /**< Number of upload buffers created. */
+   uint64_t allocations_avoided; /**< Ring wrap-arounds that reused the
+                                  *   current buffer instead of creating
+                                  *   a new one. */
+};
 
 #ifdef __cplusplus
 extern "C" {
@@ -77,6 +89,59 @@ u_upload_enable_flush_explicit(struct u_upload_mgr *upload);
 void
 u_upload_disable_persistent(struct u_upload_mgr *upload);
 
+/**
+ * Use the upload buffer as a ring buffer.
+ *
+ * When the end of the buffer is reached, suballocation wraps around to the
+ * start of the buffer instead of allocating a new one, provided the space
+ * has been retired through u_upload_ring_fence() or u_upload_ring_retire().
+ * If not enough space has been retired, a new buffer is allocated as
+ * usual.
+ *
+ * This requires coherent persistent mappings.  Returns false (and leaves
+ * the upload manager unchanged) if they aren't available.
+ */
+bool
+u_upload_enable_ring(struct u_upload_mgr *upload);
+
+/** Whether the upload manager is in ring buffer mode. */
+bool
+u_upload_ring_enabled(const struct u_upload_mgr *upload);
+
+/**
+ * Return a position that covers everything suballocated so far.
+ *
+ * Must be called from the thread that does the suballocations.
+ */
+uint64_t
+u_upload_ring_mark(struct u_upload_mgr *upload);
+
+/**
+ * Retire everything before "mark" once "fence" signals.
+ *
+ * This may be called from a thread different from the one doing the
+ * suballocations (e.g. the threaded_context driver thread), but only from
+ * one such thread at a time.  The fences are polled without waiting when
+ * the ring runs out of space.
+ */
+void
+u_upload_ring_fence(struct u_upload_mgr *upload, uint64_t mark,
+                    struct pipe_fence_handle *fence);
+
+/**
+ * Retire everything before "mark" immediately, i.e. the caller knows that
+ * the consumer is done with it.  This may be called from any thread.
+ */
+void
+u_upload_ring_retire(struct u_upload_mgr *upload, uint64_t mark);
+
+/**
+ * Return the statistics of the upload manager.
+ */
+void
+u_upload_get_stats(const struct u_upload_mgr *upload,
+                   struct u_upload_stats *stats);
+
 /**
  * Destroy the upload manager.
  */
@@ -40,6 +40,7 @@
 #include "util/u_memory.h"
 #include "util/register_allocate.h"
 #include "compiler/nir/nir_builder.h"
+#include "compiler/nir/nir_schedule.h"
 
 #include "tgsi/tgsi_strings.h"
 #include "util/u_half.h"
@@ -862,6 +863,30 @@ lower_alu(struct etna_compile *c, nir_alu_instr *alu)
    }
 }
 
+static const nir_schedule_latencies etna_schedule_latencies = {
+   .alu = 1,
+   .alu_complex = 4,
+   .tex = 100,
+   .load = 100,
+   .intrinsic = 1,
+};
+
+static void
+etna_schedule(struct etna_compile *c, nir_shader *shader)
+{
+   const nir_schedule_options options = {
+      /* registers are vec4 and pressure is counted per channel, schedule for
+       * about half of the register file
+       */
+      .threshold = c->specs->max_registers * 4 / 2,
+      .latencies = &etna_schedule_latencies,
+      .stages = BITFIELD_BIT(MESA_SHADER_VERTEX) |
+                BITFIELD_BIT(MESA_SHADER_FRAGMENT),
+   };
+
+   nir_schedule(shader, &options);
+}
+
 static bool
 emit_shader(struct etna_compile *c, unsigned *num_temps, unsigned *num_consts)
 {
@@ -962,6 +987,9 @@ emit_shader(struct etna_compile *c, unsigned *num_temps, unsigned *num_consts)
    nir_convert_from_ssa(shader, true);
    nir_opt_dce(shader);
 
+   if (DBG_ENABLED(ETNA_DBG_NIR_SCHED))
+      etna_schedule(c, shader);
+
    etna_ra_assign(c, shader);
 
    emit_cf_list(c, &nir_shader_get_entrypoint(shader)->body);
@@ -55,6 +55,7 @@
 #define ETNA_DBG_NO_SINGLEBUF    0x1000000 /* disable single buffer feature */
 #define ETNA_DBG_NIR             0x2000000 /* use new NIR compiler */
 #define ETNA_DBG_DEQP            0x4000000 /* Hacks to run dEQP GLES3 tests */
+#define ETNA_DBG_NIR_SCHED       0x8000000 /* schedule NIR for register pressure */
 
 extern int etna_mesa_debug; /* set in etna_screen.c from ETNA_DEBUG */
 
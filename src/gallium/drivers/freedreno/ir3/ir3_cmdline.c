@@ -263,11 +263,12 @@ load_spirv(const char *filename, const char *entry, gl_shader_stage stage)
 	return nir;
 }
 
-static const char *shortopts = "g:hv";
+static const char *shortopts = "g:hsv";
 
 static const struct option longopts[] = {
 	{ "gpu",            required_argument, 0, 'g' },
 	{ "help",           no_argument,       0, 'h' },
+	{ "nir-sched",      no_argument,       0, 's' },
 	{ "verbose",        no_argument,       0, 'v' },
 };
 
@@ -277,6 +278,7 @@ print_usage(void)
 	printf("Usage: ir3_compiler [OPTIONS]... <file.tgsi | file.spv entry_point | (file.vert | file.frag)*>\n");
 	printf("    -g, --gpu GPU_ID - specify gpu-id (default 320)\n");
 	printf("    -h, --help       - show this message\n");
+	printf("    -s, --nir-sched  - schedule NIR for register pressure\n");
 	printf("    -v, --verbose    - verbose compiler/debug messages\n");
 }
 
@@ -300,6 +302,9 @@ main(int argc, char **argv)
 		case 'g':
 			gpu_id = strtol(optarg, NULL, 0);
 			break;
+		case 's':
+			ir3_shader_debug |= IR3_DBG_NIRSCHED;
+			break;
 		case 'v':
 			ir3_shader_debug |= IR3_DBG_OPTMSGS | IR3_DBG_DISASM;
 			break;
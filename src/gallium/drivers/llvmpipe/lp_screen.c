@@ -215,6 +215,8 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_TGSI_TEXCOORD:
    case PIPE_CAP_DRAW_INDIRECT:
       return 1;
+   case PIPE_CAP_SHAREABLE_CSOS:
+      return 1;
 
    case PIPE_CAP_CUBE_MAP_ARRAY:
       return 1;
@@ -748,6 +748,14 @@ static struct pipe_context *si_pipe_create_context(struct pipe_screen *screen, v
       ((struct threaded_context *) tc)->bytes_mapped_limit = total_ram / 4;
    }
 
+   /* Reuse the upload buffers of the threaded context once the flush fences
+    * say the GPU is done with them, instead of allocating new ones. */
+   if (tc && tc != ctx) {
+      u_upload_enable_ring(tc->stream_uploader);
+      if (tc->const_uploader != tc->stream_uploader)
+         u_upload_enable_ring(tc->const_uploader);
+   }
+
    return tc;
 }
 
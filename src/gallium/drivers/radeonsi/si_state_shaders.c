@@ -2143,7 +2143,7 @@ current_not_ready:
     * in a compiler thread.
     */
    if (thread_index < 0)
-      util_queue_fence_wait(&sel->ready);
+      util_queue_wait_job(&sscreen->shader_compiler_queue, &sel->ready);
 
    simple_mtx_lock(&sel->mutex);
 
@@ -2199,7 +2199,7 @@ current_not_ready:
 
       /* We need to wait for the previous shader. */
       if (previous_stage_sel && thread_index < 0)
-         util_queue_fence_wait(&previous_stage_sel->ready);
+         util_queue_wait_job(&sscreen->shader_compiler_queue, &previous_stage_sel->ready);
    }
 
    bool is_pure_monolithic =
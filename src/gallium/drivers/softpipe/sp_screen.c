@@ -256,6 +256,8 @@ softpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_TGSI_TEXCOORD:
    case PIPE_CAP_TGSI_ANY_REG_AS_ADDRESS:
       return 1;
+   case PIPE_CAP_SHAREABLE_CSOS:
+      return 1;
    case PIPE_CAP_CLEAR_TEXTURE:
       return 1;
    case PIPE_CAP_MAX_VARYINGS:
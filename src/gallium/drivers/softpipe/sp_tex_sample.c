@@ -41,6 +41,7 @@
 #include "util/format/u_format.h"
 #include "util/u_memory.h"
 #include "util/u_inlines.h"
+#include "util/u_sse.h"
 #include "sp_quad.h"   /* only for #define QUAD_* tokens */
 #include "sp_tex_sample.h"
 #include "sp_texture.h"
@@ -94,6 +95,72 @@ lerp_2d(float a, float b,
 }
 
 
+/**
+ * Bilinear interpolation of all four channels of a 2x2 texel footprint.
+ * tx[] are RGBA texels in the order (x0,y0), (x1,y0), (x0,y1), (x1,y1).
+ * The result is written with the TGSI_NUM_CHANNELS stride used by the
+ * image filters.  Uses the same operation order as lerp_2d() so both paths
+ * give identical results.
+ */
+static inline void
+lerp_2d_rgba(float a, float b, const float *tx[4], float *rgba)
+{
+#if defined(PIPE_ARCH_SSE)
+   const __m128 wa = _mm_set1_ps(a);
+   const __m128 wb = _mm_set1_ps(b);
+   const __m128 t00 = _mm_loadu_ps(tx[0]);
+   const __m128 t10 = _mm_loadu_ps(tx[1]);
+   const __m128 t01 = _mm_loadu_ps(tx[2]);
+   const __m128 t11 = _mm_loadu_ps(tx[3]);
+   const __m128 temp0 = _mm_add_ps(t00, _mm_mul_ps(wa, _mm_sub_ps(t10, t00)));
+   const __m128 temp1 = _mm_add_ps(t01, _mm_mul_ps(wa, _mm_sub_ps(t11, t01)));
+   union { __m128 m; float f[4]; } res;
+
+   res.m = _mm_add_ps(temp0, _mm_mul_ps(wb, _mm_sub_ps(temp1, temp0)));
+   rgba[0] = res.f[0];
+   rgba[TGSI_NUM_CHANNELS] = res.f[1];
+   rgba[2*TGSI_NUM_CHANNELS] = res.f[2];
+   rgba[3*TGSI_NUM_CHANNELS] = res.f[3];
+#else
+   int c;
+
+   for (c = 0; c < TGSI_NUM_CHANNELS; c++)
+      rgba[TGSI_NUM_CHANNELS*c] = lerp_2d(a, b,
+                                          tx[0][c], tx[1][c],
+                                          tx[2][c], tx[3][c]);
+#endif
+}
+
+
+/**
+ * Linear interpolation between two filtered quads, per pixel weight.
+ * Used to blend mipmap levels for a whole quad at once.
+ */
+static inline void
+lerp_quad_rgba(const float w[TGSI_QUAD_SIZE],
+               float rgba0[TGSI_NUM_CHANNELS][TGSI_QUAD_SIZE],
+               float rgba1[TGSI_NUM_CHANNELS][TGSI_QUAD_SIZE],
+               float rgba[TGSI_NUM_CHANNELS][TGSI_QUAD_SIZE])
+{
+#if defined(PIPE_ARCH_SSE)
+   const __m128 wv = _mm_loadu_ps(w);
+   int c;
+
+   for (c = 0; c < TGSI_NUM_CHANNELS; c++) {
+      const __m128 v0 = _mm_loadu_ps(rgba0[c]);
+      const __m128 v1 = _mm_loadu_ps(rgba1[c]);
+      _mm_storeu_ps(rgba[c], _mm_add_ps(v0, _mm_mul_ps(wv, _mm_sub_ps(v1, v0))));
+   }
+#else
+   int c, j;
+
+   for (c = 0; c < TGSI_NUM_CHANNELS; c++)
+      for (j = 0; j < TGSI_QUAD_SIZE; j++)
+         rgba[c][j] = lerp(w[j], rgba0[c][j], rgba1[c][j]);
+#endif
+}
+
+
 /**
  * As above, but 3D interpolation of 8 values.
  */
@@ -716,15 +783,16 @@ static inline const float *
 get_texel_buffer_no_border(const struct sp_sampler_view *sp_sview,
                            union tex_tile_address addr, int x, unsigned elmsize)
 {
+   const struct softpipe_tex_tile_cache *tc = sp_sview->cache;
    const struct softpipe_tex_cached_tile *tile;
-   addr.bits.x = x * elmsize / TEX_TILE_SIZE;
-   assert(x * elmsize / TEX_TILE_SIZE == addr.bits.x);
+   addr.bits.x = x * elmsize / tc->tile_size;
+   assert(x * elmsize / tc->tile_size == addr.bits.x);
 
-   x %= TEX_TILE_SIZE / elmsize;
+   x %= tc->tile_size / elmsize;
 
    tile = sp_get_cached_tile_tex(sp_sview->cache, addr);
 
-   return &tile->data.color[0][x][0];
+   return sp_tex_tile_texel(tc, tile, x, 0);
 }
 
 
@@ -732,15 +800,17 @@ static inline const float *
 get_texel_2d_no_border(const struct sp_sampler_view *sp_sview,
                        union tex_tile_address addr, int x, int y)
 {
+   const struct softpipe_tex_tile_cache *tc = sp_sview->cache;
    const struct softpipe_tex_cached_tile *tile;
-   addr.bits.x = x / TEX_TILE_SIZE;
-   addr.bits.y = y / TEX_TILE_SIZE;
-   y %= TEX_TILE_SIZE;
-   x %= TEX_TILE_SIZE;
+   const unsigned mask = tc->tile_size - 1;
+   addr.bits.x = x >> tc->tile_size_log2;
+   addr.bits.y = y >> tc->tile_size_log2;
+   y &= mask;
+   x &= mask;
 
    tile = sp_get_cached_tile_tex(sp_sview->cache, addr);
 
-   return &tile->data.color[y][x][0];
+   return sp_tex_tile_texel(tc, tile, x, y);
 }
 
 
@@ -918,19 +988,21 @@ get_texel_quad_2d_no_border_single_tile(const struct sp_sampler_view *sp_sview,
                                         unsigned x, unsigned y,
                                         const float *out[4])
 {
-    const struct softpipe_tex_cached_tile *tile;
+   const struct softpipe_tex_tile_cache *tc = sp_sview->cache;
+   const struct softpipe_tex_cached_tile *tile;
+   const unsigned mask = tc->tile_size - 1;
 
-   addr.bits.x = x / TEX_TILE_SIZE;
-   addr.bits.y = y / TEX_TILE_SIZE;
-   y %= TEX_TILE_SIZE;
-   x %= TEX_TILE_SIZE;
+   addr.bits.x = x >> tc->tile_size_log2;
+   addr.bits.y = y >> tc->tile_size_log2;
+   y &= mask;
+   x &= mask;
 
    tile = sp_get_cached_tile_tex(sp_sview->cache, addr);
-      
-   out[0] = &tile->data.color[y  ][x  ][0];
-   out[1] = &tile->data.color[y  ][x+1][0];
-   out[2] = &tile->data.color[y+1][x  ][0];
-   out[3] = &tile->data.color[y+1][x+1][0];
+
+   out[0] = sp_tex_tile_texel(tc, tile, x,   y  );
+   out[1] = out[0] + 4;
+   out[2] = sp_tex_tile_texel(tc, tile, x,   y+1);
+   out[3] = out[2] + 4;
 }
 
 
@@ -956,17 +1028,19 @@ static inline const float *
 get_texel_3d_no_border(const struct sp_sampler_view *sp_sview,
                        union tex_tile_address addr, int x, int y, int z)
 {
+   const struct softpipe_tex_tile_cache *tc = sp_sview->cache;
    const struct softpipe_tex_cached_tile *tile;
+   const unsigned mask = tc->tile_size - 1;
 
-   addr.bits.x = x / TEX_TILE_SIZE;
-   addr.bits.y = y / TEX_TILE_SIZE;
+   addr.bits.x = x >> tc->tile_size_log2;
+   addr.bits.y = y >> tc->tile_size_log2;
    addr.bits.z = z;
-   y %= TEX_TILE_SIZE;
-   x %= TEX_TILE_SIZE;
+   y &= mask;
+   x &= mask;
 
    tile = sp_get_cached_tile_tex(sp_sview->cache, addr);
 
-   return &tile->data.color[y][x][0];
+   return sp_tex_tile_texel(tc, tile, x, y);
 }
 
 
@@ -1140,40 +1214,42 @@ print_sample_4(const char *function, float rgba[TGSI_NUM_CHANNELS][TGSI_QUAD_SIZ
 
 /* Some image-filter fastpaths:
  */
+
+/* Gather the 2x2 footprint of a bilinear sample of a POT texture with
+ * REPEAT wrapping, along with the interpolation weights.
+ */
 static inline void
-img_filter_2d_linear_repeat_POT(const struct sp_sampler_view *sp_sview,
-                                const struct sp_sampler *sp_samp,
-                                const struct img_filter_args *args,
-                                float *rgba)
-{
-   const unsigned xpot = pot_level_size(sp_sview->xpot, args->level);
-   const unsigned ypot = pot_level_size(sp_sview->ypot, args->level);
-   const int xmax = (xpot - 1) & (TEX_TILE_SIZE - 1); /* MIN2(TEX_TILE_SIZE, xpot) - 1; */
-   const int ymax = (ypot - 1) & (TEX_TILE_SIZE - 1); /* MIN2(TEX_TILE_SIZE, ypot) - 1; */
+get_texel_quad_2d_repeat_POT(const struct sp_sampler_view *sp_sview,
+                             unsigned level, float s, float t,
+                             const int8_t *offset,
+                             const float *tx[4], float *xw, float *yw)
+{
+   const unsigned xpot = pot_level_size(sp_sview->xpot, level);
+   const unsigned ypot = pot_level_size(sp_sview->ypot, level);
+   const int tile_mask = sp_sview->cache->tile_size - 1;
    union tex_tile_address addr;
-   int c;
 
-   const float u = (args->s * xpot - 0.5F) + args->offset[0];
-   const float v = (args->t * ypot - 0.5F) + args->offset[1];
+   const float u = (s * xpot - 0.5F) + offset[0];
+   const float v = (t * ypot - 0.5F) + offset[1];
 
    const int uflr = util_ifloor(u);
    const int vflr = util_ifloor(v);
 
-   const float xw = u - (float)uflr;
-   const float yw = v - (float)vflr;
-
    const int x0 = uflr & (xpot - 1);
    const int y0 = vflr & (ypot - 1);
 
-   const float *tx[4];
-      
+   *xw = u - (float)uflr;
+   *yw = v - (float)vflr;
+
    addr.value = 0;
-   addr.bits.level = args->level;
+   addr.bits.level = level;
    addr.bits.z = sp_sview->base.u.tex.first_layer;
 
-   /* Can we fetch all four at once:
+   /* Can we fetch all four at once, i.e. does the footprint neither wrap
+    * around the image nor straddle a tile boundary:
     */
-   if (x0 < xmax && y0 < ymax) {
+   if (x0 < (int) xpot - 1 && (x0 & tile_mask) != tile_mask &&
+       y0 < (int) ypot - 1 && (y0 & tile_mask) != tile_mask) {
       get_texel_quad_2d_no_border_single_tile(sp_sview, addr, x0, y0, tx);
    }
    else {
@@ -1181,13 +1257,23 @@ img_filter_2d_linear_repeat_POT(const struct sp_sampler_view *sp_sview,
       const unsigned y1 = (y0 + 1) & (ypot - 1);
       get_texel_quad_2d_no_border(sp_sview, addr, x0, y0, x1, y1, tx);
    }
+}
+
+
+static inline void
+img_filter_2d_linear_repeat_POT(const struct sp_sampler_view *sp_sview,
+                                const struct sp_sampler *sp_samp,
+                                const struct img_filter_args *args,
+                                float *rgba)
+{
+   const float *tx[4];
+   float xw, yw;
+
+   get_texel_quad_2d_repeat_POT(sp_sview, args->level, args->s, args->t,
+                                args->offset, tx, &xw, &yw);
 
    /* interpolate R, G, B, A */
-   for (c = 0; c < TGSI_NUM_CHANNELS; c++) {
-      rgba[TGSI_NUM_CHANNELS*c] = lerp_2d(xw, yw, 
-                                       tx[0][c], tx[1][c], 
-                                       tx[2][c], tx[3][c]);
-   }
+   lerp_2d_rgba(xw, yw, tx, rgba);
 
    if (DEBUG_TEX) {
       print_sample(__FUNCTION__, rgba);
@@ -1195,6 +1281,35 @@ img_filter_2d_linear_repeat_POT(const struct sp_sampler_view *sp_sview,
 }
 
 
+/**
+ * As img_filter_2d_linear_repeat_POT, but for all pixels of a quad at
+ * the same mipmap level.
+ *
+ * Each footprint is filtered right after it is gathered: the texel
+ * pointers point into the direct-mapped tile cache and fetching the
+ * footprint of another pixel may evict their tile.
+ */
+static inline void
+img_filter_2d_linear_repeat_POT_quad(const struct sp_sampler_view *sp_sview,
+                                     unsigned level,
+                                     const float s[TGSI_QUAD_SIZE],
+                                     const float t[TGSI_QUAD_SIZE],
+                                     const int8_t *offset,
+                                     float rgba[TGSI_NUM_CHANNELS][TGSI_QUAD_SIZE])
+{
+   int j;
+
+   for (j = 0; j < TGSI_QUAD_SIZE; j++) {
+      const float *tx[4];
+      float xw, yw;
+
+      get_texel_quad_2d_repeat_POT(sp_sview, level, s[j], t[j], offset,
+                                   tx, &xw, &yw);
+      lerp_2d_rgba(xw, yw, tx, &rgba[0][j]);
+   }
+}
+
+
 static inline void
 img_filter_2d_nearest_repeat_POT(const struct sp_sampler_view *sp_sview,
                                  const struct sp_sampler *sp_samp,
@@ -1682,10 +1797,7 @@ img_filter_2d_linear(const struct sp_sampler_view *sp_sview,
                                                       tx);
    } else {
       /* interpolate R, G, B, A */
-      for (c = 0; c < TGSI_NUM_CHANNELS; c++)
-         rgba[TGSI_NUM_CHANNELS*c] = lerp_2d(xw, yw,
-                                             tx[0][c], tx[1][c],
-                                             tx[2][c], tx[3][c]);
+      lerp_2d_rgba(xw, yw, tx, rgba);
    }
 }
 
@@ -1728,10 +1840,7 @@ img_filter_2d_array_linear(const struct sp_sampler_view *sp_sview,
                                                       tx);
    } else {
       /* interpolate R, G, B, A */
-      for (c = 0; c < TGSI_NUM_CHANNELS; c++)
-         rgba[TGSI_NUM_CHANNELS*c] = lerp_2d(xw, yw,
-                                             tx[0][c], tx[1][c],
-                                             tx[2][c], tx[3][c]);
+      lerp_2d_rgba(xw, yw, tx, rgba);
    }
 }
 
@@ -2689,8 +2798,41 @@ mip_filter_linear_2d_linear_repeat_POT(
    float rgba[TGSI_NUM_CHANNELS][TGSI_QUAD_SIZE])
 {
    const struct pipe_sampler_view *psview = &sp_sview->base;
+   const int quad_level0 = psview->u.tex.first_level + (int)lod[0];
    int j;
 
+   /* Fast path: the whole quad samples the same mipmap level(s), so it can
+    * be filtered a level at a time and blended between levels at once.
+    */
+   if (quad_level0 == psview->u.tex.first_level + (int)lod[1] &&
+       quad_level0 == psview->u.tex.first_level + (int)lod[2] &&
+       quad_level0 == psview->u.tex.first_level + (int)lod[3]) {
+      if ((unsigned)quad_level0 >= psview->u.tex.last_level) {
+         const unsigned level = quad_level0 < 0 ? psview->u.tex.first_level :
+                                                  psview->u.tex.last_level;
+         img_filter_2d_linear_repeat_POT_quad(sp_sview, level, s, t,
+                                              filt_args->offset, rgba);
+      }
+      else {
+         float rgba0[TGSI_NUM_CHANNELS][TGSI_QUAD_SIZE];
+         float rgba1[TGSI_NUM_CHANNELS][TGSI_QUAD_SIZE];
+         float levelBlend[TGSI_QUAD_SIZE];
+
+         img_filter_2d_linear_repeat_POT_quad(sp_sview, quad_level0, s, t,
+                                              filt_args->offset, rgba0);
+         img_filter_2d_linear_repeat_POT_quad(sp_sview, quad_level0 + 1, s, t,
+                                              filt_args->offset, rgba1);
+         for (j = 0; j < TGSI_QUAD_SIZE; j++)
+            levelBlend[j] = frac(lod[j]);
+         lerp_quad_rgba(levelBlend, rgba0, rgba1, rgba);
+      }
+
+      if (DEBUG_TEX) {
+         print_sample_4(__FUNCTION__, rgba);
+      }
+      return;
+   }
+
    for (j = 0; j < TGSI_QUAD_SIZE; j++) {
       const int level0 = psview->u.tex.first_level + (int)lod[j];
       struct img_filter_args args;
@@ -3638,6 +3780,17 @@ softpipe_create_sampler_view(struct pipe_context *pipe,
 
       sview->xpot = util_logbase2( resource->width0 );
       sview->ypot = util_logbase2( resource->height0 );
+
+      /* Large 2D textures get wider cache tiles, so more bilinear
+       * footprints and neighbouring quads are served by the same tile.
+       */
+      if ((view->target == PIPE_TEXTURE_2D ||
+           view->target == PIPE_TEXTURE_RECT ||
+           view->target == PIPE_TEXTURE_2D_ARRAY) &&
+          resource->width0 >= 256 && resource->height0 >= 256)
+         sview->tile_size_log2 = TEX_TILE_SIZE_LOG2_MAX;
+      else
+         sview->tile_size_log2 = TEX_TILE_SIZE_LOG2;
    }
 
    return (struct pipe_sampler_view *) sview;
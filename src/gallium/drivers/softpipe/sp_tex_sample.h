@@ -117,6 +117,9 @@ struct sp_sampler_view
    boolean pot2d;
    boolean need_cube_convert;
 
+   /* log2 of the texture tile cache tile size wanted for this view */
+   unsigned tile_size_log2;
+
    /* these are different per shader type */
    struct softpipe_tex_tile_cache *cache;
    compute_lambda_func compute_lambda;
@@ -39,9 +39,48 @@
 #include "util/u_math.h"
 #include "sp_context.h"
 #include "sp_texture.h"
+#include "sp_tex_sample.h"
 #include "sp_tex_tile_cache.h"
 
-   
+
+/**
+ * (Re)allocate the texel storage of all cache entries for the given tile
+ * size.  All entries are invalidated.  On allocation failure the previous
+ * storage and tile size are kept.
+ */
+static boolean
+sp_tex_tile_cache_set_tile_size(struct softpipe_tex_tile_cache *tc,
+                                unsigned tile_size_log2)
+{
+   const unsigned tile_size = 1 << tile_size_log2;
+   const size_t tile_floats = (size_t)tile_size * tile_size * 4;
+   float *storage;
+   uint pos;
+
+   assert(tile_size_log2 >= TEX_TILE_SIZE_LOG2);
+   assert(tile_size_log2 <= TEX_TILE_SIZE_LOG2_MAX);
+
+   if (tc->tile_storage && tc->tile_size_log2 == tile_size_log2)
+      return TRUE;
+
+   storage = align_malloc(tile_floats * sizeof(float) * NUM_TEX_TILE_ENTRIES,
+                          16);
+   if (!storage)
+      return FALSE;
+
+   align_free(tc->tile_storage);
+   tc->tile_storage = storage;
+   tc->tile_size_log2 = tile_size_log2;
+   tc->tile_size = tile_size;
+
+   for (pos = 0; pos < ARRAY_SIZE(tc->entries); pos++) {
+      tc->entries[pos].color = storage + pos * tile_floats;
+      tc->entries[pos].addr.bits.invalid = 1;
+   }
+   return TRUE;
+}
+
+
 
 struct softpipe_tex_tile_cache *
 sp_create_tex_tile_cache( struct pipe_context *pipe )
@@ -58,6 +97,10 @@ sp_create_tex_tile_cache( struct pipe_context *pipe )
       for (pos = 0; pos < ARRAY_SIZE(tc->entries); pos++) {
          tc->entries[pos].addr.bits.invalid = 1;
       }
+      if (!sp_tex_tile_cache_set_tile_size(tc, TEX_TILE_SIZE_LOG2)) {
+         FREE(tc);
+         return NULL;
+      }
       tc->last_tile = &tc->entries[0]; /* any tile */
    }
    return tc;
@@ -80,6 +123,7 @@ sp_destroy_tex_tile_cache(struct softpipe_tex_tile_cache *tc)
          tc->pipe->transfer_unmap(tc->pipe, tc->tex_trans);
       }
 
+      align_free(tc->tile_storage);
       FREE( tc );
    }
 }
@@ -108,7 +152,9 @@ sp_tex_tile_is_compat_view(struct softpipe_tex_tile_cache *tc,
 {
    if (!view)
       return FALSE;
-   return (tc->texture == view->texture &&
+   return (tc->tile_size_log2 ==
+              ((const struct sp_sampler_view *)view)->tile_size_log2 &&
+           tc->texture == view->texture &&
            tc->format == view->format &&
            tc->swizzle_r == view->swizzle_r &&
            tc->swizzle_g == view->swizzle_g &&
@@ -143,6 +189,12 @@ sp_tex_tile_cache_set_sampler_view(struct softpipe_tex_tile_cache *tc,
          tc->swizzle_b = view->swizzle_b;
          tc->swizzle_a = view->swizzle_a;
          tc->format = view->format;
+
+         /* If the wider tiles can't be allocated just keep using the
+          * current ones; the samplers always query tc->tile_size_log2.
+          */
+         sp_tex_tile_cache_set_tile_size(tc,
+            ((const struct sp_sampler_view *)view)->tile_size_log2);
       }
 
       /* mark as entries as invalid/empty */
@@ -260,12 +312,12 @@ sp_find_cached_tile_tex(struct softpipe_tex_tile_cache *tc,
        * the image format.
        */
       pipe_get_tile_rgba(tc->tex_trans, tc->tex_trans_map,
-                         addr.bits.x * TEX_TILE_SIZE,
-                         addr.bits.y * TEX_TILE_SIZE,
-                         TEX_TILE_SIZE,
-                         TEX_TILE_SIZE,
+                         addr.bits.x << tc->tile_size_log2,
+                         addr.bits.y << tc->tile_size_log2,
+                         tc->tile_size,
+                         tc->tile_size,
                          tc->format,
-                         (float *) tile->data.color);
+                         tile->color);
       tile->addr = addr;
    }
 
@@ -38,10 +38,14 @@ struct softpipe_tex_tile_cache;
 
 
 /**
- * Cache tile size (width and height). This needs to be a power of two.
+ * Default cache tile size (width and height). This needs to be a power of
+ * two.  Sampler views of large 2D textures may ask for wider tiles, up to
+ * TEX_TILE_SIZE_LOG2_MAX, which amortizes the per-tile conversion cost over
+ * more texels.
  */
 #define TEX_TILE_SIZE_LOG2 5
 #define TEX_TILE_SIZE (1 << TEX_TILE_SIZE_LOG2)
+#define TEX_TILE_SIZE_LOG2_MAX 6
 
 #define TEX_ADDR_BITS (SP_MAX_TEXTURE_2D_LEVELS - 1)
 #define TEX_Y_BITS (SP_MAX_TEXTURE_2D_LEVELS - 1 - TEX_TILE_SIZE_LOG2)
@@ -64,11 +68,7 @@ union tex_tile_address {
 struct softpipe_tex_cached_tile
 {
    union tex_tile_address addr;
-   union {
-      float color[TEX_TILE_SIZE][TEX_TILE_SIZE][4];
-      unsigned int colorui[TEX_TILE_SIZE][TEX_TILE_SIZE][4];
-      int colori[TEX_TILE_SIZE][TEX_TILE_SIZE][4];
-   } data;
+   float *color;  /**< tile_size x tile_size RGBA texels, row major */
 };
 
 /*
@@ -90,6 +90,10 @@ struct softpipe_tex_tile_cache
 
    struct softpipe_tex_cached_tile entries[NUM_TEX_TILE_ENTRIES];
 
+   unsigned tile_size_log2;   /**< current tile size, see TEX_TILE_SIZE */
+   unsigned tile_size;
+   float *tile_storage;       /**< backing store for all entries' texels */
+
    struct pipe_transfer *tex_trans;
    void *tex_trans_map;
    int tex_level, tex_z;
@@ -127,7 +131,8 @@ sp_find_cached_tile_tex(struct softpipe_tex_tile_cache *tc,
                         union tex_tile_address addr );
 
 static inline union tex_tile_address
-tex_tile_address( unsigned x,
+tex_tile_address( const struct softpipe_tex_tile_cache *tc,
+                  unsigned x,
                   unsigned y,
                   unsigned z,
                   unsigned face,
@@ -136,14 +141,24 @@ tex_tile_address( unsigned x,
    union tex_tile_address addr;
 
    addr.value = 0;
-   addr.bits.x = x / TEX_TILE_SIZE;
-   addr.bits.y = y / TEX_TILE_SIZE;
+   addr.bits.x = x >> tc->tile_size_log2;
+   addr.bits.y = y >> tc->tile_size_log2;
    addr.bits.z = z;
    addr.bits.level = level;
 
    return addr;
 }
 
+/* Return a pointer to the RGBA texel at (x, y) within a cached tile.
+ */
+static inline const float *
+sp_tex_tile_texel(const struct softpipe_tex_tile_cache *tc,
+                  const struct softpipe_tex_cached_tile *tile,
+                  unsigned x, unsigned y)
+{
+   return tile->color + (((y << tc->tile_size_log2) + x) << 2);
+}
+
 /* Quickly retrieve tile if it matches last lookup.
  */
 static inline const struct softpipe_tex_cached_tile *
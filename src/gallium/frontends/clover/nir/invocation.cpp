@@ -33,7 +33,9 @@
 #include <compiler/glsl_types.h>
 #include <compiler/nir/nir_serialize.h>
 #include <compiler/spirv/nir_spirv.h>
+#include <util/u_cpu_detect.h>
 #include <util/u_math.h>
+#include <util/u_queue.h>
 
 using namespace clover;
 
@@ -58,6 +60,47 @@ dev_get_nir_compiler_options(const device &dev)
    return static_cast<const nir_shader_compiler_options*>(co);
 }
 
+// Threads that help the calling thread optimize the functions of a kernel,
+// or NULL if there's only one CPU.  The caller waits for the jobs, and the
+// shared thread pool might be busy running jobs that wait themselves, so
+// the queue gets threads of its own.
+static util_queue *
+get_function_queue()
+{
+   static util_queue queue;
+   static const bool initialized = [] {
+      util_cpu_detect();
+      return util_cpu_caps.nr_cpus > 1 &&
+             util_queue_init(&queue, "clnir", 32, util_cpu_caps.nr_cpus - 1,
+                             UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                             UTIL_QUEUE_INIT_DEDICATED_THREADS);
+   }();
+
+   return initialized ? &queue : NULL;
+}
+
+// Cleans up a function before it gets inlined, so that this is done once
+// instead of for every copy.  Only uses passes that are safe to run on
+// several functions at the same time.
+static bool
+optimize_function(nir_function_impl *impl)
+{
+   bool progress, any_progress = false;
+
+   do {
+      progress = false;
+      progress |= nir_lower_vars_to_ssa_impl(impl);
+      progress |= nir_copy_prop_impl(impl);
+      progress |= nir_opt_deref_impl(impl);
+      progress |= nir_opt_dce_impl(impl);
+      progress |= nir_opt_dead_cf_impl(impl);
+      progress |= nir_opt_cse_impl(impl);
+      any_progress |= progress;
+   } while (progress);
+
+   return any_progress;
+}
+
 module clover::nir::spirv_to_nir(const module &mod, const device &dev,
                                  std::string &r_log)
 {
@@ -111,6 +154,8 @@ module clover::nir::spirv_to_nir(const module &mod, const device &dev,
       // according to the comment on nir_inline_functions
       NIR_PASS_V(nir, nir_lower_variable_initializers, nir_var_function_temp);
       NIR_PASS_V(nir, nir_lower_returns);
+      NIR_PASS_V(nir, nir_shader_foreach_impl_parallel, get_function_queue(),
+                 optimize_function);
       NIR_PASS_V(nir, nir_inline_functions);
       NIR_PASS_V(nir, nir_copy_prop);
       NIR_PASS_V(nir, nir_opt_deref);
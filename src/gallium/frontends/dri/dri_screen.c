@@ -43,6 +43,7 @@
 #include "frontend/drm_driver.h"
 
 #include "util/u_debug.h"
+#include "util/u_queue.h"
 #include "util/format/u_format_s3tc.h"
 
 #define MSAA_VISUAL_MAX_SAMPLES 32
@@ -573,6 +574,10 @@ dri_init_options(struct dri_screen *screen)
 {
    pipe_loader_load_options(screen->dev);
 
+   /* This must be set before the screen creates its queues. */
+   util_queue_set_shared_pool_size(
+      driQueryOptioni(&screen->dev->option_cache, "mesa_thread_pool_size"));
+
    dri_fill_st_options(screen);
 }
 
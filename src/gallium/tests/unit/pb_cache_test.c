@@ -0,0 +1,257 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The Mesa authors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ *  Test case and benchmark for pb_cache.
+ *
+ *  A number of threads repeatedly reclaim buffers of random sizes from a
+ *  shared cache, allocating new ones on a miss, and put them back.  The
+ *  test checks that reclaimed buffers are compatible with the request and
+ *  that no buffer is handed out twice, and reports alloc/free throughput.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipebuffer/pb_cache.h"
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_memory.h"
+#include "util/u_thread.h"
+
+
+#define MAX_THREADS 8
+#define NUM_HEAPS 4
+#define ITERATIONS 100000
+#define LIVE_BUFFERS 16
+
+static int verbosity = 0;
+
+struct test_buffer {
+   struct pb_buffer base;
+   struct pb_cache_entry cache_entry;
+   int in_use;
+};
+
+struct test_thread {
+   struct pb_cache *cache;
+   unsigned seed;
+   thrd_t thread;
+};
+
+static int num_created = 0;
+static int num_destroyed = 0;
+
+
+#define LOG(fmt, ...) \
+   if (verbosity > 0) { \
+      fprintf(stdout, fmt, ##__VA_ARGS__); \
+   }
+
+#define CHECK(_cond) \
+   if (!(_cond)) { \
+      fprintf(stderr, "%s:%u: `%s` failed\n", __FILE__, __LINE__, #_cond); \
+      _exit(EXIT_FAILURE); \
+   }
+
+
+static void
+test_destroy_buffer(struct pb_buffer *buf)
+{
+   p_atomic_inc(&num_destroyed);
+   FREE(buf);
+}
+
+static bool
+test_can_reclaim(struct pb_buffer *buf)
+{
+   return true;
+}
+
+static unsigned
+next_rand(unsigned *seed)
+{
+   *seed = *seed * 1103515245 + 12345;
+   return *seed >> 8;
+}
+
+static struct test_buffer *
+test_alloc(struct pb_cache *cache, pb_size size, unsigned heap)
+{
+   struct test_buffer *buf;
+
+   buf = (struct test_buffer *)
+      pb_cache_reclaim_buffer(cache, size, 4096, 0, heap);
+   if (buf) {
+      CHECK(buf->base.size >= size);
+      CHECK(buf->base.size <= 2 * size);
+      CHECK(buf->cache_entry.bucket_index == heap);
+      CHECK(p_atomic_cmpxchg(&buf->in_use, 0, 1) == 0);
+      return buf;
+   }
+
+   buf = CALLOC_STRUCT(test_buffer);
+   CHECK(buf);
+   pipe_reference_init(&buf->base.reference, 1);
+   buf->base.size = size;
+   buf->base.alignment = 4096;
+   buf->in_use = 1;
+   pb_cache_init_entry(cache, &buf->cache_entry, &buf->base, heap);
+   p_atomic_inc(&num_created);
+   return buf;
+}
+
+static void
+test_free(struct test_buffer *buf)
+{
+   p_atomic_set(&buf->in_use, 0);
+   if (pipe_reference(&buf->base.reference, NULL))
+      pb_cache_add_buffer(&buf->cache_entry);
+}
+
+static int
+thread_function(void *thread_data)
+{
+   struct test_thread *t = (struct test_thread *)thread_data;
+   struct test_buffer *live[LIVE_BUFFERS] = {0};
+   unsigned i;
+
+   for (i = 0; i < ITERATIONS; i++) {
+      unsigned slot = next_rand(&t->seed) % LIVE_BUFFERS;
+      /* Sizes between 4 KB and 16 MB, skewed towards small buffers like
+       * in real workloads.
+       */
+      pb_size size = (pb_size)4096 << (next_rand(&t->seed) % 13);
+      unsigned heap = next_rand(&t->seed) % NUM_HEAPS;
+
+      size += (next_rand(&t->seed) % 4) * 4096;
+
+      if (live[slot])
+         test_free(live[slot]);
+      live[slot] = test_alloc(t->cache, size, heap);
+   }
+
+   for (i = 0; i < LIVE_BUFFERS; i++) {
+      if (live[i])
+         test_free(live[i]);
+   }
+   return 0;
+}
+
+static void
+run(unsigned num_threads, bool async_release)
+{
+   struct test_thread threads[MAX_THREADS];
+   struct pb_cache cache;
+   int64_t start, end;
+   unsigned i;
+
+   num_created = num_destroyed = 0;
+
+   pb_cache_init(&cache, NUM_HEAPS, 1000000, 2.0f, 0, 1024 * 1024 * 1024,
+                 test_destroy_buffer, test_can_reclaim);
+   if (async_release)
+      CHECK(pb_cache_enable_async_release(&cache));
+
+   start = os_time_get();
+   for (i = 0; i < num_threads; i++) {
+      threads[i].cache = &cache;
+      threads[i].seed = i + 1;
+      threads[i].thread = u_thread_create(thread_function, &threads[i]);
+   }
+   for (i = 0; i < num_threads; i++)
+      thrd_join(threads[i].thread, NULL);
+   end = os_time_get();
+
+   pb_cache_deinit(&cache);
+   CHECK(num_created == num_destroyed);
+
+   printf("%u thread(s)%s: %.2f Mops/s, %d buffers created\n",
+          num_threads, async_release ? ", async release" : "",
+          (double)num_threads * ITERATIONS / MAX2(end - start, 1),
+          num_created);
+}
+
+/* The release thread sleeps while the cache is empty, and has to wake up
+ * for the buffers added after that.
+ */
+static void
+test_async_expiry(void)
+{
+   struct pb_cache cache;
+   unsigned i;
+
+   num_created = num_destroyed = 0;
+
+   pb_cache_init(&cache, NUM_HEAPS, 10000, 2.0f, 0, 1024 * 1024 * 1024,
+                 test_destroy_buffer, test_can_reclaim);
+   CHECK(pb_cache_enable_async_release(&cache));
+
+   for (i = 0; i < 2; i++) {
+      test_free(test_alloc(&cache, 4096, 0));
+
+      /* Wait for much longer than the buffer stays in the cache. */
+      os_time_sleep(200000);
+      CHECK(p_atomic_read(&num_destroyed) == i + 1);
+   }
+
+   pb_cache_deinit(&cache);
+   CHECK(num_created == num_destroyed);
+}
+
+
+int main(int argc, char *argv[])
+{
+   unsigned n;
+   int i;
+
+   for (i = 1; i < argc; ++i) {
+      const char *arg = argv[i];
+      if (strcmp(arg, "-v") == 0) {
+         ++verbosity;
+      } else {
+         fprintf(stderr, "error: unrecognized option `%s`\n", arg);
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   LOG("pb_cache_test starting\n");
+
+   test_async_expiry();
+
+   for (n = 1; n <= MAX_THREADS; n *= 2) {
+      run(n, false);
+      run(n, true);
+   }
+
+   LOG("pb_cache_test exiting\n");
+
+   return 0;
+}
@@ -0,0 +1,376 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The Mesa authors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ *  Test case and benchmark for u_index_scan and the u_indices translators.
+ *
+ *  Every helper is compared against a straightforward per-index loop for
+ *  all index sizes and a range of lengths, so that both the vector loops
+ *  and the scalar tails are covered.  Then the time taken to process a
+ *  large index buffer is reported for the helpers and the reference loops.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "indices/u_indices.h"
+#include "util/os_time.h"
+#include "util/u_index_scan.h"
+#include "util/u_memory.h"
+
+
+#define BENCH_COUNT (4 * 1024 * 1024)
+#define BENCH_ITERATIONS 8
+
+static int verbosity = 0;
+
+
+#define LOG(fmt, ...) \
+   if (verbosity > 0) { \
+      fprintf(stdout, fmt, ##__VA_ARGS__); \
+   }
+
+#define CHECK(_cond) \
+   if (!(_cond)) { \
+      fprintf(stderr, "%s:%u: `%s` failed\n", __FILE__, __LINE__, #_cond); \
+      _exit(EXIT_FAILURE); \
+   }
+
+
+static unsigned
+next_rand(unsigned *seed)
+{
+   *seed = *seed * 1103515245 + 12345;
+   return *seed >> 8;
+}
+
+static unsigned
+get_index(const void *indices, unsigned index_size, unsigned i)
+{
+   switch (index_size) {
+   case 1: return ((const uint8_t *)indices)[i];
+   case 2: return ((const uint16_t *)indices)[i];
+   default: return ((const uint32_t *)indices)[i];
+   }
+}
+
+static void
+put_index(void *indices, unsigned index_size, unsigned i, unsigned value)
+{
+   switch (index_size) {
+   case 1: ((uint8_t *)indices)[i] = value; break;
+   case 2: ((uint16_t *)indices)[i] = value; break;
+   default: ((uint32_t *)indices)[i] = value; break;
+   }
+}
+
+static unsigned
+size_mask(unsigned index_size)
+{
+   return index_size == 4 ? ~0u : (1u << (index_size * 8)) - 1;
+}
+
+/* Fill with random indices, roughly one in "restart_freq" being the
+ * restart index.
+ */
+static void
+fill_indices(void *indices, unsigned index_size, unsigned count,
+             unsigned restart_index, unsigned restart_freq, unsigned *seed)
+{
+   unsigned i;
+
+   for (i = 0; i < count; i++) {
+      unsigned value = next_rand(seed) & size_mask(index_size);
+
+      if (restart_freq && next_rand(seed) % restart_freq == 0)
+         value = restart_index;
+      put_index(indices, index_size, i, value);
+   }
+}
+
+
+static void
+ref_minmax(const void *indices, unsigned index_size, unsigned count,
+           bool primitive_restart, unsigned restart_index,
+           unsigned *out_min, unsigned *out_max)
+{
+   unsigned min = size_mask(index_size), max = 0, i;
+
+   if (!count) {
+      *out_min = *out_max = 0;
+      return;
+   }
+
+   for (i = 0; i < count; i++) {
+      unsigned index = get_index(indices, index_size, i);
+
+      if (primitive_restart && index == restart_index)
+         continue;
+      min = MIN2(min, index);
+      max = MAX2(max, index);
+   }
+   *out_min = min;
+   *out_max = max;
+}
+
+static unsigned
+ref_find(const void *indices, unsigned index_size, unsigned count,
+         unsigned value)
+{
+   unsigned i;
+
+   for (i = 0; i < count; i++) {
+      if (get_index(indices, index_size, i) == value)
+         return i;
+   }
+   return count;
+}
+
+static void
+ref_translate_restart(const void *src, unsigned src_index_size,
+                      void *dst, unsigned dst_index_size,
+                      unsigned count, unsigned restart_index)
+{
+   unsigned i;
+
+   for (i = 0; i < count; i++) {
+      unsigned index = get_index(src, src_index_size, i);
+
+      put_index(dst, dst_index_size, i,
+                index == restart_index ? size_mask(dst_index_size) : index);
+   }
+}
+
+
+static void
+test_correctness(void)
+{
+   static const unsigned sizes[] = {1, 2, 4};
+   unsigned seed = 1;
+   uint32_t *src = MALLOC(256 * sizeof(uint32_t));
+   uint32_t *dst = MALLOC(512 * sizeof(uint32_t));
+   uint32_t *ref = MALLOC(512 * sizeof(uint32_t));
+   unsigned s, d, count, pr;
+
+   CHECK(src && dst && ref);
+
+   for (s = 0; s < 3; s++) {
+      unsigned isize = sizes[s];
+
+      for (count = 0; count < 100; count++) {
+         for (pr = 0; pr < 3; pr++) {
+            /* Restart index that is common, rare, and out of range. */
+            unsigned restart = pr == 2 ? 0x10000 + isize : size_mask(isize);
+            unsigned min, max, rmin, rmax, pos;
+
+            fill_indices(src, isize, count, restart & size_mask(isize),
+                         pr == 0 ? 4 : 40, &seed);
+
+            util_index_minmax(src, isize, count, true, restart, &min, &max);
+            ref_minmax(src, isize, count, true, restart, &rmin, &rmax);
+            CHECK(min == rmin && max == rmax);
+
+            util_index_minmax(src, isize, count, false, restart, &min, &max);
+            ref_minmax(src, isize, count, false, restart, &rmin, &rmax);
+            CHECK(min == rmin && max == rmax);
+
+            pos = util_index_find(src, isize, count, restart);
+            CHECK(pos == ref_find(src, isize, count, restart));
+
+            for (d = s; d < 3; d++) {
+               unsigned osize = sizes[d];
+
+               if (osize == 1)
+                  continue;
+
+               memset(dst, 0xcd, 512 * sizeof(uint32_t));
+               memset(ref, 0xcd, 512 * sizeof(uint32_t));
+               util_index_translate_restart(src, isize, dst, osize, count,
+                                            restart);
+               ref_translate_restart(src, isize, ref, osize, count, restart);
+               CHECK(memcmp(dst, ref, 512 * sizeof(uint32_t)) == 0);
+            }
+         }
+
+         for (d = 1; d < 3; d++) {
+            unsigned osize = sizes[d];
+            unsigned q, i;
+
+            memset(dst, 0xcd, 512 * sizeof(uint32_t));
+            util_index_copy(src, isize, dst, osize, count);
+            for (i = 0; i < count; i++) {
+               CHECK(get_index(dst, osize, i) ==
+                     (get_index(src, isize, i) & size_mask(osize)));
+            }
+            CHECK(get_index(dst, osize, count) ==
+                  (0xcdcdcdcd & size_mask(osize)));
+
+            for (pr = 0; pr < 2; pr++) {
+               static const unsigned first[6] = {0, 1, 2, 0, 2, 3};
+               static const unsigned last[6] = {0, 1, 3, 1, 2, 3};
+               const unsigned *map = pr ? last : first;
+
+               memset(dst, 0xcd, 512 * sizeof(uint32_t));
+               util_index_quads_to_tris(src, isize, dst, osize, count / 4, pr);
+               for (q = 0; q < count / 4; q++) {
+                  for (i = 0; i < 6; i++) {
+                     CHECK(get_index(dst, osize, q * 6 + i) ==
+                           (get_index(src, isize, q * 4 + map[i]) &
+                            size_mask(osize)));
+                  }
+               }
+               CHECK(get_index(dst, osize, count / 4 * 6) ==
+                     (0xcdcdcdcd & size_mask(osize)));
+            }
+         }
+      }
+   }
+
+   FREE(src);
+   FREE(dst);
+   FREE(ref);
+}
+
+
+static double
+mindices_per_sec(int64_t start, int64_t end)
+{
+   return (double)BENCH_COUNT * BENCH_ITERATIONS / MAX2(end - start, 1);
+}
+
+static void
+bench(unsigned isize)
+{
+   void *src = MALLOC(BENCH_COUNT * isize);
+   void *dst = MALLOC(BENCH_COUNT / 4 * 6 * 4);
+   unsigned restart = size_mask(isize);
+   unsigned seed = 1, it, min, max, sink = 0;
+   unsigned osize = MAX2(isize, 2);
+   enum pipe_prim_type out_prim;
+   unsigned out_index_size, out_nr;
+   u_translate_func translate;
+   int64_t start;
+
+   CHECK(src && dst);
+   fill_indices(src, isize, BENCH_COUNT, restart, 1000, &seed);
+
+   printf("%u-byte indices (Mindices/s):\n", isize);
+
+   start = os_time_get();
+   for (it = 0; it < BENCH_ITERATIONS; it++) {
+      ref_minmax(src, isize, BENCH_COUNT, true, restart, &min, &max);
+      sink += min + max;
+   }
+   printf("  minmax:            %8.1f reference\n",
+          mindices_per_sec(start, os_time_get()));
+   start = os_time_get();
+   for (it = 0; it < BENCH_ITERATIONS; it++) {
+      util_index_minmax(src, isize, BENCH_COUNT, true, restart, &min, &max);
+      sink += min + max;
+   }
+   printf("                     %8.1f\n",
+          mindices_per_sec(start, os_time_get()));
+
+   start = os_time_get();
+   for (it = 0; it < BENCH_ITERATIONS; it++) {
+      unsigned first = 0;
+
+      while (first < BENCH_COUNT)
+         first += ref_find((uint8_t *)src + first * isize, isize,
+                           BENCH_COUNT - first, restart) + 1;
+      sink += first;
+   }
+   printf("  restart split:     %8.1f reference\n",
+          mindices_per_sec(start, os_time_get()));
+   start = os_time_get();
+   for (it = 0; it < BENCH_ITERATIONS; it++) {
+      unsigned first = 0;
+
+      while (first < BENCH_COUNT)
+         first += util_index_find((uint8_t *)src + first * isize, isize,
+                                  BENCH_COUNT - first, restart) + 1;
+      sink += first;
+   }
+   printf("                     %8.1f\n",
+          mindices_per_sec(start, os_time_get()));
+
+   start = os_time_get();
+   for (it = 0; it < BENCH_ITERATIONS; it++)
+      ref_translate_restart(src, isize, dst, osize, BENCH_COUNT, restart);
+   printf("  restart translate: %8.1f reference\n",
+          mindices_per_sec(start, os_time_get()));
+   start = os_time_get();
+   for (it = 0; it < BENCH_ITERATIONS; it++)
+      util_index_translate_restart(src, isize, dst, osize, BENCH_COUNT,
+                                   restart);
+   printf("                     %8.1f\n",
+          mindices_per_sec(start, os_time_get()));
+
+   /* Quads to triangles through the u_indices translator, as used by
+    * u_primconvert.
+    */
+   u_index_translator(1 << PIPE_PRIM_TRIANGLES, PIPE_PRIM_QUADS, isize, BENCH_COUNT,
+                      PV_FIRST, PV_FIRST, false, &out_prim,
+                      &out_index_size, &out_nr, &translate);
+   start = os_time_get();
+   for (it = 0; it < BENCH_ITERATIONS; it++)
+      translate(src, 0, BENCH_COUNT, out_nr, 0, dst);
+   printf("  quads to tris:     %8.1f\n",
+          mindices_per_sec(start, os_time_get()));
+
+   LOG("  (%u)\n", sink);
+
+   FREE(src);
+   FREE(dst);
+}
+
+
+int main(int argc, char *argv[])
+{
+   int i;
+
+   for (i = 1; i < argc; ++i) {
+      const char *arg = argv[i];
+      if (strcmp(arg, "-v") == 0) {
+         ++verbosity;
+      } else {
+         fprintf(stderr, "error: unrecognized option `%s`\n", arg);
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   test_correctness();
+
+   bench(1);
+   bench(2);
+   bench(4);
+
+   return 0;
+}
@@ -0,0 +1,420 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The Mesa authors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ *  Test case for the ring buffer mode of u_upload_mgr.
+ *
+ *  The upload manager runs on top of a fake screen whose buffers live in
+ *  malloc'ed memory and whose fences are signalled by the test.  The ring
+ *  is filled, parts of it are retired through fences and directly, and
+ *  the test checks which allocations wrap around in the current buffer
+ *  and which ones have to create a new buffer.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_upload_mgr.h"
+
+
+#define BUFFER_SIZE 4096
+#define CHUNK 1024
+
+static int verbosity = 0;
+
+struct test_resource {
+   struct pipe_resource base;
+   uint8_t *data;
+};
+
+struct pipe_fence_handle {
+   struct pipe_reference reference;
+   bool signalled;
+};
+
+static int num_resources = 0;
+static int num_transfers = 0;
+
+
+#define LOG(fmt, ...) \
+   if (verbosity > 0) { \
+      fprintf(stdout, fmt, ##__VA_ARGS__); \
+   }
+
+#define CHECK(_cond) \
+   if (!(_cond)) { \
+      fprintf(stderr, "%s:%u: `%s` failed\n", __FILE__, __LINE__, #_cond); \
+      _exit(EXIT_FAILURE); \
+   }
+
+
+static int
+test_get_param(struct pipe_screen *screen, enum pipe_cap param)
+{
+   return param == PIPE_CAP_BUFFER_MAP_PERSISTENT_COHERENT;
+}
+
+static struct pipe_resource *
+test_resource_create(struct pipe_screen *screen,
+                     const struct pipe_resource *templ)
+{
+   struct test_resource *res = CALLOC_STRUCT(test_resource);
+
+   CHECK(res);
+   res->base = *templ;
+   res->base.screen = screen;
+   pipe_reference_init(&res->base.reference, 1);
+   res->data = MALLOC(templ->width0);
+   CHECK(res->data);
+   num_resources++;
+   return &res->base;
+}
+
+static void
+test_resource_destroy(struct pipe_screen *screen, struct pipe_resource *pres)
+{
+   struct test_resource *res = (struct test_resource *)pres;
+
+   FREE(res->data);
+   FREE(res);
+   num_resources--;
+}
+
+static void
+test_fence_reference(struct pipe_screen *screen,
+                     struct pipe_fence_handle **dst,
+                     struct pipe_fence_handle *src)
+{
+   if (pipe_reference(*dst ? &(*dst)->reference : NULL,
+                      src ? &src->reference : NULL))
+      FREE(*dst);
+   *dst = src;
+}
+
+static bool
+test_fence_finish(struct pipe_screen *screen, struct pipe_context *ctx,
+                  struct pipe_fence_handle *fence, uint64_t timeout)
+{
+   /* The upload manager must only poll. */
+   CHECK(timeout == 0);
+   return fence->signalled;
+}
+
+static void *
+test_transfer_map(struct pipe_context *pipe, struct pipe_resource *pres,
+                  unsigned level, unsigned usage,
+                  const struct pipe_box *box,
+                  struct pipe_transfer **out_transfer)
+{
+   struct test_resource *res = (struct test_resource *)pres;
+   struct pipe_transfer *transfer = CALLOC_STRUCT(pipe_transfer);
+
+   CHECK(transfer);
+   CHECK(usage & PIPE_TRANSFER_PERSISTENT);
+   pipe_resource_reference(&transfer->resource, pres);
+   transfer->usage = usage;
+   transfer->box = *box;
+   *out_transfer = transfer;
+   num_transfers++;
+   return res->data + box->x;
+}
+
+static void
+test_transfer_unmap(struct pipe_context *pipe,
+                    struct pipe_transfer *transfer)
+{
+   pipe_resource_reference(&transfer->resource, NULL);
+   FREE(transfer);
+   num_transfers--;
+}
+
+static struct pipe_fence_handle *
+create_fence(void)
+{
+   struct pipe_fence_handle *fence = CALLOC_STRUCT(pipe_fence_handle);
+
+   CHECK(fence);
+   pipe_reference_init(&fence->reference, 1);
+   return fence;
+}
+
+/* Suballocate "size" bytes, check the result and return the offset. */
+static unsigned
+alloc(struct u_upload_mgr *upload, unsigned size,
+      struct pipe_resource **buffer)
+{
+   struct test_resource *res;
+   unsigned offset;
+   void *ptr;
+
+   u_upload_alloc(upload, 0, size, 256, &offset, buffer, &ptr);
+   CHECK(ptr && *buffer);
+   CHECK(offset % 256 == 0);
+   CHECK(offset + size <= (*buffer)->width0);
+
+   res = (struct test_resource *)*buffer;
+   CHECK((uint8_t *)ptr == res->data + offset);
+   memset(ptr, 0xcd, size);
+
+   LOG("alloc %u -> %p + %u\n", size, (void *)*buffer, offset);
+   return offset;
+}
+
+static void
+test_ring(struct pipe_context *pipe)
+{
+   struct pipe_screen *screen = pipe->screen;
+   struct pipe_resource *first = NULL, *buffer = NULL;
+   struct pipe_fence_handle *fences[4];
+   struct u_upload_stats stats;
+   struct u_upload_mgr *upload;
+   uint64_t marks[2];
+   unsigned i;
+
+   upload = u_upload_create(pipe, BUFFER_SIZE, PIPE_BIND_VERTEX_BUFFER,
+                            PIPE_USAGE_STREAM, 0);
+   CHECK(upload);
+   CHECK(!u_upload_ring_enabled(upload));
+   CHECK(u_upload_enable_ring(upload));
+   CHECK(u_upload_ring_enabled(upload));
+
+   for (i = 0; i < ARRAY_SIZE(fences); i++)
+      fences[i] = create_fence();
+
+   /* Fill the ring, fencing the first and the second half. */
+   CHECK(alloc(upload, CHUNK, &first) == 0);
+   CHECK(alloc(upload, CHUNK, &buffer) == CHUNK);
+   marks[0] = u_upload_ring_mark(upload);
+   u_upload_ring_fence(upload, marks[0], fences[0]);
+   CHECK(alloc(upload, CHUNK, &buffer) == 2 * CHUNK);
+   CHECK(alloc(upload, CHUNK, &buffer) == 3 * CHUNK);
+   marks[1] = u_upload_ring_mark(upload);
+   u_upload_ring_fence(upload, marks[1], fences[1]);
+   CHECK(buffer == first);
+
+   /* Retiring the first half lets the allocations wrap into it. */
+   fences[0]->signalled = true;
+   CHECK(alloc(upload, CHUNK, &buffer) == 0);
+   CHECK(buffer == first);
+   CHECK(alloc(upload, CHUNK, &buffer) == CHUNK);
+   CHECK(buffer == first);
+
+   /* Only the signalled fence was released. */
+   CHECK(p_atomic_read(&fences[0]->reference.count) == 1);
+   CHECK(p_atomic_read(&fences[1]->reference.count) == 2);
+
+   u_upload_get_stats(upload, &stats);
+   CHECK(stats.buffers_allocated == 1);
+   CHECK(stats.allocations_avoided == 1);
+
+   /* Retire the third quarter directly. */
+   u_upload_ring_retire(upload, marks[1] - CHUNK);
+   CHECK(alloc(upload, CHUNK, &buffer) == 2 * CHUNK);
+   CHECK(buffer == first);
+   u_upload_ring_fence(upload, u_upload_ring_mark(upload), fences[2]);
+
+   /* An allocation that doesn't fit at the end of the buffer skips the
+    * rest of it and wraps again.
+    */
+   fences[1]->signalled = true;
+   fences[2]->signalled = true;
+   CHECK(alloc(upload, 2 * CHUNK, &buffer) == 0);
+   CHECK(buffer == first);
+   CHECK(p_atomic_read(&fences[1]->reference.count) == 1);
+   CHECK(p_atomic_read(&fences[2]->reference.count) == 1);
+
+   /* Retiring an older position doesn't move the tail back. */
+   u_upload_ring_retire(upload, marks[0]);
+   CHECK(alloc(upload, CHUNK, &buffer) == 2 * CHUNK);
+   CHECK(buffer == first);
+
+   u_upload_get_stats(upload, &stats);
+   CHECK(stats.buffers_allocated == 1);
+   CHECK(stats.allocations_avoided == 2);
+   CHECK(stats.bytes_uploaded == 10 * CHUNK);
+
+   /* The rest of the ring is still fenced, so a new buffer is created. */
+   u_upload_ring_fence(upload, u_upload_ring_mark(upload), fences[3]);
+   CHECK(alloc(upload, CHUNK, &buffer) == 0);
+   CHECK(buffer != first);
+
+   u_upload_get_stats(upload, &stats);
+   CHECK(stats.buffers_allocated == 2);
+   CHECK(stats.allocations_avoided == 2);
+
+   /* Marks taken for the old buffer don't retire space in the new one. */
+   fences[3]->signalled = true;
+   CHECK(alloc(upload, CHUNK, &buffer) == CHUNK);
+   CHECK(alloc(upload, CHUNK, &buffer) == 2 * CHUNK);
+   CHECK(alloc(upload, CHUNK, &buffer) == 3 * CHUNK);
+   CHECK(p_atomic_read(&fences[3]->reference.count) == 1);
+   CHECK(alloc(upload, CHUNK, &buffer) == 0);
+
+   u_upload_get_stats(upload, &stats);
+   CHECK(stats.buffers_allocated == 3);
+   CHECK(stats.allocations_avoided == 2);
+
+   /* Destroying the upload manager releases the pending fences. */
+   u_upload_ring_fence(upload, u_upload_ring_mark(upload), fences[0]);
+   CHECK(p_atomic_read(&fences[0]->reference.count) == 2);
+   u_upload_destroy(upload);
+   CHECK(p_atomic_read(&fences[0]->reference.count) == 1);
+
+   pipe_resource_reference(&first, NULL);
+   pipe_resource_reference(&buffer, NULL);
+   for (i = 0; i < ARRAY_SIZE(fences); i++)
+      screen->fence_reference(screen, &fences[i], NULL);
+
+   CHECK(num_resources == 0);
+   CHECK(num_transfers == 0);
+}
+
+/* More pending fences than the queue holds: the ones that don't fit are
+ * dropped and a later fence retires their space.
+ */
+static void
+test_fence_queue_full(struct pipe_context *pipe)
+{
+   struct pipe_screen *screen = pipe->screen;
+   struct pipe_resource *first = NULL, *buffer = NULL;
+   struct pipe_fence_handle *fences[40], *last;
+   struct u_upload_stats stats;
+   struct u_upload_mgr *upload;
+   unsigned i;
+
+   upload = u_upload_create(pipe, 64 * 1024, PIPE_BIND_VERTEX_BUFFER,
+                            PIPE_USAGE_STREAM, 0);
+   CHECK(upload && u_upload_enable_ring(upload));
+
+   for (i = 0; i < ARRAY_SIZE(fences); i++) {
+      fences[i] = create_fence();
+      alloc(upload, CHUNK, i ? &buffer : &first);
+      u_upload_ring_fence(upload, u_upload_ring_mark(upload), fences[i]);
+   }
+
+   for (i = 0; i < ARRAY_SIZE(fences); i++) {
+      CHECK(p_atomic_read(&fences[i]->reference.count) == (i < 32 ? 2 : 1));
+      fences[i]->signalled = true;
+   }
+
+   /* This retires the queued fences, which makes room for another one. */
+   alloc(upload, CHUNK, &buffer);
+   for (i = 0; i < ARRAY_SIZE(fences); i++)
+      CHECK(p_atomic_read(&fences[i]->reference.count) == 1);
+
+   last = create_fence();
+   last->signalled = true;
+   u_upload_ring_fence(upload, u_upload_ring_mark(upload), last);
+
+   /* Fill the rest of the buffer, then the space the fences retired. */
+   while (alloc(upload, CHUNK, &buffer) != 0)
+      CHECK(buffer == first);
+   for (i = 0; i < ARRAY_SIZE(fences); i++) {
+      alloc(upload, CHUNK, &buffer);
+      CHECK(buffer == first);
+   }
+
+   /* That was all of it. */
+   alloc(upload, CHUNK, &buffer);
+   CHECK(buffer != first);
+
+   u_upload_get_stats(upload, &stats);
+   CHECK(stats.buffers_allocated == 2);
+   CHECK(stats.allocations_avoided == 1);
+
+   u_upload_destroy(upload);
+   pipe_resource_reference(&first, NULL);
+   pipe_resource_reference(&buffer, NULL);
+   for (i = 0; i < ARRAY_SIZE(fences); i++)
+      screen->fence_reference(screen, &fences[i], NULL);
+   screen->fence_reference(screen, &last, NULL);
+
+   CHECK(num_resources == 0);
+   CHECK(num_transfers == 0);
+}
+
+/* Without coherent persistent mappings, ring mode can't be enabled. */
+static void
+test_not_persistent(struct pipe_context *pipe)
+{
+   struct u_upload_mgr *upload;
+
+   upload = u_upload_create(pipe, BUFFER_SIZE, PIPE_BIND_VERTEX_BUFFER,
+                            PIPE_USAGE_STREAM, 0);
+   CHECK(upload);
+   u_upload_enable_flush_explicit(upload);
+   CHECK(!u_upload_enable_ring(upload));
+   CHECK(!u_upload_ring_enabled(upload));
+   u_upload_destroy(upload);
+}
+
+
+int main(int argc, char *argv[])
+{
+   struct pipe_screen screen;
+   struct pipe_context pipe;
+   int i;
+
+   for (i = 1; i < argc; ++i) {
+      const char *arg = argv[i];
+      if (strcmp(arg, "-v") == 0) {
+         ++verbosity;
+      } else {
+         fprintf(stderr, "error: unrecognized option `%s`\n", arg);
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   LOG("u_upload_ring_test starting\n");
+
+   memset(&screen, 0, sizeof(screen));
+   screen.get_param = test_get_param;
+   screen.resource_create = test_resource_create;
+   screen.resource_destroy = test_resource_destroy;
+   screen.fence_reference = test_fence_reference;
+   screen.fence_finish = test_fence_finish;
+
+   memset(&pipe, 0, sizeof(pipe));
+   pipe.screen = &screen;
+   pipe.transfer_map = test_transfer_map;
+   pipe.transfer_unmap = test_transfer_unmap;
+
+   test_ring(&pipe);
+   test_fence_queue_full(&pipe);
+   test_not_persistent(&pipe);
+
+   LOG("u_upload_ring_test exiting\n");
+
+   return 0;
+}
@@ -441,6 +441,7 @@ amdgpu_winsys_create(int fd, const struct pipe_screen_config *config,
                     500000, aws->check_vm ? 1.0f : 2.0f, 0,
                     (aws->info.vram_size + aws->info.gart_size) / 8,
                     amdgpu_bo_destroy, amdgpu_bo_can_reclaim);
+      pb_cache_enable_async_release(&aws->bo_cache);
 
       unsigned min_slab_order = 9;  /* 512 bytes */
       unsigned max_slab_order = 18; /* 256 KB - higher numbers increase memory usage */
@@ -494,7 +495,8 @@ amdgpu_winsys_create(int fd, const struct pipe_screen_config *config,
       (void) simple_mtx_init(&aws->bo_export_table_lock, mtx_plain);
 
       if (!util_queue_init(&aws->cs_queue, "cs", 8, 1,
-                           UTIL_QUEUE_INIT_RESIZE_IF_FULL)) {
+                           UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                           UTIL_QUEUE_INIT_DEDICATED_THREADS)) {
          amdgpu_winsys_destroy(&ws->base);
          simple_mtx_unlock(&dev_tab_mutex);
          return NULL;
@@ -80,7 +80,7 @@ _mesa_glthread_init(struct gl_context *ctx)
    assert(!glthread->enabled);
 
    if (!util_queue_init(&glthread->queue, "gl", MARSHAL_MAX_BATCHES - 2,
-                        1, 0)) {
+                        1, UTIL_QUEUE_INIT_DEDICATED_THREADS)) {
       return;
    }
 
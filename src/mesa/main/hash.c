@@ -38,8 +38,27 @@
 #include "glheader.h"
 #include "hash.h"
 #include "util/hash_table.h"
+#include "util/u_atomic.h"
 #include "util/u_memory.h"
 
+/* Initial and maximum number of names in the dense array. */
+#define DENSE_MIN_SIZE 64
+#define DENSE_MAX_SIZE (1 << 18)
+
+
+static struct _mesa_HashDense *
+alloc_dense(GLuint size)
+{
+   struct _mesa_HashDense *dense =
+      calloc(1, sizeof(*dense) + size * sizeof(void *));
+
+   if (dense) {
+      dense->Size = size;
+      dense->Data = (void **)(dense + 1);
+   }
+   return dense;
+}
+
 
 /**
  * Create a new hash table.
@@ -54,7 +73,10 @@ _mesa_NewHashTable(void)
    if (table) {
       table->ht = _mesa_hash_table_create(NULL, uint_key_hash,
                                           uint_key_compare);
-      if (table->ht == NULL) {
+      table->Dense = alloc_dense(DENSE_MIN_SIZE);
+      if (table->ht == NULL || table->Dense == NULL) {
+         _mesa_hash_table_destroy(table->ht, NULL);
+         free(table->Dense);
          free(table);
          _mesa_error_no_memory(__func__);
          return NULL;
@@ -89,12 +111,18 @@ _mesa_DeleteHashTable(struct _mesa_HashTable *table)
 {
    assert(table);
 
-   if (_mesa_hash_table_next_entry(table->ht, NULL) != NULL) {
+   if (_mesa_HashNumEntries(table)) {
       _mesa_problem(NULL, "In _mesa_DeleteHashTable, found non-freed data");
    }
 
    _mesa_hash_table_destroy(table->ht, NULL);
 
+   while (table->Dense) {
+      struct _mesa_HashDense *prev = table->Dense->Prev;
+      free(table->Dense);
+      table->Dense = prev;
+   }
+
    mtx_destroy(&table->Mutex);
    free(table);
 }
@@ -113,8 +141,8 @@ _mesa_HashLookup_unlocked(struct _mesa_HashTable *table, GLuint key)
    assert(table);
    assert(key);
 
-   if (key == DELETED_KEY_VALUE)
-      return table->deleted_key_data;
+   if (key < table->Dense->Size)
+      return table->Dense->Data[key];
 
    entry = _mesa_hash_table_search_pre_hashed(table->ht,
                                               uint_hash(key),
@@ -137,7 +165,18 @@ _mesa_HashLookup_unlocked(struct _mesa_HashTable *table, GLuint key)
 void *
 _mesa_HashLookup(struct _mesa_HashTable *table, GLuint key)
 {
+   struct _mesa_HashDense *dense = p_atomic_read(&table->Dense);
    void *res;
+
+   /* Writers only store complete pointers into the array, and replaced
+    * arrays stay allocated, so no lock is needed.
+    */
+   if (key < dense->Size)
+      return p_atomic_read(&dense->Data[key]);
+
+   /* The name may have moved to a new array in the meantime, which the
+    * locked lookup checks again.
+    */
    _mesa_HashLockMutex(table);
    res = _mesa_HashLookup_unlocked(table, key);
    _mesa_HashUnlockMutex(table);
@@ -163,6 +202,43 @@ _mesa_HashLookupLocked(struct _mesa_HashTable *table, GLuint key)
 }
 
 
+/**
+ * Replace the dense array by one that's large enough for \p key, and move
+ * the names it covers out of the hash table.
+ */
+static void
+grow_dense(struct _mesa_HashTable *table, GLuint key)
+{
+   struct _mesa_HashDense *old = table->Dense;
+   struct _mesa_HashDense *dense;
+   GLuint size = old->Size;
+
+   while (size <= key)
+      size *= 2;
+
+   dense = alloc_dense(size);
+   if (!dense)
+      return; /* the name just goes into the hash table */
+
+   memcpy(dense->Data, old->Data, old->Size * sizeof(void *));
+   dense->Prev = old;
+
+   hash_table_foreach(table->ht, entry) {
+      GLuint name = (uintptr_t)entry->key;
+
+      if (name < size) {
+         dense->Data[name] = entry->data;
+         if (entry->data)
+            table->DenseEntries++;
+         _mesa_hash_table_remove(table->ht, entry);
+      }
+   }
+
+   /* Publish it only once it's complete. */
+   p_atomic_set(&table->Dense, dense);
+}
+
+
 static inline void
 _mesa_HashInsert_unlocked(struct _mesa_HashTable *table, GLuint key, void *data)
 {
@@ -175,8 +251,19 @@ _mesa_HashInsert_unlocked(struct _mesa_HashTable *table, GLuint key, void *data)
    if (key > table->MaxKey)
       table->MaxKey = key;
 
-   if (key == DELETED_KEY_VALUE) {
-      table->deleted_key_data = data;
+   /* Only grow the array for names close to the ones it already has, so
+    * that a few large names don't waste memory.
+    */
+   if (key >= table->Dense->Size && key < 2 * table->Dense->Size &&
+       key < DENSE_MAX_SIZE)
+      grow_dense(table, key);
+
+   if (key < table->Dense->Size) {
+      void **slot = &table->Dense->Data[key];
+
+      /* NULL data is the same as no entry. */
+      table->DenseEntries += (data != NULL) - (*slot != NULL);
+      p_atomic_set(slot, data);
    } else {
       entry = _mesa_hash_table_search_pre_hashed(table->ht, hash, uint_key(key));
       if (entry) {
@@ -212,7 +299,8 @@ _mesa_HashInsertLocked(struct _mesa_HashTable *table, GLuint key, void *data)
  *
  * \param table the hash table.
  * \param key the key (not zero).
- * \param data pointer to user data.
+ * \param data pointer to user data.  Inserting NULL for a name in the dense
+ *             array removes it.
  */
 void
 _mesa_HashInsert(struct _mesa_HashTable *table, GLuint key, void *data)
@@ -245,8 +333,12 @@ _mesa_HashRemove_unlocked(struct _mesa_HashTable *table, GLuint key)
     */
    assert(!table->InDeleteAll);
 
-   if (key == DELETED_KEY_VALUE) {
-      table->deleted_key_data = NULL;
+   if (key < table->Dense->Size) {
+      void **slot = &table->Dense->Data[key];
+
+      if (*slot)
+         table->DenseEntries--;
+      p_atomic_set(slot, NULL);
    } else {
       entry = _mesa_hash_table_search_pre_hashed(table->ht,
                                                  uint_hash(key),
@@ -287,14 +379,19 @@ _mesa_HashDeleteAll(struct _mesa_HashTable *table,
    assert(callback);
    _mesa_HashLockMutex(table);
    table->InDeleteAll = GL_TRUE;
+   for (GLuint key = 1; key < table->Dense->Size; key++) {
+      void *data = table->Dense->Data[key];
+
+      if (data) {
+         callback(key, data, userData);
+         p_atomic_set(&table->Dense->Data[key], NULL);
+      }
+   }
+   table->DenseEntries = 0;
    hash_table_foreach(table->ht, entry) {
       callback((uintptr_t)entry->key, entry->data, userData);
       _mesa_hash_table_remove(table->ht, entry);
    }
-   if (table->deleted_key_data) {
-      callback(DELETED_KEY_VALUE, table->deleted_key_data, userData);
-      table->deleted_key_data = NULL;
-   }
    table->InDeleteAll = GL_FALSE;
    _mesa_HashUnlockMutex(table);
 }
@@ -312,14 +409,51 @@ hash_walk_unlocked(const struct _mesa_HashTable *table,
                    void (*callback)(GLuint key, void *data, void *userData),
                    void *userData)
 {
+   /* cast-away const */
+   struct _mesa_HashTable *table2 = (struct _mesa_HashTable *) table;
+   GLuint num_keys, *keys;
+
    assert(table);
    assert(callback);
 
+   /* The callback may add names, which can replace the array.  The names
+    * that move out of the hash table are all above the current one, so
+    * reading the current array visits them.
+    */
+   for (GLuint key = 1; key < table->Dense->Size; key++) {
+      void *data = table->Dense->Data[key];
+
+      if (data)
+         callback(key, data, userData);
+   }
+
+   num_keys = _mesa_hash_table_num_entries(table->ht);
+   if (!num_keys)
+      return;
+
+   /* Once the walk is in the hash table, a new array would take names out
+    * of it before they are reached.  Walk a copy of the names instead and
+    * look each one up where it is now.
+    */
+   keys = malloc(num_keys * sizeof(*keys));
+   if (!keys) {
+      hash_table_foreach(table->ht, entry) {
+         callback((uintptr_t)entry->key, entry->data, userData);
+      }
+      return;
+   }
+
+   num_keys = 0;
    hash_table_foreach(table->ht, entry) {
-      callback((uintptr_t)entry->key, entry->data, userData);
+      keys[num_keys++] = (uintptr_t)entry->key;
+   }
+   for (GLuint i = 0; i < num_keys; i++) {
+      void *data = _mesa_HashLookup_unlocked(table2, keys[i]);
+
+      if (data)
+         callback(keys[i], data, userData);
    }
-   if (table->deleted_key_data)
-      callback(DELETED_KEY_VALUE, table->deleted_key_data, userData);
+   free(keys);
 }
 
 
@@ -358,8 +492,6 @@ debug_print_entry(GLuint key, void *data, void *userData)
 void
 _mesa_HashPrint(const struct _mesa_HashTable *table)
 {
-   if (table->deleted_key_data)
-      debug_print_entry(DELETED_KEY_VALUE, table->deleted_key_data, NULL);
    _mesa_HashWalk(table, debug_print_entry, NULL);
 }
 
@@ -416,12 +548,5 @@ _mesa_HashFindFreeKeyBlock(struct _mesa_HashTable *table, GLuint numKeys)
 GLuint
 _mesa_HashNumEntries(const struct _mesa_HashTable *table)
 {
-   GLuint count = 0;
-
-   if (table->deleted_key_data)
-      count++;
-
-   count += _mesa_hash_table_num_entries(table->ht);
-
-   return count;
+   return table->DenseEntries + _mesa_hash_table_num_entries(table->ht);
 }
@@ -47,7 +47,8 @@
  * and we use a 1:1 mapping from GLuints to key pointers, so we need to be
  * able to track a GLuint that happens to match the deleted key outside of
  * struct hash_table.  We tell the hash table to use "1" as the deleted key
- * value, so that we test the deleted-key-in-the-table path as best we can.
+ * value.  Since small names are kept in the dense array, that name never
+ * reaches the hash table.
  */
 #define DELETED_KEY_VALUE 1
 
@@ -95,16 +96,30 @@ uint_key(GLuint id)
 }
 /** @} */
 
+/**
+ * Array of the objects with small names, indexed by the name.
+ *
+ * Since names are usually allocated sequentially, most objects end up here,
+ * and _mesa_HashLookup() reads it without taking the mutex.  For that, the
+ * array is never resized in place.  It's replaced by a larger copy, and the
+ * replaced arrays are only freed with the table.
+ */
+struct _mesa_HashDense {
+   GLuint Size;
+   void **Data;                          /**< NULL for unused names */
+   struct _mesa_HashDense *Prev;         /**< replaced array */
+};
+
 /**
  * The hash table data structure.
  */
 struct _mesa_HashTable {
-   struct hash_table *ht;
+   struct hash_table *ht;                /**< names not in Dense */
+   struct _mesa_HashDense *Dense;
+   GLuint DenseEntries;                  /**< non-NULL entries in Dense */
    GLuint MaxKey;                        /**< highest key inserted so far */
-   mtx_t Mutex;                          /**< mutual exclusion lock */
+   mtx_t Mutex;                          /**< serializes writers */
    GLboolean InDeleteAll;                /**< Debug check */
-   /** Value that would be in the table for DELETED_KEY_VALUE. */
-   void *deleted_key_data;
 };
 
 extern struct _mesa_HashTable *_mesa_NewHashTable(void);
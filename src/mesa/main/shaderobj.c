@@ -103,7 +103,8 @@ struct gl_shader *
 _mesa_new_shader(GLuint name, gl_shader_stage stage)
 {
    struct gl_shader *shader;
-   shader = rzalloc(NULL, struct gl_shader);
+   /* The IR is allocated out of the shader. */
+   shader = rzalloc_arena(NULL, struct gl_shader);
    if (shader) {
       shader->Stage = stage;
       shader->Name = name;
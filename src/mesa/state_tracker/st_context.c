@@ -606,7 +606,8 @@ st_create_context_priv(struct gl_context *ctx, struct pipe_context *pipe,
       break;
    }
 
-   st->cso_context = cso_create_context(pipe, cso_flags);
+   st->cso_context = cso_create_context(pipe,
+                                        cso_flags | CSO_SHARED_STATE_CACHE);
 
    st_init_atoms(st);
    st_init_clear(st);
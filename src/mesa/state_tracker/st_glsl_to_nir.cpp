@@ -288,6 +288,8 @@ st_nir_opts(nir_shader *nir)
       }
       NIR_PASS(progress, nir, nir_opt_if, false);
       NIR_PASS(progress, nir, nir_opt_dead_cf);
+      if (nir->options->use_gvn_pre)
+         NIR_PASS(progress, nir, nir_opt_gvn_pre);
       NIR_PASS(progress, nir, nir_opt_cse);
       NIR_PASS(progress, nir, nir_opt_peephole_select, 8, true, true);
 
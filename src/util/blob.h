@@ -291,6 +291,19 @@ blob_overwrite_intptr(struct blob *blob,
                       size_t offset,
                       intptr_t value);
 
+/**
+ * Add a uint32_t to a blob as a variable-length integer.
+ *
+ * The value is stored 7 bits per byte, least significant bits first, with
+ * the high bit of each byte set when another byte follows.  Values below 128
+ * take a single byte and no value takes more than 5.  Unlike the other
+ * integer writes, no padding is added for alignment.
+ *
+ * \return True unless allocation failed.
+ */
+bool
+blob_write_varint(struct blob *blob, uint32_t value);
+
 /**
  * Add a NULL-terminated string to a blob, (including the NULL terminator).
  *
@@ -396,6 +409,15 @@ blob_read_uint64(struct blob_reader *blob);
 intptr_t
 blob_read_intptr(struct blob_reader *blob);
 
+/**
+ * Read a variable-length integer written by blob_write_varint() from the
+ * current location, (and update the current location to just past it).
+ *
+ * \return The uint32_t read
+ */
+uint32_t
+blob_read_varint(struct blob_reader *blob);
+
 /**
  * Read a NULL-terminated string from the current location, (and update the
  * current location to just past this string).
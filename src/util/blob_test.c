@@ -271,6 +271,50 @@ test_overrun(void)
    blob_finish(&blob);
 }
 
+/* Test variable-length integers of every length. */
+static void
+test_varint(void)
+{
+   static const uint32_t values[] = {
+      0, 1, 0x7f, 0x80, 0x3fff, 0x4000, 0x1fffff, 0x200000,
+      0xfffffff, 0x10000000, 0xdeadbeef, 0xffffffff,
+   };
+   static const size_t sizes[] = { 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 5 };
+   struct blob blob;
+   struct blob_reader reader;
+   size_t total = 0;
+
+   blob_init(&blob);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(values); i++) {
+      size_t before = blob.size;
+      blob_write_varint(&blob, values[i]);
+      expect_equal(sizes[i], blob.size - before, "varint size");
+      total += sizes[i];
+   }
+
+   /* Varints aren't aligned. */
+   expect_equal(total, blob.size, "varints aren't padded");
+
+   blob_reader_init(&reader, blob.data, blob.size);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(values); i++) {
+      expect_equal(values[i], blob_read_varint(&reader),
+                   "blob_write/read_varint");
+   }
+
+   expect_equal(false, reader.overrun, "overrun flag not set");
+   expect_equal(0, blob_read_varint(&reader), "varint read at overrun");
+   expect_equal(true, reader.overrun, "overrun flag set");
+
+   /* A varint cut off at the end of the blob is an overrun. */
+   blob_reader_init(&reader, blob.data + blob.size - 5, 4);
+   blob_read_varint(&reader);
+   expect_equal(true, reader.overrun, "truncated varint");
+
+   blob_finish(&blob);
+}
+
 /* Test that we can read and write some large objects, (exercising the code in
  * the blob_write functions to realloc blob->data.
  */
@@ -322,6 +366,7 @@ main (void)
    test_write_and_read_functions ();
    test_alignment ();
    test_overrun ();
+   test_varint ();
    test_big_objects ();
 
    return error ? 1 : 0;
@@ -42,10 +42,12 @@
 
 #ifdef HAVE_ZSTD
 #include "zstd.h"
+#include "zdict.h"
 #endif
 
 #include "util/crc32.h"
 #include "util/debug.h"
+#include "util/hash_table.h"
 #include "util/rand_xor.h"
 #include "util/u_atomic.h"
 #include "util/u_queue.h"
@@ -54,6 +56,7 @@
 #include "util/compiler.h"
 
 #include "disk_cache.h"
+#include "disk_cache_pack.h"
 
 /* Number of bits to mask off from a cache key to get an index. */
 #define CACHE_INDEX_KEY_BITS 16
@@ -81,14 +84,35 @@
 /* 3 is the recomended level, with 22 as the absolute maximum */
 #define ZSTD_COMPRESSION_LEVEL 3
 
+/* Size of the trained zstd dictionary, and how much sample data is collected
+ * to train it.  zstd recommends about 100 times more samples than the
+ * dictionary size.
+ */
+#define ZSTD_DICT_SIZE (64 * 1024)
+#define ZSTD_DICT_SAMPLES_SIZE (4 * 1024 * 1024)
+#define ZSTD_DICT_MAX_SAMPLES 2048
+#define ZSTD_DICT_MAX_SAMPLE_SIZE (64 * 1024)
+
+/* Prefetched entries beyond this total size are dropped. */
+#define CACHE_PREFETCH_MAX_SIZE (64 * 1024 * 1024)
+
 struct disk_cache {
    /* The path to the cache directory. */
    char *path;
    bool path_init_failed;
 
-   /* Thread queue for compressing and writing cache entries to disk */
+   /* Thread queue for compressing and writing cache entries to disk, and
+    * for loading them ahead of time.
+    */
    struct util_queue cache_queue;
 
+   /* Entries loaded by disk_cache_prefetch() that haven't been asked for
+    * yet, by key.
+    */
+   mtx_t prefetch_mutex;
+   struct hash_table *prefetched;
+   size_t prefetched_size;
+
    /* Seed for rand, which is used to pick a random directory */
    uint64_t seed_xorshift128plus[2];
 
@@ -105,12 +129,36 @@ struct disk_cache {
    /* Maximum size of all cached objects (in bytes). */
    uint64_t max_size;
 
+   /* Single-file storage, used instead of one file per entry if non-NULL. */
+   struct disk_cache_pack *pack;
+
    /* Driver cache keys. */
    uint8_t *driver_keys_blob;
    size_t driver_keys_blob_size;
 
    disk_cache_put_cb blob_put_cb;
    disk_cache_get_cb blob_get_cb;
+
+#ifdef HAVE_ZSTD
+   /* Compression and decompression contexts not in use by any thread. */
+   mtx_t zstd_ctx_mutex;
+   struct zstd_ctx *zstd_free_ctxs;
+
+   /* Dictionary trained on this driver's entries, if there is one. */
+   ZSTD_CDict *zstd_cdict;
+   ZSTD_DDict *zstd_ddict;
+   unsigned zstd_dict_id;
+
+   /* Samples collected to train the dictionary when there is none yet.
+    * zstd_samples is NULL once the dictionary is being trained.
+    */
+   mtx_t zstd_dict_mutex;
+   char *zstd_dict_path;
+   uint8_t *zstd_samples;
+   size_t zstd_samples_size;
+   size_t *zstd_sample_sizes;
+   unsigned zstd_num_samples;
+#endif
 };
 
 struct disk_cache_put_job {
@@ -129,6 +177,33 @@ struct disk_cache_put_job {
    struct cache_item_metadata cache_item_metadata;
 };
 
+struct disk_cache_get_job {
+   struct util_queue_fence fence;
+
+   struct disk_cache *cache;
+
+   cache_key key;
+
+   /* Result, owned by the job until handed out. */
+   void *data;
+   size_t size;
+
+   /* Whether the job ran, as opposed to being dropped from the queue. */
+   bool done;
+};
+
+struct prefetched_entry {
+   cache_key key;
+   void *data;
+   size_t size;
+};
+
+struct disk_cache_batch {
+   struct disk_cache *cache;
+   unsigned num_keys;
+   struct disk_cache_get_job jobs[];
+};
+
 /* Create a directory named 'path' if it does not already exist.
  *
  * Returns: 0 if path already exists as a directory or if created.
@@ -195,6 +270,28 @@ do {                                       \
    _dst += _src_size;                      \
 } while (0);
 
+#ifdef HAVE_ZSTD
+static void
+init_zstd_dict(struct disk_cache *cache);
+
+static void
+destroy_zstd_dict(struct disk_cache *cache);
+#endif
+
+static uint32_t
+prefetch_key_hash(const void *key)
+{
+   uint32_t hash;
+   memcpy(&hash, key, sizeof(hash));
+   return hash;
+}
+
+static bool
+prefetch_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, CACHE_KEY_SIZE) == 0;
+}
+
 struct disk_cache *
 disk_cache_create(const char *gpu_name, const char *driver_id,
                   uint64_t driver_flags)
@@ -375,6 +472,12 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
 
    cache->max_size = max_size;
 
+   if (env_var_as_boolean("MESA_DISK_CACHE_SINGLE_FILE", false)) {
+      cache->pack = disk_cache_pack_open(cache->path, max_size);
+      if (!cache->pack)
+         goto path_fail;
+   }
+
    /* 4 threads were chosen below because just about all modern CPUs currently
     * available that run Mesa have *at least* 4 cores. For these CPUs allowing
     * more threads can result in the queue being processed faster, thus
@@ -390,6 +493,14 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
                    UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY |
                    UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY);
 
+   cache->prefetched = _mesa_hash_table_create(cache, prefetch_key_hash,
+                                               prefetch_key_equal);
+   if (!cache->prefetched) {
+      util_queue_destroy(&cache->cache_queue);
+      goto path_fail;
+   }
+   (void) mtx_init(&cache->prefetch_mutex, mtx_plain);
+
    cache->path_init_failed = false;
 
  path_fail:
@@ -430,6 +541,11 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
    /* Seed our rand function */
    s_rand_xorshift128plus(cache->seed_xorshift128plus, true);
 
+#ifdef HAVE_ZSTD
+   if (!cache->path_init_failed)
+      init_zstd_dict(cache);
+#endif
+
    ralloc_free(local);
 
    return cache;
@@ -448,6 +564,17 @@ disk_cache_destroy(struct disk_cache *cache)
    if (cache && !cache->path_init_failed) {
       util_queue_finish(&cache->cache_queue);
       util_queue_destroy(&cache->cache_queue);
+      hash_table_foreach(cache->prefetched, he) {
+         struct prefetched_entry *entry = he->data;
+
+         free(entry->data);
+         free(entry);
+      }
+      mtx_destroy(&cache->prefetch_mutex);
+#ifdef HAVE_ZSTD
+      destroy_zstd_dict(cache);
+#endif
+      disk_cache_pack_close(cache->pack);
       munmap(cache->index_mmap, cache->index_mmap_size);
    }
 
@@ -684,11 +811,51 @@ evict_lru_item(struct disk_cache *cache)
       p_atomic_add(cache->size, - (uint64_t)size);
 }
 
+/**
+ * Removes \p key from the prefetched entries and returns its data, if it was
+ * there.
+ */
+static void *
+take_prefetched_entry(struct disk_cache *cache, const cache_key key,
+                      size_t *size)
+{
+   struct prefetched_entry *entry = NULL;
+
+   mtx_lock(&cache->prefetch_mutex);
+   struct hash_entry *he = _mesa_hash_table_search(cache->prefetched, key);
+   if (he) {
+      entry = he->data;
+      _mesa_hash_table_remove(cache->prefetched, he);
+      cache->prefetched_size -= entry->size;
+   }
+   mtx_unlock(&cache->prefetch_mutex);
+
+   if (!entry)
+      return NULL;
+
+   void *data = entry->data;
+   if (size)
+      *size = entry->size;
+   free(entry);
+
+   return data;
+}
+
 void
 disk_cache_remove(struct disk_cache *cache, const cache_key key)
 {
    struct stat sb;
 
+   if (!cache->path_init_failed) {
+      void *data = take_prefetched_entry(cache, key, NULL);
+      free(data);
+   }
+
+   if (cache->pack) {
+      disk_cache_pack_remove(cache->pack, key);
+      return;
+   }
+
    char *filename = get_cache_file(cache, key);
    if (filename == NULL) {
       return;
@@ -736,6 +903,220 @@ write_all(int fd, const void *buf, size_t count)
    return done;
 }
 
+#ifdef HAVE_ZSTD
+/* Compression and decompression contexts are reused by the threads using a
+ * cache, which take one from its free list while they need it.
+ */
+struct zstd_ctx {
+   ZSTD_CCtx *cctx;
+   ZSTD_DCtx *dctx;
+   struct zstd_ctx *next;
+};
+
+static struct zstd_ctx *
+get_zstd_ctx(struct disk_cache *cache)
+{
+   mtx_lock(&cache->zstd_ctx_mutex);
+   struct zstd_ctx *ctx = cache->zstd_free_ctxs;
+   if (ctx)
+      cache->zstd_free_ctxs = ctx->next;
+   mtx_unlock(&cache->zstd_ctx_mutex);
+
+   if (!ctx)
+      ctx = (struct zstd_ctx *) calloc(1, sizeof(*ctx));
+   return ctx;
+}
+
+static void
+put_zstd_ctx(struct disk_cache *cache, struct zstd_ctx *ctx)
+{
+   mtx_lock(&cache->zstd_ctx_mutex);
+   ctx->next = cache->zstd_free_ctxs;
+   cache->zstd_free_ctxs = ctx;
+   mtx_unlock(&cache->zstd_ctx_mutex);
+}
+
+/**
+ * Loads the dictionary for this driver, or prepares for training one if
+ * there is none yet.
+ *
+ * The dictionary file is named after the driver keys, so each driver and
+ * CACHE_VERSION gets its own.  Its ID is stored in every frame compressed
+ * with it, so a process which didn't load it just misses on those entries.
+ */
+static void
+init_zstd_dict(struct disk_cache *cache)
+{
+   unsigned char sha1[20];
+   char sha1_str[41];
+   struct stat sb;
+   void *dict = NULL;
+   int fd;
+
+   (void) mtx_init(&cache->zstd_ctx_mutex, mtx_plain);
+
+   if (!env_var_as_boolean("MESA_DISK_CACHE_ZSTD_DICT", true))
+      return;
+
+   _mesa_sha1_compute(cache->driver_keys_blob, cache->driver_keys_blob_size,
+                      sha1);
+   _mesa_sha1_format(sha1_str, sha1);
+   cache->zstd_dict_path = ralloc_asprintf(cache, "%s/zstd_dict_%s",
+                                           cache->path, sha1_str);
+   if (!cache->zstd_dict_path)
+      return;
+
+   (void) mtx_init(&cache->zstd_dict_mutex, mtx_plain);
+
+   fd = open(cache->zstd_dict_path, O_RDONLY | O_CLOEXEC);
+   if (fd == -1) {
+      cache->zstd_samples = (uint8_t *) malloc(ZSTD_DICT_SAMPLES_SIZE);
+      cache->zstd_sample_sizes = (size_t *)
+         malloc(ZSTD_DICT_MAX_SAMPLES * sizeof(size_t));
+      if (!cache->zstd_samples || !cache->zstd_sample_sizes) {
+         free(cache->zstd_samples);
+         free(cache->zstd_sample_sizes);
+         cache->zstd_samples = NULL;
+         cache->zstd_sample_sizes = NULL;
+      }
+      return;
+   }
+
+   if (fstat(fd, &sb) == -1 || sb.st_size == 0 ||
+       sb.st_size > 2 * ZSTD_DICT_SIZE)
+      goto out;
+
+   dict = malloc(sb.st_size);
+   if (!dict || read_all(fd, dict, sb.st_size) == -1)
+      goto out;
+
+   cache->zstd_dict_id = ZSTD_getDictID_fromDict(dict, sb.st_size);
+   if (!cache->zstd_dict_id)
+      goto out;
+
+   cache->zstd_cdict = ZSTD_createCDict(dict, sb.st_size,
+                                        ZSTD_COMPRESSION_LEVEL);
+   cache->zstd_ddict = ZSTD_createDDict(dict, sb.st_size);
+   if (!cache->zstd_cdict || !cache->zstd_ddict) {
+      ZSTD_freeCDict(cache->zstd_cdict);
+      ZSTD_freeDDict(cache->zstd_ddict);
+      cache->zstd_cdict = NULL;
+      cache->zstd_ddict = NULL;
+      cache->zstd_dict_id = 0;
+   }
+
+ out:
+   free(dict);
+   close(fd);
+}
+
+static void
+destroy_zstd_dict(struct disk_cache *cache)
+{
+   while (cache->zstd_free_ctxs) {
+      struct zstd_ctx *ctx = cache->zstd_free_ctxs;
+
+      cache->zstd_free_ctxs = ctx->next;
+      ZSTD_freeCCtx(ctx->cctx);
+      ZSTD_freeDCtx(ctx->dctx);
+      free(ctx);
+   }
+   mtx_destroy(&cache->zstd_ctx_mutex);
+
+   if (!cache->zstd_dict_path)
+      return;
+
+   ZSTD_freeCDict(cache->zstd_cdict);
+   ZSTD_freeDDict(cache->zstd_ddict);
+   free(cache->zstd_samples);
+   free(cache->zstd_sample_sizes);
+   mtx_destroy(&cache->zstd_dict_mutex);
+}
+
+static void
+write_zstd_dict(struct disk_cache *cache, const void *dict, size_t size)
+{
+   char *filename_tmp = ralloc_asprintf(NULL, "%s.%u.tmp",
+                                        cache->zstd_dict_path,
+                                        (unsigned) getpid());
+   if (!filename_tmp)
+      return;
+
+   int fd = open(filename_tmp, O_WRONLY | O_CLOEXEC | O_CREAT | O_TRUNC,
+                 0644);
+   if (fd == -1) {
+      ralloc_free(filename_tmp);
+      return;
+   }
+
+   /* link() doesn't replace an existing file, so if several processes
+    * trained a dictionary at the same time, the first one wins.
+    */
+   if (write_all(fd, dict, size) != -1)
+      link(filename_tmp, cache->zstd_dict_path);
+
+   close(fd);
+   unlink(filename_tmp);
+   ralloc_free(filename_tmp);
+}
+
+/**
+ * Adds an entry to the samples for training a dictionary, and trains it
+ * once enough were collected.  The dictionary is only used by processes
+ * started afterwards.
+ */
+static void
+add_zstd_dict_sample(struct disk_cache *cache, const void *data, size_t size)
+{
+   uint8_t *samples;
+   size_t *sample_sizes;
+   unsigned num_samples;
+
+   if (!cache->zstd_dict_path)
+      return;
+
+   size = MIN2(size, ZSTD_DICT_MAX_SAMPLE_SIZE);
+
+   mtx_lock(&cache->zstd_dict_mutex);
+   if (!cache->zstd_samples) {
+      mtx_unlock(&cache->zstd_dict_mutex);
+      return;
+   }
+
+   if (cache->zstd_samples_size + size <= ZSTD_DICT_SAMPLES_SIZE) {
+      memcpy(cache->zstd_samples + cache->zstd_samples_size, data, size);
+      cache->zstd_samples_size += size;
+      cache->zstd_sample_sizes[cache->zstd_num_samples++] = size;
+   }
+
+   if (cache->zstd_samples_size + ZSTD_DICT_MAX_SAMPLE_SIZE <
+          ZSTD_DICT_SAMPLES_SIZE &&
+       cache->zstd_num_samples < ZSTD_DICT_MAX_SAMPLES) {
+      mtx_unlock(&cache->zstd_dict_mutex);
+      return;
+   }
+
+   samples = cache->zstd_samples;
+   sample_sizes = cache->zstd_sample_sizes;
+   num_samples = cache->zstd_num_samples;
+   cache->zstd_samples = NULL;
+   cache->zstd_sample_sizes = NULL;
+   mtx_unlock(&cache->zstd_dict_mutex);
+
+   void *dict = malloc(ZSTD_DICT_SIZE);
+   if (dict) {
+      size_t dict_size = ZDICT_trainFromBuffer(dict, ZSTD_DICT_SIZE, samples,
+                                               sample_sizes, num_samples);
+      if (!ZDICT_isError(dict_size))
+         write_zstd_dict(cache, dict, dict_size);
+      free(dict);
+   }
+
+   free(samples);
+   free(sample_sizes);
+}
+#endif
+
 /* From the zlib docs:
  *    "If the memory is available, buffers sizes on the order of 128K or 256K
  *    bytes should be used."
@@ -747,18 +1128,42 @@ write_all(int fd, const void *buf, size_t count)
  * of the data written to disk.
  */
 static size_t
-deflate_and_write_to_disk(const void *in_data, size_t in_data_size, int dest,
-                          const char *filename)
+deflate_and_write_to_disk(struct disk_cache *cache, const void *in_data,
+                          size_t in_data_size, int dest)
 {
 #ifdef HAVE_ZSTD
+   struct zstd_ctx *ctx = get_zstd_ctx(cache);
+   if (!ctx)
+      return 0;
+
+   if (!ctx->cctx) {
+      ctx->cctx = ZSTD_createCCtx();
+      if (!ctx->cctx) {
+         put_zstd_ctx(cache, ctx);
+         return 0;
+      }
+   }
+
    /* from the zstd docs (https://facebook.github.io/zstd/zstd_manual.html):
     * compression runs faster if `dstCapacity` >= `ZSTD_compressBound(srcSize)`.
     */
    size_t out_size = ZSTD_compressBound(in_data_size);
    void * out = malloc(out_size);
+   if (!out) {
+      put_zstd_ctx(cache, ctx);
+      return 0;
+   }
 
-   size_t ret = ZSTD_compress(out, out_size, in_data, in_data_size,
+   size_t ret;
+   if (cache->zstd_cdict) {
+      ret = ZSTD_compress_usingCDict(ctx->cctx, out, out_size,
+                                     in_data, in_data_size,
+                                     cache->zstd_cdict);
+   } else {
+      ret = ZSTD_compressCCtx(ctx->cctx, out, out_size, in_data, in_data_size,
                               ZSTD_COMPRESSION_LEVEL);
+   }
+   put_zstd_ctx(cache, ctx);
    if (ZSTD_isError(ret)) {
       free(out);
       return 0;
@@ -895,6 +1300,63 @@ struct cache_entry_file_data {
    uint32_t uncompressed_size;
 };
 
+/**
+ * Writes a complete cache entry to \p fd: the driver keys, the item
+ * metadata, the CRC and the compressed data.
+ */
+static bool
+write_cache_entry(int fd, void *job)
+{
+   struct disk_cache_put_job *dc_job = (struct disk_cache_put_job *) job;
+   ssize_t ret;
+
+   /* Write the driver_keys_blob, this can be used find information about the
+    * mesa version that produced the entry or deal with hash collisions,
+    * should that ever become a real problem.
+    */
+   ret = write_all(fd, dc_job->cache->driver_keys_blob,
+                   dc_job->cache->driver_keys_blob_size);
+   if (ret == -1)
+      return false;
+
+   /* Write the cache item metadata. This data can be used to deal with
+    * hash collisions, as well as providing useful information to 3rd party
+    * tools reading the cache files.
+    */
+   ret = write_all(fd, &dc_job->cache_item_metadata.type,
+                   sizeof(uint32_t));
+   if (ret == -1)
+      return false;
+
+   if (dc_job->cache_item_metadata.type == CACHE_ITEM_TYPE_GLSL) {
+      ret = write_all(fd, &dc_job->cache_item_metadata.num_keys,
+                      sizeof(uint32_t));
+      if (ret == -1)
+         return false;
+
+      ret = write_all(fd, dc_job->cache_item_metadata.keys[0],
+                      dc_job->cache_item_metadata.num_keys *
+                      sizeof(cache_key));
+      if (ret == -1)
+         return false;
+   }
+
+   /* Create CRC of the data. We will read this when restoring the cache and
+    * use it to check for corruption.
+    */
+   struct cache_entry_file_data cf_data;
+   cf_data.crc32 = util_hash_crc32(dc_job->data, dc_job->size);
+   cf_data.uncompressed_size = dc_job->size;
+
+   size_t cf_data_size = sizeof(cf_data);
+   ret = write_all(fd, &cf_data, cf_data_size);
+   if (ret == -1)
+      return false;
+
+   return deflate_and_write_to_disk(dc_job->cache, dc_job->data, dc_job->size,
+                                    fd) != 0;
+}
+
 static void
 cache_put(void *job, int thread_index)
 {
@@ -905,6 +1367,16 @@ cache_put(void *job, int thread_index)
    char *filename = NULL, *filename_tmp = NULL;
    struct disk_cache_put_job *dc_job = (struct disk_cache_put_job *) job;
 
+#ifdef HAVE_ZSTD
+   add_zstd_dict_sample(dc_job->cache, dc_job->data, dc_job->size);
+#endif
+
+   if (dc_job->cache->pack) {
+      disk_cache_pack_put(dc_job->cache->pack, dc_job->key,
+                          write_cache_entry, dc_job);
+      return;
+   }
+
    filename = get_cache_file(dc_job->cache, dc_job->key);
    if (filename == NULL)
       goto done;
@@ -973,66 +1445,11 @@ cache_put(void *job, int thread_index)
     * by some other process.
     */
 
-   /* Write the driver_keys_blob, this can be used find information about the
-    * mesa version that produced the entry or deal with hash collisions,
-    * should that ever become a real problem.
-    */
-   ret = write_all(fd, dc_job->cache->driver_keys_blob,
-                   dc_job->cache->driver_keys_blob_size);
-   if (ret == -1) {
-      unlink(filename_tmp);
-      goto done;
-   }
-
-   /* Write the cache item metadata. This data can be used to deal with
-    * hash collisions, as well as providing useful information to 3rd party
-    * tools reading the cache files.
-    */
-   ret = write_all(fd, &dc_job->cache_item_metadata.type,
-                   sizeof(uint32_t));
-   if (ret == -1) {
-      unlink(filename_tmp);
-      goto done;
-   }
-
-   if (dc_job->cache_item_metadata.type == CACHE_ITEM_TYPE_GLSL) {
-      ret = write_all(fd, &dc_job->cache_item_metadata.num_keys,
-                      sizeof(uint32_t));
-      if (ret == -1) {
-         unlink(filename_tmp);
-         goto done;
-      }
-
-      ret = write_all(fd, dc_job->cache_item_metadata.keys[0],
-                      dc_job->cache_item_metadata.num_keys *
-                      sizeof(cache_key));
-      if (ret == -1) {
-         unlink(filename_tmp);
-         goto done;
-      }
-   }
-
-   /* Create CRC of the data. We will read this when restoring the cache and
-    * use it to check for corruption.
-    */
-   struct cache_entry_file_data cf_data;
-   cf_data.crc32 = util_hash_crc32(dc_job->data, dc_job->size);
-   cf_data.uncompressed_size = dc_job->size;
-
-   size_t cf_data_size = sizeof(cf_data);
-   ret = write_all(fd, &cf_data, cf_data_size);
-   if (ret == -1) {
-      unlink(filename_tmp);
-      goto done;
-   }
-
    /* Now, finally, write out the contents to the temporary file, then
     * rename them atomically to the destination filename, and also
     * perform an atomic increment of the total cache size.
     */
-   size_t file_size = deflate_and_write_to_disk(dc_job->data, dc_job->size,
-                                                fd, filename_tmp);
-   if (file_size == 0) {
+   if (!write_cache_entry(fd, dc_job)) {
       unlink(filename_tmp);
       goto done;
    }
@@ -1081,8 +1498,11 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
 
    if (dc_job) {
       util_queue_fence_init(&dc_job->fence);
-      util_queue_add_job(&cache->cache_queue, dc_job, &dc_job->fence,
-                         cache_put, destroy_put_job, dc_job->size);
+      /* Writes are the least urgent, let lookups go first. */
+      util_queue_add_job_with_priority(&cache->cache_queue, dc_job,
+                                       &dc_job->fence, cache_put,
+                                       destroy_put_job, dc_job->size,
+                                       UTIL_QUEUE_PRIORITY_LOW);
    }
 }
 
@@ -1090,11 +1510,39 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
  * Decompresses cache entry, returns true if successful.
  */
 static bool
-inflate_cache_data(uint8_t *in_data, size_t in_data_size,
+inflate_cache_data(struct disk_cache *cache,
+                   uint8_t *in_data, size_t in_data_size,
                    uint8_t *out_data, size_t out_data_size)
 {
 #ifdef HAVE_ZSTD
-   size_t ret = ZSTD_decompress(out_data, out_data_size, in_data, in_data_size);
+   unsigned dict_id = ZSTD_getDictID_fromFrame(in_data, in_data_size);
+   if (dict_id != 0 && dict_id != cache->zstd_dict_id) {
+      /* Compressed with a dictionary we don't have. */
+      return false;
+   }
+
+   struct zstd_ctx *ctx = get_zstd_ctx(cache);
+   if (!ctx)
+      return false;
+
+   if (!ctx->dctx) {
+      ctx->dctx = ZSTD_createDCtx();
+      if (!ctx->dctx) {
+         put_zstd_ctx(cache, ctx);
+         return false;
+      }
+   }
+
+   size_t ret;
+   if (dict_id == 0) {
+      ret = ZSTD_decompressDCtx(ctx->dctx, out_data, out_data_size,
+                                in_data, in_data_size);
+   } else {
+      ret = ZSTD_decompress_usingDDict(ctx->dctx, out_data, out_data_size,
+                                       in_data, in_data_size,
+                                       cache->zstd_ddict);
+   }
+   put_zstd_ctx(cache, ctx);
    return !ZSTD_isError(ret);
 #else
    z_stream strm;
@@ -1130,15 +1578,147 @@ inflate_cache_data(uint8_t *in_data, size_t in_data_size,
 #endif
 }
 
-void *
-disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+/**
+ * Checks and decompresses a cache entry as written by write_cache_entry().
+ */
+static void *
+parse_cache_entry(struct disk_cache *cache, const uint8_t *entry,
+                  size_t entry_size, size_t *size)
+{
+   const uint8_t *p = entry, *end = entry + entry_size;
+   uint8_t *uncompressed_data;
+
+   size_t ck_size = cache->driver_keys_blob_size;
+   if (entry_size < ck_size + sizeof(uint32_t))
+      return NULL;
+
+   /* Check for extremely unlikely hash collisions */
+   if (memcmp(cache->driver_keys_blob, p, ck_size) != 0) {
+      assert(!"Mesa cache keys mismatch!");
+      return NULL;
+   }
+   p += ck_size;
+
+   uint32_t md_type;
+   memcpy(&md_type, p, sizeof(uint32_t));
+   p += sizeof(uint32_t);
+
+   if (md_type == CACHE_ITEM_TYPE_GLSL) {
+      uint32_t num_keys;
+      if ((size_t)(end - p) < sizeof(uint32_t))
+         return NULL;
+      memcpy(&num_keys, p, sizeof(uint32_t));
+      p += sizeof(uint32_t);
+
+      /* The cache item metadata is currently just used for distributing
+       * precompiled shaders, they are not used by Mesa so just skip them for
+       * now.
+       * TODO: pass the metadata back to the caller and do some basic
+       * validation.
+       */
+      if ((size_t)(end - p) < (size_t)num_keys * sizeof(cache_key))
+         return NULL;
+      p += (size_t)num_keys * sizeof(cache_key);
+   }
+
+   /* Load the CRC that was created when the file was written. */
+   struct cache_entry_file_data cf_data;
+   if ((size_t)(end - p) < sizeof(cf_data))
+      return NULL;
+   memcpy(&cf_data, p, sizeof(cf_data));
+   p += sizeof(cf_data);
+
+   /* Uncompress the cache data */
+   uncompressed_data = malloc(cf_data.uncompressed_size);
+   if (!uncompressed_data)
+      return NULL;
+
+   if (!inflate_cache_data(cache, (uint8_t *) p, end - p, uncompressed_data,
+                           cf_data.uncompressed_size))
+      goto fail;
+
+   /* Check the data for corruption */
+   if (cf_data.crc32 != util_hash_crc32(uncompressed_data,
+                                        cf_data.uncompressed_size))
+      goto fail;
+
+   if (size)
+      *size = cf_data.uncompressed_size;
+
+   return uncompressed_data;
+
+ fail:
+   free(uncompressed_data);
+   return NULL;
+}
+
+/**
+ * Reads the whole cache file for \p key into memory.
+ */
+static uint8_t *
+read_cache_file(struct disk_cache *cache, const cache_key key, size_t *size)
 {
-   int fd = -1, ret;
    struct stat sb;
-   char *filename = NULL;
    uint8_t *data = NULL;
-   uint8_t *uncompressed_data = NULL;
-   uint8_t *file_header = NULL;
+   int fd;
+
+   char *filename = get_cache_file(cache, key);
+   if (filename == NULL)
+      return NULL;
+
+   fd = open(filename, O_RDONLY | O_CLOEXEC);
+   free(filename);
+   if (fd == -1)
+      return NULL;
+
+   if (fstat(fd, &sb) == -1)
+      goto fail;
+
+   data = malloc(sb.st_size);
+   if (data == NULL)
+      goto fail;
+
+   if (read_all(fd, data, sb.st_size) == -1)
+      goto fail;
+
+   close(fd);
+   *size = sb.st_size;
+   return data;
+
+ fail:
+   free(data);
+   close(fd);
+   return NULL;
+}
+
+/**
+ * Loads and decompresses the entry for \p key from disk.
+ */
+static void *
+load_cache_entry(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   uint8_t *entry;
+   size_t entry_size = 0;
+   void *data;
+
+   if (cache->pack)
+      entry = disk_cache_pack_get(cache->pack, key, &entry_size);
+   else
+      entry = read_cache_file(cache, key, &entry_size);
+
+   if (!entry)
+      return NULL;
+
+   data = parse_cache_entry(cache, entry, entry_size, size);
+   free(entry);
+
+   return data;
+}
+
+void *
+disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   void *data;
 
    if (size)
       *size = 0;
@@ -1165,112 +1745,176 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
       return blob;
    }
 
-   filename = get_cache_file(cache, key);
-   if (filename == NULL)
-      goto fail;
+   if (!cache->path_init_failed) {
+      data = take_prefetched_entry(cache, key, size);
+      if (data)
+         return data;
+   }
 
-   fd = open(filename, O_RDONLY | O_CLOEXEC);
-   if (fd == -1)
-      goto fail;
+   return load_cache_entry(cache, key, size);
+}
 
-   if (fstat(fd, &sb) == -1)
-      goto fail;
+static void
+cache_get_job(void *job, int thread_index)
+{
+   struct disk_cache_get_job *get_job = (struct disk_cache_get_job *) job;
 
-   data = malloc(sb.st_size);
-   if (data == NULL)
-      goto fail;
+   get_job->data = load_cache_entry(get_job->cache, get_job->key,
+                                    &get_job->size);
+   get_job->done = true;
+}
 
-   size_t ck_size = cache->driver_keys_blob_size;
-   file_header = malloc(ck_size);
-   if (!file_header)
-      goto fail;
+struct disk_cache_batch *
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys)
+{
+   struct disk_cache_batch *batch = (struct disk_cache_batch *)
+      calloc(1, sizeof(*batch) + num_keys * sizeof(batch->jobs[0]));
+   if (!batch)
+      return NULL;
 
-   if (sb.st_size < ck_size)
-      goto fail;
+   batch->cache = cache;
+   batch->num_keys = num_keys;
 
-   ret = read_all(fd, file_header, ck_size);
-   if (ret == -1)
-      goto fail;
+   for (unsigned i = 0; i < num_keys; i++) {
+      struct disk_cache_get_job *job = &batch->jobs[i];
 
-   /* Check for extremely unlikely hash collisions */
-   if (memcmp(cache->driver_keys_blob, file_header, ck_size) != 0) {
-      assert(!"Mesa cache keys mismatch!");
-      goto fail;
+      job->cache = cache;
+      memcpy(job->key, keys[i], sizeof(cache_key));
+      util_queue_fence_init(&job->fence);
+
+      /* The blob callbacks aren't required to be thread-safe, those entries
+       * are looked up in disk_cache_batch_get() instead.
+       */
+      if (cache->blob_get_cb || cache->path_init_failed)
+         continue;
+
+      /* Entries that were prefetched already need no work. */
+      job->data = take_prefetched_entry(cache, job->key, &job->size);
+      if (job->data) {
+         job->done = true;
+         continue;
+      }
+
+      util_queue_add_job(&cache->cache_queue, job, &job->fence,
+                         cache_get_job, NULL, 0);
    }
 
-   size_t cache_item_md_size = sizeof(uint32_t);
-   uint32_t md_type;
-   ret = read_all(fd, &md_type, cache_item_md_size);
-   if (ret == -1)
-      goto fail;
+   return batch;
+}
 
-   if (md_type == CACHE_ITEM_TYPE_GLSL) {
-      uint32_t num_keys;
-      cache_item_md_size += sizeof(uint32_t);
-      ret = read_all(fd, &num_keys, sizeof(uint32_t));
-      if (ret == -1)
-         goto fail;
+void *
+disk_cache_batch_get(struct disk_cache_batch *batch, unsigned index,
+                     size_t *size)
+{
+   struct disk_cache_get_job *job = &batch->jobs[index];
+   struct disk_cache *cache = batch->cache;
+   void *data;
 
-      /* The cache item metadata is currently just used for distributing
-       * precompiled shaders, they are not used by Mesa so just skip them for
-       * now.
-       * TODO: pass the metadata back to the caller and do some basic
-       * validation.
+   assert(index < batch->num_keys);
+
+   if (size)
+      *size = 0;
+
+   if (!util_queue_fence_is_signalled(&job->fence)) {
+      /* The queue runs at the lowest priority, so rather than waiting for
+       * it to get to this entry, load it here if it hasn't started yet.
        */
-      cache_item_md_size += num_keys * sizeof(cache_key);
-      ret = lseek(fd, num_keys * sizeof(cache_key), SEEK_CUR);
-      if (ret == -1)
-         goto fail;
+      util_queue_drop_job(&cache->cache_queue, &job->fence);
    }
 
-   /* Load the CRC that was created when the file was written. */
-   struct cache_entry_file_data cf_data;
-   size_t cf_data_size = sizeof(cf_data);
-   ret = read_all(fd, &cf_data, cf_data_size);
-   if (ret == -1)
-      goto fail;
+   if (!job->done)
+      return disk_cache_get(cache, job->key, size);
 
-   /* Load the actual cache data. */
-   size_t cache_data_size =
-      sb.st_size - cf_data_size - ck_size - cache_item_md_size;
-   ret = read_all(fd, data, cache_data_size);
-   if (ret == -1)
-      goto fail;
+   data = job->data;
+   job->data = NULL;
+   if (data && size)
+      *size = job->size;
 
-   /* Uncompress the cache data */
-   uncompressed_data = malloc(cf_data.uncompressed_size);
-   if (!inflate_cache_data(data, cache_data_size, uncompressed_data,
-                           cf_data.uncompressed_size))
-      goto fail;
+   return data;
+}
 
-   /* Check the data for corruption */
-   if (cf_data.crc32 != util_hash_crc32(uncompressed_data,
-                                        cf_data.uncompressed_size))
-      goto fail;
+void
+disk_cache_batch_destroy(struct disk_cache_batch *batch)
+{
+   if (!batch)
+      return;
 
-   free(data);
-   free(filename);
-   free(file_header);
-   close(fd);
+   for (unsigned i = 0; i < batch->num_keys; i++) {
+      struct disk_cache_get_job *job = &batch->jobs[i];
 
-   if (size)
-      *size = cf_data.uncompressed_size;
+      if (!util_queue_fence_is_signalled(&job->fence))
+         util_queue_drop_job(&batch->cache->cache_queue, &job->fence);
+      util_queue_fence_destroy(&job->fence);
+      free(job->data);
+   }
 
-   return uncompressed_data;
+   free(batch);
+}
 
- fail:
-   if (data)
+static void
+cache_prefetch_job(void *job, int thread_index)
+{
+   struct disk_cache_get_job *get_job = (struct disk_cache_get_job *) job;
+   struct disk_cache *cache = get_job->cache;
+   struct prefetched_entry *entry;
+   size_t size;
+
+   void *data = load_cache_entry(cache, get_job->key, &size);
+   if (!data)
+      return;
+
+   entry = (struct prefetched_entry *) malloc(sizeof(*entry));
+   if (!entry) {
       free(data);
-   if (uncompressed_data)
-      free(uncompressed_data);
-   if (filename)
-      free(filename);
-   if (file_header)
-      free(file_header);
-   if (fd != -1)
-      close(fd);
+      return;
+   }
 
-   return NULL;
+   memcpy(entry->key, get_job->key, sizeof(cache_key));
+   entry->data = data;
+   entry->size = size;
+
+   mtx_lock(&cache->prefetch_mutex);
+   if (cache->prefetched_size + size > CACHE_PREFETCH_MAX_SIZE ||
+       _mesa_hash_table_search(cache->prefetched, entry->key)) {
+      mtx_unlock(&cache->prefetch_mutex);
+      free(data);
+      free(entry);
+      return;
+   }
+   _mesa_hash_table_insert(cache->prefetched, entry->key, entry);
+   cache->prefetched_size += size;
+   mtx_unlock(&cache->prefetch_mutex);
+}
+
+static void
+destroy_prefetch_job(void *job, int thread_index)
+{
+   struct disk_cache_get_job *get_job = (struct disk_cache_get_job *) job;
+
+   util_queue_fence_destroy(&get_job->fence);
+   free(get_job);
+}
+
+void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys)
+{
+   if (cache->blob_get_cb || cache->path_init_failed)
+      return;
+
+   for (unsigned i = 0; i < num_keys; i++) {
+      struct disk_cache_get_job *job = (struct disk_cache_get_job *)
+         calloc(1, sizeof(*job));
+      if (!job)
+         return;
+
+      job->cache = cache;
+      memcpy(job->key, keys[i], sizeof(cache_key));
+      util_queue_fence_init(&job->fence);
+      util_queue_add_job(&cache->cache_queue, job, &job->fence,
+                         cache_prefetch_job, destroy_prefetch_job, 0);
+   }
 }
 
 void
@@ -75,6 +75,7 @@ struct cache_item_metadata {
 };
 
 struct disk_cache;
+struct disk_cache_batch;
 
 static inline char *
 disk_cache_format_hex_id(char *buf, const uint8_t *hex_id, unsigned size)
@@ -222,6 +223,39 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
 void *
 disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size);
 
+/**
+ * Start loading the entries for \p keys on the cache's threads.
+ *
+ * The entries are then retrieved with disk_cache_batch_get(), which waits
+ * for the corresponding entry if it isn't loaded yet.  Returns NULL if out
+ * of memory.
+ */
+struct disk_cache_batch *
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys);
+
+/**
+ * Retrieve entry \p index of a batch, like disk_cache_get() would.  Each
+ * entry can only be retrieved once, the caller owns the returned memory.
+ */
+void *
+disk_cache_batch_get(struct disk_cache_batch *batch, unsigned index,
+                     size_t *size);
+
+/**
+ * Free a batch along with any entries that were not retrieved.
+ */
+void
+disk_cache_batch_destroy(struct disk_cache_batch *batch);
+
+/**
+ * Load the entries for \p keys in the background, so that later calls to
+ * disk_cache_get() for them don't have to wait for the disk.
+ */
+void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys);
+
 /**
  * Store the name \key within the cache, (without any associated data).
  *
@@ -292,6 +326,33 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    return NULL;
 }
 
+static inline struct disk_cache_batch *
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys)
+{
+   return NULL;
+}
+
+static inline void *
+disk_cache_batch_get(struct disk_cache_batch *batch, unsigned index,
+                     size_t *size)
+{
+   return NULL;
+}
+
+static inline void
+disk_cache_batch_destroy(struct disk_cache_batch *batch)
+{
+   return;
+}
+
+static inline void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys)
+{
+   return;
+}
+
 static inline void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
@@ -0,0 +1,689 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifdef ENABLE_SHADER_CACHE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "util/crc32.h"
+#include "util/hash_table.h"
+#include "util/macros.h"
+#include "util/os_time.h"
+#include "util/ralloc.h"
+#include "util/u_thread.h"
+
+#include "disk_cache.h"
+#include "disk_cache_pack.h"
+
+/* Bump this whenever the layout of the pack or index files changes. */
+#define PACK_VERSION 1
+
+/* Both files start with this header.  The generation is chosen at random
+ * whenever the files are (re)created, and must match between the pack and
+ * the index.
+ */
+struct pack_header {
+   char magic[8];
+   uint32_t version;
+   uint32_t generation;
+};
+
+static const char pack_magic[8] = "MESAPAK";
+static const char index_magic[8] = "MESAIDX";
+
+/* Index file record.  A size of 0 marks a removed entry. */
+struct pack_index_record {
+   uint8_t key[CACHE_KEY_SIZE];
+   uint32_t size;
+   uint64_t offset;
+   uint32_t crc32;
+   uint32_t pad;
+};
+
+struct pack_entry {
+   uint8_t key[CACHE_KEY_SIZE];
+   uint64_t offset;
+   uint32_t size;
+};
+
+struct disk_cache_pack {
+   char *pack_path;
+   char *index_path;
+
+   int pack_fd;
+   int index_fd;
+   int lock_fd;
+
+   /* Identity of the open index file, to notice when another process
+    * replaced it by compacting the cache.
+    */
+   dev_t index_dev;
+   ino_t index_ino;
+
+   /* How far the index file has been read, or 0 if the headers of the open
+    * files haven't been checked yet.
+    */
+   uint64_t index_offset;
+
+   uint64_t max_size;
+
+   /* Key -> pack_entry, for all entries in the index up to index_offset. */
+   struct hash_table *entries;
+
+   /* Protects all of the above against the cache's threads. */
+   mtx_t mutex;
+};
+
+static uint32_t
+key_hash(const void *key)
+{
+   /* Keys are SHA-1 hashes, any part of them is a good hash. */
+   uint32_t hash;
+   memcpy(&hash, key, sizeof(hash));
+   return hash;
+}
+
+static bool
+key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, CACHE_KEY_SIZE) == 0;
+}
+
+static void
+free_entry(struct hash_entry *he)
+{
+   free(he->data);
+}
+
+static bool
+write_all(int fd, const void *buf, size_t count)
+{
+   const char *out = buf;
+   ssize_t written;
+   size_t done;
+
+   for (done = 0; done < count; done += written) {
+      written = write(fd, out + done, count - done);
+      if (written == -1 && errno == EINTR) {
+         written = 0;
+         continue;
+      }
+      /* Nothing written without an error won't get any better by retrying. */
+      if (written <= 0)
+         return false;
+   }
+   return true;
+}
+
+static int
+pack_lock(struct disk_cache_pack *pack, bool exclusive)
+{
+   int ret;
+
+   do {
+#ifdef HAVE_FLOCK
+      ret = flock(pack->lock_fd, exclusive ? LOCK_EX : LOCK_SH);
+#else
+      struct flock lock = {
+         .l_start = 0,
+         .l_len = 0, /* entire file */
+         .l_type = exclusive ? F_WRLCK : F_RDLCK,
+         .l_whence = SEEK_SET
+      };
+      ret = fcntl(pack->lock_fd, F_SETLKW, &lock);
+#endif
+   } while (ret == -1 && errno == EINTR);
+
+   return ret;
+}
+
+static void
+pack_unlock(struct disk_cache_pack *pack)
+{
+#ifdef HAVE_FLOCK
+   flock(pack->lock_fd, LOCK_UN);
+#else
+   struct flock lock = {
+      .l_start = 0,
+      .l_len = 0, /* entire file */
+      .l_type = F_UNLCK,
+      .l_whence = SEEK_SET
+   };
+   fcntl(pack->lock_fd, F_SETLK, &lock);
+#endif
+}
+
+static uint32_t
+pack_new_generation(void)
+{
+   return (uint32_t)os_time_get_nano() ^ ((uint32_t)getpid() << 16);
+}
+
+static void
+pack_init_header(struct pack_header *header, const char *magic,
+                 uint32_t generation)
+{
+   memcpy(header->magic, magic, sizeof(header->magic));
+   header->version = PACK_VERSION;
+   header->generation = generation;
+}
+
+static bool
+pack_read_header(int fd, const char *magic, uint32_t *generation)
+{
+   struct pack_header header;
+
+   if (pread(fd, &header, sizeof(header), 0) != sizeof(header))
+      return false;
+
+   if (memcmp(header.magic, magic, sizeof(header.magic)) != 0 ||
+       header.version != PACK_VERSION)
+      return false;
+
+   *generation = header.generation;
+   return true;
+}
+
+static void
+pack_close_files(struct disk_cache_pack *pack)
+{
+   if (pack->pack_fd != -1)
+      close(pack->pack_fd);
+   if (pack->index_fd != -1)
+      close(pack->index_fd);
+
+   pack->pack_fd = -1;
+   pack->index_fd = -1;
+   pack->index_offset = 0;
+   _mesa_hash_table_clear(pack->entries, free_entry);
+}
+
+static bool
+pack_open_files(struct disk_cache_pack *pack)
+{
+   struct stat sb;
+
+   pack->pack_fd = open(pack->pack_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   pack->index_fd = open(pack->index_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if (pack->pack_fd == -1 || pack->index_fd == -1 ||
+       fstat(pack->index_fd, &sb) == -1) {
+      pack_close_files(pack);
+      return false;
+   }
+
+   pack->index_dev = sb.st_dev;
+   pack->index_ino = sb.st_ino;
+   pack->index_offset = 0;
+   return true;
+}
+
+/* Start over with empty files.  Must be called with the exclusive lock. */
+static bool
+pack_reset(struct disk_cache_pack *pack)
+{
+   struct pack_header pack_header, index_header;
+   uint32_t generation = pack_new_generation();
+
+   pack_init_header(&pack_header, pack_magic, generation);
+   pack_init_header(&index_header, index_magic, generation);
+
+   _mesa_hash_table_clear(pack->entries, free_entry);
+   pack->index_offset = 0;
+
+   if (ftruncate(pack->pack_fd, 0) == -1 ||
+       ftruncate(pack->index_fd, 0) == -1 ||
+       pwrite(pack->pack_fd, &pack_header, sizeof(pack_header), 0) !=
+          sizeof(pack_header) ||
+       pwrite(pack->index_fd, &index_header, sizeof(index_header), 0) !=
+          sizeof(index_header))
+      return false;
+
+   pack->index_offset = sizeof(struct pack_header);
+   return true;
+}
+
+static void
+pack_apply_record(struct disk_cache_pack *pack,
+                  const struct pack_index_record *record)
+{
+   struct hash_entry *he = _mesa_hash_table_search(pack->entries, record->key);
+   struct pack_entry *entry;
+
+   if (record->size == 0) {
+      if (he) {
+         entry = he->data;
+         _mesa_hash_table_remove(pack->entries, he);
+         free(entry);
+      }
+      return;
+   }
+
+   if (he) {
+      entry = he->data;
+   } else {
+      entry = malloc(sizeof(*entry));
+      if (!entry)
+         return;
+
+      memcpy(entry->key, record->key, CACHE_KEY_SIZE);
+      if (!_mesa_hash_table_insert(pack->entries, entry->key, entry)) {
+         free(entry);
+         return;
+      }
+   }
+
+   entry->offset = record->offset;
+   entry->size = record->size;
+}
+
+static uint32_t
+pack_record_crc(const struct pack_index_record *record)
+{
+   return util_hash_crc32(record, offsetof(struct pack_index_record, crc32));
+}
+
+/* Read index records appended since the last call.  Stops at the first
+ * incomplete or corrupt record, which is what an interrupted append leaves
+ * behind.  The next append overwrites it.
+ */
+static void
+pack_read_index(struct disk_cache_pack *pack)
+{
+   struct pack_index_record records[256];
+
+   while (1) {
+      ssize_t ret = pread(pack->index_fd, records, sizeof(records),
+                          pack->index_offset);
+      unsigned i, count;
+
+      if (ret <= 0)
+         return;
+
+      count = ret / sizeof(records[0]);
+      for (i = 0; i < count; i++) {
+         if (records[i].crc32 != pack_record_crc(&records[i]))
+            return;
+
+         pack_apply_record(pack, &records[i]);
+         pack->index_offset += sizeof(records[0]);
+      }
+
+      if (count < ARRAY_SIZE(records))
+         return;
+   }
+}
+
+/* Bring the in-memory index up to date with the files on disk.  Must be
+ * called with the file lock held.  Invalid files, either new ones or left
+ * behind by an interrupted compaction, are only reset with the exclusive
+ * lock and make this fail otherwise.
+ */
+static bool
+pack_sync(struct disk_cache_pack *pack, bool exclusive)
+{
+   struct stat sb;
+
+   if (pack->index_fd != -1 &&
+       (stat(pack->index_path, &sb) == -1 ||
+        sb.st_dev != pack->index_dev || sb.st_ino != pack->index_ino))
+      pack_close_files(pack);
+
+   if (pack->index_fd == -1 && !pack_open_files(pack))
+      return false;
+
+   if (pack->index_offset == 0) {
+      uint32_t pack_generation, index_generation;
+
+      if (!pack_read_header(pack->pack_fd, pack_magic, &pack_generation) ||
+          !pack_read_header(pack->index_fd, index_magic, &index_generation) ||
+          pack_generation != index_generation)
+         return exclusive && pack_reset(pack);
+
+      pack->index_offset = sizeof(struct pack_header);
+   }
+
+   pack_read_index(pack);
+   return true;
+}
+
+static bool
+pack_append_record(struct disk_cache_pack *pack, const uint8_t *key,
+                   uint64_t offset, uint32_t size)
+{
+   struct pack_index_record record;
+
+   memset(&record, 0, sizeof(record));
+   memcpy(record.key, key, CACHE_KEY_SIZE);
+   record.size = size;
+   record.offset = offset;
+   record.crc32 = pack_record_crc(&record);
+
+   if (pwrite(pack->index_fd, &record, sizeof(record), pack->index_offset) !=
+       sizeof(record))
+      return false;
+
+   pack->index_offset += sizeof(record);
+   pack_apply_record(pack, &record);
+   return true;
+}
+
+static int
+compare_entry_offsets(const void *a, const void *b)
+{
+   const struct pack_entry *ea = *(const struct pack_entry **)a;
+   const struct pack_entry *eb = *(const struct pack_entry **)b;
+
+   return ea->offset < eb->offset ? -1 : ea->offset > eb->offset;
+}
+
+/* Copy the most recently added entries that fit in half of the maximum
+ * size, and always the last one, to new files which then replace the
+ * current ones.  Must be called with the exclusive lock.
+ */
+static void
+pack_compact(struct disk_cache_pack *pack)
+{
+   unsigned count = pack->entries->entries;
+   struct pack_entry **list = malloc(count * sizeof(*list));
+   struct pack_index_record *records = malloc(count * sizeof(*records));
+   char *pack_tmp = ralloc_asprintf(NULL, "%s.tmp", pack->pack_path);
+   char *index_tmp = ralloc_asprintf(NULL, "%s.tmp", pack->index_path);
+   int pack_fd = -1, index_fd = -1;
+   uint32_t generation = pack_new_generation();
+   struct pack_header header;
+   uint64_t total = 0, offset;
+   void *buf = NULL;
+   size_t buf_size = 0;
+   unsigned i, first;
+   struct stat sb;
+
+   if (!list || !records || !pack_tmp || !index_tmp)
+      goto fail;
+
+   i = 0;
+   hash_table_foreach(pack->entries, he)
+      list[i++] = he->data;
+   qsort(list, count, sizeof(*list), compare_entry_offsets);
+
+   first = count;
+   while (first > 0 &&
+          (first == count ||
+           total + list[first - 1]->size <= pack->max_size / 2)) {
+      total += list[first - 1]->size;
+      first--;
+   }
+
+   pack_fd = open(pack_tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   index_fd = open(index_tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (pack_fd == -1 || index_fd == -1)
+      goto fail;
+
+   pack_init_header(&header, pack_magic, generation);
+   if (!write_all(pack_fd, &header, sizeof(header)))
+      goto fail;
+
+   offset = sizeof(header);
+   for (i = first; i < count; i++) {
+      struct pack_entry *entry = list[i];
+      struct pack_index_record *record = &records[i - first];
+
+      if (entry->size > buf_size) {
+         void *tmp = realloc(buf, entry->size);
+         if (!tmp)
+            goto fail;
+         buf = tmp;
+         buf_size = entry->size;
+      }
+
+      if (pread(pack->pack_fd, buf, entry->size, entry->offset) !=
+          entry->size ||
+          !write_all(pack_fd, buf, entry->size))
+         goto fail;
+
+      memset(record, 0, sizeof(*record));
+      memcpy(record->key, entry->key, CACHE_KEY_SIZE);
+      record->size = entry->size;
+      record->offset = offset;
+      record->crc32 = pack_record_crc(record);
+      offset += entry->size;
+   }
+
+   pack_init_header(&header, index_magic, generation);
+   if (!write_all(index_fd, &header, sizeof(header)) ||
+       !write_all(index_fd, records, (count - first) * sizeof(*records)) ||
+       fstat(index_fd, &sb) == -1)
+      goto fail;
+
+   /* If we crash between the two renames, the generations don't match and
+    * the cache starts over empty.
+    */
+   if (rename(pack_tmp, pack->pack_path) == -1)
+      goto fail;
+   if (rename(index_tmp, pack->index_path) == -1) {
+      unlink(index_tmp);
+      close(pack_fd);
+      close(index_fd);
+      pack_close_files(pack);
+      goto out;
+   }
+
+   pack_close_files(pack);
+   pack->pack_fd = pack_fd;
+   pack->index_fd = index_fd;
+   pack->index_dev = sb.st_dev;
+   pack->index_ino = sb.st_ino;
+   pack->index_offset = sizeof(header);
+   pack_read_index(pack);
+   goto out;
+
+fail:
+   if (pack_fd != -1) {
+      close(pack_fd);
+      unlink(pack_tmp);
+   }
+   if (index_fd != -1) {
+      close(index_fd);
+      unlink(index_tmp);
+   }
+out:
+   free(buf);
+   free(list);
+   free(records);
+   ralloc_free(pack_tmp);
+   ralloc_free(index_tmp);
+}
+
+struct disk_cache_pack *
+disk_cache_pack_open(const char *path, uint64_t max_size)
+{
+   struct disk_cache_pack *pack;
+   char *lock_path;
+   bool ok;
+
+   STATIC_ASSERT(sizeof(struct pack_index_record) == 40);
+
+   pack = rzalloc(NULL, struct disk_cache_pack);
+   if (!pack)
+      return NULL;
+
+   pack->pack_fd = -1;
+   pack->index_fd = -1;
+   pack->lock_fd = -1;
+   pack->max_size = max_size;
+
+   pack->pack_path = ralloc_asprintf(pack, "%s/cache.pack", path);
+   pack->index_path = ralloc_asprintf(pack, "%s/cache.idx", path);
+   lock_path = ralloc_asprintf(pack, "%s/cache.lock", path);
+   pack->entries = _mesa_hash_table_create(pack, key_hash, key_equal);
+   if (!pack->pack_path || !pack->index_path || !lock_path || !pack->entries)
+      goto fail;
+
+   pack->lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if (pack->lock_fd == -1)
+      goto fail;
+
+   /* Create or validate the files right away, so that an unusable cache
+    * directory disables the cache like it does for the file backend.
+    */
+   if (pack_lock(pack, true) == -1)
+      goto fail;
+   ok = pack_sync(pack, true);
+   pack_unlock(pack);
+   if (!ok)
+      goto fail;
+
+   mtx_init(&pack->mutex, mtx_plain);
+   return pack;
+
+fail:
+   pack_close_files(pack);
+   if (pack->lock_fd != -1)
+      close(pack->lock_fd);
+   ralloc_free(pack);
+   return NULL;
+}
+
+void
+disk_cache_pack_close(struct disk_cache_pack *pack)
+{
+   if (!pack)
+      return;
+
+   pack_close_files(pack);
+   close(pack->lock_fd);
+   mtx_destroy(&pack->mutex);
+   ralloc_free(pack);
+}
+
+bool
+disk_cache_pack_put(struct disk_cache_pack *pack, const uint8_t *key,
+                    disk_cache_pack_write_cb write_entry, void *data)
+{
+   bool ret = false;
+   off_t offset, end;
+
+   mtx_lock(&pack->mutex);
+   if (pack_lock(pack, true) == -1) {
+      mtx_unlock(&pack->mutex);
+      return false;
+   }
+
+   if (!pack_sync(pack, true))
+      goto out;
+
+   /* Another process may have added the same entry in the meantime. */
+   if (_mesa_hash_table_search(pack->entries, key)) {
+      ret = true;
+      goto out;
+   }
+
+   offset = lseek(pack->pack_fd, 0, SEEK_END);
+   if (offset == -1)
+      goto out;
+
+   if (!write_entry(pack->pack_fd, data) ||
+       (end = lseek(pack->pack_fd, 0, SEEK_CUR)) == -1 ||
+       end == offset || end - offset > UINT32_MAX ||
+       !pack_append_record(pack, key, offset, end - offset)) {
+      /* Without an index record, the data is unreachable anyway. */
+      if (ftruncate(pack->pack_fd, offset) == -1) {
+         /* Nothing we can do, compaction will drop it eventually. */
+      }
+      goto out;
+   }
+
+   ret = true;
+
+   if ((uint64_t)end > pack->max_size)
+      pack_compact(pack);
+
+out:
+   pack_unlock(pack);
+   mtx_unlock(&pack->mutex);
+   return ret;
+}
+
+void *
+disk_cache_pack_get(struct disk_cache_pack *pack, const uint8_t *key,
+                    size_t *size)
+{
+   struct hash_entry *he;
+   void *data = NULL;
+
+   mtx_lock(&pack->mutex);
+
+   he = _mesa_hash_table_search(pack->entries, key);
+   if (!he) {
+      /* Look for entries added by other processes. */
+      if (pack_lock(pack, false) == 0) {
+         pack_sync(pack, false);
+         pack_unlock(pack);
+      }
+      he = _mesa_hash_table_search(pack->entries, key);
+   }
+
+   if (he) {
+      struct pack_entry *entry = he->data;
+
+      /* If another process compacted the cache since, pack_fd still refers
+       * to the old file, so the offset stays valid.
+       */
+      data = malloc(entry->size);
+      if (data && pread(pack->pack_fd, data, entry->size, entry->offset) !=
+                  entry->size) {
+         free(data);
+         data = NULL;
+      }
+      if (data && size)
+         *size = entry->size;
+   }
+
+   mtx_unlock(&pack->mutex);
+   return data;
+}
+
+void
+disk_cache_pack_remove(struct disk_cache_pack *pack, const uint8_t *key)
+{
+   mtx_lock(&pack->mutex);
+   if (pack_lock(pack, true) == -1) {
+      mtx_unlock(&pack->mutex);
+      return;
+   }
+
+   if (pack_sync(pack, true) &&
+       _mesa_hash_table_search(pack->entries, key))
+      pack_append_record(pack, key, 0, 0);
+
+   pack_unlock(pack);
+   mtx_unlock(&pack->mutex);
+}
+
+#endif /* ENABLE_SHADER_CACHE */
@@ -0,0 +1,81 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Single-file storage backend for disk_cache.
+ *
+ * Instead of one file per entry, all entries of a cache directory are
+ * appended to one pack file.  A second, append-only index file maps keys to
+ * the offset and size of their entry in the pack.  Each process keeps the
+ * index in memory and catches up with entries appended by other processes
+ * when it misses.
+ *
+ * Writers serialize on an flock of a separate lock file.  An entry is only
+ * visible once its index record has been written after the entry data, and
+ * index records carry a CRC, so a crash in the middle of an append leaves at
+ * worst some unreachable bytes at the end of the pack.
+ *
+ * When the pack grows beyond the cache's maximum size, the most recently
+ * added entries that fit in half of it are copied into new pack and index
+ * files which then replace the old ones.
+ */
+
+#ifndef DISK_CACHE_PACK_H
+#define DISK_CACHE_PACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct disk_cache_pack;
+
+/* Write an entry to \p fd at its current position.  Returns false on
+ * failure, in which case anything written is discarded.
+ */
+typedef bool (*disk_cache_pack_write_cb)(int fd, void *data);
+
+struct disk_cache_pack *
+disk_cache_pack_open(const char *path, uint64_t max_size);
+
+void
+disk_cache_pack_close(struct disk_cache_pack *pack);
+
+bool
+disk_cache_pack_put(struct disk_cache_pack *pack, const uint8_t *key,
+                    disk_cache_pack_write_cb write_entry, void *data);
+
+void *
+disk_cache_pack_get(struct disk_cache_pack *pack, const uint8_t *key,
+                    size_t *size);
+
+void
+disk_cache_pack_remove(struct disk_cache_pack *pack, const uint8_t *key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DISK_CACHE_PACK_H */
@@ -322,6 +322,11 @@ DRI_CONF_OPT_BEGIN_B(mesa_glthread, def) \
         DRI_CONF_DESC("Enable offloading GL driver work to a separate thread") \
 DRI_CONF_OPT_END
 
+#define DRI_CONF_MESA_THREAD_POOL_SIZE(def) \
+DRI_CONF_OPT_BEGIN_V(mesa_thread_pool_size, int, def, "0:64") \
+        DRI_CONF_DESC("Run background driver work such as shader compilation on a shared pool of this many threads (0 = separate threads for each queue)") \
+DRI_CONF_OPT_END
+
 #define DRI_CONF_MESA_NO_ERROR(def) \
 DRI_CONF_OPT_BEGIN_B(mesa_no_error, def) \
         DRI_CONF_DESC("Disable GL driver error checking") \
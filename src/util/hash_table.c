@@ -33,9 +33,10 @@
  */
 
 /**
- * Implements an open-addressing, linear-reprobing hash table.
+ * Implements an open-addressing hash table with a control byte per entry,
+ * see hash_table_group.h.
  *
- * For more information, see:
+ * For more information about the original design, see:
  *
  * http://cgit.freedesktop.org/~anholt/hash_table/tree/README
  */
@@ -48,7 +49,7 @@
 #include "ralloc.h"
 #include "macros.h"
 #include "u_memory.h"
-#include "fast_urem_by_const.h"
+#include "hash_table_group.h"
 #include "util/u_memory.h"
 
 #define XXH_INLINE_ALL
@@ -75,74 +76,31 @@ uint_key(unsigned id)
 
 static const uint32_t deleted_key_value;
 
-/**
- * From Knuth -- a good choice for hash/rehash values is p, p-2 where
- * p and p-2 are both prime.  These tables are sized to have an extra 10%
- * free to avoid exponential performance degradation as the hash table fills
- */
-static const struct {
-   uint32_t max_entries, size, rehash;
-   uint64_t size_magic, rehash_magic;
-} hash_sizes[] = {
-#define ENTRY(max_entries, size, rehash) \
-   { max_entries, size, rehash, \
-      REMAINDER_MAGIC(size), REMAINDER_MAGIC(rehash) }
-
-   ENTRY(2,            5,            3            ),
-   ENTRY(4,            7,            5            ),
-   ENTRY(8,            13,           11           ),
-   ENTRY(16,           19,           17           ),
-   ENTRY(32,           43,           41           ),
-   ENTRY(64,           73,           71           ),
-   ENTRY(128,          151,          149          ),
-   ENTRY(256,          283,          281          ),
-   ENTRY(512,          571,          569          ),
-   ENTRY(1024,         1153,         1151         ),
-   ENTRY(2048,         2269,         2267         ),
-   ENTRY(4096,         4519,         4517         ),
-   ENTRY(8192,         9013,         9011         ),
-   ENTRY(16384,        18043,        18041        ),
-   ENTRY(32768,        36109,        36107        ),
-   ENTRY(65536,        72091,        72089        ),
-   ENTRY(131072,       144409,       144407       ),
-   ENTRY(262144,       288361,       288359       ),
-   ENTRY(524288,       576883,       576881       ),
-   ENTRY(1048576,      1153459,      1153457      ),
-   ENTRY(2097152,      2307163,      2307161      ),
-   ENTRY(4194304,      4613893,      4613891      ),
-   ENTRY(8388608,      9227641,      9227639      ),
-   ENTRY(16777216,     18455029,     18455027     ),
-   ENTRY(33554432,     36911011,     36911009     ),
-   ENTRY(67108864,     73819861,     73819859     ),
-   ENTRY(134217728,    147639589,    147639587    ),
-   ENTRY(268435456,    295279081,    295279079    ),
-   ENTRY(536870912,    590559793,    590559791    ),
-   ENTRY(1073741824,   1181116273,   1181116271   ),
-   ENTRY(2147483648ul, 2362232233ul, 2362232231ul )
-};
-
 ASSERTED static inline bool
 key_pointer_is_reserved(const struct hash_table *ht, const void *key)
 {
    return key == NULL || key == ht->deleted_key;
 }
 
-static int
-entry_is_free(const struct hash_entry *entry)
+/* Allocates the entries and the control bytes of a table together. */
+static struct hash_entry *
+hash_table_alloc_table(void *mem_ctx, uint32_t size, int8_t **ctrl)
 {
-   return entry->key == NULL;
-}
+   struct hash_entry *table =
+      ralloc_size(mem_ctx, size * sizeof(struct hash_entry) +
+                           ht_ctrl_size(size));
+   if (table == NULL)
+      return NULL;
 
-static int
-entry_is_deleted(const struct hash_table *ht, struct hash_entry *entry)
-{
-   return entry->key == ht->deleted_key;
+   *ctrl = (int8_t *)(table + size);
+   ht_ctrl_init(*ctrl, size);
+   return table;
 }
 
-static int
+static inline bool
 entry_is_present(const struct hash_table *ht, struct hash_entry *entry)
 {
-   return entry->key != NULL && entry->key != ht->deleted_key;
+   return ht_ctrl_is_present(ht->ctrl[entry - ht->table]);
 }
 
 bool
@@ -152,15 +110,11 @@ _mesa_hash_table_init(struct hash_table *ht,
                       bool (*key_equals_function)(const void *a,
                                                   const void *b))
 {
-   ht->size_index = 0;
-   ht->size = hash_sizes[ht->size_index].size;
-   ht->rehash = hash_sizes[ht->size_index].rehash;
-   ht->size_magic = hash_sizes[ht->size_index].size_magic;
-   ht->rehash_magic = hash_sizes[ht->size_index].rehash_magic;
-   ht->max_entries = hash_sizes[ht->size_index].max_entries;
+   ht->size = HT_MIN_SIZE;
+   ht->max_entries = ht_max_entries(ht->size);
    ht->key_hash_function = key_hash_function;
    ht->key_equals_function = key_equals_function;
-   ht->table = rzalloc_array(mem_ctx, struct hash_entry, ht->size);
+   ht->table = hash_table_alloc_table(mem_ctx, ht->size, &ht->ctrl);
    ht->entries = 0;
    ht->deleted_entries = 0;
    ht->deleted_key = &deleted_key_value;
@@ -202,13 +156,16 @@ _mesa_hash_table_clone(struct hash_table *src, void *dst_mem_ctx)
 
    memcpy(ht, src, sizeof(struct hash_table));
 
-   ht->table = ralloc_array(ht, struct hash_entry, ht->size);
+   ht->table = ralloc_size(ht, ht->size * sizeof(struct hash_entry) +
+                               ht_ctrl_size(ht->size));
    if (ht->table == NULL) {
       ralloc_free(ht);
       return NULL;
    }
 
-   memcpy(ht->table, src->table, ht->size * sizeof(struct hash_entry));
+   memcpy(ht->table, src->table, ht->size * sizeof(struct hash_entry) +
+                                 ht_ctrl_size(ht->size));
+   ht->ctrl = (int8_t *)(ht->table + ht->size);
 
    return ht;
 }
@@ -244,18 +201,13 @@ void
 _mesa_hash_table_clear(struct hash_table *ht,
                        void (*delete_function)(struct hash_entry *entry))
 {
-   struct hash_entry *entry;
-
-   for (entry = ht->table; entry != ht->table + ht->size; entry++) {
-      if (entry->key == NULL)
-         continue;
-
-      if (delete_function != NULL && entry->key != ht->deleted_key)
+   if (delete_function) {
+      hash_table_foreach(ht, entry) {
          delete_function(entry);
-
-      entry->key = NULL;
+      }
    }
 
+   ht_ctrl_init(ht->ctrl, ht->size);
    ht->entries = 0;
    ht->deleted_entries = 0;
 }
@@ -281,27 +233,26 @@ hash_table_search(struct hash_table *ht, uint32_t hash, const void *key)
 {
    assert(!key_pointer_is_reserved(ht, key));
 
-   uint32_t size = ht->size;
-   uint32_t start_hash_address = util_fast_urem32(hash, size, ht->size_magic);
-   uint32_t double_hash = 1 + util_fast_urem32(hash, ht->rehash,
-                                               ht->rehash_magic);
-   uint32_t hash_address = start_hash_address;
+   struct ht_probe probe = ht_probe_start(hash, ht->size);
+   int8_t ctrl = ht_ctrl_from_hash(hash);
 
    do {
-      struct hash_entry *entry = ht->table + hash_address;
+      uint32_t group = ht_probe_group(&probe);
+      const int8_t *group_ctrl = ht->ctrl + group;
 
-      if (entry_is_free(entry)) {
-         return NULL;
-      } else if (entry_is_present(ht, entry) && entry->hash == hash) {
-         if (ht->key_equals_function(key, entry->key)) {
+      for (ht_mask match = ht_group_match(group_ctrl, ctrl); match;
+           match &= match - 1) {
+         struct hash_entry *entry = ht->table + group + ht_mask_first(match);
+
+         if (entry->hash == hash && ht->key_equals_function(key, entry->key))
             return entry;
-         }
       }
 
-      hash_address += double_hash;
-      if (hash_address >= size)
-         hash_address -= size;
-   } while (hash_address != start_hash_address);
+      if (ht_group_match_empty(group_ctrl))
+         return NULL;
+
+      ht_probe_next(&probe);
+   } while (!ht_probe_done(&probe));
 
    return NULL;
 }
@@ -327,58 +278,51 @@ _mesa_hash_table_search_pre_hashed(struct hash_table *ht, uint32_t hash,
    return hash_table_search(ht, hash, key);
 }
 
-static struct hash_entry *
-hash_table_insert(struct hash_table *ht, uint32_t hash,
-                  const void *key, void *data);
-
 static void
 hash_table_insert_rehash(struct hash_table *ht, uint32_t hash,
                          const void *key, void *data)
 {
-   uint32_t size = ht->size;
-   uint32_t start_hash_address = util_fast_urem32(hash, size, ht->size_magic);
-   uint32_t double_hash = 1 + util_fast_urem32(hash, ht->rehash,
-                                               ht->rehash_magic);
-   uint32_t hash_address = start_hash_address;
-   do {
-      struct hash_entry *entry = ht->table + hash_address;
+   struct ht_probe probe = ht_probe_start(hash, ht->size);
+
+   while (true) {
+      uint32_t group = ht_probe_group(&probe);
+      ht_mask empty = ht_group_match_empty(ht->ctrl + group);
+
+      if (likely(empty)) {
+         uint32_t i = group + ht_mask_first(empty);
 
-      if (likely(entry->key == NULL)) {
-         entry->hash = hash;
-         entry->key = key;
-         entry->data = data;
+         ht->ctrl[i] = ht_ctrl_from_hash(hash);
+         ht->table[i].hash = hash;
+         ht->table[i].key = key;
+         ht->table[i].data = data;
          return;
       }
 
-      hash_address += double_hash;
-      if (hash_address >= size)
-         hash_address -= size;
-   } while (true);
+      ht_probe_next(&probe);
+   }
 }
 
 static void
-_mesa_hash_table_rehash(struct hash_table *ht, unsigned new_size_index)
+_mesa_hash_table_rehash(struct hash_table *ht, uint32_t new_size)
 {
    struct hash_table old_ht;
    struct hash_entry *table;
+   int8_t *ctrl;
 
-   if (new_size_index >= ARRAY_SIZE(hash_sizes))
+   /* Also catches the overflow of doubling the largest size. */
+   if (new_size < HT_MIN_SIZE)
       return;
 
-   table = rzalloc_array(ralloc_parent(ht->table), struct hash_entry,
-                         hash_sizes[new_size_index].size);
+   table = hash_table_alloc_table(ralloc_parent(ht->table), new_size, &ctrl);
    if (table == NULL)
       return;
 
    old_ht = *ht;
 
    ht->table = table;
-   ht->size_index = new_size_index;
-   ht->size = hash_sizes[ht->size_index].size;
-   ht->rehash = hash_sizes[ht->size_index].rehash;
-   ht->size_magic = hash_sizes[ht->size_index].size_magic;
-   ht->rehash_magic = hash_sizes[ht->size_index].rehash_magic;
-   ht->max_entries = hash_sizes[ht->size_index].max_entries;
+   ht->ctrl = ctrl;
+   ht->size = new_size;
+   ht->max_entries = ht_max_entries(new_size);
    ht->entries = 0;
    ht->deleted_entries = 0;
 
@@ -395,31 +339,22 @@ static struct hash_entry *
 hash_table_insert(struct hash_table *ht, uint32_t hash,
                   const void *key, void *data)
 {
-   struct hash_entry *available_entry = NULL;
+   uint32_t available = UINT32_MAX;
 
    assert(!key_pointer_is_reserved(ht, key));
 
    if (ht->entries >= ht->max_entries) {
-      _mesa_hash_table_rehash(ht, ht->size_index + 1);
+      _mesa_hash_table_rehash(ht, ht->size * 2);
    } else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
-      _mesa_hash_table_rehash(ht, ht->size_index);
+      _mesa_hash_table_rehash(ht, ht->size);
    }
 
-   uint32_t size = ht->size;
-   uint32_t start_hash_address = util_fast_urem32(hash, size, ht->size_magic);
-   uint32_t double_hash = 1 + util_fast_urem32(hash, ht->rehash,
-                                               ht->rehash_magic);
-   uint32_t hash_address = start_hash_address;
+   struct ht_probe probe = ht_probe_start(hash, ht->size);
+   int8_t ctrl = ht_ctrl_from_hash(hash);
+
    do {
-      struct hash_entry *entry = ht->table + hash_address;
-
-      if (!entry_is_present(ht, entry)) {
-         /* Stash the first available entry we find */
-         if (available_entry == NULL)
-            available_entry = entry;
-         if (entry_is_free(entry))
-            break;
-      }
+      uint32_t group = ht_probe_group(&probe);
+      const int8_t *group_ctrl = ht->ctrl + group;
 
       /* Implement replacement when another insert happens
        * with a matching key.  This is a relatively common
@@ -432,27 +367,41 @@ hash_table_insert(struct hash_table *ht, uint32_t hash,
        * required to avoid memory leaks, perform a search
        * before inserting.
        */
-      if (!entry_is_deleted(ht, entry) &&
-          entry->hash == hash &&
-          ht->key_equals_function(key, entry->key)) {
-         entry->key = key;
-         entry->data = data;
-         return entry;
+      for (ht_mask match = ht_group_match(group_ctrl, ctrl); match;
+           match &= match - 1) {
+         struct hash_entry *entry = ht->table + group + ht_mask_first(match);
+
+         if (entry->hash == hash && ht->key_equals_function(key, entry->key)) {
+            entry->key = key;
+            entry->data = data;
+            return entry;
+         }
       }
 
-      hash_address += double_hash;
-      if (hash_address >= size)
-         hash_address -= size;
-   } while (hash_address != start_hash_address);
+      /* Stash the first available entry we find */
+      if (available == UINT32_MAX) {
+         ht_mask unused = ht_group_match_empty_or_deleted(group_ctrl);
+         if (unused)
+            available = group + ht_mask_first(unused);
+      }
+
+      if (ht_group_match_empty(group_ctrl))
+         break;
+
+      ht_probe_next(&probe);
+   } while (!ht_probe_done(&probe));
+
+   if (available != UINT32_MAX) {
+      struct hash_entry *entry = ht->table + available;
 
-   if (available_entry) {
-      if (entry_is_deleted(ht, available_entry))
+      if (ht->ctrl[available] == HT_CTRL_DELETED)
          ht->deleted_entries--;
-      available_entry->hash = hash;
-      available_entry->key = key;
-      available_entry->data = data;
+      ht->ctrl[available] = ctrl;
+      entry->hash = hash;
+      entry->key = key;
+      entry->data = data;
       ht->entries++;
-      return available_entry;
+      return entry;
    }
 
    /* We could hit here if a required resize failed. An unchecked-malloc
@@ -495,6 +444,7 @@ _mesa_hash_table_remove(struct hash_table *ht,
    if (!entry)
       return;
 
+   ht->ctrl[entry - ht->table] = HT_CTRL_DELETED;
    entry->key = ht->deleted_key;
    ht->entries--;
    ht->deleted_entries++;
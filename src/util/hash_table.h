@@ -46,15 +46,12 @@ struct hash_entry {
 
 struct hash_table {
    struct hash_entry *table;
+   int8_t *ctrl; /* one byte per entry, see hash_table_group.h */
    uint32_t (*key_hash_function)(const void *key);
    bool (*key_equals_function)(const void *a, const void *b);
    const void *deleted_key;
    uint32_t size;
-   uint32_t rehash;
-   uint64_t size_magic;
-   uint64_t rehash_magic;
    uint32_t max_entries;
-   uint32_t size_index;
    uint32_t entries;
    uint32_t deleted_entries;
 };
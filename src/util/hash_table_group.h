@@ -0,0 +1,245 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Control bytes shared by hash_table.c and set.c.
+ *
+ * Besides the array of entries, a table has one control byte per entry.
+ * It's either HT_CTRL_EMPTY, HT_CTRL_DELETED, or 7 bits of the entry's hash
+ * if the entry is present.  Lookups compare the control bytes of a group of
+ * HT_GROUP_SIZE entries at once and only look at the entries whose control
+ * byte matches, which usually is just the one that's searched for.
+ *
+ * Tables smaller than a group have HT_CTRL_SENTINEL control bytes after the
+ * last entry, which never match anything.
+ */
+
+#ifndef HASH_TABLE_GROUP_H
+#define HASH_TABLE_GROUP_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "bitscan.h"
+#include "macros.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HT_GROUP_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HT_GROUP_NEON
+#endif
+
+#define HT_GROUP_SIZE 16
+
+/* Table sizes are powers of two, starting with this one. */
+#define HT_MIN_SIZE 4
+
+/* Signed, so that one compare finds the empty and deleted bytes. */
+#define HT_CTRL_EMPTY    ((int8_t)-128)
+#define HT_CTRL_DELETED  ((int8_t)-2)
+#define HT_CTRL_SENTINEL ((int8_t)-1)
+
+/* The largest number of entries a table of the given size may hold,
+ * including deleted ones, so that each probe sequence ends at an empty
+ * entry.
+ */
+static inline uint32_t
+ht_max_entries(uint32_t size)
+{
+   return size - MAX2(size / 8, 1);
+}
+
+/* Number of control bytes to allocate for a table of the given size. */
+static inline uint32_t
+ht_ctrl_size(uint32_t size)
+{
+   return MAX2(size, HT_GROUP_SIZE);
+}
+
+static inline void
+ht_ctrl_init(int8_t *ctrl, uint32_t size)
+{
+   memset(ctrl, HT_CTRL_EMPTY, size);
+   if (size < HT_GROUP_SIZE)
+      memset(ctrl + size, HT_CTRL_SENTINEL, HT_GROUP_SIZE - size);
+}
+
+/* The low bits select the group and the high bits are the control byte.
+ * Mix the hash first, because the pointer hash has neither well
+ * distributed low bits nor high bits that change much.
+ */
+static inline uint32_t
+ht_mix_hash(uint32_t hash)
+{
+   hash ^= hash >> 16;
+   hash *= 0x85ebca6bu;
+   hash ^= hash >> 13;
+   return hash;
+}
+
+static inline int8_t
+ht_ctrl_from_hash(uint32_t hash)
+{
+   return ht_mix_hash(hash) >> 25;
+}
+
+static inline bool
+ht_ctrl_is_present(int8_t ctrl)
+{
+   return ctrl >= 0;
+}
+
+/* A set of entries of a group, with HT_MASK_STRIDE bits per entry. */
+typedef uint64_t ht_mask;
+
+#ifdef HT_GROUP_NEON
+#define HT_MASK_STRIDE 4
+#else
+#define HT_MASK_STRIDE 1
+#endif
+
+/* The index in the group of the first entry in the mask, which must not be
+ * empty.  mask &= mask - 1 removes that entry from the mask.
+ */
+static inline unsigned
+ht_mask_first(ht_mask mask)
+{
+   return (ffsll(mask) - 1) / HT_MASK_STRIDE;
+}
+
+#if defined(HT_GROUP_SSE2)
+
+static inline ht_mask
+ht_group_match(const int8_t *group, int8_t ctrl)
+{
+   __m128i g = _mm_loadu_si128((const __m128i *)group);
+   return _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(ctrl)));
+}
+
+static inline ht_mask
+ht_group_match_empty_or_deleted(const int8_t *group)
+{
+   __m128i g = _mm_loadu_si128((const __m128i *)group);
+   return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(HT_CTRL_SENTINEL),
+                                           g));
+}
+
+#elif defined(HT_GROUP_NEON)
+
+/* NEON has no movemask.  Narrowing the compare result gives 4 bits per
+ * byte, of which one is kept.
+ */
+static inline ht_mask
+ht_neon_mask(uint8x16_t cmp)
+{
+   uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4);
+   return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) &
+          0x8888888888888888ull;
+}
+
+static inline ht_mask
+ht_group_match(const int8_t *group, int8_t ctrl)
+{
+   int8x16_t g = vld1q_s8(group);
+   return ht_neon_mask(vceqq_s8(g, vdupq_n_s8(ctrl)));
+}
+
+static inline ht_mask
+ht_group_match_empty_or_deleted(const int8_t *group)
+{
+   int8x16_t g = vld1q_s8(group);
+   return ht_neon_mask(vcltq_s8(g, vdupq_n_s8(HT_CTRL_SENTINEL)));
+}
+
+#else
+
+static inline ht_mask
+ht_group_match(const int8_t *group, int8_t ctrl)
+{
+   ht_mask mask = 0;
+   for (unsigned i = 0; i < HT_GROUP_SIZE; i++)
+      mask |= (ht_mask)(group[i] == ctrl) << i;
+   return mask;
+}
+
+static inline ht_mask
+ht_group_match_empty_or_deleted(const int8_t *group)
+{
+   ht_mask mask = 0;
+   for (unsigned i = 0; i < HT_GROUP_SIZE; i++)
+      mask |= (ht_mask)(group[i] < HT_CTRL_SENTINEL) << i;
+   return mask;
+}
+
+#endif
+
+static inline ht_mask
+ht_group_match_empty(const int8_t *group)
+{
+   return ht_group_match(group, HT_CTRL_EMPTY);
+}
+
+/* Groups are probed quadratically, which visits all of them because the
+ * number of groups is a power of two.
+ */
+struct ht_probe {
+   uint32_t group_mask;
+   uint32_t offset;
+   uint32_t step;
+};
+
+static inline struct ht_probe
+ht_probe_start(uint32_t hash, uint32_t size)
+{
+   struct ht_probe probe;
+
+   probe.group_mask = (ht_ctrl_size(size) / HT_GROUP_SIZE) - 1;
+   probe.offset = ht_mix_hash(hash) & probe.group_mask;
+   probe.step = 0;
+   return probe;
+}
+
+/* The index of the first entry of the current group. */
+static inline uint32_t
+ht_probe_group(const struct ht_probe *probe)
+{
+   return probe->offset * HT_GROUP_SIZE;
+}
+
+static inline void
+ht_probe_next(struct ht_probe *probe)
+{
+   probe->step++;
+   probe->offset = (probe->offset + probe->step) & probe->group_mask;
+}
+
+/* Whether all groups have been probed. */
+static inline bool
+ht_probe_done(const struct ht_probe *probe)
+{
+   return probe->step > probe->group_mask;
+}
+
+#endif /* HASH_TABLE_GROUP_H */
@@ -35,6 +35,7 @@ _CRTIMP int _vscprintf(const char *format, va_list argptr);
 #endif
 
 #include "ralloc.h"
+#include "simple_mtx.h"
 
 #ifndef va_copy
 #ifdef __va_copy
@@ -80,6 +81,9 @@ __declspec(align(16))
    struct ralloc_header *next;
 
    void (*destructor)(void *);
+
+   /* The arena the block was allocated out of, or NULL if it was malloc'd */
+   struct ralloc_arena *arena;
 };
 
 typedef struct ralloc_header ralloc_header;
@@ -87,6 +91,330 @@ typedef struct ralloc_header ralloc_header;
 static void unlink_block(ralloc_header *info);
 static void unsafe_free(ralloc_header *info);
 
+/***************************************************************************
+ * Arenas, see ralloc_arena_size().
+ ***************************************************************************
+ *
+ * Small blocks are carved out of the current chunk of the arena, and are
+ * put on a free list for their size when they are freed.  Large blocks get
+ * a chunk of their own instead, which is freed with the block.
+ *
+ * A block whose parent isn't in the same arena, e.g. the root of the arena
+ * or a block that was stolen by another context, holds a reference to the
+ * arena.  Once the last of them is freed, nothing can refer to any block of
+ * the arena anymore, so all chunks are freed at once.
+ *
+ * An arena made thread-safe with ralloc_arena_set_thread_safe() serializes
+ * all changes to its blocks with a lock, see get_lock_arena() and
+ * lock_arena().
+ */
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_MIN_CHUNK_SIZE 4096
+#define ARENA_MAX_CHUNK_SIZE (256 * 1024)
+#define ARENA_LARGE_SIZE 2048
+
+struct arena_chunk {
+   struct arena_chunk *prev;
+   struct arena_chunk *next;
+   size_t size; /* of the data, after the chunk header */
+};
+
+/* Precedes the ralloc_header of each block of an arena. */
+struct arena_block {
+   uint32_t size;  /* of the data, rounded up to ARENA_ALIGNMENT */
+   uint32_t large; /* whether the block has a chunk of its own */
+   struct arena_block *next_free;
+};
+
+#define ARENA_CHUNK_HEADER ALIGN_POT(sizeof(struct arena_chunk), ARENA_ALIGNMENT)
+#define ARENA_BLOCK_HEADER ALIGN_POT(sizeof(struct arena_block), ARENA_ALIGNMENT)
+
+struct ralloc_arena {
+   /* Number of blocks whose parent isn't in this arena. */
+   unsigned refs;
+
+   /* Whether freeing a block must visit its children, because some block
+    * has a destructor or a child that's not in this arena.  Otherwise the
+    * children can simply be forgotten when the whole arena goes away.
+    */
+   bool needs_walk;
+
+   struct arena_chunk *chunks;
+   char *cur, *end; /* unused space of the current chunk */
+   size_t chunk_size; /* of the next chunk */
+
+   struct arena_block *free_lists[ARENA_LARGE_SIZE / ARENA_ALIGNMENT + 1];
+
+   /* Taken by every change to the arena or to the links of its blocks while
+    * thread_safe is set.
+    */
+   bool thread_safe;
+   simple_mtx_t lock;
+};
+
+static struct arena_block *
+get_arena_block(const ralloc_header *info)
+{
+   return (struct arena_block *) ((char *) info - ARENA_BLOCK_HEADER);
+}
+
+#define HEADER_FROM_ARENA_BLOCK(block) \
+   ((ralloc_header *) ((char *) (block) + ARENA_BLOCK_HEADER))
+
+#define CHUNK_FROM_LARGE_BLOCK(block) \
+   ((struct arena_chunk *) ((char *) (block) - ARENA_CHUNK_HEADER))
+
+static struct arena_chunk *
+arena_add_chunk(struct ralloc_arena *arena, size_t size)
+{
+   struct arena_chunk *chunk = malloc(ARENA_CHUNK_HEADER + size);
+
+   if (unlikely(chunk == NULL))
+      return NULL;
+
+   chunk->prev = NULL;
+   chunk->next = arena->chunks;
+   chunk->size = size;
+   if (arena->chunks != NULL)
+      arena->chunks->prev = chunk;
+   arena->chunks = chunk;
+   return chunk;
+}
+
+static void
+arena_remove_chunk(struct ralloc_arena *arena, struct arena_chunk *chunk)
+{
+   if (chunk->prev != NULL)
+      chunk->prev->next = chunk->next;
+   else
+      arena->chunks = chunk->next;
+
+   if (chunk->next != NULL)
+      chunk->next->prev = chunk->prev;
+}
+
+/* Allocate a block for a ralloc_header and \p size bytes of data. */
+static ralloc_header *
+arena_alloc(struct ralloc_arena *arena, size_t size)
+{
+   struct arena_block *block;
+   size_t full_size;
+
+   size = ALIGN_POT(size, ARENA_ALIGNMENT);
+   full_size = ARENA_BLOCK_HEADER + sizeof(ralloc_header) + size;
+
+   if (unlikely(size > ARENA_LARGE_SIZE)) {
+      struct arena_chunk *chunk = arena_add_chunk(arena, full_size);
+
+      if (unlikely(chunk == NULL))
+         return NULL;
+
+      block = (struct arena_block *) ((char *) chunk + ARENA_CHUNK_HEADER);
+      block->size = 0;
+      block->large = true;
+      return HEADER_FROM_ARENA_BLOCK(block);
+   }
+
+   block = arena->free_lists[size / ARENA_ALIGNMENT];
+   if (block != NULL) {
+      arena->free_lists[size / ARENA_ALIGNMENT] = block->next_free;
+      return HEADER_FROM_ARENA_BLOCK(block);
+   }
+
+   if (unlikely((size_t) (arena->end - arena->cur) < full_size)) {
+      struct arena_chunk *chunk = arena_add_chunk(arena, arena->chunk_size);
+
+      if (unlikely(chunk == NULL))
+         return NULL;
+
+      /* The rest of the previous chunk is lost. */
+      arena->cur = (char *) chunk + ARENA_CHUNK_HEADER;
+      arena->end = arena->cur + arena->chunk_size;
+      arena->chunk_size = MIN2(arena->chunk_size * 2, ARENA_MAX_CHUNK_SIZE);
+   }
+
+   block = (struct arena_block *) arena->cur;
+   block->size = size;
+   block->large = false;
+   arena->cur += full_size;
+   return HEADER_FROM_ARENA_BLOCK(block);
+}
+
+/* Return the memory of a block to its arena. */
+static void
+arena_release(ralloc_header *info)
+{
+   struct ralloc_arena *arena = info->arena;
+   struct arena_block *block = get_arena_block(info);
+
+   if (block->large) {
+      struct arena_chunk *chunk = CHUNK_FROM_LARGE_BLOCK(block);
+
+      arena_remove_chunk(arena, chunk);
+      free(chunk);
+   } else {
+      block->next_free = arena->free_lists[block->size / ARENA_ALIGNMENT];
+      arena->free_lists[block->size / ARENA_ALIGNMENT] = block;
+   }
+}
+
+/* The number of bytes of data that a block of an arena can hold. */
+static size_t
+arena_block_size(const ralloc_header *info)
+{
+   struct arena_block *block = get_arena_block(info);
+
+   if (block->large) {
+      return CHUNK_FROM_LARGE_BLOCK(block)->size - ARENA_BLOCK_HEADER -
+             sizeof(ralloc_header);
+   }
+
+   return block->size;
+}
+
+static ralloc_header *
+arena_resize(ralloc_header *old, size_t size)
+{
+   struct ralloc_arena *arena = old->arena;
+   struct arena_block *block = get_arena_block(old);
+   ralloc_header *info;
+
+   if (block->large) {
+      struct arena_chunk *chunk = CHUNK_FROM_LARGE_BLOCK(block);
+      struct arena_chunk *new_chunk =
+         realloc(chunk, ARENA_CHUNK_HEADER + ARENA_BLOCK_HEADER +
+                        sizeof(ralloc_header) + size);
+
+      if (unlikely(new_chunk == NULL))
+         return NULL;
+
+      new_chunk->size = ARENA_BLOCK_HEADER + sizeof(ralloc_header) + size;
+
+      /* Update the neighbours of the moved chunk. */
+      if (new_chunk->prev != NULL)
+         new_chunk->prev->next = new_chunk;
+      else
+         arena->chunks = new_chunk;
+      if (new_chunk->next != NULL)
+         new_chunk->next->prev = new_chunk;
+
+      return HEADER_FROM_ARENA_BLOCK((char *) new_chunk + ARENA_CHUNK_HEADER);
+   }
+
+   if (size <= block->size)
+      return old;
+
+   /* The last block of the current chunk, e.g. a growing string, can grow
+    * in place.
+    */
+   if (size <= ARENA_LARGE_SIZE &&
+       (char *) &old[1] + block->size == arena->cur &&
+       ALIGN_POT(size, ARENA_ALIGNMENT) - block->size <=
+       (size_t) (arena->end - arena->cur)) {
+      arena->cur += ALIGN_POT(size, ARENA_ALIGNMENT) - block->size;
+      block->size = ALIGN_POT(size, ARENA_ALIGNMENT);
+      return old;
+   }
+
+   info = arena_alloc(arena, size);
+   if (unlikely(info == NULL))
+      return NULL;
+
+   memcpy(info, old, sizeof(ralloc_header) + block->size);
+   arena_release(old);
+   return info;
+}
+
+static void
+arena_destroy(struct ralloc_arena *arena)
+{
+   assert(!arena->thread_safe);
+   simple_mtx_destroy(&arena->lock);
+
+   while (arena->chunks != NULL) {
+      struct arena_chunk *chunk = arena->chunks;
+
+      arena->chunks = chunk->next;
+      free(chunk);
+   }
+   free(arena);
+}
+
+/* Whether the block holds a reference to its arena. */
+static bool
+is_arena_ref(const ralloc_header *info)
+{
+   return info->arena != NULL &&
+          (info->parent == NULL || info->parent->arena != info->arena);
+}
+
+/* Free a block of an arena, but not its children. */
+static void
+arena_free(ralloc_header *info)
+{
+   struct ralloc_arena *arena = info->arena;
+   bool is_ref = is_arena_ref(info);
+
+   arena_release(info);
+
+   if (is_ref && --arena->refs == 0)
+      arena_destroy(arena);
+}
+
+/* Update the arena bookkeeping for a block that moves from \p old_parent to
+ * \p new_parent, either of which may be NULL.
+ */
+static void
+reparent_arena(ralloc_header *info, ralloc_header *old_parent,
+               ralloc_header *new_parent)
+{
+   struct ralloc_arena *arena = info->arena;
+
+   if (arena != NULL) {
+      if (old_parent != NULL && old_parent->arena == arena)
+         arena->refs++;
+      if (new_parent != NULL && new_parent->arena == arena)
+         arena->refs--;
+   }
+
+   if (new_parent != NULL && new_parent->arena != NULL &&
+       new_parent->arena != arena)
+      new_parent->arena->needs_walk = true;
+}
+
+/* The arena whose lock protects the links of \p info: its own arena, or
+ * the arena of its parent if it was malloc'd.
+ */
+static struct ralloc_arena *
+get_lock_arena(const ralloc_header *info)
+{
+   if (info->arena != NULL)
+      return info->arena;
+
+   return info->parent != NULL ? info->parent->arena : NULL;
+}
+
+/* Lock \p arena if it's thread-safe.  Returns the arena to pass to
+ * unlock_arena().
+ */
+static struct ralloc_arena *
+lock_arena(struct ralloc_arena *arena)
+{
+   if (arena == NULL || likely(!arena->thread_safe))
+      return NULL;
+
+   simple_mtx_lock(&arena->lock);
+   return arena;
+}
+
+static void
+unlock_arena(struct ralloc_arena *locked)
+{
+   if (locked != NULL)
+      simple_mtx_unlock(&locked->lock);
+}
+
 static ralloc_header *
 get_header(const void *ptr)
 {
@@ -102,6 +430,7 @@ static void
 add_child(ralloc_header *parent, ralloc_header *info)
 {
    if (parent != NULL) {
+      reparent_arena(info, NULL, parent);
       info->parent = parent;
       info->next = parent->child;
       parent->child = info;
@@ -117,17 +446,22 @@ ralloc_context(const void *ctx)
    return ralloc_size(ctx, 0);
 }
 
-void *
-ralloc_size(const void *ctx, size_t size)
+static void *
+alloc_block(ralloc_header *parent, struct ralloc_arena *arena, size_t size)
 {
-   void *block = malloc(size + sizeof(ralloc_header));
+   struct ralloc_arena *locked = lock_arena(parent ? parent->arena : NULL);
    ralloc_header *info;
-   ralloc_header *parent;
 
-   if (unlikely(block == NULL))
+   if (arena != NULL)
+      info = arena_alloc(arena, size);
+   else
+      info = malloc(size + sizeof(ralloc_header));
+
+   if (unlikely(info == NULL)) {
+      unlock_arena(locked);
       return NULL;
+   }
 
-   info = (ralloc_header *) block;
    /* measurements have shown that calloc is slower (because of
     * the multiplication overflow checking?), so clear things
     * manually
@@ -137,8 +471,11 @@ ralloc_size(const void *ctx, size_t size)
    info->prev = NULL;
    info->next = NULL;
    info->destructor = NULL;
+   info->arena = arena;
 
-   parent = ctx != NULL ? get_header(ctx) : NULL;
+   /* The block holds a reference until it gets a parent in the arena. */
+   if (arena != NULL)
+      arena->refs++;
 
    add_child(parent, info);
 
@@ -146,9 +483,66 @@ ralloc_size(const void *ctx, size_t size)
    info->canary = CANARY;
 #endif
 
+   unlock_arena(locked);
+
    return PTR_FROM_HEADER(info);
 }
 
+void *
+ralloc_size(const void *ctx, size_t size)
+{
+   ralloc_header *parent = ctx != NULL ? get_header(ctx) : NULL;
+
+   return alloc_block(parent, parent ? parent->arena : NULL, size);
+}
+
+void *
+ralloc_arena_size(const void *ctx, size_t size)
+{
+   struct ralloc_arena *arena = calloc(1, sizeof(*arena));
+   void *ptr;
+
+   if (unlikely(arena == NULL))
+      return NULL;
+
+   arena->chunk_size = ARENA_MIN_CHUNK_SIZE;
+   simple_mtx_init(&arena->lock, mtx_plain);
+
+   ptr = alloc_block(ctx != NULL ? get_header(ctx) : NULL, arena, size);
+   if (unlikely(ptr == NULL)) {
+      simple_mtx_destroy(&arena->lock);
+      free(arena);
+   }
+
+   return ptr;
+}
+
+void *
+rzalloc_arena_size(const void *ctx, size_t size)
+{
+   void *ptr = ralloc_arena_size(ctx, size);
+
+   if (likely(ptr))
+      memset(ptr, 0, size);
+
+   return ptr;
+}
+
+void *
+ralloc_arena_context(const void *ctx)
+{
+   return ralloc_arena_size(ctx, 0);
+}
+
+void
+ralloc_arena_set_thread_safe(const void *ctx, bool thread_safe)
+{
+   struct ralloc_arena *arena = get_header(ctx)->arena;
+
+   assert(arena != NULL);
+   arena->thread_safe = thread_safe;
+}
+
 void *
 rzalloc_size(const void *ctx, size_t size)
 {
@@ -165,12 +559,20 @@ static void *
 resize(void *ptr, size_t size)
 {
    ralloc_header *child, *old, *info;
+   struct ralloc_arena *locked;
 
    old = get_header(ptr);
-   info = realloc(old, size + sizeof(ralloc_header));
+   locked = lock_arena(get_lock_arena(old));
+
+   if (old->arena != NULL)
+      info = arena_resize(old, size);
+   else
+      info = realloc(old, size + sizeof(ralloc_header));
 
-   if (info == NULL)
+   if (info == NULL) {
+      unlock_arena(locked);
       return NULL;
+   }
 
    /* Update parent and sibling's links to the reallocated node. */
    if (info != old && info->parent != NULL) {
@@ -188,6 +590,8 @@ resize(void *ptr, size_t size)
    for (child = info->child; child != NULL; child = child->next)
       child->parent = info;
 
+   unlock_arena(locked);
+
    return PTR_FROM_HEADER(info);
 }
 
@@ -257,13 +661,16 @@ void
 ralloc_free(void *ptr)
 {
    ralloc_header *info;
+   struct ralloc_arena *locked;
 
    if (ptr == NULL)
       return;
 
    info = get_header(ptr);
+   locked = lock_arena(get_lock_arena(info));
    unlink_block(info);
    unsafe_free(info);
+   unlock_arena(locked);
 }
 
 static void
@@ -271,6 +678,8 @@ unlink_block(ralloc_header *info)
 {
    /* Unlink from parent & siblings */
    if (info->parent != NULL) {
+      reparent_arena(info, info->parent, NULL);
+
       if (info->parent->child == info)
 	 info->parent->child = info->next;
 
@@ -290,6 +699,18 @@ unsafe_free(ralloc_header *info)
 {
    /* Recursively free any children...don't waste time unlinking them. */
    ralloc_header *temp;
+
+   /* When this frees the last reference to the arena, all of its chunks
+    * go at once.  Unless something in the arena needs it, don't even visit
+    * the children then.  Any other subtree is walked to put its blocks back
+    * on the free lists, e.g. everything nir_sweep() throws away.
+    */
+   if (info->arena != NULL && !info->arena->needs_walk &&
+       is_arena_ref(info) && info->arena->refs == 1) {
+      arena_free(info);
+      return;
+   }
+
    while (info->child != NULL) {
       temp = info->child;
       info->child = temp->next;
@@ -300,13 +721,17 @@ unsafe_free(ralloc_header *info)
    if (info->destructor != NULL)
       info->destructor(PTR_FROM_HEADER(info));
 
-   free(info);
+   if (info->arena != NULL)
+      arena_free(info);
+   else
+      free(info);
 }
 
 void
 ralloc_steal(const void *new_ctx, void *ptr)
 {
    ralloc_header *info, *parent;
+   struct ralloc_arena *locked;
 
    if (unlikely(ptr == NULL))
       return;
@@ -314,15 +739,71 @@ ralloc_steal(const void *new_ctx, void *ptr)
    info = get_header(ptr);
    parent = new_ctx ? get_header(new_ctx) : NULL;
 
+   locked = lock_arena(get_lock_arena(info));
+
    unlink_block(info);
 
    add_child(parent, info);
+
+   unlock_arena(locked);
+}
+
+void *
+ralloc_steal_copy(const void *new_ctx, void *ptr)
+{
+   ralloc_header *info, *parent, *copy, *child;
+   struct ralloc_arena *arena, *locked;
+   size_t size;
+
+   if (unlikely(ptr == NULL))
+      return NULL;
+
+   info = get_header(ptr);
+   parent = new_ctx ? get_header(new_ctx) : NULL;
+   arena = info->arena;
+
+   if (arena == NULL || (parent != NULL && parent->arena == arena)) {
+      ralloc_steal(new_ctx, ptr);
+      return ptr;
+   }
+
+   locked = lock_arena(arena);
+
+   size = arena_block_size(info);
+   copy = malloc(sizeof(ralloc_header) + size);
+   if (unlikely(copy == NULL)) {
+      unlock_arena(locked);
+      return NULL;
+   }
+
+   unlink_block(info);
+   memcpy(copy, info, sizeof(ralloc_header) + size);
+   copy->arena = NULL;
+
+   /* The children stay where they are, and those in the arena now hold a
+    * reference to it.
+    */
+   for (child = copy->child; child != NULL; child = child->next) {
+      child->parent = copy;
+      if (child->arena == arena)
+         arena->refs++;
+   }
+
+   add_child(parent, copy);
+
+   /* This drops the reference the block held after unlink_block(). */
+   arena_free(info);
+
+   unlock_arena(locked);
+
+   return PTR_FROM_HEADER(copy);
 }
 
 void
 ralloc_adopt(const void *new_ctx, void *old_ctx)
 {
    ralloc_header *new_info, *old_info, *child;
+   struct ralloc_arena *locked;
 
    if (unlikely(old_ctx == NULL))
       return;
@@ -330,14 +811,20 @@ ralloc_adopt(const void *new_ctx, void *old_ctx)
    old_info = get_header(old_ctx);
    new_info = get_header(new_ctx);
 
+   locked = lock_arena(old_info->arena ? old_info->arena : new_info->arena);
+
    /* If there are no children, bail. */
-   if (unlikely(old_info->child == NULL))
+   if (unlikely(old_info->child == NULL)) {
+      unlock_arena(locked);
       return;
+   }
 
    /* Set all the children's parent to new_ctx; get a pointer to the last child. */
    for (child = old_info->child; child->next != NULL; child = child->next) {
+      reparent_arena(child, old_info, new_info);
       child->parent = new_info;
    }
+   reparent_arena(child, old_info, new_info);
    child->parent = new_info;
 
    /* Connect the two lists together; parent them to new_ctx; make old_ctx empty. */
@@ -346,6 +833,8 @@ ralloc_adopt(const void *new_ctx, void *old_ctx)
       child->next->prev = child;
    new_info->child = old_info->child;
    old_info->child = NULL;
+
+   unlock_arena(locked);
 }
 
 void *
@@ -365,6 +854,9 @@ ralloc_set_destructor(const void *ptr, void(*destructor)(void *))
 {
    ralloc_header *info = get_header(ptr);
    info->destructor = destructor;
+
+   if (destructor != NULL && info->arena != NULL)
+      info->arena->needs_walk = true;
 }
 
 char *
@@ -107,6 +107,69 @@ void *ralloc_size(const void *ctx, size_t size) MALLOCLIKE;
  */
 void *rzalloc_size(const void *ctx, size_t size) MALLOCLIKE;
 
+/**
+ * \def rzalloc_arena(ctx, type)
+ * Allocate a new zero-initialized object that's the root of an arena.
+ *
+ * This is equivalent to:
+ * \code
+ * ((type *) rzalloc_arena_size(ctx, sizeof(type))
+ * \endcode
+ */
+#define rzalloc_arena(ctx, type) ((type *) rzalloc_arena_size(ctx, sizeof(type)))
+
+/**
+ * Allocate memory chained off of the given context that's the root of a new
+ * arena.
+ *
+ * Everything allocated out of the returned pointer or its descendants is
+ * carved out of large chunks instead of being malloc'd separately.  It can
+ * be used like any other ralloc memory, including freeing, stealing and
+ * destructors, but freed memory is only returned to the system once all of
+ * the arena's memory has been freed.  In exchange, freeing the arena is
+ * nearly free when none of its memory has a destructor or children from
+ * outside of the arena, because the tree doesn't need to be walked.
+ *
+ * This is meant for the root of large, long-lived trees of small objects,
+ * such as shaders.
+ */
+void *ralloc_arena_size(const void *ctx, size_t size) MALLOCLIKE;
+
+/**
+ * Allocate zero-initialized memory that's the root of a new arena.
+ *
+ * \sa ralloc_arena_size
+ */
+void *rzalloc_arena_size(const void *ctx, size_t size) MALLOCLIKE;
+
+/**
+ * Allocate a new ralloc context that's the root of a new arena.
+ *
+ * \sa ralloc_arena_size
+ */
+void *ralloc_arena_context(const void *ctx);
+
+/**
+ * Make the arena that \p ctx was allocated out of safe to use from several
+ * threads at the same time, or stop doing so.
+ *
+ * While it's set, allocating, resizing, freeing, stealing and adopting
+ * blocks of the arena or blocks whose parent is in the arena take a lock of
+ * the arena.  Different threads can then work on different parts of the
+ * same tree at once, e.g. on different functions of a shader.
+ *
+ * Without it, nothing is locked, so a block of the arena must not be freed
+ * or stolen by one thread while another thread uses the arena, e.g. when
+ * it was stolen by a context that another thread owns.
+ *
+ * Nothing else becomes thread-safe: two threads still must not use the same
+ * block at the same time, blocks must not be moved between the arena and
+ * other contexts that another thread is using, destructors of blocks of the
+ * arena must not call ralloc, and the arena must not be freed while it's
+ * thread-safe.
+ */
+void ralloc_arena_set_thread_safe(const void *ctx, bool thread_safe);
+
 /**
  * Resize a piece of ralloc-managed memory, preserving data.
  *
@@ -285,6 +348,9 @@ void *rerzalloc_array_size(const void *ctx, void *ptr, size_t size,
  * Free a piece of ralloc-managed memory.
  *
  * This will also free the memory of any children allocated this context.
+ *
+ * Freeing a block of an arena isn't locked unless the arena is thread-safe,
+ * see ralloc_arena_set_thread_safe().
  */
 void ralloc_free(void *ptr);
 
@@ -293,9 +359,25 @@ void ralloc_free(void *ptr);
  *
  * This changes \p ptr's context to \p new_ctx.  This is quite useful if
  * memory is allocated out of a temporary context.
+ *
+ * If \p ptr was allocated out of an arena that \p new_ctx isn't in, it
+ * stays in the arena, and keeps all of the arena's chunks alive until it's
+ * freed, however small it is.  Use ralloc_steal_copy() to avoid that.
  */
 void ralloc_steal(const void *new_ctx, void *ptr);
 
+/**
+ * Steal memory like ralloc_steal(), but copy it out of its arena first.
+ *
+ * If \p ptr was allocated out of an arena that \p new_ctx isn't in, it's
+ * moved to memory of its own, so that it doesn't keep the arena's chunks
+ * alive.  Its children are not moved, so those in the arena still do.
+ *
+ * \return The new location of \p ptr, which must not be used anymore, or
+ *         NULL if allocation failed, in which case \p ptr is unchanged.
+ */
+void *ralloc_steal_copy(const void *new_ctx, void *ptr);
+
 /**
  * Reparent all children from one context to another.
  *
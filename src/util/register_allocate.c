@@ -125,8 +125,6 @@ struct ra_node {
     * List of which nodes this node interferes with.  This should be
     * symmetric with the other node.
     */
-   BITSET_WORD *adjacency;
-
    struct util_dynarray adjacency_list;
    /** @} */
 
@@ -169,6 +167,13 @@ struct ra_graph {
 
    unsigned int alloc; /**< count of nodes allocated. */
 
+   /**
+    * Bit-set indicating, for each pair of nodes, if they interfere.  It's a
+    * triangular matrix, see ra_get_adjacency_bit_index(), so that it only
+    * has to be extended when nodes are added.
+    */
+   BITSET_WORD *adjacency;
+
    ra_select_reg_callback select_reg_callback;
    void *select_reg_callback_data;
 
@@ -183,9 +188,18 @@ struct ra_graph {
       /** Bit-set indicating, for each register, if it pre-assigned */
       BITSET_WORD *reg_assigned;
 
-      /** Bit-set indicating, for each register, the value of the pq test */
+      /**
+       * Bit-set indicating, for each register not yet in the stack or
+       * assigned, if it passes the pq test.
+       */
       BITSET_WORD *pq_test;
 
+      /**
+       * Bit-set of the BITSET_WORDs of pq_test that may be non-zero.  Bits
+       * are only cleared when ra_simplify() finds the word to be zero.
+       */
+      BITSET_WORD *pq_test_words;
+
       /** For each BITSET_WORD, the minimum q value or ~0 if unknown */
       unsigned int *min_q_total;
 
@@ -195,6 +209,14 @@ struct ra_graph {
        */
       unsigned int *min_q_node;
 
+      /**
+       * For each block of BITSET_WORDBITS BITSET_WORDs, the word with the
+       * minimum q value, or NO_NODE if none of the words has any nodes left.
+       * Only valid if the block's bit in min_q_block_dirty isn't set.
+       */
+      unsigned int *min_q_block;
+      BITSET_WORD *min_q_block_dirty;
+
       /**
        * Tracks the start of the set of optimistically-colored registers in the
        * stack.
@@ -203,6 +225,8 @@ struct ra_graph {
    } tmp;
 };
 
+#define NO_NODE ~0U
+
 /**
  * Creates a set of registers for the allocator.
  *
@@ -484,11 +508,24 @@ ra_set_deserialize(void *mem_ctx, struct blob_reader *blob)
    return regs;
 }
 
+static uint64_t
+ra_get_adjacency_bit_index(unsigned int n1, unsigned int n2)
+{
+   assert(n1 != n2);
+   uint64_t k1 = MAX2(n1, n2);
+   uint64_t k2 = MIN2(n1, n2);
+   return (k1 * (k1 - 1)) / 2 + k2;
+}
+
+static bool
+ra_node_interferes(struct ra_graph *g, unsigned int n1, unsigned int n2)
+{
+   return BITSET_TEST(g->adjacency, ra_get_adjacency_bit_index(n1, n2));
+}
+
 static void
 ra_add_node_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
 {
-   BITSET_SET(g->nodes[n1].adjacency, n2);
-
    assert(n1 != n2);
 
    int n1_class = g->nodes[n1].class;
@@ -501,7 +538,7 @@ ra_add_node_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
 static void
 ra_node_remove_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
 {
-   BITSET_CLEAR(g->nodes[n1].adjacency, n2);
+   BITSET_CLEAR(g->adjacency, ra_get_adjacency_bit_index(n1, n2));
 
    assert(n1 != n2);
 
@@ -527,19 +564,18 @@ ra_realloc_interference_graph(struct ra_graph *g, unsigned int alloc)
 
    g->nodes = reralloc(g, g->nodes, struct ra_node, alloc);
 
-   unsigned g_bitset_count = BITSET_WORDS(g->alloc);
-   unsigned bitset_count = BITSET_WORDS(alloc);
-   /* For nodes already in the graph, we just have to grow the adjacency set */
-   for (unsigned i = 0; i < g->alloc; i++) {
-      assert(g->nodes[i].adjacency != NULL);
-      g->nodes[i].adjacency = rerzalloc(g, g->nodes[i].adjacency, BITSET_WORD,
-                                        g_bitset_count, bitset_count);
-   }
+   /* The adjacency bits of the existing nodes stay where they are, so only
+    * the bits of the new ones have to be added.
+    */
+   size_t g_adjacency_count = BITSET_WORDS((uint64_t)g->alloc *
+                                           (g->alloc - 1) / 2);
+   size_t adjacency_count = BITSET_WORDS((uint64_t)alloc * (alloc - 1) / 2);
+   g->adjacency = rerzalloc(g, g->adjacency, BITSET_WORD,
+                            g_adjacency_count, adjacency_count);
 
    /* For new nodes, we have to fully initialize them */
    for (unsigned i = g->alloc; i < alloc; i++) {
       memset(&g->nodes[i], 0, sizeof(g->nodes[i]));
-      g->nodes[i].adjacency = rzalloc_array(g, BITSET_WORD, bitset_count);
       util_dynarray_init(&g->nodes[i].adjacency_list, g);
       g->nodes[i].q_total = 0;
 
@@ -550,16 +586,24 @@ ra_realloc_interference_graph(struct ra_graph *g, unsigned int alloc)
    /* These are scratch values and don't need to be zeroed.  We'll clear them
     * as part of ra_select() setup.
     */
+   unsigned bitset_count = BITSET_WORDS(alloc);
    g->tmp.stack = reralloc(g, g->tmp.stack, unsigned int, alloc);
    g->tmp.in_stack = reralloc(g, g->tmp.in_stack, BITSET_WORD, bitset_count);
 
    g->tmp.reg_assigned = reralloc(g, g->tmp.reg_assigned, BITSET_WORD,
                                   bitset_count);
    g->tmp.pq_test = reralloc(g, g->tmp.pq_test, BITSET_WORD, bitset_count);
+   g->tmp.pq_test_words = reralloc(g, g->tmp.pq_test_words, BITSET_WORD,
+                                   BITSET_WORDS(bitset_count));
    g->tmp.min_q_total = reralloc(g, g->tmp.min_q_total, unsigned int,
                                  bitset_count);
    g->tmp.min_q_node = reralloc(g, g->tmp.min_q_node, unsigned int,
                                 bitset_count);
+   g->tmp.min_q_block = reralloc(g, g->tmp.min_q_block, unsigned int,
+                                 BITSET_WORDS(bitset_count));
+   g->tmp.min_q_block_dirty = reralloc(g, g->tmp.min_q_block_dirty,
+                                       BITSET_WORD,
+                                       BITSET_WORDS(BITSET_WORDS(bitset_count)));
 
    g->alloc = alloc;
 }
@@ -582,7 +626,7 @@ ra_resize_interference_graph(struct ra_graph *g, unsigned int count)
 {
    g->count = count;
    if (count > g->alloc)
-      ra_realloc_interference_graph(g, g->alloc * 2);
+      ra_realloc_interference_graph(g, MAX2(count, g->alloc * 2));
 }
 
 void ra_set_select_reg_callback(struct ra_graph *g,
@@ -623,7 +667,8 @@ ra_add_node_interference(struct ra_graph *g,
                          unsigned int n1, unsigned int n2)
 {
    assert(n1 < g->count && n2 < g->count);
-   if (n1 != n2 && !BITSET_TEST(g->nodes[n1].adjacency, n2)) {
+   if (n1 != n2 && !ra_node_interferes(g, n1, n2)) {
+      BITSET_SET(g->adjacency, ra_get_adjacency_bit_index(n1, n2));
       ra_add_node_adjacency(g, n1, n2);
       ra_add_node_adjacency(g, n2, n1);
    }
@@ -636,30 +681,127 @@ ra_reset_node_interference(struct ra_graph *g, unsigned int n)
       ra_node_remove_adjacency(g, *n2p, n);
    }
 
-   memset(g->nodes[n].adjacency, 0,
-          BITSET_WORDS(g->count) * sizeof(BITSET_WORD));
    util_dynarray_clear(&g->nodes[n].adjacency_list);
+   g->nodes[n].q_total = 0;
+}
+
+/**
+ * Writes the interference graph, including the node classes, forced
+ * registers and spill costs, but not the register set or the register
+ * selection callback.  Used to replay the allocation of real shaders in
+ * benchmarks.
+ */
+void
+ra_graph_serialize(const struct ra_graph *g, struct blob *blob)
+{
+   blob_write_uint32(blob, g->count);
+
+   for (unsigned int n = 0; n < g->count; n++) {
+      blob_write_uint32(blob, g->nodes[n].class);
+      blob_write_uint32(blob, g->nodes[n].forced_reg);
+      blob_write_uint32(blob, fui(g->nodes[n].spill_cost));
+   }
+
+   /* Each interference is only written for the higher of the two nodes. */
+   for (unsigned int n = 0; n < g->count; n++) {
+      const struct util_dynarray *adj = &g->nodes[n].adjacency_list;
+      unsigned int num_lower = 0;
+
+      util_dynarray_foreach(adj, unsigned int, n2p) {
+         if (*n2p < n)
+            num_lower++;
+      }
+
+      blob_write_uint32(blob, num_lower);
+      util_dynarray_foreach(adj, unsigned int, n2p) {
+         if (*n2p < n)
+            blob_write_uint32(blob, *n2p);
+      }
+   }
+}
+
+/**
+ * Reads a graph written by ra_graph_serialize() for the given register set.
+ * Returns NULL if the data is truncated or malformed.
+ */
+struct ra_graph *
+ra_graph_deserialize(struct ra_regs *regs, struct blob_reader *blob)
+{
+   unsigned int count = blob_read_uint32(blob);
+   if (blob->overrun)
+      return NULL;
+
+   struct ra_graph *g = ra_alloc_interference_graph(regs, count);
+
+   for (unsigned int n = 0; n < count && !blob->overrun; n++) {
+      g->nodes[n].class = blob_read_uint32(blob);
+      g->nodes[n].forced_reg = blob_read_uint32(blob);
+      g->nodes[n].spill_cost = uif(blob_read_uint32(blob));
+
+      if (g->nodes[n].class >= regs->class_count ||
+          (g->nodes[n].forced_reg != NO_REG &&
+           g->nodes[n].forced_reg >= regs->count))
+         blob->overrun = true;
+   }
+
+   for (unsigned int n = 0; n < count && !blob->overrun; n++) {
+      unsigned int num_lower = blob_read_uint32(blob);
+
+      for (unsigned int i = 0; i < num_lower && !blob->overrun; i++) {
+         unsigned int n2 = blob_read_uint32(blob);
+         if (n2 >= n)
+            blob->overrun = true;
+         else
+            ra_add_node_interference(g, n, n2);
+      }
+   }
+
+   if (blob->overrun) {
+      ralloc_free(g);
+      return NULL;
+   }
+
+   return g;
+}
+
+/* Whether node n with the given q value is a better candidate for optimistic
+ * coloring than the one of the given BITSET_WORD.  In order to remain
+ * consistent with the old naive implementation of the algorithm, we do a
+ * lexicographical sort to ensure that we always choose the node with the
+ * highest node index.
+ */
+static bool
+is_min_q_node(struct ra_graph *g, unsigned int q, unsigned int n,
+              unsigned int word)
+{
+   return q < g->tmp.min_q_total[word] ||
+          (q == g->tmp.min_q_total[word] && n > g->tmp.min_q_node[word]);
 }
 
 static void
 update_pq_info(struct ra_graph *g, unsigned int n)
 {
    int i = n / BITSET_WORDBITS;
+   int b = i / BITSET_WORDBITS;
    int n_class = g->nodes[n].class;
-   if (g->nodes[n].tmp.q_total < g->regs->classes[n_class]->p) {
+   unsigned int q = g->nodes[n].tmp.q_total;
+
+   if (q < g->regs->classes[n_class]->p) {
       BITSET_SET(g->tmp.pq_test, n);
+      BITSET_SET(g->tmp.pq_test_words, i);
    } else if (g->tmp.min_q_total[i] != UINT_MAX) {
       /* Only update min_q_total and min_q_node if min_q_total != UINT_MAX so
        * that we don't update while we have stale data and accidentally mark
-       * it as non-stale.  Also, in order to remain consistent with the old
-       * naive implementation of the algorithm, we do a lexicographical sort
-       * to ensure that we always choose the node with the highest node index.
+       * it as non-stale.  The same goes for the block.
        */
-      if (g->nodes[n].tmp.q_total < g->tmp.min_q_total[i] ||
-          (g->nodes[n].tmp.q_total == g->tmp.min_q_total[i] &&
-           n > g->tmp.min_q_node[i])) {
-         g->tmp.min_q_total[i] = g->nodes[n].tmp.q_total;
+      if (is_min_q_node(g, q, n, i)) {
+         g->tmp.min_q_total[i] = q;
          g->tmp.min_q_node[i] = n;
+
+         if (!BITSET_TEST(g->tmp.min_q_block_dirty, b) &&
+             (g->tmp.min_q_block[b] == NO_NODE ||
+              is_min_q_node(g, q, n, g->tmp.min_q_block[b])))
+            g->tmp.min_q_block[b] = i;
       }
    }
 }
@@ -679,16 +821,118 @@ add_node_to_stack(struct ra_graph *g, unsigned int n)
           !BITSET_TEST(g->tmp.reg_assigned, n2)) {
          assert(g->nodes[n2].tmp.q_total >= g->regs->classes[n2_class]->q[n_class]);
          g->nodes[n2].tmp.q_total -= g->regs->classes[n2_class]->q[n_class];
-         update_pq_info(g, n2);
+         if (!BITSET_TEST(g->tmp.pq_test, n2))
+            update_pq_info(g, n2);
       }
    }
 
    g->tmp.stack[g->tmp.stack_count] = n;
    g->tmp.stack_count++;
    BITSET_SET(g->tmp.in_stack, n);
+   BITSET_CLEAR(g->tmp.pq_test, n);
 
    /* Flag the min_q_total for n's block as dirty so it gets recalculated */
    g->tmp.min_q_total[n / BITSET_WORDBITS] = UINT_MAX;
+   BITSET_SET(g->tmp.min_q_block_dirty, n / BITSET_WORDBITS / BITSET_WORDBITS);
+}
+
+/**
+ * Returns the highest word of pq_test at or below the given one that is not
+ * zero, or -1 if there isn't any.
+ */
+static int
+find_last_pq_test_word(struct ra_graph *g, int i)
+{
+   if (i < 0)
+      return -1;
+
+   for (int w = i / BITSET_WORDBITS; w >= 0; w--) {
+      BITSET_WORD words = g->tmp.pq_test_words[w];
+
+      if (w == i / BITSET_WORDBITS)
+         words &= ~(BITSET_WORD)0 >> (BITSET_WORDBITS - 1 - i % BITSET_WORDBITS);
+
+      while (words) {
+         int j = util_last_bit(words) - 1;
+         int word = w * BITSET_WORDBITS + j;
+
+         if (g->tmp.pq_test[word])
+            return word;
+
+         g->tmp.pq_test_words[w] &= ~BITSET_BIT(j);
+         words &= ~BITSET_BIT(j);
+      }
+   }
+
+   return -1;
+}
+
+static void
+update_min_q_word(struct ra_graph *g, unsigned int i)
+{
+   unsigned int first = i * BITSET_WORDBITS;
+   unsigned int last = MIN2(first + BITSET_WORDBITS, g->count) - 1;
+   BITSET_WORD skip = g->tmp.in_stack[i] | g->tmp.reg_assigned[i];
+
+   if (skip == ~(BITSET_WORD)0 >> (BITSET_WORDBITS - 1 - (last - first)))
+      return;
+
+   for (int n = last; n >= (int)first; n--) {
+      if (skip & BITSET_BIT(n))
+         continue;
+
+      if (g->nodes[n].tmp.q_total < g->tmp.min_q_total[i]) {
+         g->tmp.min_q_total[i] = g->nodes[n].tmp.q_total;
+         g->tmp.min_q_node[i] = n;
+      }
+   }
+}
+
+/**
+ * Returns the node not yet in the stack or assigned with the lowest q_total,
+ * or the highest-numbered of them if there are several, or NO_NODE.
+ *
+ * Only the words and blocks of words that had nodes added to the stack since
+ * the last call are looked at again.
+ */
+static unsigned int
+find_min_q_node(struct ra_graph *g)
+{
+   unsigned int num_words = BITSET_WORDS(g->count);
+   unsigned int min_q_word = NO_NODE;
+
+   for (int b = BITSET_WORDS(num_words) - 1; b >= 0; b--) {
+      if (BITSET_TEST(g->tmp.min_q_block_dirty, b)) {
+         unsigned int first = b * BITSET_WORDBITS;
+         unsigned int last = MIN2(first + BITSET_WORDBITS, num_words) - 1;
+
+         g->tmp.min_q_block[b] = NO_NODE;
+         for (int i = last; i >= (int)first; i--) {
+            /* The min_q_total and min_q_node are dirty because we added
+             * one of these nodes to the stack.  It needs to be
+             * recalculated.
+             */
+            if (g->tmp.min_q_total[i] == UINT_MAX)
+               update_min_q_word(g, i);
+
+            if (g->tmp.min_q_total[i] != UINT_MAX &&
+                (g->tmp.min_q_block[b] == NO_NODE ||
+                 g->tmp.min_q_total[i] <
+                 g->tmp.min_q_total[g->tmp.min_q_block[b]]))
+               g->tmp.min_q_block[b] = i;
+         }
+
+         BITSET_CLEAR(g->tmp.min_q_block_dirty, b);
+      }
+
+      unsigned int i = g->tmp.min_q_block[b];
+      if (i != NO_NODE &&
+          (min_q_word == NO_NODE ||
+           g->tmp.min_q_total[i] < g->tmp.min_q_total[min_q_word]))
+         min_q_word = i;
+   }
+
+   return min_q_word == NO_NODE ? NO_NODE : g->tmp.min_q_node[min_q_word];
 }
 
 /**
@@ -700,97 +944,68 @@ add_node_to_stack(struct ra_graph *g, unsigned int n)
  * we optimistically choose a node and push it on the stack. We heuristically
  * push the node with the lowest total q value, since it has the fewest
  * neighbors and therefore is most likely to be allocated.
+ *
+ * The trivially-colorable nodes are in the pq_test bit-set, whose zero words
+ * are skipped with pq_test_words.  For the other nodes, the minimum q value
+ * is cached for each BITSET_WORD and for each block of those, so that large
+ * graphs don't have to be walked all over for each node pushed on the stack.
  */
 static void
 ra_simplify(struct ra_graph *g)
 {
    bool progress = true;
    unsigned int stack_optimistic_start = UINT_MAX;
-
-   /* Figure out the high bit and bit mask for the first iteration of a loop
-    * over BITSET_WORDs.
-    */
-   const unsigned int top_word_high_bit = (g->count - 1) % BITSET_WORDBITS;
+   unsigned int num_words = BITSET_WORDS(g->count);
 
    /* Do a quick pre-pass to set things up */
    g->tmp.stack_count = 0;
-   for (int i = BITSET_WORDS(g->count) - 1, high_bit = top_word_high_bit;
-        i >= 0; i--, high_bit = BITSET_WORDBITS - 1) {
-      g->tmp.in_stack[i] = 0;
-      g->tmp.reg_assigned[i] = 0;
-      g->tmp.pq_test[i] = 0;
-      g->tmp.min_q_total[i] = UINT_MAX;
-      g->tmp.min_q_node[i] = UINT_MAX;
-      for (int j = high_bit; j >= 0; j--) {
-         unsigned int n = i * BITSET_WORDBITS + j;
-         g->nodes[n].reg = g->nodes[n].forced_reg;
-         g->nodes[n].tmp.q_total = g->nodes[n].q_total;
-         if (g->nodes[n].reg != NO_REG)
-            g->tmp.reg_assigned[i] |= BITSET_BIT(j);
+   memset(g->tmp.in_stack, 0, num_words * sizeof(BITSET_WORD));
+   memset(g->tmp.reg_assigned, 0, num_words * sizeof(BITSET_WORD));
+   memset(g->tmp.pq_test, 0, num_words * sizeof(BITSET_WORD));
+   memset(g->tmp.pq_test_words, 0,
+          BITSET_WORDS(num_words) * sizeof(BITSET_WORD));
+   memset(g->tmp.min_q_total, 0xff, num_words * sizeof(unsigned int));
+   memset(g->tmp.min_q_block_dirty, 0xff,
+          BITSET_WORDS(BITSET_WORDS(num_words)) * sizeof(BITSET_WORD));
+
+   for (unsigned int n = 0; n < g->count; n++) {
+      g->nodes[n].reg = g->nodes[n].forced_reg;
+      g->nodes[n].tmp.q_total = g->nodes[n].q_total;
+      if (g->nodes[n].reg != NO_REG)
+         BITSET_SET(g->tmp.reg_assigned, n);
+      else
          update_pq_info(g, n);
-      }
    }
 
    while (progress) {
-      unsigned int min_q_total = UINT_MAX;
-      unsigned int min_q_node = UINT_MAX;
-
       progress = false;
 
-      for (int i = BITSET_WORDS(g->count) - 1, high_bit = top_word_high_bit;
-           i >= 0; i--, high_bit = BITSET_WORDBITS - 1) {
-         BITSET_WORD mask = ~(BITSET_WORD)0 >> (31 - high_bit);
-
-         BITSET_WORD skip = g->tmp.in_stack[i] | g->tmp.reg_assigned[i];
-         if (skip == mask)
-            continue;
-
-         BITSET_WORD pq = g->tmp.pq_test[i] & ~skip;
-         if (pq) {
-            /* In this case, we have stuff we can immediately take off the
-             * stack.  This also means that we're guaranteed to make progress
-             * and we don't need to bother updating lowest_q_total because we
-             * know we're going to loop again before attempting to do anything
-             * optimistic.
+      /* In each sweep, nodes are taken off the graph from the highest one
+       * down.  Nodes below the current one that become trivially colorable
+       * are taken in the same sweep, the others in the next one.
+       */
+      for (int i = find_last_pq_test_word(g, num_words - 1);
+           i >= 0; i = find_last_pq_test_word(g, i - 1)) {
+         BITSET_WORD pq = g->tmp.pq_test[i];
+
+         while (pq) {
+            int j = util_last_bit(pq) - 1;
+            unsigned int n = i * BITSET_WORDBITS + j;
+            assert(n < g->count);
+            add_node_to_stack(g, n);
+            /* add_node_to_stack() may update pq_test for this word so
+             * we need to update our local copy.
              */
-            for (int j = high_bit; j >= 0; j--) {
-               if (pq & BITSET_BIT(j)) {
-                  unsigned int n = i * BITSET_WORDBITS + j;
-                  assert(n < g->count);
-                  add_node_to_stack(g, n);
-                  /* add_node_to_stack() may update pq_test for this word so
-                   * we need to update our local copy.
-                   */
-                  pq = g->tmp.pq_test[i] & ~skip;
-                  progress = true;
-               }
-            }
-         } else if (!progress) {
-            if (g->tmp.min_q_total[i] == UINT_MAX) {
-               /* The min_q_total and min_q_node are dirty because we added
-                * one of these nodes to the stack.  It needs to be
-                * recalculated.
-                */
-               for (int j = high_bit; j >= 0; j--) {
-                  if (skip & BITSET_BIT(j))
-                     continue;
-
-                  unsigned int n = i * BITSET_WORDBITS + j;
-                  assert(n < g->count);
-                  if (g->nodes[n].tmp.q_total < g->tmp.min_q_total[i]) {
-                     g->tmp.min_q_total[i] = g->nodes[n].tmp.q_total;
-                     g->tmp.min_q_node[i] = n;
-                  }
-               }
-            }
-            if (g->tmp.min_q_total[i] < min_q_total) {
-               min_q_node = g->tmp.min_q_node[i];
-               min_q_total = g->tmp.min_q_total[i];
-            }
+            pq = g->tmp.pq_test[i] & (BITSET_BIT(j) - 1);
+            progress = true;
          }
       }
 
-      if (!progress && min_q_total != UINT_MAX) {
+      if (!progress) {
+         unsigned int min_q_node = find_min_q_node(g);
+         if (min_q_node == NO_NODE)
+            break;
+
          if (stack_optimistic_start == UINT_MAX)
             stack_optimistic_start = g->tmp.stack_count;
 
@@ -802,17 +1017,40 @@ ra_simplify(struct ra_graph *g)
    g->tmp.stack_optimistic_start = stack_optimistic_start;
 }
 
-static bool
-ra_any_neighbors_conflict(struct ra_graph *g, unsigned int n, unsigned int r)
+/* Computes a bitfield of the registers assigned to the neighbors of n that
+ * are not in the stack, and returns the range of words that aren't zero.
+ */
+static void
+ra_compute_neighbor_regs(struct ra_graph *g, unsigned int n,
+                         BITSET_WORD *used, int *first_word, int *last_word)
 {
+   memset(used, 0, BITSET_WORDS(g->regs->count) * sizeof(BITSET_WORD));
+   *first_word = INT_MAX;
+   *last_word = -1;
+
    util_dynarray_foreach(&g->nodes[n].adjacency_list, unsigned int, n2p) {
       unsigned int n2 = *n2p;
 
-      if (!BITSET_TEST(g->tmp.in_stack, n2) &&
-          BITSET_TEST(g->regs->regs[r].conflicts, g->nodes[n2].reg)) {
-         return true;
+      if (!BITSET_TEST(g->tmp.in_stack, n2)) {
+         unsigned int r = g->nodes[n2].reg;
+         BITSET_SET(used, r);
+         *first_word = MIN2(*first_word, (int)BITSET_BITWORD(r));
+         *last_word = MAX2(*last_word, (int)BITSET_BITWORD(r));
       }
    }
+}
+
+static bool
+ra_any_neighbors_conflict(struct ra_graph *g, unsigned int r,
+                          const BITSET_WORD *used,
+                          int first_word, int last_word)
+{
+   const BITSET_WORD *conflicts = g->regs->regs[r].conflicts;
+
+   for (int i = first_word; i <= last_word; i++) {
+      if (conflicts[i] & used[i])
+         return true;
+   }
 
    return false;
 }
@@ -824,9 +1062,11 @@ ra_any_neighbors_conflict(struct ra_graph *g, unsigned int n, unsigned int r)
  * or round robin policies (which don't require knowing the whole bitset)
  */
 static bool
-ra_compute_available_regs(struct ra_graph *g, unsigned int n, BITSET_WORD *regs)
+ra_compute_available_regs(struct ra_graph *g, unsigned int n,
+                          const BITSET_WORD *used, BITSET_WORD *regs)
 {
    struct ra_class *c = g->regs->classes[g->nodes[n].class];
+   unsigned int r;
 
    /* Populate with the set of regs that are in the node's class. */
    memcpy(regs, c->regs, BITSET_WORDS(g->regs->count) * sizeof(BITSET_WORD));
@@ -834,14 +1074,9 @@ ra_compute_available_regs(struct ra_graph *g, unsigned int n, BITSET_WORD *regs)
    /* Remove any regs that conflict with nodes that we're adjacent to and have
     * already colored.
     */
-   util_dynarray_foreach(&g->nodes[n].adjacency_list, unsigned int, n2p) {
-      unsigned int n2 = *n2p;
-      unsigned int r = g->nodes[n2].reg;
-
-      if (!BITSET_TEST(g->tmp.in_stack, n2)) {
-         for (int j = 0; j < BITSET_WORDS(g->regs->count); j++)
-            regs[j] &= ~g->regs->regs[r].conflicts[j];
-      }
+   BITSET_FOREACH_SET(r, used, g->regs->count) {
+      for (int j = 0; j < BITSET_WORDS(g->regs->count); j++)
+         regs[j] &= ~g->regs->regs[r].conflicts[j];
    }
 
    for (int i = 0; i < BITSET_WORDS(g->regs->count); i++) {
@@ -863,25 +1098,31 @@ static bool
 ra_select(struct ra_graph *g)
 {
    int start_search_reg = 0;
+   unsigned int reg_count = g->regs->count;
+   BITSET_WORD *used = malloc(BITSET_WORDS(reg_count) * sizeof(BITSET_WORD));
    BITSET_WORD *select_regs = NULL;
 
    if (g->select_reg_callback)
-      select_regs = malloc(BITSET_WORDS(g->regs->count) * sizeof(BITSET_WORD));
+      select_regs = malloc(BITSET_WORDS(reg_count) * sizeof(BITSET_WORD));
 
    while (g->tmp.stack_count != 0) {
       unsigned int ri;
       unsigned int r = -1;
       int n = g->tmp.stack[g->tmp.stack_count - 1];
       struct ra_class *c = g->regs->classes[g->nodes[n].class];
+      int first_word, last_word;
 
       /* set this to false even if we return here so that
        * ra_get_best_spill_node() considers this node later.
        */
       BITSET_CLEAR(g->tmp.in_stack, n);
 
+      ra_compute_neighbor_regs(g, n, used, &first_word, &last_word);
+
       if (g->select_reg_callback) {
-         if (!ra_compute_available_regs(g, n, select_regs)) {
+         if (!ra_compute_available_regs(g, n, used, select_regs)) {
             free(select_regs);
+            free(used);
             return false;
          }
 
@@ -891,17 +1132,29 @@ ra_select(struct ra_graph *g)
          /* Find the lowest-numbered reg which is not used by a member
           * of the graph adjacent to us.
           */
-         for (ri = 0; ri < g->regs->count; ri++) {
-            r = (start_search_reg + ri) % g->regs->count;
-            if (!reg_belongs_to_class(r, c))
+         for (ri = 0; ri < reg_count; ri++) {
+            r = (start_search_reg + ri) % reg_count;
+
+            /* Skip to the next register of the class. */
+            BITSET_WORD bits = c->regs[BITSET_BITWORD(r)] >> (r % BITSET_WORDBITS);
+            if (!bits) {
+               ri += MIN2(BITSET_WORDBITS - r % BITSET_WORDBITS,
+                          reg_count - r) - 1;
                continue;
+            }
+            ri += ffs(bits) - 1;
+            r += ffs(bits) - 1;
+            if (ri >= reg_count)
+               break;
 
-            if (!ra_any_neighbors_conflict(g, n, r))
+            if (!ra_any_neighbors_conflict(g, r, used, first_word, last_word))
                break;
          }
 
-         if (ri >= g->regs->count)
+         if (ri >= reg_count) {
+            free(used);
             return false;
+         }
       }
 
       g->nodes[n].reg = r;
@@ -922,6 +1175,7 @@ ra_select(struct ra_graph *g)
    }
 
    free(select_regs);
+   free(used);
 
    return true;
 }
@@ -961,25 +1215,17 @@ ra_set_node_reg(struct ra_graph *g, unsigned int n, unsigned int reg)
    g->nodes[n].forced_reg = reg;
 }
 
+/* Define the benefit of eliminating an interference between n, n2 through
+ * spilling as q(C, B) / p(C).  This is similar to the "count number of edges"
+ * approach of traditional graph coloring, but takes classes into account.
+ * Summed over the neighbors of n, that's just the q total of n over p(C).
+ */
 static float
 ra_get_spill_benefit(struct ra_graph *g, unsigned int n)
 {
-   float benefit = 0;
    int n_class = g->nodes[n].class;
 
-   /* Define the benefit of eliminating an interference between n, n2
-    * through spilling as q(C, B) / p(C).  This is similar to the
-    * "count number of edges" approach of traditional graph coloring,
-    * but takes classes into account.
-    */
-   util_dynarray_foreach(&g->nodes[n].adjacency_list, unsigned int, n2p) {
-      unsigned int n2 = *n2p;
-      unsigned int n2_class = g->nodes[n2].class;
-      benefit += ((float)g->regs->classes[n_class]->q[n2_class] /
-                  g->regs->classes[n_class]->p);
-   }
-
-   return benefit;
+   return (float)g->nodes[n].q_total / g->regs->classes[n_class]->p;
 }
 
 /**
@@ -40,80 +40,36 @@
 #include "macros.h"
 #include "ralloc.h"
 #include "set.h"
-#include "fast_urem_by_const.h"
-
-/*
- * From Knuth -- a good choice for hash/rehash values is p, p-2 where
- * p and p-2 are both prime.  These tables are sized to have an extra 10%
- * free to avoid exponential performance degradation as the hash table fills
- */
+#include "hash_table_group.h"
 
 static const uint32_t deleted_key_value;
 static const void *deleted_key = &deleted_key_value;
 
-static const struct {
-   uint32_t max_entries, size, rehash;
-   uint64_t size_magic, rehash_magic;
-} hash_sizes[] = {
-#define ENTRY(max_entries, size, rehash) \
-   { max_entries, size, rehash, \
-      REMAINDER_MAGIC(size), REMAINDER_MAGIC(rehash) }
-
-   ENTRY(2,            5,            3            ),
-   ENTRY(4,            7,            5            ),
-   ENTRY(8,            13,           11           ),
-   ENTRY(16,           19,           17           ),
-   ENTRY(32,           43,           41           ),
-   ENTRY(64,           73,           71           ),
-   ENTRY(128,          151,          149          ),
-   ENTRY(256,          283,          281          ),
-   ENTRY(512,          571,          569          ),
-   ENTRY(1024,         1153,         1151         ),
-   ENTRY(2048,         2269,         2267         ),
-   ENTRY(4096,         4519,         4517         ),
-   ENTRY(8192,         9013,         9011         ),
-   ENTRY(16384,        18043,        18041        ),
-   ENTRY(32768,        36109,        36107        ),
-   ENTRY(65536,        72091,        72089        ),
-   ENTRY(131072,       144409,       144407       ),
-   ENTRY(262144,       288361,       288359       ),
-   ENTRY(524288,       576883,       576881       ),
-   ENTRY(1048576,      1153459,      1153457      ),
-   ENTRY(2097152,      2307163,      2307161      ),
-   ENTRY(4194304,      4613893,      4613891      ),
-   ENTRY(8388608,      9227641,      9227639      ),
-   ENTRY(16777216,     18455029,     18455027     ),
-   ENTRY(33554432,     36911011,     36911009     ),
-   ENTRY(67108864,     73819861,     73819859     ),
-   ENTRY(134217728,    147639589,    147639587    ),
-   ENTRY(268435456,    295279081,    295279079    ),
-   ENTRY(536870912,    590559793,    590559791    ),
-   ENTRY(1073741824,   1181116273,   1181116271   ),
-   ENTRY(2147483648ul, 2362232233ul, 2362232231ul )
-};
-
 ASSERTED static inline bool
 key_pointer_is_reserved(const void *key)
 {
    return key == NULL || key == deleted_key;
 }
 
-static int
-entry_is_free(struct set_entry *entry)
+/* Allocates the entries and the control bytes of a set together. */
+static struct set_entry *
+set_alloc_table(void *mem_ctx, uint32_t size, int8_t **ctrl)
 {
-   return entry->key == NULL;
-}
+   struct set_entry *table =
+      ralloc_size(mem_ctx, size * sizeof(struct set_entry) +
+                           ht_ctrl_size(size));
+   if (table == NULL)
+      return NULL;
 
-static int
-entry_is_deleted(struct set_entry *entry)
-{
-   return entry->key == deleted_key;
+   *ctrl = (int8_t *)(table + size);
+   ht_ctrl_init(*ctrl, size);
+   return table;
 }
 
-static int
-entry_is_present(struct set_entry *entry)
+static inline bool
+entry_is_present(const struct set *ht, struct set_entry *entry)
 {
-   return entry->key != NULL && entry->key != deleted_key;
+   return ht_ctrl_is_present(ht->ctrl[entry - ht->table]);
 }
 
 struct set *
@@ -128,15 +84,11 @@ _mesa_set_create(void *mem_ctx,
    if (ht == NULL)
       return NULL;
 
-   ht->size_index = 0;
-   ht->size = hash_sizes[ht->size_index].size;
-   ht->rehash = hash_sizes[ht->size_index].rehash;
-   ht->size_magic = hash_sizes[ht->size_index].size_magic;
-   ht->rehash_magic = hash_sizes[ht->size_index].rehash_magic;
-   ht->max_entries = hash_sizes[ht->size_index].max_entries;
+   ht->size = HT_MIN_SIZE;
+   ht->max_entries = ht_max_entries(ht->size);
    ht->key_hash_function = key_hash_function;
    ht->key_equals_function = key_equals_function;
-   ht->table = rzalloc_array(ht, struct set_entry, ht->size);
+   ht->table = set_alloc_table(ht, ht->size, &ht->ctrl);
    ht->entries = 0;
    ht->deleted_entries = 0;
 
@@ -159,13 +111,16 @@ _mesa_set_clone(struct set *set, void *dst_mem_ctx)
 
    memcpy(clone, set, sizeof(struct set));
 
-   clone->table = ralloc_array(clone, struct set_entry, clone->size);
+   clone->table = ralloc_size(clone, clone->size * sizeof(struct set_entry) +
+                                     ht_ctrl_size(clone->size));
    if (clone->table == NULL) {
       ralloc_free(clone);
       return NULL;
    }
 
-   memcpy(clone->table, set->table, clone->size * sizeof(struct set_entry));
+   memcpy(clone->table, set->table, clone->size * sizeof(struct set_entry) +
+                                    ht_ctrl_size(clone->size));
+   clone->ctrl = (int8_t *)(clone->table + clone->size);
 
    return clone;
 }
@@ -203,15 +158,13 @@ _mesa_set_clear(struct set *set, void (*delete_function)(struct set_entry *entry
    if (!set)
       return;
 
-   struct set_entry *entry;
-
-   for (entry = set->table; entry != set->table + set->size; entry++) {
-      if (entry_is_present(entry) && delete_function != NULL)
+   if (delete_function) {
+      set_foreach (set, entry) {
          delete_function(entry);
-
-      entry->key = NULL;
+      }
    }
 
+   ht_ctrl_init(set->ctrl, set->size);
    set->entries = 0;
    set->deleted_entries = 0;
 }
@@ -226,26 +179,26 @@ set_search(const struct set *ht, uint32_t hash, const void *key)
 {
    assert(!key_pointer_is_reserved(key));
 
-   uint32_t size = ht->size;
-   uint32_t start_address = util_fast_urem32(hash, size, ht->size_magic);
-   uint32_t double_hash = util_fast_urem32(hash, ht->rehash,
-                                           ht->rehash_magic) + 1;
-   uint32_t hash_address = start_address;
+   struct ht_probe probe = ht_probe_start(hash, ht->size);
+   int8_t ctrl = ht_ctrl_from_hash(hash);
+
    do {
-      struct set_entry *entry = ht->table + hash_address;
+      uint32_t group = ht_probe_group(&probe);
+      const int8_t *group_ctrl = ht->ctrl + group;
 
-      if (entry_is_free(entry)) {
-         return NULL;
-      } else if (entry_is_present(entry) && entry->hash == hash) {
-         if (ht->key_equals_function(key, entry->key)) {
+      for (ht_mask match = ht_group_match(group_ctrl, ctrl); match;
+           match &= match - 1) {
+         struct set_entry *entry = ht->table + group + ht_mask_first(match);
+
+         if (entry->hash == hash && ht->key_equals_function(key, entry->key))
             return entry;
-         }
       }
 
-      hash_address += double_hash;
-      if (hash_address >= size)
-         hash_address -= size;
-   } while (hash_address != start_address);
+      if (ht_group_match_empty(group_ctrl))
+         return NULL;
+
+      ht_probe_next(&probe);
+   } while (!ht_probe_done(&probe));
 
    return NULL;
 }
@@ -269,48 +222,46 @@ _mesa_set_search_pre_hashed(const struct set *set, uint32_t hash,
 static void
 set_add_rehash(struct set *ht, uint32_t hash, const void *key)
 {
-   uint32_t size = ht->size;
-   uint32_t start_address = util_fast_urem32(hash, size, ht->size_magic);
-   uint32_t double_hash = util_fast_urem32(hash, ht->rehash,
-                                           ht->rehash_magic) + 1;
-   uint32_t hash_address = start_address;
-   do {
-      struct set_entry *entry = ht->table + hash_address;
-      if (likely(entry->key == NULL)) {
-         entry->hash = hash;
-         entry->key = key;
+   struct ht_probe probe = ht_probe_start(hash, ht->size);
+
+   while (true) {
+      uint32_t group = ht_probe_group(&probe);
+      ht_mask empty = ht_group_match_empty(ht->ctrl + group);
+
+      if (likely(empty)) {
+         uint32_t i = group + ht_mask_first(empty);
+
+         ht->ctrl[i] = ht_ctrl_from_hash(hash);
+         ht->table[i].hash = hash;
+         ht->table[i].key = key;
          return;
       }
 
-      hash_address = hash_address + double_hash;
-      if (hash_address >= size)
-         hash_address -= size;
-   } while (true);
+      ht_probe_next(&probe);
+   }
 }
 
 static void
-set_rehash(struct set *ht, unsigned new_size_index)
+set_rehash(struct set *ht, uint32_t new_size)
 {
    struct set old_ht;
    struct set_entry *table;
+   int8_t *ctrl;
 
-   if (new_size_index >= ARRAY_SIZE(hash_sizes))
+   /* Also catches the overflow of doubling the largest size. */
+   if (new_size < HT_MIN_SIZE)
       return;
 
-   table = rzalloc_array(ht, struct set_entry,
-                         hash_sizes[new_size_index].size);
+   table = set_alloc_table(ht, new_size, &ctrl);
    if (table == NULL)
       return;
 
    old_ht = *ht;
 
    ht->table = table;
-   ht->size_index = new_size_index;
-   ht->size = hash_sizes[ht->size_index].size;
-   ht->rehash = hash_sizes[ht->size_index].rehash;
-   ht->size_magic = hash_sizes[ht->size_index].size_magic;
-   ht->rehash_magic = hash_sizes[ht->size_index].rehash_magic;
-   ht->max_entries = hash_sizes[ht->size_index].max_entries;
+   ht->ctrl = ctrl;
+   ht->size = new_size;
+   ht->max_entries = ht_max_entries(new_size);
    ht->entries = 0;
    ht->deleted_entries = 0;
 
@@ -330,11 +281,11 @@ _mesa_set_resize(struct set *set, uint32_t entries)
    if (set->entries > entries)
       entries = set->entries;
 
-   unsigned size_index = 0;
-   while (hash_sizes[size_index].max_entries < entries)
-      size_index++;
+   uint32_t size = HT_MIN_SIZE;
+   while (ht_max_entries(size) < entries && size < (1u << 31))
+      size *= 2;
 
-   set_rehash(set, size_index);
+   set_rehash(set, size);
 }
 
 /**
@@ -347,55 +298,60 @@ _mesa_set_resize(struct set *set, uint32_t entries)
 static struct set_entry *
 set_search_or_add(struct set *ht, uint32_t hash, const void *key, bool *found)
 {
-   struct set_entry *available_entry = NULL;
+   uint32_t available = UINT32_MAX;
 
    assert(!key_pointer_is_reserved(key));
 
    if (ht->entries >= ht->max_entries) {
-      set_rehash(ht, ht->size_index + 1);
+      set_rehash(ht, ht->size * 2);
    } else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
-      set_rehash(ht, ht->size_index);
+      set_rehash(ht, ht->size);
    }
 
-   uint32_t size = ht->size;
-   uint32_t start_address = util_fast_urem32(hash, size, ht->size_magic);
-   uint32_t double_hash = util_fast_urem32(hash, ht->rehash,
-                                           ht->rehash_magic) + 1;
-   uint32_t hash_address = start_address;
+   struct ht_probe probe = ht_probe_start(hash, ht->size);
+   int8_t ctrl = ht_ctrl_from_hash(hash);
+
    do {
-      struct set_entry *entry = ht->table + hash_address;
-
-      if (!entry_is_present(entry)) {
-         /* Stash the first available entry we find */
-         if (available_entry == NULL)
-            available_entry = entry;
-         if (entry_is_free(entry))
-            break;
+      uint32_t group = ht_probe_group(&probe);
+      const int8_t *group_ctrl = ht->ctrl + group;
+
+      for (ht_mask match = ht_group_match(group_ctrl, ctrl); match;
+           match &= match - 1) {
+         struct set_entry *entry = ht->table + group + ht_mask_first(match);
+
+         if (entry->hash == hash && ht->key_equals_function(key, entry->key)) {
+            if (found)
+               *found = true;
+            return entry;
+         }
       }
 
-      if (!entry_is_deleted(entry) &&
-          entry->hash == hash &&
-          ht->key_equals_function(key, entry->key)) {
-         if (found)
-            *found = true;
-         return entry;
+      /* Stash the first available entry we find */
+      if (available == UINT32_MAX) {
+         ht_mask unused = ht_group_match_empty_or_deleted(group_ctrl);
+         if (unused)
+            available = group + ht_mask_first(unused);
       }
 
-      hash_address = hash_address + double_hash;
-      if (hash_address >= size)
-         hash_address -= size;
-   } while (hash_address != start_address);
+      if (ht_group_match_empty(group_ctrl))
+         break;
 
-   if (available_entry) {
+      ht_probe_next(&probe);
+   } while (!ht_probe_done(&probe));
+
+   if (available != UINT32_MAX) {
       /* There is no matching entry, create it. */
-      if (entry_is_deleted(available_entry))
+      struct set_entry *entry = ht->table + available;
+
+      if (ht->ctrl[available] == HT_CTRL_DELETED)
          ht->deleted_entries--;
-      available_entry->hash = hash;
-      available_entry->key = key;
+      ht->ctrl[available] = ctrl;
+      entry->hash = hash;
+      entry->key = key;
       ht->entries++;
       if (found)
          *found = false;
-      return available_entry;
+      return entry;
    }
 
    /* We could hit here if a required resize failed. An unchecked-malloc
@@ -501,6 +457,7 @@ _mesa_set_remove(struct set *ht, struct set_entry *entry)
    if (!entry)
       return;
 
+   ht->ctrl[entry - ht->table] = HT_CTRL_DELETED;
    entry->key = deleted_key;
    ht->entries--;
    ht->deleted_entries++;
@@ -530,7 +487,7 @@ _mesa_set_next_entry(const struct set *ht, struct set_entry *entry)
       entry = entry + 1;
 
    for (; entry != ht->table + ht->size; entry++) {
-      if (entry_is_present(entry)) {
+      if (entry_is_present(ht, entry)) {
          return entry;
       }
    }
@@ -549,14 +506,14 @@ _mesa_set_random_entry(struct set *ht,
       return NULL;
 
    for (entry = ht->table + i; entry != ht->table + ht->size; entry++) {
-      if (entry_is_present(entry) &&
+      if (entry_is_present(ht, entry) &&
           (!predicate || predicate(entry))) {
          return entry;
       }
    }
 
    for (entry = ht->table; entry != ht->table + i; entry++) {
-      if (entry_is_present(entry) &&
+      if (entry_is_present(ht, entry) &&
           (!predicate || predicate(entry))) {
          return entry;
       }
@@ -24,10 +24,15 @@
 #include "slab.h"
 #include "macros.h"
 #include "u_atomic.h"
+#include "u_math.h"
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
+/* Number of elements of another pool that are given back at once. */
+#define SLAB_MIGRATE_BATCH_SIZE 32
+
 #define SLAB_MAGIC_ALLOCATED 0xcafe4321
 #define SLAB_MAGIC_FREE 0x7ee01234
 
@@ -41,8 +46,13 @@
 
 /* One array element within a big buffer. */
 struct slab_element_header {
-   /* The next element in the free or migrated list. */
-   struct slab_element_header *next;
+   union {
+      /* The next element in the free or migrated list. */
+      struct slab_element_header *next;
+
+      /* The size class of an allocated element of a sized pool. */
+      uintptr_t size_class;
+   } u;
 
    /* This is either
     * - a pointer to the child pool to which this element belongs, or
@@ -106,16 +116,16 @@ slab_create_parent(struct slab_parent_pool *parent,
                    unsigned item_size,
                    unsigned num_items)
 {
-   mtx_init(&parent->mutex, mtx_plain);
    parent->element_size = ALIGN_POT(sizeof(struct slab_element_header) + item_size,
                                     sizeof(intptr_t));
    parent->num_elements = num_items;
+   parent->num_migrating = 0;
 }
 
 void
 slab_destroy_parent(struct slab_parent_pool *parent)
 {
-   mtx_destroy(&parent->mutex);
+   assert(parent->num_migrating == 0);
 }
 
 /**
@@ -127,7 +137,77 @@ void slab_create_child(struct slab_child_pool *pool,
    pool->parent = parent;
    pool->pages = NULL;
    pool->free = NULL;
-   pool->migrated = NULL;
+   pool->migrated = 0;
+   pool->num_migrated = 0;
+   pool->num_migrated_reclaimed = 0;
+   pool->num_live = 0;
+   pool->peak_live = 0;
+   pool->batch = NULL;
+   pool->batch_owner = 0;
+   pool->batch_size = 0;
+}
+
+/* Take all elements from the migrated list of the pool. */
+static struct slab_element_header *
+slab_take_migrated(struct slab_child_pool *pool)
+{
+   intptr_t head = p_atomic_read(&pool->migrated);
+
+   while (head) {
+      intptr_t old = p_atomic_cmpxchg(&pool->migrated, head, (intptr_t)0);
+      if (old == head)
+         break;
+      head = old;
+   }
+
+   return (struct slab_element_header *)head;
+}
+
+/* Give the batch of elements that were freed with this pool back to their
+ * owner.
+ */
+static void
+slab_flush_batch(struct slab_child_pool *pool)
+{
+   struct slab_child_pool *owner = (struct slab_child_pool *)pool->batch_owner;
+   struct slab_element_header *head = NULL, *tail = NULL;
+   unsigned num = 0;
+
+   /* The owner must not be destroyed while we push to its list. */
+   p_atomic_inc(&pool->parent->num_migrating);
+
+   /* Elements of an owner that was destroyed in the meantime are orphaned,
+    * and the owner's memory may even have been reused by a new pool.
+    */
+   while (pool->batch) {
+      struct slab_element_header *elt = pool->batch;
+      pool->batch = elt->u.next;
+
+      if (p_atomic_read(&elt->owner) == pool->batch_owner) {
+         elt->u.next = head;
+         head = elt;
+         if (!tail)
+            tail = elt;
+         num++;
+      } else {
+         slab_free_orphaned(elt);
+      }
+   }
+
+   if (head) {
+      intptr_t old;
+
+      p_atomic_add(&owner->num_migrated, num);
+
+      do {
+         old = p_atomic_read(&owner->migrated);
+         tail->u.next = (struct slab_element_header *)old;
+      } while (p_atomic_cmpxchg(&owner->migrated, old, (intptr_t)head) != old);
+   }
+
+   p_atomic_dec(&pool->parent->num_migrating);
+
+   pool->batch_size = 0;
 }
 
 /**
@@ -138,10 +218,13 @@ void slab_create_child(struct slab_child_pool *pool,
  */
 void slab_destroy_child(struct slab_child_pool *pool)
 {
+   struct slab_element_header *migrated;
+
    if (!pool->parent)
       return; /* the slab probably wasn't even created */
 
-   mtx_lock(&pool->parent->mutex);
+   if (pool->batch)
+      slab_flush_batch(pool);
 
    while (pool->pages) {
       struct slab_page_header *page = pool->pages;
@@ -154,17 +237,23 @@ void slab_destroy_child(struct slab_child_pool *pool)
       }
    }
 
-   while (pool->migrated) {
-      struct slab_element_header *elt = pool->migrated;
-      pool->migrated = elt->next;
+   /* Threads that free an element from now on see that it's orphaned.  Wait
+    * for those that might have seen the pool as the owner.  The atomic add
+    * orders this with the stores above.
+    */
+   while (p_atomic_add_return(&pool->parent->num_migrating, 0))
+      thrd_yield();
+
+   migrated = slab_take_migrated(pool);
+   while (migrated) {
+      struct slab_element_header *elt = migrated;
+      migrated = elt->u.next;
       slab_free_orphaned(elt);
    }
 
-   mtx_unlock(&pool->parent->mutex);
-
    while (pool->free) {
       struct slab_element_header *elt = pool->free;
-      pool->free = elt->next;
+      pool->free = elt->u.next;
       slab_free_orphaned(elt);
    }
 
@@ -186,7 +275,7 @@ slab_add_new_page(struct slab_child_pool *pool)
       elt->owner = (intptr_t)pool;
       assert(!(elt->owner & 1));
 
-      elt->next = pool->free;
+      elt->u.next = pool->free;
       pool->free = elt;
       SET_MAGIC(elt, SLAB_MAGIC_FREE);
    }
@@ -209,12 +298,14 @@ slab_alloc(struct slab_child_pool *pool)
 
    if (!pool->free) {
       /* First, collect elements that belong to us but were freed from a
-       * different child pool.
+       * different child pool.  num_migrated is incremented before an element
+       * is pushed, so it may count a few elements that we only get later.
        */
-      mtx_lock(&pool->parent->mutex);
-      pool->free = pool->migrated;
-      pool->migrated = NULL;
-      mtx_unlock(&pool->parent->mutex);
+      unsigned num_migrated = p_atomic_read(&pool->num_migrated);
+
+      pool->free = slab_take_migrated(pool);
+      pool->num_live -= num_migrated - pool->num_migrated_reclaimed;
+      pool->num_migrated_reclaimed = num_migrated;
 
       /* Now allocate a new page. */
       if (!pool->free && !slab_add_new_page(pool))
@@ -222,11 +313,14 @@ slab_alloc(struct slab_child_pool *pool)
    }
 
    elt = pool->free;
-   pool->free = elt->next;
+   pool->free = elt->u.next;
 
    CHECK_MAGIC(elt, SLAB_MAGIC_FREE);
    SET_MAGIC(elt, SLAB_MAGIC_ALLOCATED);
 
+   if (++pool->num_live > pool->peak_live)
+      pool->peak_live = pool->num_live;
+
    return &elt[1];
 }
 
@@ -251,29 +345,43 @@ void slab_free(struct slab_child_pool *pool, void *ptr)
       /* This is the simple case: The caller guarantees that we can safely
        * access the free list.
        */
-      elt->next = pool->free;
+      elt->u.next = pool->free;
       pool->free = elt;
+      pool->num_live--;
       return;
    }
 
    /* The slow case: migration or an orphaned page. */
-   mtx_lock(&pool->parent->mutex);
-
-   /* Note: we _must_ re-read elt->owner here because the owning child pool
-    * may have been destroyed by another thread in the meantime.
-    */
    owner_int = p_atomic_read(&elt->owner);
 
-   if (!(owner_int & 1)) {
-      struct slab_child_pool *owner = (struct slab_child_pool *)owner_int;
-      elt->next = owner->migrated;
-      owner->migrated = elt;
-      mtx_unlock(&pool->parent->mutex);
-   } else {
-      mtx_unlock(&pool->parent->mutex);
-
+   if (owner_int & 1) {
       slab_free_orphaned(elt);
+      return;
    }
+
+   /* Collect elements of the same owner and give them back at once, which
+    * only needs a few atomic operations for the whole batch.
+    */
+   if (pool->batch && owner_int != pool->batch_owner)
+      slab_flush_batch(pool);
+
+   elt->u.next = pool->batch;
+   pool->batch = elt;
+   pool->batch_owner = owner_int;
+
+   if (++pool->batch_size == SLAB_MIGRATE_BATCH_SIZE)
+      slab_flush_batch(pool);
+}
+
+/**
+ * Return statistics of the child pool.  Single-threaded like slab_alloc.
+ */
+void
+slab_get_stats(struct slab_child_pool *pool, struct slab_stats *stats)
+{
+   stats->num_live = pool->num_live;
+   stats->peak_live = pool->peak_live;
+   stats->num_migrated = p_atomic_read(&pool->num_migrated);
 }
 
 /**
@@ -315,3 +423,130 @@ slab_create(struct slab_mempool *mempool,
    slab_create_parent(&mempool->parent, item_size, num_items);
    slab_create_child(&mempool->child, &mempool->parent);
 }
+
+/**
+ * Create a parent pool for the allocation of objects of different sizes.
+ *
+ * There is one size class for each power of two from \p min_size to
+ * \p max_size.  Larger objects are malloc'd.
+ *
+ * \param num_items     Number of objects of the smallest size to allocate at
+ *                      once.  Larger sizes allocate fewer objects at once.
+ */
+void
+slab_create_sized_parent(struct slab_sized_parent_pool *parent,
+                         unsigned min_size,
+                         unsigned max_size,
+                         unsigned num_items)
+{
+   parent->min_size_log2 = util_logbase2_ceil(MAX2(min_size, 1));
+   parent->num_classes = MIN2(util_logbase2_ceil(MAX2(max_size, 1)) -
+                              parent->min_size_log2 + 1,
+                              SLAB_MAX_SIZE_CLASSES);
+
+   for (unsigned i = 0; i < parent->num_classes; i++) {
+      slab_create_parent(&parent->classes[i],
+                         1u << (parent->min_size_log2 + i),
+                         MAX2(num_items >> i, 4));
+   }
+}
+
+void
+slab_destroy_sized_parent(struct slab_sized_parent_pool *parent)
+{
+   for (unsigned i = 0; i < parent->num_classes; i++)
+      slab_destroy_parent(&parent->classes[i]);
+}
+
+void
+slab_create_sized_child(struct slab_sized_child_pool *pool,
+                        struct slab_sized_parent_pool *parent)
+{
+   pool->parent = parent;
+   for (unsigned i = 0; i < parent->num_classes; i++)
+      slab_create_child(&pool->classes[i], &parent->classes[i]);
+}
+
+void
+slab_destroy_sized_child(struct slab_sized_child_pool *pool)
+{
+   if (!pool->parent)
+      return;
+
+   for (unsigned i = 0; i < pool->parent->num_classes; i++)
+      slab_destroy_child(&pool->classes[i]);
+
+   pool->parent = NULL;
+}
+
+/**
+ * Allocate an object of the given size from the sized child pool.  The same
+ * rules as for slab_alloc apply.
+ */
+void *
+slab_alloc_sized(struct slab_sized_child_pool *pool, unsigned size)
+{
+   struct slab_sized_parent_pool *parent = pool->parent;
+   struct slab_element_header *elt;
+   unsigned size_class = 0;
+
+   if (size > (1u << parent->min_size_log2))
+      size_class = util_logbase2_ceil(size) - parent->min_size_log2;
+
+   if (size_class < parent->num_classes) {
+      void *ptr = slab_alloc(&pool->classes[size_class]);
+
+      if (!ptr)
+         return NULL;
+      elt = (struct slab_element_header *)ptr - 1;
+   } else {
+      /* Too large for a slab. */
+      size_class = parent->num_classes;
+      elt = malloc(sizeof(struct slab_element_header) + size);
+      if (!elt)
+         return NULL;
+      SET_MAGIC(elt, SLAB_MAGIC_ALLOCATED);
+   }
+
+   elt->u.size_class = size_class;
+   return &elt[1];
+}
+
+/**
+ * Free an object allocated from a sized pool.  The same rules as for
+ * slab_free apply.
+ */
+void
+slab_free_sized(struct slab_sized_child_pool *pool, void *ptr)
+{
+   struct slab_element_header *elt = ((struct slab_element_header*)ptr - 1);
+   unsigned size_class = elt->u.size_class;
+
+   CHECK_MAGIC(elt, SLAB_MAGIC_ALLOCATED);
+
+   if (size_class < pool->parent->num_classes)
+      slab_free(&pool->classes[size_class], ptr);
+   else
+      free(elt);
+}
+
+/**
+ * Return statistics of all size classes of the sized child pool, not
+ * including malloc'd objects.  The peak is the sum of the peaks of the
+ * classes.
+ */
+void
+slab_get_sized_stats(struct slab_sized_child_pool *pool,
+                     struct slab_stats *stats)
+{
+   memset(stats, 0, sizeof(*stats));
+
+   for (unsigned i = 0; i < pool->parent->num_classes; i++) {
+      struct slab_stats class_stats;
+
+      slab_get_stats(&pool->classes[i], &class_stats);
+      stats->num_live += class_stats.num_live;
+      stats->peak_live += class_stats.peak_live;
+      stats->num_migrated += class_stats.num_migrated;
+   }
+}
@@ -32,8 +32,13 @@
  *
  * Allocations obtained from one child pool should usually be freed in the
  * same child pool. Freeing an allocation in a different child pool associated
- * to the same parent is allowed (and requires no locking by the caller), but
- * it is discouraged because it implies a performance penalty.
+ * to the same parent is allowed (and requires no locking by the caller). Such
+ * allocations are collected in small batches, which are put on a lock-free
+ * list of the owning pool.  The owner takes them back all at once when it
+ * runs out of free elements.
+ *
+ * For objects of different sizes, the sized pools below have one pool per
+ * power-of-two size class.
  *
  * For convenience and to ease the transition, there is also a set of wrapper
  * functions around a single parent-child pair.
@@ -42,15 +47,24 @@
 #ifndef SLAB_H
 #define SLAB_H
 
+#include <stdint.h>
 #include "c11/threads.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 struct slab_element_header;
 struct slab_page_header;
 
 struct slab_parent_pool {
-   mtx_t mutex;
    unsigned element_size;
    unsigned num_elements;
+
+   /* Number of threads that are moving an element to the migrated list of
+    * another pool, which must not be destroyed in the meantime.
+    */
+   unsigned num_migrating;
 };
 
 struct slab_child_pool {
@@ -64,9 +78,35 @@ struct slab_child_pool {
    /* Elements that are owned by this pool but were freed with a different
     * pool as the argument to slab_free.
     *
-    * This list is protected by the parent mutex.
+    * This is a struct slab_element_header pointer, which other threads
+    * only push to with atomic compare-and-swap.
     */
-   struct slab_element_header *migrated;
+   intptr_t migrated;
+
+   /* Number of elements that were pushed to the migrated list (atomic). */
+   unsigned num_migrated;
+   unsigned num_migrated_reclaimed;
+
+   unsigned num_live;
+   unsigned peak_live;
+
+   /* Elements of another pool that were freed with this one, which are
+    * given back to their owner all at once.  They all have the same owner.
+    */
+   struct slab_element_header *batch;
+   intptr_t batch_owner;
+   unsigned batch_size;
+};
+
+struct slab_stats {
+   /* Allocated elements, including elements that were freed with a
+    * different pool but not yet taken back.
+    */
+   unsigned num_live;
+   unsigned peak_live;
+
+   /* Elements that were freed with a different pool. */
+   unsigned num_migrated;
 };
 
 void slab_create_parent(struct slab_parent_pool *parent,
@@ -78,6 +118,33 @@ void slab_create_child(struct slab_child_pool *pool,
 void slab_destroy_child(struct slab_child_pool *pool);
 void *slab_alloc(struct slab_child_pool *pool);
 void slab_free(struct slab_child_pool *pool, void *ptr);
+void slab_get_stats(struct slab_child_pool *pool, struct slab_stats *stats);
+
+#define SLAB_MAX_SIZE_CLASSES 8
+
+struct slab_sized_parent_pool {
+   struct slab_parent_pool classes[SLAB_MAX_SIZE_CLASSES];
+   unsigned num_classes;
+   unsigned min_size_log2;
+};
+
+struct slab_sized_child_pool {
+   struct slab_sized_parent_pool *parent;
+   struct slab_child_pool classes[SLAB_MAX_SIZE_CLASSES];
+};
+
+void slab_create_sized_parent(struct slab_sized_parent_pool *parent,
+                              unsigned min_size,
+                              unsigned max_size,
+                              unsigned num_items);
+void slab_destroy_sized_parent(struct slab_sized_parent_pool *parent);
+void slab_create_sized_child(struct slab_sized_child_pool *pool,
+                             struct slab_sized_parent_pool *parent);
+void slab_destroy_sized_child(struct slab_sized_child_pool *pool);
+void *slab_alloc_sized(struct slab_sized_child_pool *pool, unsigned size);
+void slab_free_sized(struct slab_sized_child_pool *pool, void *ptr);
+void slab_get_sized_stats(struct slab_sized_child_pool *pool,
+                          struct slab_stats *stats);
 
 struct slab_mempool {
    struct slab_parent_pool parent;
@@ -91,4 +158,8 @@ void slab_destroy(struct slab_mempool *mempool);
 void *slab_alloc_st(struct slab_mempool *mempool);
 void slab_free_st(struct slab_mempool *mempool, void *ptr);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
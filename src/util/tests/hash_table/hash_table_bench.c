@@ -0,0 +1,190 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Times hash_table and set operations with the access patterns of the
+ * compiler, e.g. the pointer-keyed remap tables of nir_clone and the
+ * instruction sets of the optimization passes.
+ *
+ * Usage: hash_table_bench [scale]
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hash_table.h"
+#include "os_time.h"
+#include "ralloc.h"
+#include "set.h"
+
+/* Stands in for NIR instructions and variables, which are separately
+ * allocated and thus spread out in memory.
+ */
+struct node {
+   char name[16];
+   uint64_t payload[3];
+};
+
+static struct node **
+alloc_nodes(void *mem_ctx, unsigned num)
+{
+   struct node **nodes = ralloc_array(mem_ctx, struct node *, num);
+
+   for (unsigned i = 0; i < num; i++) {
+      nodes[i] = ralloc(mem_ctx, struct node);
+      snprintf(nodes[i]->name, sizeof(nodes[i]->name), "ssa_%u", i);
+   }
+   return nodes;
+}
+
+static void
+report(const char *name, int64_t start, uint64_t num_ops)
+{
+   int64_t time = os_time_get_nano() - start;
+
+   printf("%-32s %8.2f ms  %6.2f ns/op\n", name, time / 1e6,
+          (double)time / num_ops);
+}
+
+/* Many small tables that are filled, queried and thrown away, like the
+ * remap table of nir_clone for each function.
+ */
+static void
+bench_small_maps(struct node **nodes, unsigned num_nodes, unsigned table_size,
+                 unsigned repeat)
+{
+   char name[64];
+   uint64_t num_ops = 0;
+   int64_t start = os_time_get_nano();
+
+   for (unsigned r = 0; r < repeat; r++) {
+      struct hash_table *ht = _mesa_pointer_hash_table_create(NULL);
+      unsigned base = (r * table_size) % (num_nodes - table_size);
+
+      for (unsigned i = 0; i < table_size; i++)
+         _mesa_hash_table_insert(ht, nodes[base + i], nodes[i]);
+
+      for (unsigned i = 0; i < table_size * 4; i++) {
+         struct hash_entry *entry =
+            _mesa_hash_table_search(ht, nodes[base + i % table_size]);
+         assert(entry);
+         (void)entry;
+      }
+
+      num_ops += table_size * 5;
+      _mesa_hash_table_destroy(ht, NULL);
+   }
+
+   snprintf(name, sizeof(name), "pointer map, %u entries", table_size);
+   report(name, start, num_ops);
+}
+
+/* One large table with hits and misses. */
+static void
+bench_large_map(struct node **nodes, unsigned num_nodes)
+{
+   struct hash_table *ht = _mesa_pointer_hash_table_create(NULL);
+   unsigned half = num_nodes / 2;
+   unsigned hits = 0;
+   int64_t start;
+
+   start = os_time_get_nano();
+   for (unsigned i = 0; i < half; i++)
+      _mesa_hash_table_insert(ht, nodes[i], nodes[i]);
+   report("pointer map insert", start, half);
+
+   start = os_time_get_nano();
+   for (unsigned r = 0; r < 8; r++) {
+      for (unsigned i = 0; i < num_nodes; i++)
+         hits += _mesa_hash_table_search(ht, nodes[i]) != NULL;
+   }
+   report("pointer map search, 50% hits", start, 8ull * num_nodes);
+   assert(hits == 8 * half);
+
+   _mesa_hash_table_destroy(ht, NULL);
+}
+
+/* Adding and removing the same keys over and over, like the worklists and
+ * live sets of the optimization passes.
+ */
+static void
+bench_set_churn(struct node **nodes, unsigned num_nodes)
+{
+   struct set *set = _mesa_pointer_set_create(NULL);
+   uint64_t num_ops = 0;
+   int64_t start = os_time_get_nano();
+
+   for (unsigned r = 0; r < 16; r++) {
+      for (unsigned i = 0; i < num_nodes; i++) {
+         _mesa_set_add(set, nodes[i]);
+         if (i >= 64)
+            _mesa_set_remove_key(set, nodes[i - 64]);
+      }
+      _mesa_set_clear(set, NULL);
+      num_ops += 2 * num_nodes;
+   }
+   report("pointer set add/remove", start, num_ops);
+
+   _mesa_set_destroy(set, NULL);
+}
+
+/* Name lookups, like the symbol tables of the GLSL compiler. */
+static void
+bench_string_map(struct node **nodes, unsigned num_nodes)
+{
+   struct hash_table *ht =
+      _mesa_hash_table_create(NULL, _mesa_hash_string,
+                              _mesa_key_string_equal);
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < num_nodes; i++)
+      _mesa_hash_table_insert(ht, nodes[i]->name, nodes[i]);
+
+   for (unsigned r = 0; r < 4; r++) {
+      for (unsigned i = 0; i < num_nodes; i++)
+         _mesa_hash_table_search(ht, nodes[i]->name);
+   }
+   report("string map insert/search", start, 5ull * num_nodes);
+
+   _mesa_hash_table_destroy(ht, NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned scale = argc > 1 ? atoi(argv[1]) : 1;
+   unsigned num_nodes = 100000 * scale;
+   void *mem_ctx = ralloc_context(NULL);
+   struct node **nodes = alloc_nodes(mem_ctx, num_nodes);
+
+   bench_small_maps(nodes, num_nodes, 8, 20000 * scale);
+   bench_small_maps(nodes, num_nodes, 64, 4000 * scale);
+   bench_small_maps(nodes, num_nodes, 1024, 250 * scale);
+   bench_small_maps(nodes, num_nodes, 700, 360 * scale);
+   bench_large_map(nodes, num_nodes);
+   bench_set_churn(nodes, num_nodes);
+   bench_string_map(nodes, num_nodes);
+
+   ralloc_free(mem_ctx);
+   return 0;
+}
@@ -0,0 +1,233 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "util/ralloc.h"
+
+static int num_destroyed;
+
+static void
+destroy(void *ptr)
+{
+   num_destroyed++;
+}
+
+TEST(ralloc, arena_basic)
+{
+   void *arena = ralloc_arena_context(NULL);
+   int *a = ralloc_array(arena, int, 16);
+   int *b = ralloc_array(a, int, 4);
+
+   for (int i = 0; i < 16; i++)
+      a[i] = i;
+   memset(b, 0xff, 4 * sizeof(int));
+
+   EXPECT_EQ(ralloc_parent(a), arena);
+   EXPECT_EQ(ralloc_parent(b), a);
+   for (int i = 0; i < 16; i++)
+      EXPECT_EQ(a[i], i);
+
+   /* Freed memory is reused. */
+   ralloc_free(b);
+   EXPECT_EQ(ralloc_array(a, int, 4), b);
+
+   ralloc_free(arena);
+}
+
+/* Freeing a part of the arena reuses the memory of all of its blocks. */
+TEST(ralloc, arena_free_subtree)
+{
+   void *arena = ralloc_arena_context(NULL);
+   void *a = ralloc_size(arena, 32);
+   void *b = ralloc_size(a, 32);
+   void *ctx, *c, *d;
+
+   ralloc_free(a);
+   c = ralloc_size(arena, 32);
+   d = ralloc_size(arena, 32);
+   EXPECT_TRUE((c == a && d == b) || (c == b && d == a));
+
+   /* The same through another context, like nir_sweep() does it. */
+   ctx = ralloc_context(NULL);
+   ralloc_adopt(ctx, arena);
+   ralloc_steal(arena, d);
+   ralloc_free(ctx);
+   EXPECT_EQ(ralloc_parent(d), arena);
+
+   a = ralloc_size(arena, 32);
+   EXPECT_EQ(a, c);
+
+   ralloc_free(arena);
+}
+
+TEST(ralloc, arena_resize)
+{
+   void *arena = ralloc_arena_context(NULL);
+   char *str = ralloc_strdup(arena, "");
+   int *large = ralloc_array(arena, int, 1);
+   int *child = ralloc(large, int);
+
+   for (int i = 0; i < 100; i++)
+      ralloc_asprintf_append(&str, "%d ", i % 10);
+   EXPECT_EQ(strlen(str), 200u);
+   EXPECT_EQ(strncmp(str, "0 1 2 3", 7), 0);
+
+   /* Grow into a block of its own and back. */
+   large[0] = 42;
+   large = reralloc(arena, large, int, 10000);
+   large[9999] = 43;
+   EXPECT_EQ(large[0], 42);
+   EXPECT_EQ(ralloc_parent(child), large);
+   large = reralloc(arena, large, int, 100000);
+   EXPECT_EQ(large[0], 42);
+   EXPECT_EQ(large[9999], 43);
+   EXPECT_EQ(ralloc_parent(child), large);
+
+   ralloc_free(arena);
+}
+
+TEST(ralloc, arena_destructor)
+{
+   void *ctx = ralloc_context(NULL);
+   void *arena = ralloc_arena_context(ctx);
+   void *a = ralloc_size(arena, 8);
+   void *b = ralloc_size(a, 8);
+
+   num_destroyed = 0;
+   ralloc_set_destructor(a, destroy);
+   ralloc_set_destructor(b, destroy);
+
+   ralloc_free(ctx);
+   EXPECT_EQ(num_destroyed, 2);
+}
+
+/* Memory of the arena that's moved elsewhere stays valid. */
+TEST(ralloc, arena_steal)
+{
+   void *ctx = ralloc_context(NULL);
+   void *arena = ralloc_arena_context(NULL);
+   void *arena2 = ralloc_arena_context(NULL);
+   char *str = ralloc_strdup(arena, "stolen");
+   void *malloced = ralloc_size(NULL, 8);
+   void *child = ralloc_size(malloced, 8);
+
+   num_destroyed = 0;
+   ralloc_set_destructor(child, destroy);
+
+   ralloc_steal(ctx, str);
+   ralloc_steal(arena2, malloced);
+   ralloc_free(arena);
+   EXPECT_STREQ(str, "stolen");
+
+   ralloc_steal(arena2, str);
+   ralloc_adopt(ctx, arena2);
+   ralloc_free(arena2);
+   EXPECT_STREQ(str, "stolen");
+   EXPECT_EQ(ralloc_parent(str), ctx);
+   EXPECT_EQ(num_destroyed, 0);
+
+   ralloc_free(ctx);
+   EXPECT_EQ(num_destroyed, 1);
+}
+
+/* A block copied out of its arena doesn't keep the arena alive, but its
+ * children in the arena do.
+ */
+TEST(ralloc, arena_steal_copy)
+{
+   void *ctx = ralloc_context(NULL);
+   void *arena = ralloc_arena_context(NULL);
+   char *str = ralloc_strdup(arena, "stolen");
+   char *large = (char *) ralloc_size(arena, 3000);
+   char *child = ralloc_strdup(large, "child");
+
+   memset(large, 'x', 3000);
+
+   char *copy = (char *) ralloc_steal_copy(ctx, str);
+   EXPECT_NE(copy, str);
+   EXPECT_STREQ(copy, "stolen");
+   EXPECT_EQ(ralloc_parent(copy), ctx);
+
+   char *large_copy = (char *) ralloc_steal_copy(ctx, large);
+   EXPECT_EQ(large_copy[2999], 'x');
+   EXPECT_EQ(ralloc_parent(child), large_copy);
+
+   /* Stealing within the same arena leaves the block where it is. */
+   char *same = ralloc_strdup(arena, "same");
+   void *sub = ralloc_context(arena);
+   EXPECT_EQ(ralloc_steal_copy(sub, same), same);
+
+   ralloc_free(arena);
+   EXPECT_STREQ(copy, "stolen");
+   EXPECT_STREQ(child, "child");
+
+   ralloc_free(large_copy);
+   EXPECT_STREQ(copy, "stolen");
+   ralloc_free(ctx);
+}
+
+/* Threads that each work on their own subtree of a thread-safe arena. */
+TEST(ralloc, arena_thread_safe)
+{
+   const unsigned num_threads = 4;
+   void *arena = ralloc_arena_context(NULL);
+   std::vector<void *> roots;
+   std::vector<std::thread> threads;
+
+   for (unsigned i = 0; i < num_threads; i++)
+      roots.push_back(ralloc_context(arena));
+
+   ralloc_arena_set_thread_safe(arena, true);
+
+   for (unsigned i = 0; i < num_threads; i++) {
+      threads.emplace_back([arena, root = roots[i]]() {
+         char *str = ralloc_strdup(root, "");
+
+         for (unsigned j = 0; j < 10000; j++) {
+            /* Children of the arena itself, of the subtree and of malloc'd
+             * memory in the subtree.
+             */
+            void *a = ralloc_size(arena, 8 + j % 64);
+            void *b = ralloc_size(root, 8 + j % 200);
+            void *c = ralloc_size(b, 3000);
+
+            ralloc_asprintf_append(&str, "%u", j % 10);
+            if (j % 3 == 0)
+               ralloc_steal(root, c);
+            ralloc_free(a);
+            if (j % 2 == 0)
+               ralloc_free(b);
+         }
+         EXPECT_EQ(strlen(str), 10000u);
+      });
+   }
+
+   for (std::thread &thread : threads)
+      thread.join();
+
+   ralloc_arena_set_thread_safe(arena, false);
+   ralloc_free(arena);
+}
@@ -0,0 +1,262 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Times ra_allocate() on interference graphs.
+ *
+ * Without arguments, graphs are generated from random live ranges with a
+ * register file like the one of the Intel backend: 128 registers and
+ * classes of 1, 2, 4 and 8 contiguous registers.
+ *
+ * Otherwise each file is replayed.  A file holds a register set written by
+ * ra_set_serialize() followed by a graph written by ra_graph_serialize(),
+ * which a backend can dump right before calling ra_allocate().  With -w, the
+ * generated graphs are written to files in this format.
+ *
+ * Usage: ra_bench [-w] [-s scale] [file...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blob.h"
+#include "os_file.h"
+#include "os_time.h"
+#include "ralloc.h"
+#include "register_allocate.h"
+
+#define NUM_BASE_REGS 128
+
+static const unsigned class_sizes[] = { 1, 2, 4, 8 };
+
+static struct ra_regs *
+create_reg_set(void *mem_ctx)
+{
+   unsigned count = 0;
+   for (unsigned c = 0; c < ARRAY_SIZE(class_sizes); c++)
+      count += NUM_BASE_REGS - class_sizes[c] + 1;
+
+   struct ra_regs *regs = ra_alloc_reg_set(mem_ctx, count, true);
+   unsigned reg = 0;
+
+   for (unsigned c = 0; c < ARRAY_SIZE(class_sizes); c++) {
+      unsigned class = ra_alloc_reg_class(regs);
+
+      for (unsigned base = 0; base + class_sizes[c] <= NUM_BASE_REGS; base++) {
+         ra_class_add_reg(regs, class, reg);
+         for (unsigned i = 0; c && i < class_sizes[c]; i++)
+            ra_add_transitive_reg_conflict(regs, base + i, reg);
+         reg++;
+      }
+   }
+
+   ra_set_finalize(regs, NULL);
+   return regs;
+}
+
+struct live_range {
+   unsigned start, end;
+};
+
+/* Makes a graph of num_nodes live ranges of which about max_live are live
+ * at the same time.  The first few nodes are assigned to fixed registers,
+ * like the payload of a shader.
+ */
+static struct ra_graph *
+create_graph(struct ra_regs *regs, unsigned num_nodes, unsigned max_live,
+             unsigned seed)
+{
+   struct ra_graph *g = ra_alloc_interference_graph(regs, num_nodes);
+   struct live_range *ranges = malloc(num_nodes * sizeof(*ranges));
+
+   srand(seed);
+
+   for (unsigned n = 0; n < num_nodes; n++) {
+      unsigned r = rand() % 16;
+      unsigned class = r < 10 ? 0 : r < 13 ? 1 : r < 15 ? 2 : 3;
+      unsigned len = 1 + rand() % (2 * max_live);
+
+      /* A few values live much longer, like loop counters. */
+      if (rand() % 64 == 0)
+         len *= 16;
+
+      ranges[n].start = n;
+      ranges[n].end = n + len;
+
+      ra_set_node_class(g, n, class);
+      ra_set_node_spill_cost(g, n, 1.0f + rand() % 100);
+      if (n < 8)
+         ra_set_node_reg(g, n, n);
+   }
+
+   /* The ranges start in node order, so each one interferes with the
+    * earlier ones that are still live.
+    */
+   unsigned *live = malloc(num_nodes * sizeof(*live));
+   unsigned num_live = 0;
+
+   for (unsigned n = 0; n < num_nodes; n++) {
+      unsigned j = 0;
+      for (unsigned i = 0; i < num_live; i++) {
+         if (ranges[live[i]].end <= n)
+            continue;
+         ra_add_node_interference(g, n, live[i]);
+         live[j++] = live[i];
+      }
+      live[j++] = n;
+      num_live = j;
+   }
+
+   free(live);
+   free(ranges);
+   return g;
+}
+
+static void
+write_graph(const char *filename, struct ra_regs *regs, struct ra_graph *g)
+{
+   struct blob blob;
+   FILE *f = fopen(filename, "wb");
+
+   if (!f) {
+      fprintf(stderr, "Couldn't open %s\n", filename);
+      return;
+   }
+
+   blob_init(&blob);
+   ra_set_serialize(regs, &blob);
+   ra_graph_serialize(g, &blob);
+   fwrite(blob.data, 1, blob.size, f);
+   blob_finish(&blob);
+   fclose(f);
+}
+
+static void
+run(const char *name, struct ra_graph *g, int64_t build_time)
+{
+   int64_t start = os_time_get_nano();
+   bool ok = ra_allocate(g);
+   int64_t alloc_time = os_time_get_nano() - start;
+   int64_t spill_time = 0;
+
+   if (!ok) {
+      start = os_time_get_nano();
+      ra_get_best_spill_node(g);
+      spill_time = os_time_get_nano() - start;
+   }
+
+   printf("%-32s build %8.2f ms  allocate %8.2f ms  %s",
+          name, build_time / 1e6, alloc_time / 1e6, ok ? "ok" : "spill");
+   if (!ok)
+      printf(" %8.2f ms", spill_time / 1e6);
+   printf("\n");
+}
+
+static void
+replay(const char *filename)
+{
+   size_t size;
+   char *data = os_read_file(filename, &size);
+   struct blob_reader blob;
+
+   if (!data) {
+      fprintf(stderr, "Couldn't read %s\n", filename);
+      return;
+   }
+
+   void *mem_ctx = ralloc_context(NULL);
+   int64_t start = os_time_get_nano();
+
+   blob_reader_init(&blob, data, size);
+   struct ra_regs *regs = ra_set_deserialize(mem_ctx, &blob);
+   struct ra_graph *g = ra_graph_deserialize(regs, &blob);
+
+   if (g) {
+      run(filename, g, os_time_get_nano() - start);
+      ralloc_free(g);
+   } else {
+      fprintf(stderr, "%s is not a valid graph\n", filename);
+   }
+
+   ralloc_free(mem_ctx);
+   free(data);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned scale = 1;
+   bool write = false;
+   int i;
+
+   for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+      if (strcmp(argv[i], "-w") == 0)
+         write = true;
+      else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+         scale = atoi(argv[++i]);
+   }
+
+   if (i < argc) {
+      for (; i < argc; i++)
+         replay(argv[i]);
+      return 0;
+   }
+
+   static const struct {
+      unsigned num_nodes, max_live;
+   } graphs[] = {
+      { 1000, 16 },
+      { 1000, 64 },
+      { 10000, 32 },
+      { 10000, 96 },
+      { 40000, 48 },
+      { 40000, 160 },
+   };
+
+   void *mem_ctx = ralloc_context(NULL);
+   struct ra_regs *regs = create_reg_set(mem_ctx);
+
+   for (unsigned j = 0; j < ARRAY_SIZE(graphs); j++) {
+      unsigned num_nodes = graphs[j].num_nodes * scale;
+      char name[64];
+
+      snprintf(name, sizeof(name), "%u nodes, %u live",
+               num_nodes, graphs[j].max_live);
+
+      int64_t start = os_time_get_nano();
+      struct ra_graph *g = create_graph(regs, num_nodes, graphs[j].max_live, j);
+      int64_t build_time = os_time_get_nano() - start;
+
+      if (write) {
+         char filename[64];
+         snprintf(filename, sizeof(filename), "ra_graph_%u.bin", j);
+         write_graph(filename, regs, g);
+      }
+
+      run(name, g, build_time);
+      ralloc_free(g);
+   }
+
+   ralloc_free(mem_ctx);
+   return 0;
+}
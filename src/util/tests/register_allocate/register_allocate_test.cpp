@@ -0,0 +1,190 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include "util/blob.h"
+#include "util/ralloc.h"
+#include "util/register_allocate.h"
+
+class ra_test : public ::testing::Test {
+protected:
+   ra_test();
+   ~ra_test();
+
+   struct ra_graph *create_graph(unsigned num_nodes, unsigned max_live);
+   void check_allocation(struct ra_graph *g);
+
+   void *mem_ctx;
+   struct ra_regs *regs;
+   std::vector<std::pair<unsigned, unsigned>> edges;
+};
+
+#define NUM_BASE_REGS 16
+
+/* Single registers and pairs of them, which don't have to be aligned. */
+ra_test::ra_test()
+{
+   mem_ctx = ralloc_context(NULL);
+   regs = ra_alloc_reg_set(mem_ctx, 2 * NUM_BASE_REGS - 1, true);
+
+   unsigned c0 = ra_alloc_reg_class(regs);
+   unsigned c1 = ra_alloc_reg_class(regs);
+   for (unsigned r = 0; r < NUM_BASE_REGS; r++)
+      ra_class_add_reg(regs, c0, r);
+   for (unsigned r = 0; r < NUM_BASE_REGS - 1; r++) {
+      ra_class_add_reg(regs, c1, NUM_BASE_REGS + r);
+      ra_add_transitive_reg_conflict(regs, r, NUM_BASE_REGS + r);
+      ra_add_transitive_reg_conflict(regs, r + 1, NUM_BASE_REGS + r);
+   }
+   ra_set_finalize(regs, NULL);
+}
+
+ra_test::~ra_test()
+{
+   ralloc_free(mem_ctx);
+}
+
+struct ra_graph *
+ra_test::create_graph(unsigned num_nodes, unsigned max_live)
+{
+   struct ra_graph *g = ra_alloc_interference_graph(regs, 0);
+   std::vector<unsigned> end;
+
+   srand(num_nodes * max_live);
+   edges.clear();
+
+   for (unsigned n = 0; n < num_nodes; n++) {
+      EXPECT_EQ(ra_add_node(g, rand() % 4 == 0), n);
+      ra_set_node_spill_cost(g, n, 1 + rand() % 10);
+      end.push_back(n + 1 + rand() % max_live);
+
+      for (unsigned n2 = 0; n2 < n; n2++) {
+         if (end[n2] > n) {
+            ra_add_node_interference(g, n, n2);
+            edges.push_back(std::make_pair(n, n2));
+         }
+      }
+   }
+
+   if (ra_get_node_class(g, 0) == 0)
+      ra_set_node_reg(g, 0, 3);
+
+   return g;
+}
+
+/* Checks that no interfering nodes were assigned overlapping registers. */
+void
+ra_test::check_allocation(struct ra_graph *g)
+{
+   for (auto edge : edges) {
+      unsigned r1 = ra_get_node_reg(g, edge.first);
+      unsigned r2 = ra_get_node_reg(g, edge.second);
+      unsigned base1 = r1 % NUM_BASE_REGS, size1 = 1 + r1 / NUM_BASE_REGS;
+      unsigned base2 = r2 % NUM_BASE_REGS, size2 = 1 + r2 / NUM_BASE_REGS;
+
+      EXPECT_TRUE(base1 + size1 <= base2 || base2 + size2 <= base1)
+         << "nodes " << edge.first << " and " << edge.second;
+   }
+}
+
+TEST_F(ra_test, allocate)
+{
+   for (unsigned max_live = 2; max_live <= 8; max_live++) {
+      struct ra_graph *g = create_graph(2000, max_live);
+
+      ASSERT_TRUE(ra_allocate(g));
+      check_allocation(g);
+      if (ra_get_node_class(g, 0) == 0) {
+         EXPECT_EQ(ra_get_node_reg(g, 0), 3);
+      }
+
+      ralloc_free(g);
+   }
+}
+
+TEST_F(ra_test, spill)
+{
+   struct ra_graph *g = create_graph(300, 24);
+
+   /* Spilling the best node and removing its interference eventually
+    * makes the graph colorable.
+    */
+   unsigned num_spills = 0;
+   while (!ra_allocate(g)) {
+      int n = ra_get_best_spill_node(g);
+      ASSERT_GE(n, 0);
+
+      ra_set_node_spill_cost(g, n, 0);
+      ra_reset_node_interference(g, n);
+      for (auto it = edges.begin(); it != edges.end();) {
+         if (it->first == (unsigned)n || it->second == (unsigned)n)
+            it = edges.erase(it);
+         else
+            it++;
+      }
+      num_spills++;
+   }
+
+   EXPECT_GT(num_spills, 0);
+   check_allocation(g);
+
+   ralloc_free(g);
+}
+
+TEST_F(ra_test, serialize)
+{
+   struct ra_graph *g = create_graph(500, 12);
+   struct blob blob;
+
+   blob_init(&blob);
+   ra_set_serialize(regs, &blob);
+   ra_graph_serialize(g, &blob);
+
+   struct blob_reader reader;
+   blob_reader_init(&reader, blob.data, blob.size);
+   struct ra_regs *regs2 = ra_set_deserialize(mem_ctx, &reader);
+   struct ra_graph *g2 = ra_graph_deserialize(regs2, &reader);
+   ASSERT_TRUE(g2 != NULL);
+   EXPECT_EQ(reader.current, reader.end);
+
+   /* The copy is allocated the same way, including the spill choice. */
+   bool ok = ra_allocate(g);
+   EXPECT_EQ(ra_allocate(g2), ok);
+   for (unsigned n = 0; n < 500; n++)
+      EXPECT_EQ(ra_get_node_reg(g2, n), ra_get_node_reg(g, n));
+   if (!ok) {
+      EXPECT_EQ(ra_get_best_spill_node(g2), ra_get_best_spill_node(g));
+   }
+
+   /* Truncated data is rejected. */
+   blob_reader_init(&reader, blob.data, blob.size - 4);
+   regs2 = ra_set_deserialize(mem_ctx, &reader);
+   EXPECT_TRUE(ra_graph_deserialize(regs2, &reader) == NULL);
+
+   blob_finish(&blob);
+   ralloc_free(g2);
+   ralloc_free(g);
+}
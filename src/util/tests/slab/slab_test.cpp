@@ -0,0 +1,146 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "util/macros.h"
+#include "util/slab.h"
+
+#define NUM_OBJECTS 1024 /* a multiple of the page size */
+
+TEST(slab, migrate)
+{
+   struct slab_parent_pool parent;
+   struct slab_child_pool owner, other;
+   struct slab_stats stats;
+   std::vector<void *> objects;
+
+   slab_create_parent(&parent, 40, 16);
+   slab_create_child(&owner, &parent);
+   slab_create_child(&other, &parent);
+
+   for (unsigned i = 0; i < NUM_OBJECTS; i++)
+      objects.push_back(slab_alloc(&owner));
+
+   slab_get_stats(&owner, &stats);
+   EXPECT_EQ(stats.num_live, NUM_OBJECTS);
+   EXPECT_EQ(stats.peak_live, NUM_OBJECTS);
+
+   /* Destroying the pool gives back the last batch. */
+   std::thread thread([&] {
+      for (void *ptr : objects)
+         slab_free(&other, ptr);
+      slab_destroy_child(&other);
+   });
+   thread.join();
+
+   slab_get_stats(&owner, &stats);
+   EXPECT_EQ(stats.num_migrated, NUM_OBJECTS);
+
+   /* The migrated objects are reused. */
+   std::vector<void *> freed = objects;
+   for (unsigned i = 0; i < NUM_OBJECTS; i++) {
+      objects[i] = slab_alloc(&owner);
+      EXPECT_NE(std::find(freed.begin(), freed.end(), objects[i]), freed.end());
+   }
+
+   slab_get_stats(&owner, &stats);
+   EXPECT_EQ(stats.num_live, NUM_OBJECTS);
+   EXPECT_EQ(stats.peak_live, NUM_OBJECTS);
+
+   for (void *ptr : objects)
+      slab_free(&owner, ptr);
+
+   slab_get_stats(&owner, &stats);
+   EXPECT_EQ(stats.num_live, 0u);
+
+   slab_destroy_child(&owner);
+   slab_destroy_parent(&parent);
+}
+
+/* Free objects from other threads while the owner is destroyed. */
+TEST(slab, orphan)
+{
+   struct slab_parent_pool parent;
+   struct slab_child_pool owner;
+   std::vector<std::thread> threads;
+   std::vector<void *> objects;
+
+   slab_create_parent(&parent, 16, 8);
+   slab_create_child(&owner, &parent);
+
+   for (unsigned i = 0; i < NUM_OBJECTS; i++)
+      objects.push_back(slab_alloc(&owner));
+
+   for (unsigned t = 0; t < 4; t++) {
+      threads.emplace_back([&, t] {
+         struct slab_child_pool pool;
+
+         slab_create_child(&pool, &parent);
+         for (unsigned i = t; i < NUM_OBJECTS; i += 4)
+            slab_free(&pool, objects[i]);
+         slab_destroy_child(&pool);
+      });
+   }
+
+   slab_destroy_child(&owner);
+   for (std::thread &thread : threads)
+      thread.join();
+
+   slab_destroy_parent(&parent);
+}
+
+TEST(slab, sized)
+{
+   struct slab_sized_parent_pool parent;
+   struct slab_sized_child_pool pool;
+   struct slab_stats stats;
+   unsigned sizes[] = {1, 16, 17, 100, 256, 257, 5000};
+   void *objects[ARRAY_SIZE(sizes)];
+
+   slab_create_sized_parent(&parent, 16, 256, 64);
+   EXPECT_EQ(parent.num_classes, 5u);
+   slab_create_sized_child(&pool, &parent);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(sizes); i++) {
+      objects[i] = slab_alloc_sized(&pool, sizes[i]);
+      memset(objects[i], i, sizes[i]);
+   }
+
+   slab_get_sized_stats(&pool, &stats);
+   EXPECT_EQ(stats.num_live, ARRAY_SIZE(sizes) - 2);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(sizes); i++) {
+      for (unsigned j = 0; j < sizes[i]; j++)
+         EXPECT_EQ(((unsigned char *)objects[i])[j], i);
+      slab_free_sized(&pool, objects[i]);
+   }
+
+   slab_get_sized_stats(&pool, &stats);
+   EXPECT_EQ(stats.num_live, 0u);
+
+   slab_destroy_sized_child(&pool);
+   slab_destroy_sized_parent(&parent);
+}
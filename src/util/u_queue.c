@@ -28,6 +28,7 @@
 
 #include "c11/threads.h"
 
+#include "util/bitscan.h"
 #include "util/os_time.h"
 #include "util/u_string.h"
 #include "util/u_thread.h"
@@ -243,6 +244,318 @@ struct thread_input {
    int thread_index;
 };
 
+static void
+util_queue_update_stats(struct util_queue *queue, unsigned priority,
+                        const struct util_queue_job *job)
+{
+   uint64_t wait_time = os_time_get_nano() - job->queued_time;
+
+   queue->stats.num_jobs[priority]++;
+   queue->stats.total_wait_time_ns[priority] += wait_time;
+   queue->stats.max_wait_time_ns[priority] =
+      MAX2(queue->stats.max_wait_time_ns[priority], wait_time);
+}
+
+/* Take the oldest job of the highest priority.  Must be called with the
+ * queue lock held and at least one job queued.
+ */
+static void
+util_queue_pop_job(struct util_queue *queue, struct util_queue_job *job)
+{
+   struct util_queue_ring *ring = queue->rings;
+
+   while (ring->num_queued == 0)
+      ring++;
+
+   *job = ring->jobs[ring->read_idx];
+   memset(&ring->jobs[ring->read_idx], 0, sizeof(struct util_queue_job));
+   ring->read_idx = (ring->read_idx + 1) % ring->max_jobs;
+
+   ring->num_queued--;
+   queue->num_queued--;
+   queue->num_active++;
+   /* Adders of other priorities may be waiting on the same condition. */
+   cnd_broadcast(&queue->has_space_cond);
+   if (job->job) {
+      queue->total_jobs_size -= job->job_size;
+      util_queue_update_stats(queue, ring - queue->rings, job);
+   }
+}
+
+/* Must be called with the queue lock held once a job taken with
+ * util_queue_pop_job has completed.
+ */
+static void
+util_queue_job_done(struct util_queue *queue, const struct util_queue_job *job)
+{
+   bool finished = false;
+
+   queue->num_active--;
+   if (job->seq < queue->finish_seq)
+      finished = --queue->num_finish_pending == 0;
+
+   /* Wake up util_queue_finish and util_queue_kill_threads. */
+   if (finished || !queue->num_active)
+      cnd_broadcast(&queue->job_done_cond);
+}
+
+/* Turn a queued job into a no-op.  It keeps its place in the order. */
+static void
+util_queue_clear_job(struct util_queue_job *job)
+{
+   uint64_t seq = job->seq;
+
+   memset(job, 0, sizeof(*job));
+   job->seq = seq;
+}
+
+static void
+util_queue_execute_job(struct util_queue_job *job, int thread_index)
+{
+   if (job->job) {
+      job->execute(job->job, thread_index);
+      util_queue_fence_signal(job->fence);
+      if (job->cleanup)
+         job->cleanup(job->job, thread_index);
+   }
+}
+
+/* Signal the fences of the jobs that will never run because all threads
+ * are being terminated.  Must be called with the queue lock held.
+ */
+static void
+util_queue_signal_remaining_jobs(struct util_queue *queue)
+{
+   for (unsigned p = 0; p < UTIL_QUEUE_NUM_PRIORITIES; p++) {
+      struct util_queue_ring *ring = &queue->rings[p];
+
+      for (int n = 0, i = ring->read_idx; n < ring->num_queued;
+           n++, i = (i + 1) % ring->max_jobs) {
+         if (ring->jobs[i].job) {
+            util_queue_fence_signal(ring->jobs[i].fence);
+            ring->jobs[i].job = NULL;
+         }
+      }
+      ring->read_idx = ring->write_idx;
+      ring->num_queued = 0;
+   }
+   queue->num_queued = 0;
+}
+
+static void
+util_queue_set_full_thread_affinity(void)
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY
+   /* Don't inherit the thread affinity from the parent thread.
+    * Set the full mask.
+    */
+   cpu_set_t cpuset;
+   CPU_ZERO(&cpuset);
+   for (unsigned i = 0; i < CPU_SETSIZE; i++)
+      CPU_SET(i, &cpuset);
+
+   pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+#endif
+}
+
+/****************************************************************************
+ * Shared thread pool
+ *
+ * Shared queues don't have threads of their own.  Instead, idle pool threads
+ * go through the list of shared queues and start the next job of the first
+ * queue that has one and isn't already running as many jobs as it has
+ * threads.  That queue is then moved to the end of the list, so that a busy
+ * queue can't starve the others.
+ *
+ * The pool threads are created when shared queues are initialized, up to the
+ * pool size or the total number of threads the shared queues asked for, and
+ * they are terminated when the last shared queue is destroyed, so that none
+ * are left running when the driver is unloaded.
+ */
+
+/* active_slots of the queues has 64 bits. */
+#define UTIL_QUEUE_MAX_SHARED_THREADS 64
+
+static once_flag pool_once_flag = ONCE_FLAG_INIT;
+
+static struct {
+   mtx_t resize_lock; /* serializes creating and terminating threads */
+   mtx_t lock;
+   cnd_t has_work_cond;
+   unsigned max_threads;
+   unsigned num_threads; /* decreasing this number will terminate threads */
+   unsigned num_requested_threads; /* of all shared queues */
+   thrd_t threads[UTIL_QUEUE_MAX_SHARED_THREADS];
+   struct list_head queues;
+} pool;
+
+static void
+pool_init(void)
+{
+   (void) mtx_init(&pool.resize_lock, mtx_plain);
+   (void) mtx_init(&pool.lock, mtx_plain);
+   cnd_init(&pool.has_work_cond);
+   list_inithead(&pool.queues);
+}
+
+void
+util_queue_set_shared_pool_size(unsigned num_threads)
+{
+   call_once(&pool_once_flag, pool_init);
+
+   mtx_lock(&pool.lock);
+   pool.max_threads = MIN2(num_threads, UTIL_QUEUE_MAX_SHARED_THREADS);
+   mtx_unlock(&pool.lock);
+}
+
+/* Start the next job of a shared queue, if there is one that may start
+ * a job.  Must be called with the pool lock held.
+ */
+static bool
+util_queue_pool_take_job(struct util_queue **out_queue,
+                         struct util_queue_job *job, int *slot)
+{
+   struct util_queue *queue;
+
+   LIST_FOR_EACH_ENTRY(queue, &pool.queues, pool_head) {
+      mtx_lock(&queue->lock);
+      if (queue->num_queued && queue->num_active < queue->num_threads) {
+         util_queue_pop_job(queue, job);
+
+         *slot = ffsll(~queue->active_slots) - 1;
+         queue->active_slots |= BITFIELD64_BIT(*slot);
+         mtx_unlock(&queue->lock);
+
+         /* Round-robin between the queues. */
+         list_del(&queue->pool_head);
+         list_addtail(&queue->pool_head, &pool.queues);
+
+         *out_queue = queue;
+         return true;
+      }
+      mtx_unlock(&queue->lock);
+   }
+   return false;
+}
+
+static int
+util_queue_pool_thread_func(void *input)
+{
+   unsigned index = (uintptr_t)input;
+   char name[16];
+
+   util_queue_set_full_thread_affinity();
+
+   snprintf(name, sizeof(name), "mesa:pool%u", index);
+   u_thread_setname(name);
+
+   mtx_lock(&pool.lock);
+   while (index < pool.num_threads) {
+      struct util_queue *queue;
+      struct util_queue_job job;
+      int slot;
+
+      if (!util_queue_pool_take_job(&queue, &job, &slot)) {
+         cnd_wait(&pool.has_work_cond, &pool.lock);
+         continue;
+      }
+      mtx_unlock(&pool.lock);
+
+      util_queue_execute_job(&job, slot);
+
+      mtx_lock(&queue->lock);
+      queue->active_slots &= ~BITFIELD64_BIT(slot);
+      util_queue_job_done(queue, &job);
+      /* Jobs of the queue may have been skipped because of the limit. */
+      bool has_queued = queue->num_queued > 0;
+      mtx_unlock(&queue->lock);
+
+      mtx_lock(&pool.lock);
+      if (has_queued)
+         cnd_signal(&pool.has_work_cond);
+   }
+   mtx_unlock(&pool.lock);
+   return 0;
+}
+
+static void
+util_queue_pool_wake_up(void)
+{
+   mtx_lock(&pool.lock);
+   cnd_broadcast(&pool.has_work_cond);
+   mtx_unlock(&pool.lock);
+}
+
+/* Returns false if the queue can't use the pool. */
+static bool
+util_queue_pool_add_queue(struct util_queue *queue)
+{
+   if (queue->flags & (UTIL_QUEUE_INIT_DEDICATED_THREADS |
+                       UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY) ||
+       queue->max_threads > UTIL_QUEUE_MAX_SHARED_THREADS)
+      return false;
+
+   call_once(&pool_once_flag, pool_init);
+
+   mtx_lock(&pool.resize_lock);
+   mtx_lock(&pool.lock);
+   if (!pool.max_threads) {
+      mtx_unlock(&pool.lock);
+      mtx_unlock(&pool.resize_lock);
+      return false;
+   }
+
+   unsigned num_threads = MIN2(pool.num_requested_threads + queue->max_threads,
+                               pool.max_threads);
+
+   for (unsigned i = pool.num_threads; i < num_threads; i++) {
+      /* Update num_threads first, so that the new thread doesn't exit. */
+      pool.num_threads = i + 1;
+      pool.threads[i] = u_thread_create(util_queue_pool_thread_func,
+                                        (void*)(uintptr_t)i);
+      if (!pool.threads[i]) {
+         pool.num_threads = i;
+         break;
+      }
+   }
+
+   if (!pool.num_threads) {
+      mtx_unlock(&pool.lock);
+      mtx_unlock(&pool.resize_lock);
+      return false;
+   }
+
+   queue->shared = true;
+   pool.num_requested_threads += queue->max_threads;
+   list_addtail(&queue->pool_head, &pool.queues);
+   mtx_unlock(&pool.lock);
+   mtx_unlock(&pool.resize_lock);
+   return true;
+}
+
+/* The queue must not have any running jobs. */
+static void
+util_queue_pool_remove_queue(struct util_queue *queue)
+{
+   unsigned num_threads = 0;
+
+   mtx_lock(&pool.resize_lock);
+   mtx_lock(&pool.lock);
+   list_del(&queue->pool_head);
+   pool.num_requested_threads -= queue->max_threads;
+
+   if (list_is_empty(&pool.queues)) {
+      num_threads = pool.num_threads;
+      pool.num_threads = 0;
+      cnd_broadcast(&pool.has_work_cond);
+   }
+   mtx_unlock(&pool.lock);
+
+   for (unsigned i = 0; i < num_threads; i++)
+      thrd_join(pool.threads[i], NULL);
+   mtx_unlock(&pool.resize_lock);
+}
+
 static int
 util_queue_thread_func(void *input)
 {
@@ -251,19 +564,8 @@ util_queue_thread_func(void *input)
 
    free(input);
 
-#ifdef HAVE_PTHREAD_SETAFFINITY
-   if (queue->flags & UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY) {
-      /* Don't inherit the thread affinity from the parent thread.
-       * Set the full mask.
-       */
-      cpu_set_t cpuset;
-      CPU_ZERO(&cpuset);
-      for (unsigned i = 0; i < CPU_SETSIZE; i++)
-         CPU_SET(i, &cpuset);
-
-      pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
-   }
-#endif
+   if (queue->flags & UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY)
+      util_queue_set_full_thread_affinity();
 
 #if defined(__linux__)
    if (queue->flags & UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY) {
@@ -278,11 +580,17 @@ util_queue_thread_func(void *input)
       u_thread_setname(name);
    }
 
-   while (1) {
-      struct util_queue_job job;
+   struct util_queue_job job;
+   bool has_job = false;
 
+   while (1) {
       mtx_lock(&queue->lock);
-      assert(queue->num_queued >= 0 && queue->num_queued <= queue->max_jobs);
+      assert(queue->num_queued >= 0);
+
+      if (has_job) {
+         util_queue_job_done(queue, &job);
+         has_job = false;
+      }
 
       /* wait if the queue is empty */
       while (thread_index < queue->num_threads && queue->num_queued == 0)
@@ -294,37 +602,17 @@ util_queue_thread_func(void *input)
          break;
       }
 
-      job = queue->jobs[queue->read_idx];
-      memset(&queue->jobs[queue->read_idx], 0, sizeof(struct util_queue_job));
-      queue->read_idx = (queue->read_idx + 1) % queue->max_jobs;
-
-      queue->num_queued--;
-      cnd_signal(&queue->has_space_cond);
-      if (job.job)
-         queue->total_jobs_size -= job.job_size;
+      util_queue_pop_job(queue, &job);
+      has_job = true;
       mtx_unlock(&queue->lock);
 
-      if (job.job) {
-         job.execute(job.job, thread_index);
-         util_queue_fence_signal(job.fence);
-         if (job.cleanup)
-            job.cleanup(job.job, thread_index);
-      }
+      util_queue_execute_job(&job, thread_index);
    }
 
    /* signal remaining jobs if all threads are being terminated */
    mtx_lock(&queue->lock);
-   if (queue->num_threads == 0) {
-      for (unsigned i = queue->read_idx; i != queue->write_idx;
-           i = (i + 1) % queue->max_jobs) {
-         if (queue->jobs[i].job) {
-            util_queue_fence_signal(queue->jobs[i].fence);
-            queue->jobs[i].job = NULL;
-         }
-      }
-      queue->read_idx = queue->write_idx;
-      queue->num_queued = 0;
-   }
+   if (queue->num_threads == 0)
+      util_queue_signal_remaining_jobs(queue);
    mtx_unlock(&queue->lock);
    return 0;
 }
@@ -370,6 +658,18 @@ util_queue_adjust_num_threads(struct util_queue *queue, unsigned num_threads)
    mtx_lock(&queue->finish_lock);
    unsigned old_num_threads = queue->num_threads;
 
+   if (queue->shared) {
+      /* Only the number of jobs that may run at the same time changes. */
+      mtx_lock(&queue->lock);
+      queue->num_threads = num_threads;
+      mtx_unlock(&queue->lock);
+      mtx_unlock(&queue->finish_lock);
+
+      if (num_threads > old_num_threads)
+         util_queue_pool_wake_up();
+      return;
+   }
+
    if (num_threads == old_num_threads) {
       mtx_unlock(&queue->finish_lock);
       return;
@@ -434,12 +734,14 @@ util_queue_init(struct util_queue *queue,
    queue->flags = flags;
    queue->max_threads = num_threads;
    queue->num_threads = num_threads;
-   queue->max_jobs = max_jobs;
 
-   queue->jobs = (struct util_queue_job*)
-                 calloc(max_jobs, sizeof(struct util_queue_job));
-   if (!queue->jobs)
-      goto fail;
+   for (i = 0; i < UTIL_QUEUE_NUM_PRIORITIES; i++) {
+      queue->rings[i].max_jobs = max_jobs;
+      queue->rings[i].jobs = (struct util_queue_job*)
+                             calloc(max_jobs, sizeof(struct util_queue_job));
+      if (!queue->rings[i].jobs)
+         goto fail_jobs;
+   }
 
    (void) mtx_init(&queue->lock, mtx_plain);
    (void) mtx_init(&queue->finish_lock, mtx_plain);
@@ -447,11 +749,17 @@ util_queue_init(struct util_queue *queue,
    queue->num_queued = 0;
    cnd_init(&queue->has_queued_cond);
    cnd_init(&queue->has_space_cond);
+   cnd_init(&queue->job_done_cond);
 
    queue->threads = (thrd_t*) calloc(num_threads, sizeof(thrd_t));
    if (!queue->threads)
       goto fail;
 
+   if (util_queue_pool_add_queue(queue)) {
+      add_to_atexit_list(queue);
+      return true;
+   }
+
    /* start threads */
    for (i = 0; i < num_threads; i++) {
       if (!util_queue_create_thread(queue, i)) {
@@ -472,12 +780,15 @@ util_queue_init(struct util_queue *queue,
 fail:
    free(queue->threads);
 
-   if (queue->jobs) {
-      cnd_destroy(&queue->has_space_cond);
-      cnd_destroy(&queue->has_queued_cond);
-      mtx_destroy(&queue->lock);
-      free(queue->jobs);
-   }
+   cnd_destroy(&queue->job_done_cond);
+   cnd_destroy(&queue->has_space_cond);
+   cnd_destroy(&queue->has_queued_cond);
+   mtx_destroy(&queue->lock);
+
+fail_jobs:
+   for (i = 0; i < UTIL_QUEUE_NUM_PRIORITIES; i++)
+      free(queue->rings[i].jobs);
+
    /* also util_queue_is_initialized can be used to check for success */
    memset(queue, 0, sizeof(*queue));
    return false;
@@ -498,6 +809,22 @@ util_queue_kill_threads(struct util_queue *queue, unsigned keep_num_threads,
       return;
    }
 
+   if (queue->shared) {
+      mtx_lock(&queue->lock);
+      queue->num_threads = keep_num_threads;
+      if (!keep_num_threads) {
+         /* Pool threads may still be running jobs of the queue. */
+         while (queue->num_active)
+            cnd_wait(&queue->job_done_cond, &queue->lock);
+         util_queue_signal_remaining_jobs(queue);
+      }
+      mtx_unlock(&queue->lock);
+
+      if (!finish_locked)
+         mtx_unlock(&queue->finish_lock);
+      return;
+   }
+
    mtx_lock(&queue->lock);
    unsigned old_num_threads = queue->num_threads;
    /* Setting num_threads is what causes the threads to terminate.
@@ -519,24 +846,71 @@ util_queue_destroy(struct util_queue *queue)
 {
    util_queue_kill_threads(queue, 0, false);
    remove_from_atexit_list(queue);
+   if (queue->shared)
+      util_queue_pool_remove_queue(queue);
 
+   cnd_destroy(&queue->job_done_cond);
    cnd_destroy(&queue->has_space_cond);
    cnd_destroy(&queue->has_queued_cond);
    mtx_destroy(&queue->finish_lock);
    mtx_destroy(&queue->lock);
-   free(queue->jobs);
+   for (unsigned i = 0; i < UTIL_QUEUE_NUM_PRIORITIES; i++)
+      free(queue->rings[i].jobs);
    free(queue->threads);
 }
 
+/* Make the ring larger, to avoid waiting for a free slot. */
+static void
+util_queue_ring_grow(struct util_queue_ring *ring)
+{
+   unsigned new_max_jobs = ring->max_jobs + 8;
+   struct util_queue_job *jobs =
+      (struct util_queue_job*)calloc(new_max_jobs,
+                                     sizeof(struct util_queue_job));
+   assert(jobs);
+
+   /* Copy all queued jobs into the new list. */
+   unsigned num_jobs = 0;
+   unsigned i = ring->read_idx;
+
+   do {
+      jobs[num_jobs++] = ring->jobs[i];
+      i = (i + 1) % ring->max_jobs;
+   } while (i != ring->write_idx);
+
+   assert(num_jobs == ring->num_queued);
+
+   free(ring->jobs);
+   ring->jobs = jobs;
+   ring->read_idx = 0;
+   ring->write_idx = num_jobs;
+   ring->max_jobs = new_max_jobs;
+}
+
+static void
+util_queue_ring_push(struct util_queue *queue, struct util_queue_ring *ring,
+                     const struct util_queue_job *job)
+{
+   assert(ring->jobs[ring->write_idx].job == NULL);
+   ring->jobs[ring->write_idx] = *job;
+   ring->write_idx = (ring->write_idx + 1) % ring->max_jobs;
+   ring->num_queued++;
+   queue->num_queued++;
+}
+
 void
-util_queue_add_job(struct util_queue *queue,
-                   void *job,
-                   struct util_queue_fence *fence,
-                   util_queue_execute_func execute,
-                   util_queue_execute_func cleanup,
-                   const size_t job_size)
+util_queue_add_job_with_priority(struct util_queue *queue,
+                                 void *job,
+                                 struct util_queue_fence *fence,
+                                 util_queue_execute_func execute,
+                                 util_queue_execute_func cleanup,
+                                 const size_t job_size,
+                                 enum util_queue_priority priority)
 {
-   struct util_queue_job *ptr;
+   struct util_queue_ring *ring = &queue->rings[priority];
+   struct util_queue_job new_job;
+
+   assert(priority < UTIL_QUEUE_NUM_PRIORITIES);
 
    mtx_lock(&queue->lock);
    if (queue->num_threads == 0) {
@@ -549,59 +923,61 @@ util_queue_add_job(struct util_queue *queue,
 
    util_queue_fence_reset(fence);
 
-   assert(queue->num_queued >= 0 && queue->num_queued <= queue->max_jobs);
+   assert(ring->num_queued >= 0 && ring->num_queued <= ring->max_jobs);
 
-   if (queue->num_queued == queue->max_jobs) {
+   if (ring->num_queued == ring->max_jobs) {
       if (queue->flags & UTIL_QUEUE_INIT_RESIZE_IF_FULL &&
           queue->total_jobs_size + job_size < S_256MB) {
-         /* If the queue is full, make it larger to avoid waiting for a free
-          * slot.
-          */
-         unsigned new_max_jobs = queue->max_jobs + 8;
-         struct util_queue_job *jobs =
-            (struct util_queue_job*)calloc(new_max_jobs,
-                                           sizeof(struct util_queue_job));
-         assert(jobs);
-
-         /* Copy all queued jobs into the new list. */
-         unsigned num_jobs = 0;
-         unsigned i = queue->read_idx;
-
-         do {
-            jobs[num_jobs++] = queue->jobs[i];
-            i = (i + 1) % queue->max_jobs;
-         } while (i != queue->write_idx);
-
-         assert(num_jobs == queue->num_queued);
-
-         free(queue->jobs);
-         queue->jobs = jobs;
-         queue->read_idx = 0;
-         queue->write_idx = num_jobs;
-         queue->max_jobs = new_max_jobs;
+         util_queue_ring_grow(ring);
       } else {
          /* Wait until there is a free slot. */
-         while (queue->num_queued == queue->max_jobs)
+         while (ring->num_queued == ring->max_jobs)
             cnd_wait(&queue->has_space_cond, &queue->lock);
       }
    }
 
-   ptr = &queue->jobs[queue->write_idx];
-   assert(ptr->job == NULL);
-   ptr->job = job;
-   ptr->fence = fence;
-   ptr->execute = execute;
-   ptr->cleanup = cleanup;
-   ptr->job_size = job_size;
+   new_job.job = job;
+   new_job.fence = fence;
+   new_job.execute = execute;
+   new_job.cleanup = cleanup;
+   new_job.job_size = job_size;
+   new_job.queued_time = os_time_get_nano();
+   new_job.seq = queue->next_seq++;
+   util_queue_ring_push(queue, ring, &new_job);
 
-   queue->write_idx = (queue->write_idx + 1) % queue->max_jobs;
-   queue->total_jobs_size += ptr->job_size;
+   queue->total_jobs_size += job_size;
+
+   if (queue->shared) {
+      mtx_unlock(&queue->lock);
+      util_queue_pool_wake_up();
+      return;
+   }
 
-   queue->num_queued++;
    cnd_signal(&queue->has_queued_cond);
    mtx_unlock(&queue->lock);
 }
 
+/* Find the queued job with the given fence.  Must be called with the queue
+ * lock held.
+ */
+static struct util_queue_job *
+util_queue_find_job(struct util_queue *queue, struct util_queue_fence *fence,
+                    unsigned *priority)
+{
+   for (unsigned p = 0; p < UTIL_QUEUE_NUM_PRIORITIES; p++) {
+      struct util_queue_ring *ring = &queue->rings[p];
+
+      for (int n = 0, i = ring->read_idx; n < ring->num_queued;
+           n++, i = (i + 1) % ring->max_jobs) {
+         if (ring->jobs[i].fence == fence) {
+            *priority = p;
+            return &ring->jobs[i];
+         }
+      }
+   }
+   return NULL;
+}
+
 /**
  * Remove a queued job. If the job hasn't started execution, it's removed from
  * the queue. If the job has started execution, the function waits for it to
@@ -615,23 +991,22 @@ util_queue_add_job(struct util_queue *queue,
 void
 util_queue_drop_job(struct util_queue *queue, struct util_queue_fence *fence)
 {
+   struct util_queue_job *job;
+   unsigned priority;
    bool removed = false;
 
    if (util_queue_fence_is_signalled(fence))
       return;
 
    mtx_lock(&queue->lock);
-   for (unsigned i = queue->read_idx; i != queue->write_idx;
-        i = (i + 1) % queue->max_jobs) {
-      if (queue->jobs[i].fence == fence) {
-         if (queue->jobs[i].cleanup)
-            queue->jobs[i].cleanup(queue->jobs[i].job, -1);
-
-         /* Just clear it. The threads will treat as a no-op job. */
-         memset(&queue->jobs[i], 0, sizeof(queue->jobs[i]));
-         removed = true;
-         break;
-      }
+   job = util_queue_find_job(queue, fence, &priority);
+   if (job) {
+      if (job->cleanup)
+         job->cleanup(job->job, -1);
+
+      /* Just clear it. The threads will treat as a no-op job. */
+      util_queue_clear_job(job);
+      removed = true;
    }
    mtx_unlock(&queue->lock);
 
@@ -641,26 +1016,60 @@ util_queue_drop_job(struct util_queue *queue, struct util_queue_fence *fence)
       util_queue_fence_wait(fence);
 }
 
-static void
-util_queue_finish_execute(void *data, int num_thread)
+void
+util_queue_wait_job(struct util_queue *queue, struct util_queue_fence *fence)
+{
+   struct util_queue_job *job;
+   unsigned priority;
+
+   if (util_queue_fence_is_signalled(fence))
+      return;
+
+   mtx_lock(&queue->lock);
+   job = util_queue_find_job(queue, fence, &priority);
+   if (job && priority != UTIL_QUEUE_PRIORITY_HIGH) {
+      struct util_queue_ring *high = &queue->rings[UTIL_QUEUE_PRIORITY_HIGH];
+
+      if (high->num_queued == high->max_jobs &&
+          queue->flags & UTIL_QUEUE_INIT_RESIZE_IF_FULL)
+         util_queue_ring_grow(high);
+
+      /* If the ring is full, just wait for the job where it is. */
+      if (high->num_queued < high->max_jobs) {
+         util_queue_ring_push(queue, high, job);
+
+         /* Leave a no-op job behind, it's still counted as queued.  It is
+          * new, so a util_queue_finish that already started doesn't wait
+          * for it.
+          */
+         memset(job, 0, sizeof(*job));
+         job->seq = queue->next_seq++;
+
+         queue->stats.num_promoted++;
+         cnd_signal(&queue->has_queued_cond);
+      }
+   }
+   mtx_unlock(&queue->lock);
+
+   util_queue_fence_wait(fence);
+}
+
+void
+util_queue_get_stats(struct util_queue *queue, struct util_queue_stats *stats)
 {
-   util_barrier *barrier = data;
-   util_barrier_wait(barrier);
+   mtx_lock(&queue->lock);
+   *stats = queue->stats;
+   mtx_unlock(&queue->lock);
 }
 
 /**
- * Wait until all previously added jobs have completed.
+ * Wait until all previously added jobs have completed.  Jobs added while
+ * waiting aren't waited for.
  */
 void
 util_queue_finish(struct util_queue *queue)
 {
-   util_barrier barrier;
-   struct util_queue_fence *fences;
-
-   /* If 2 threads were adding jobs for 2 different barries at the same time,
-    * a deadlock would happen, because 1 barrier requires that all threads
-    * wait for it exclusively.
-    */
+   /* There is only one finish_seq, so the callers take turns. */
    mtx_lock(&queue->finish_lock);
 
    /* The number of threads can be changed to 0, e.g. by the atexit handler. */
@@ -669,31 +1078,27 @@ util_queue_finish(struct util_queue *queue)
       return;
    }
 
-   fences = malloc(queue->num_threads * sizeof(*fences));
-   util_barrier_init(&barrier, queue->num_threads);
-
-   for (unsigned i = 0; i < queue->num_threads; ++i) {
-      util_queue_fence_init(&fences[i]);
-      util_queue_add_job(queue, &barrier, &fences[i],
-                         util_queue_finish_execute, NULL, 0);
-   }
+   /* All the jobs that were added so far are either queued, including
+    * dropped ones that are left as no-ops, or running.  Count them down as
+    * they complete.
+    */
+   mtx_lock(&queue->lock);
+   queue->finish_seq = queue->next_seq;
+   queue->num_finish_pending = queue->num_queued + queue->num_active;
+   while (queue->num_finish_pending)
+      cnd_wait(&queue->job_done_cond, &queue->lock);
+   mtx_unlock(&queue->lock);
 
-   for (unsigned i = 0; i < queue->num_threads; ++i) {
-      util_queue_fence_wait(&fences[i]);
-      util_queue_fence_destroy(&fences[i]);
-   }
    mtx_unlock(&queue->finish_lock);
-
-   util_barrier_destroy(&barrier);
-
-   free(fences);
 }
 
 int64_t
 util_queue_get_thread_time_nano(struct util_queue *queue, unsigned thread_index)
 {
-   /* Allow some flexibility by not raising an error. */
-   if (thread_index >= queue->num_threads)
+   /* Allow some flexibility by not raising an error. The pool threads
+    * aren't owned by shared queues.
+    */
+   if (thread_index >= queue->num_threads || queue->shared)
       return 0;
 
    return u_thread_get_time_nano(queue->threads[thread_index]);
@@ -49,6 +49,11 @@ extern "C" {
 #define UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY      (1 << 0)
 #define UTIL_QUEUE_INIT_RESIZE_IF_FULL            (1 << 1)
 #define UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY  (1 << 2)
+/* Never run the jobs on the shared thread pool, see
+ * util_queue_set_shared_pool_size().  For queues whose latency matters more
+ * than the total number of threads.
+ */
+#define UTIL_QUEUE_INIT_DEDICATED_THREADS         (1 << 3)
 
 #if UTIL_FUTEX_SUPPORTED
 #define UTIL_QUEUE_FENCE_FUTEX
@@ -191,12 +196,42 @@ util_queue_fence_wait_timeout(struct util_queue_fence *fence,
 
 typedef void (*util_queue_execute_func)(void *job, int thread_index);
 
+/* Jobs are started in priority order, and in the order they were added
+ * within each priority.
+ */
+enum util_queue_priority {
+   UTIL_QUEUE_PRIORITY_HIGH,
+   UTIL_QUEUE_PRIORITY_NORMAL,
+   UTIL_QUEUE_PRIORITY_LOW,
+   UTIL_QUEUE_NUM_PRIORITIES,
+};
+
 struct util_queue_job {
    void *job;
    size_t job_size;
    struct util_queue_fence *fence;
    util_queue_execute_func execute;
    util_queue_execute_func cleanup;
+   int64_t queued_time;
+   uint64_t seq; /* order in which the jobs were added */
+};
+
+/* Ring buffer of the queued jobs of one priority. */
+struct util_queue_ring {
+   struct util_queue_job *jobs;
+   int max_jobs;
+   int num_queued;
+   int write_idx, read_idx;
+};
+
+struct util_queue_stats {
+   /* Per priority: number of jobs started and how long they were queued. */
+   uint64_t num_jobs[UTIL_QUEUE_NUM_PRIORITIES];
+   uint64_t total_wait_time_ns[UTIL_QUEUE_NUM_PRIORITIES];
+   uint64_t max_wait_time_ns[UTIL_QUEUE_NUM_PRIORITIES];
+
+   /* Jobs moved to the highest priority by util_queue_wait_job(). */
+   uint64_t num_promoted;
 };
 
 /* Put this into your context. */
@@ -206,18 +241,36 @@ struct util_queue {
    mtx_t lock;
    cnd_t has_queued_cond;
    cnd_t has_space_cond;
+   cnd_t job_done_cond;
    thrd_t *threads;
    unsigned flags;
-   int num_queued;
+   int num_queued; /* of all priorities */
    unsigned max_threads;
    unsigned num_threads; /* decreasing this number will terminate threads */
-   int max_jobs;
-   int write_idx, read_idx; /* ring buffer pointers */
    size_t total_jobs_size;  /* memory use of all jobs in the queue */
-   struct util_queue_job *jobs;
+   struct util_queue_ring rings[UTIL_QUEUE_NUM_PRIORITIES];
+   struct util_queue_stats stats;
+   unsigned num_active; /* jobs taken from the rings that haven't completed */
+
+   /* util_queue_finish waits for the jobs added before finish_seq.
+    * num_finish_pending of them haven't completed yet.
+    */
+   uint64_t next_seq;
+   uint64_t finish_seq;
+   int num_finish_pending;
+
+   /* Set if the jobs run on the shared thread pool.  At most num_threads
+    * of them run at the same time, and thread_index is the bit of the
+    * running job in active_slots.  Protected by lock.
+    */
+   bool shared;
+   uint64_t active_slots;
 
    /* for cleanup at exit(), protected by exit_mutex */
    struct list_head head;
+
+   /* for the shared thread pool, protected by its lock */
+   struct list_head pool_head;
 };
 
 bool util_queue_init(struct util_queue *queue,
@@ -227,16 +280,49 @@ bool util_queue_init(struct util_queue *queue,
                      unsigned flags);
 void util_queue_destroy(struct util_queue *queue);
 
+/* Run the jobs of all queues initialized afterwards on a process-wide pool
+ * of at most \p num_threads threads instead of threads of their own, unless
+ * they ask for dedicated threads.  0 disables the pool for new queues.
+ * Queues don't run more jobs at the same time than the number of threads
+ * they were created with, so single-threaded queues still execute their
+ * jobs in order.
+ */
+void util_queue_set_shared_pool_size(unsigned num_threads);
+
 /* optional cleanup callback is called after fence is signaled: */
-void util_queue_add_job(struct util_queue *queue,
-                        void *job,
-                        struct util_queue_fence *fence,
-                        util_queue_execute_func execute,
-                        util_queue_execute_func cleanup,
-                        const size_t job_size);
+void util_queue_add_job_with_priority(struct util_queue *queue,
+                                      void *job,
+                                      struct util_queue_fence *fence,
+                                      util_queue_execute_func execute,
+                                      util_queue_execute_func cleanup,
+                                      const size_t job_size,
+                                      enum util_queue_priority priority);
+
+static inline void
+util_queue_add_job(struct util_queue *queue,
+                   void *job,
+                   struct util_queue_fence *fence,
+                   util_queue_execute_func execute,
+                   util_queue_execute_func cleanup,
+                   const size_t job_size)
+{
+   util_queue_add_job_with_priority(queue, job, fence, execute, cleanup,
+                                    job_size, UTIL_QUEUE_PRIORITY_NORMAL);
+}
+
 void util_queue_drop_job(struct util_queue *queue,
                          struct util_queue_fence *fence);
 
+/* Wait for a job, first moving it to the highest priority if it hasn't
+ * started yet.  Use this instead of util_queue_fence_wait() when the caller
+ * blocks on the job.
+ */
+void util_queue_wait_job(struct util_queue *queue,
+                         struct util_queue_fence *fence);
+
+void util_queue_get_stats(struct util_queue *queue,
+                          struct util_queue_stats *stats);
+
 void util_queue_finish(struct util_queue *queue);
 
 /* Adjust the number of active threads. The new number of threads can't be
@@ -0,0 +1,293 @@
+/*
+ * Copyright © 2026 The Mesa authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Force assertions, even on release builds. */
+#undef NDEBUG
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "u_queue.h"
+#include "u_thread.h"
+
+#define NUM_JOBS 8
+
+struct test_job {
+   struct util_queue_fence fence;
+   int id;
+};
+
+static struct test_job jobs[NUM_JOBS];
+static int order[NUM_JOBS];
+static int num_done;
+static int block_started;
+
+/* Keeps the only thread busy while the test fills the queue. */
+static void
+block_execute(void *data, int thread_index)
+{
+   p_atomic_set(&block_started, 1);
+   os_time_sleep(100 * 1000);
+}
+
+static void
+record_execute(void *data, int thread_index)
+{
+   struct test_job *job = (struct test_job *) data;
+
+   order[num_done++] = job->id;
+}
+
+static void
+add_job(struct util_queue *queue, int id, enum util_queue_priority priority)
+{
+   jobs[id].id = id;
+   util_queue_fence_init(&jobs[id].fence);
+   util_queue_add_job_with_priority(queue, &jobs[id], &jobs[id].fence,
+                                    record_execute, NULL, 0, priority);
+}
+
+static void
+start_test(struct util_queue *queue, struct util_queue_fence *block_fence)
+{
+   num_done = 0;
+   p_atomic_set(&block_started, 0);
+   util_queue_fence_init(block_fence);
+   util_queue_add_job(queue, block_fence, block_fence, block_execute, NULL, 0);
+
+   while (!p_atomic_read(&block_started))
+      os_time_sleep(1000);
+}
+
+static void
+test_priorities(struct util_queue *queue)
+{
+   struct util_queue_fence block_fence;
+
+   start_test(queue, &block_fence);
+   add_job(queue, 0, UTIL_QUEUE_PRIORITY_LOW);
+   add_job(queue, 1, UTIL_QUEUE_PRIORITY_NORMAL);
+   add_job(queue, 2, UTIL_QUEUE_PRIORITY_HIGH);
+   add_job(queue, 3, UTIL_QUEUE_PRIORITY_NORMAL);
+   add_job(queue, 4, UTIL_QUEUE_PRIORITY_LOW);
+   add_job(queue, 5, UTIL_QUEUE_PRIORITY_HIGH);
+
+   /* This must also wait for the low priority jobs. */
+   util_queue_finish(queue);
+
+   assert(num_done == 6);
+   assert(order[0] == 2 && order[1] == 5);
+   assert(order[2] == 1 && order[3] == 3);
+   assert(order[4] == 0 && order[5] == 4);
+}
+
+static void
+test_promotion(struct util_queue *queue)
+{
+   struct util_queue_fence block_fence;
+
+   start_test(queue, &block_fence);
+   add_job(queue, 0, UTIL_QUEUE_PRIORITY_NORMAL);
+   add_job(queue, 1, UTIL_QUEUE_PRIORITY_LOW);
+   add_job(queue, 2, UTIL_QUEUE_PRIORITY_NORMAL);
+
+   util_queue_wait_job(queue, &jobs[1].fence);
+   assert(num_done >= 1 && order[0] == 1);
+
+   /* Dropping a job that was left behind must not affect the others. */
+   util_queue_drop_job(queue, &jobs[1].fence);
+
+   util_queue_finish(queue);
+   assert(num_done == 3);
+   assert(order[1] == 0 && order[2] == 2);
+}
+
+static void
+test_resize(struct util_queue *queue)
+{
+   struct util_queue_fence block_fence;
+
+   /* More jobs than the queue size in each priority. */
+   start_test(queue, &block_fence);
+   for (int i = 0; i < NUM_JOBS; i++)
+      add_job(queue, i, i % 2 ? UTIL_QUEUE_PRIORITY_HIGH :
+                                UTIL_QUEUE_PRIORITY_NORMAL);
+
+   util_queue_finish(queue);
+   assert(num_done == NUM_JOBS);
+   for (int i = 0; i < NUM_JOBS / 2; i++) {
+      assert(order[i] == i * 2 + 1);
+      assert(order[NUM_JOBS / 2 + i] == i * 2);
+   }
+}
+
+static int gates[2];
+static int finish_done;
+
+static void
+gate_execute(void *data, int thread_index)
+{
+   int *gate = (int *) data;
+
+   while (!p_atomic_read(gate))
+      os_time_sleep(1000);
+}
+
+static int
+finish_thread_func(void *data)
+{
+   util_queue_finish((struct util_queue *) data);
+   p_atomic_set(&finish_done, 1);
+   return 0;
+}
+
+/* util_queue_finish doesn't wait for the jobs added after it was called,
+ * even if they have a higher priority.
+ */
+static void
+test_finish(struct util_queue *queue)
+{
+   struct util_queue_fence fences[2];
+   int pending = 0;
+   thrd_t thread;
+
+   p_atomic_set(&gates[0], 0);
+   p_atomic_set(&gates[1], 0);
+   p_atomic_set(&finish_done, 0);
+   util_queue_fence_init(&fences[0]);
+   util_queue_fence_init(&fences[1]);
+
+   util_queue_add_job(queue, &gates[0], &fences[0], gate_execute, NULL, 0);
+   thread = u_thread_create(finish_thread_func, queue);
+
+   /* Wait until util_queue_finish has counted the first job. */
+   while (!pending) {
+      os_time_sleep(1000);
+      mtx_lock(&queue->lock);
+      pending = queue->num_finish_pending;
+      mtx_unlock(&queue->lock);
+   }
+
+   util_queue_add_job_with_priority(queue, &gates[1], &fences[1],
+                                    gate_execute, NULL, 0,
+                                    UTIL_QUEUE_PRIORITY_HIGH);
+   p_atomic_set(&gates[0], 1);
+
+   for (int i = 0; i < 5000 && !p_atomic_read(&finish_done); i++)
+      os_time_sleep(1000);
+   assert(p_atomic_read(&finish_done));
+   assert(!util_queue_fence_is_signalled(&fences[1]));
+
+   p_atomic_set(&gates[1], 1);
+   util_queue_fence_wait(&fences[1]);
+   thrd_join(thread, NULL);
+}
+
+static int num_running;
+static int max_running;
+static uint64_t used_slots;
+
+static void
+concurrent_execute(void *data, int thread_index)
+{
+   int running = p_atomic_inc_return(&num_running);
+   int max = p_atomic_read(&max_running);
+
+   while (running > max)
+      max = p_atomic_cmpxchg(&max_running, max, running);
+
+   assert(thread_index >= 0 && thread_index < 3);
+   p_atomic_add(&used_slots, 1ull << thread_index);
+   os_time_sleep(10 * 1000);
+   p_atomic_dec(&num_running);
+}
+
+/* A shared queue runs no more jobs at the same time than it has threads. */
+static void
+test_shared_concurrency(void)
+{
+   struct util_queue queue;
+   struct util_queue_fence fences[NUM_JOBS];
+
+   if (!util_queue_init(&queue, "test", 2, 3,
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL)) {
+      fprintf(stderr, "util_queue_init failed\n");
+      exit(1);
+   }
+   assert(queue.shared);
+
+   for (int i = 0; i < NUM_JOBS; i++) {
+      util_queue_fence_init(&fences[i]);
+      util_queue_add_job(&queue, &fences[i], &fences[i], concurrent_execute,
+                         NULL, 0);
+   }
+
+   util_queue_finish(&queue);
+   assert(num_running == 0);
+   assert(max_running >= 1 && max_running <= 3);
+   assert(used_slots != 0);
+
+   util_queue_destroy(&queue);
+}
+
+static void
+run_tests(bool shared)
+{
+   struct util_queue queue;
+   struct util_queue_stats stats;
+
+   if (!util_queue_init(&queue, "test", 2, 1,
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL)) {
+      fprintf(stderr, "util_queue_init failed\n");
+      exit(1);
+   }
+   assert(queue.shared == shared);
+
+   test_priorities(&queue);
+   test_promotion(&queue);
+   test_resize(&queue);
+   test_finish(&queue);
+
+   util_queue_get_stats(&queue, &stats);
+   assert(stats.num_promoted == 1);
+   assert(stats.num_jobs[UTIL_QUEUE_PRIORITY_HIGH] == 2 + 1 + NUM_JOBS / 2 + 1);
+   assert(stats.max_wait_time_ns[UTIL_QUEUE_PRIORITY_LOW] >=
+          stats.total_wait_time_ns[UTIL_QUEUE_PRIORITY_LOW] /
+          stats.num_jobs[UTIL_QUEUE_PRIORITY_LOW]);
+
+   util_queue_destroy(&queue);
+}
+
+int
+main(void)
+{
+   run_tests(false);
+
+   /* Single-threaded queues keep their order on the shared pool. */
+   util_queue_set_shared_pool_size(2);
+   run_tests(true);
+   test_shared_concurrency();
+
+   return 0;
+}